@@ -5,14 +5,38 @@
 // Application entry points for the various latency test apps.
 // This allows easier use with Platform IO, as eell as including
 // multiple apps on devices with more user interface abilities.
+//
+// Each APP_x define builds that app into the image: main.cpp lists the
+// descriptors below in an AppRegistry (see appRegistry.h), and the "app"
+// host command switches between the ones built in.
 
 #pragma once
 
+#include <stddef.h>
+#include <stdint.h>
+
+#include "logSample.h"
+#include "staticContainers.h"
+
 class Board;
+
+/// Memory for the running app's big buffers, sized for the hungriest app
+/// built in. Apps run one at a time, so they share it: it holds whatever
+/// the last app left there when an app's setup runs.
+void *appMemoryBytes();
+
+template <typename T>
+static inline T &appMemory()
+{
+    return *static_cast<T *>(appMemoryBytes());
+}
+
 void imutestLoop(Board &board);
 
 void onsetSetup();
+void onsetTranslationSetup();
 void onsetLoop(Board &board);
+bool onsetCommand(Board &board, const char *command);
 
 void calibrateSetup();
 void calibrateLoop(Board &board);
@@ -22,3 +46,148 @@ void turnaroundLoop(Board &board);
 
 void logSetup();
 void logLoop(Board &board);
+bool logCommand(Board &board, const char *command);
+/// Print one sample as a line of the log's CSV, with the accelerometer if
+/// @p withAccel.
+void logPrintCsv(LogSample const &sample, bool withAccel);
+
+void burstSetup();
+void burstLoop(Board &board);
+bool burstCommand(Board &board, const char *command);
+
+void triggerSetup();
+void triggerLoop(Board &board);
+bool triggerCommand(Board &board, const char *command);
+
+// About 160KiB: most of the Nano 33 BLE RAM that mbed isn't using.
+#ifndef BURST_MAX_SAMPLES
+#define BURST_MAX_SAMPLES (80 * 1024)
+#endif
+
+// Total samples the trigger app keeps around an event: pre-trigger plus
+// post-trigger.
+#ifndef TRIGGER_CAPACITY
+#define TRIGGER_CAPACITY 2048
+#endif
+
+// Shared app memory each app needs: the apps check these.
+constexpr size_t ONSET_MEMORY_BYTES = 5000 * sizeof(int16_t) + 1024 * sizeof(float);
+constexpr size_t BURST_MEMORY_BYTES = BURST_MAX_SAMPLES * sizeof(int16_t) + 2048 * sizeof(float);
+constexpr size_t TRIGGER_MEMORY_BYTES = sizeof(CircularWindow<LogSample, TRIGGER_CAPACITY>);
+
+static inline bool noCommands(Board &, const char *)
+{
+    return false;
+}
+
+struct OnsetApp
+{
+#if defined(APP_ONSET) && !defined(ONSET_TRANSLATION)
+    static constexpr bool enabled = true;
+#else
+    static constexpr bool enabled = false;
+#endif
+    static constexpr const char *name = "onset";
+    static constexpr size_t memoryBytes = ONSET_MEMORY_BYTES;
+    static void setup() { onsetSetup(); }
+    static void loop(Board &board) { onsetLoop(board); }
+    static bool command(Board &board, const char *command) { return onsetCommand(board, command); }
+};
+
+struct OnsetTranslationApp
+{
+#if defined(APP_ONSET) && defined(WANT_ACCEL)
+    static constexpr bool enabled = true;
+#else
+    static constexpr bool enabled = false;
+#endif
+    static constexpr const char *name = "onset_translation";
+    static constexpr size_t memoryBytes = ONSET_MEMORY_BYTES;
+    static void setup() { onsetTranslationSetup(); }
+    static void loop(Board &board) { onsetLoop(board); }
+    static bool command(Board &board, const char *command) { return onsetCommand(board, command); }
+};
+
+struct TurnaroundApp
+{
+#ifdef APP_TURNAROUND
+    static constexpr bool enabled = true;
+#else
+    static constexpr bool enabled = false;
+#endif
+    static constexpr const char *name = "turnaround";
+    static constexpr size_t memoryBytes = 0;
+    static void setup() { turnaroundSetup(); }
+    static void loop(Board &board) { turnaroundLoop(board); }
+    static bool command(Board &board, const char *command) { return noCommands(board, command); }
+};
+
+struct LogApp
+{
+#ifdef APP_LOG
+    static constexpr bool enabled = true;
+#else
+    static constexpr bool enabled = false;
+#endif
+    static constexpr const char *name = "log";
+    static constexpr size_t memoryBytes = 0;
+    static void setup() { logSetup(); }
+    static void loop(Board &board) { logLoop(board); }
+    static bool command(Board &board, const char *command) { return logCommand(board, command); }
+};
+
+struct BurstApp
+{
+#ifdef APP_BURST
+    static constexpr bool enabled = true;
+#else
+    static constexpr bool enabled = false;
+#endif
+    static constexpr const char *name = "burst";
+    static constexpr size_t memoryBytes = BURST_MEMORY_BYTES;
+    static void setup() { burstSetup(); }
+    static void loop(Board &board) { burstLoop(board); }
+    static bool command(Board &board, const char *command) { return burstCommand(board, command); }
+};
+
+struct TriggerApp
+{
+#ifdef APP_TRIGGER
+    static constexpr bool enabled = true;
+#else
+    static constexpr bool enabled = false;
+#endif
+    static constexpr const char *name = "trigger";
+    static constexpr size_t memoryBytes = TRIGGER_MEMORY_BYTES;
+    static void setup() { triggerSetup(); }
+    static void loop(Board &board) { triggerLoop(board); }
+    static bool command(Board &board, const char *command) { return triggerCommand(board, command); }
+};
+
+struct CalibrateApp
+{
+#ifdef APP_CALIBRATE
+    static constexpr bool enabled = true;
+#else
+    static constexpr bool enabled = false;
+#endif
+    static constexpr const char *name = "calibrate";
+    static constexpr size_t memoryBytes = 0;
+    static void setup() { calibrateSetup(); }
+    static void loop(Board &board) { calibrateLoop(board); }
+    static bool command(Board &board, const char *command) { return noCommands(board, command); }
+};
+
+struct ImuTestApp
+{
+#ifdef APP_IMUTEST
+    static constexpr bool enabled = true;
+#else
+    static constexpr bool enabled = false;
+#endif
+    static constexpr const char *name = "imutest";
+    static constexpr size_t memoryBytes = 0;
+    static void setup() {}
+    static void loop(Board &board) { imutestLoop(board); }
+    static bool command(Board &board, const char *command) { return noCommands(board, command); }
+};
@@ -0,0 +1,50 @@
+// Copyright 2021, Collabora, Ltd.
+// SPDX-License-Identifier: BSL-1.0
+// Original Author: Ryan Pavlik
+//
+// The Cortex-M4 DWT cycle counter: a free-running 32-bit count of CPU
+// cycles, readable in a single instruction.
+
+#pragma once
+
+#include <stdint.h>
+
+#ifdef TARGET_NATIVE
+// On the host: the simulator's clock, as if at 64MHz.
+#include "simulator.h"
+
+static inline void cycleCounterBegin() {}
+
+static inline uint32_t cycleCount()
+{
+    return static_cast<uint32_t>(simulator().nowUs() * 64);
+}
+
+static inline uint32_t cycleCounterHz()
+{
+    return 64000000;
+}
+
+#else
+#include <nrf.h>
+
+/// Turn on the cycle counter: call once at startup.
+static inline void cycleCounterBegin()
+{
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+static inline uint32_t cycleCount()
+{
+    return DWT->CYCCNT;
+}
+
+/// Cycles per second
+static inline uint32_t cycleCounterHz()
+{
+    return SystemCoreClock;
+}
+
+#endif // TARGET_NATIVE
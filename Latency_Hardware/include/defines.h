@@ -6,10 +6,15 @@
 
 #pragma once
 
+#include "health.h"
+#include "profiler.h"
+
 #if defined(TARGET_ARDUINO_NANO33BLE)
 #include "nano33ble.h"
 #elif defined(ARDUINO_NRF52840_CLUE)
 #include "cluenrf52.h"
+#elif defined(TARGET_NATIVE)
+#include "nativeBoard.h"
 #else
 constexpr auto LED_PIN = BUILTIN_LED;
 #endif
@@ -18,12 +23,33 @@ constexpr auto LED_PIN = BUILTIN_LED;
 static inline int
 readBrightness()
 {
+    ProfileScope profile{PROFILE_READ_BRIGHTNESS};
+    healthCountAdcSamples();
     return MAX_ANALOG - analogRead(A0);
 }
 #else
 static inline int
 readBrightness()
 {
+    ProfileScope profile{PROFILE_READ_BRIGHTNESS};
+    healthCountAdcSamples();
     return analogRead(A0);
 }
 #endif
+
+#ifdef HAVE_BRIGHTNESS_BURST
+// Scale a raw sample from Board::captureBrightnessBurst() to match
+// readBrightness()
+static inline int
+burstSampleToBrightness(int16_t raw)
+{
+    // single-ended mode can read slightly below zero
+    int value = raw < 0 ? 0 : raw;
+    value = value * MAX_ANALOG / ((1 << BURST_SAMPLE_BITS) - 1);
+#ifdef HAVE_PHOTODIODE
+    return MAX_ANALOG - value;
+#else
+    return value;
+#endif
+}
+#endif
@@ -0,0 +1,166 @@
+// Copyright 2021, Collabora, Ltd.
+// SPDX-License-Identifier: BSL-1.0
+// Original Author: Ryan Pavlik
+//
+// Runtime health counters, reported by every app as a periodic status line:
+//
+//     STATUS,seq=<n>,ms=<millis>,loop_hz=<rate>,imu=<samples>,adc=<samples>,
+//       gaps=<n>,dropped=<samples>,failed_reads=<n>,max_loop_us=<us>,
+//       tx_free_min=<bytes>,tx_free_max=<bytes>
+//
+// (all one line). Counts are since the previous status line, so the host can
+// tell when during a run things went wrong. A gap is the IMU being read late
+// enough in consecutive loops that at least one sample went by unread;
+// dropped estimates how many. tx_free is the space in the serial output
+// buffer, sampled once per loop: a minimum of zero means writes stalled
+// waiting for the host.
+//
+// Apps that stop on purpose (to send a block, say) call healthPlannedStall()
+// so that loop doesn't count as degradation.
+
+#pragma once
+
+#include <Arduino.h>
+#include <limits.h>
+#include <stdint.h>
+
+#ifndef HEALTH_REPORT_INTERVAL_MS
+#define HEALTH_REPORT_INTERVAL_MS 1000
+#endif
+
+/// Counts since the last report.
+struct HealthWindow
+{
+    uint32_t loops = 0;
+    uint32_t imuSamples = 0;
+    uint32_t adcSamples = 0;
+    uint32_t gaps = 0;
+    uint32_t dropped = 0;
+    uint32_t failedReads = 0;
+    unsigned long maxLoopUs = 0;
+    int txFreeMin = INT_MAX;
+    int txFreeMax = 0;
+};
+
+struct HealthCounters
+{
+    HealthWindow window;
+    uint32_t seq = 0;
+    uint32_t totalLoops = 0;
+    uint32_t lastImuLoop = 0;
+    unsigned long lastImuUs = 0;
+    bool imuSeen = false;
+    bool plannedStall = false;
+    unsigned long lastReportMs = 0;
+    bool enabled = true;
+};
+
+inline HealthCounters &healthCounters()
+{
+    static HealthCounters counters;
+    return counters;
+}
+
+static inline void healthCountAdcSamples(uint32_t count = 1)
+{
+    healthCounters().window.adcSamples += count;
+}
+
+static inline void healthCountFailedRead()
+{
+    healthCounters().window.failedReads++;
+}
+
+/// Count an IMU sample read at @p timestamp, from a sensor that produces a
+/// new one every @p intervalUs.
+static inline void healthCountImuSample(unsigned long timestamp, unsigned long intervalUs)
+{
+    HealthCounters &h = healthCounters();
+    h.window.imuSamples++;
+    // Only compare with a read in the loop before: some apps stop reading
+    // the IMU on purpose for a while.
+    if (h.imuSeen && h.lastImuLoop + 1 == h.totalLoops)
+    {
+        unsigned long missed = (timestamp - h.lastImuUs) / intervalUs;
+        if (missed > 1)
+        {
+            h.window.gaps++;
+            h.window.dropped += missed - 1;
+        }
+    }
+    h.imuSeen = true;
+    h.lastImuLoop = h.totalLoops;
+    h.lastImuUs = timestamp;
+}
+
+/// This loop iteration is slow on purpose: don't count its time, or the
+/// IMU samples that go by meanwhile.
+static inline void healthPlannedStall()
+{
+    healthCounters().plannedStall = true;
+}
+
+/// Call after each app loop iteration.
+static inline void healthLoopDone(unsigned long loopUs)
+{
+    HealthCounters &h = healthCounters();
+    HealthWindow &w = h.window;
+    w.loops++;
+    h.totalLoops++;
+    if (h.plannedStall)
+    {
+        h.plannedStall = false;
+        h.imuSeen = false;
+        return;
+    }
+    if (loopUs > w.maxLoopUs)
+    {
+        w.maxLoopUs = loopUs;
+    }
+    int txFree = Serial.availableForWrite();
+    if (txFree < w.txFreeMin)
+    {
+        w.txFreeMin = txFree;
+    }
+    if (txFree > w.txFreeMax)
+    {
+        w.txFreeMax = txFree;
+    }
+}
+
+/// Print a status line if it's time, and start counting afresh.
+static inline void healthReport(unsigned long nowMs)
+{
+    HealthCounters &h = healthCounters();
+    HealthWindow const &w = h.window;
+    unsigned long elapsed = nowMs - h.lastReportMs;
+    if (!h.enabled || elapsed < HEALTH_REPORT_INTERVAL_MS)
+    {
+        return;
+    }
+    Serial.print("STATUS,seq=");
+    Serial.print(h.seq++);
+    Serial.print(",ms=");
+    Serial.print(nowMs);
+    Serial.print(",loop_hz=");
+    Serial.print(w.loops * 1000.0f / elapsed, 1);
+    Serial.print(",imu=");
+    Serial.print(w.imuSamples);
+    Serial.print(",adc=");
+    Serial.print(w.adcSamples);
+    Serial.print(",gaps=");
+    Serial.print(w.gaps);
+    Serial.print(",dropped=");
+    Serial.print(w.dropped);
+    Serial.print(",failed_reads=");
+    Serial.print(w.failedReads);
+    Serial.print(",max_loop_us=");
+    Serial.print(w.maxLoopUs);
+    Serial.print(",tx_free_min=");
+    Serial.print(w.loops ? w.txFreeMin : 0);
+    Serial.print(",tx_free_max=");
+    Serial.println(w.txFreeMax);
+
+    h.window = HealthWindow{};
+    h.lastReportMs = nowMs;
+}
@@ -0,0 +1,106 @@
+// Copyright 2021, Collabora, Ltd.
+// SPDX-License-Identifier: BSL-1.0
+// Original Author: Ryan Pavlik
+//
+// How much RAM the firmware really uses, so buffers can be sized right up
+// to the budget. The stack (the main thread's, where setup() and loop()
+// run) is painted at startup: the deepest it has been is where the paint
+// stops. The heap is counted by wrapping malloc and friends at link time,
+// in builds that opt in with the heap_stats flags in platformio.ini.
+//
+// Send "mem" (handled in main.cpp) for a line like
+//
+//     MEM,stack_used=<bytes>,stack_size=<bytes>,heap_bytes=<bytes>,
+//       heap_peak=<bytes>,allocs=<n>,frees=<n>,steady_allocs=<n>
+//
+// (all one line; just the stack without heap counting). steady_allocs
+// counts allocations after setup(), which the firmware shouldn't need:
+// build with -DNO_STEADY_HEAP to make them fail instead, so anything that
+// does shows up right away.
+//
+// On the host, the stack isn't painted (stack_size is 0), and only our own
+// calls to malloc are counted, not the C++ runtime's.
+
+#pragma once
+
+#include <Arduino.h>
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+constexpr uint32_t STACK_PAINT = 0xC5C5C5C5;
+
+/// Paint [begin, end).
+static inline void stackPaint(uint32_t *begin, uint32_t *end)
+{
+    for (uint32_t *p = begin; p < end; ++p)
+    {
+        *p = STACK_PAINT;
+    }
+}
+
+/// How many bytes at the top of [begin, end) have been used since
+/// painting, for a stack that grows down from end.
+static inline size_t stackPaintUsed(const uint32_t *begin, const uint32_t *end)
+{
+    const uint32_t *p = begin;
+    while (p < end && *p == STACK_PAINT)
+    {
+        ++p;
+    }
+    return static_cast<size_t>(end - p) * sizeof(uint32_t);
+}
+
+struct HeapCounters
+{
+    std::atomic<uint32_t> allocs{0};
+    std::atomic<uint32_t> frees{0};
+    std::atomic<uint32_t> steadyAllocs{0};
+    std::atomic<size_t> bytes{0};
+    std::atomic<size_t> peakBytes{0};
+    /// Once setup() is done.
+    std::atomic<bool> steady{false};
+};
+
+inline HeapCounters &heapCounters()
+{
+    // Constant-initialized, so it's ready for the first malloc.
+    static HeapCounters counters;
+    return counters;
+}
+
+/// Paint the stack: call first thing in setup().
+void memoryBegin();
+
+/// The deepest the stack has been since memoryBegin(), in bytes.
+size_t stackUsedBytes();
+size_t stackSizeBytes();
+
+/// Setup is done: from now on, allocations count as steady-state ones (and
+/// fail, with NO_STEADY_HEAP).
+static inline void heapSteadyState()
+{
+    heapCounters().steady = true;
+}
+
+static inline void memoryPrint()
+{
+    Serial.print("MEM,stack_used=");
+    Serial.print(static_cast<unsigned long>(stackUsedBytes()));
+    Serial.print(",stack_size=");
+    Serial.print(static_cast<unsigned long>(stackSizeBytes()));
+#ifdef WANT_HEAP_STATS
+    HeapCounters const &h = heapCounters();
+    Serial.print(",heap_bytes=");
+    Serial.print(static_cast<unsigned long>(h.bytes.load()));
+    Serial.print(",heap_peak=");
+    Serial.print(static_cast<unsigned long>(h.peakBytes.load()));
+    Serial.print(",allocs=");
+    Serial.print(static_cast<unsigned long>(h.allocs.load()));
+    Serial.print(",frees=");
+    Serial.print(static_cast<unsigned long>(h.frees.load()));
+    Serial.print(",steady_allocs=");
+    Serial.print(static_cast<unsigned long>(h.steadyAllocs.load()));
+#endif
+    Serial.println();
+}
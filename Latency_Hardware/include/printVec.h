@@ -4,12 +4,17 @@
 
 #include <Eigen/Core>
 #include <Arduino.h>
-#include <sstream>
 
-static inline void printVec(Eigen::Vector3f const &vec)
+/// Comma-separated, printed straight to serial: no stream or string on the
+/// heap.
+static inline void printVec(Eigen::Vector3f const &vec, int digits = 6)
 {
-    static const Eigen::IOFormat format{Eigen::FullPrecision, Eigen::DontAlignCols, ","};
-    std::ostringstream os;
-    os << vec.transpose().format(format);
-    Serial.print(os.str().c_str());
-}
\ No newline at end of file
+    for (int i = 0; i < 3; ++i)
+    {
+        if (i > 0)
+        {
+            Serial.print(",");
+        }
+        Serial.print(vec[i], digits);
+    }
+}
@@ -0,0 +1,125 @@
+// Copyright 2021, Collabora, Ltd.
+// SPDX-License-Identifier: BSL-1.0
+// Original Author: Ryan Pavlik
+//
+// Cycle-counting profiler for the hot paths of app loops, using the DWT
+// cycle counter of the Cortex-M4.
+//
+// Put a ProfileScope at the top of a block to count the cycles spent in it
+// under one of the zones below. Zones may nest: each counts everything
+// inside it. Build with -DWANT_PROFILER to turn it on: otherwise a
+// ProfileScope is empty and compiles to nothing.
+//
+// Send "profile" to print the table of min/mean/max cycles per zone,
+// "profile reset" to clear it (handled in main.cpp).
+
+#pragma once
+
+#include <stdint.h>
+
+enum ProfileZone : uint8_t
+{
+    PROFILE_LOOP,
+    PROFILE_DO_READ,
+    PROFILE_GYRO_PROCESS,
+    PROFILE_READ_BRIGHTNESS,
+    PROFILE_FORMAT,
+    PROFILE_SERIAL_WRITE,
+    PROFILE_ZONE_COUNT
+};
+
+#ifdef WANT_PROFILER
+
+#include <Arduino.h>
+#include <string.h>
+
+#include "cycleCounter.h"
+
+struct ProfileStats
+{
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+    uint64_t total;
+};
+
+static constexpr const char *profileZoneNames[PROFILE_ZONE_COUNT] = {
+    "loop", "doRead", "GyroProc::process", "readBrightness", "format", "serial_write"};
+
+inline ProfileStats *profileStats()
+{
+    static ProfileStats stats[PROFILE_ZONE_COUNT];
+    return stats;
+}
+
+static inline void profilerReset()
+{
+    memset(profileStats(), 0, sizeof(ProfileStats) * PROFILE_ZONE_COUNT);
+}
+
+static inline void profilerRecord(ProfileZone zone, uint32_t cycles)
+{
+    ProfileStats &stats = profileStats()[zone];
+    if (stats.count == 0 || cycles < stats.min)
+    {
+        stats.min = cycles;
+    }
+    if (cycles > stats.max)
+    {
+        stats.max = cycles;
+    }
+    stats.total += cycles;
+    stats.count++;
+}
+
+/// Print the table: a header line with the clock rate, then one line per
+/// zone that has been entered.
+static inline void profilerDump()
+{
+    Serial.print("PROFILE,cpu_hz=");
+    Serial.println(cycleCounterHz());
+    Serial.println("PROFILE,zone,count,min_cycles,mean_cycles,max_cycles");
+    for (int zone = 0; zone < PROFILE_ZONE_COUNT; ++zone)
+    {
+        ProfileStats const &stats = profileStats()[zone];
+        if (stats.count == 0)
+        {
+            continue;
+        }
+        Serial.print("PROFILE,");
+        Serial.print(profileZoneNames[zone]);
+        Serial.print(",");
+        Serial.print(stats.count);
+        Serial.print(",");
+        Serial.print(stats.min);
+        Serial.print(",");
+        Serial.print(static_cast<uint32_t>(stats.total / stats.count));
+        Serial.print(",");
+        Serial.println(stats.max);
+    }
+}
+
+class ProfileScope
+{
+public:
+    explicit ProfileScope(ProfileZone zone) : zone_(zone), start_(cycleCount()) {}
+    // Unsigned subtraction is right even if the counter wrapped.
+    ~ProfileScope() { profilerRecord(zone_, cycleCount() - start_); }
+
+    ProfileScope(ProfileScope const &) = delete;
+    ProfileScope &operator=(ProfileScope const &) = delete;
+
+private:
+    ProfileZone zone_;
+    uint32_t start_;
+};
+
+#else // WANT_PROFILER
+
+class ProfileScope
+{
+public:
+    explicit ProfileScope(ProfileZone) {}
+};
+
+#endif // WANT_PROFILER
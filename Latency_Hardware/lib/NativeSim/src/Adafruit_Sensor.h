@@ -0,0 +1,37 @@
+// Copyright 2021, Collabora, Ltd.
+// SPDX-License-Identifier: BSL-1.0
+// Original Author: Ryan Pavlik
+//
+// The parts of the Adafruit unified sensor types the firmware uses.
+
+#pragma once
+
+#include <stdint.h>
+
+typedef struct
+{
+    union
+    {
+        float v[3];
+        struct
+        {
+            float x;
+            float y;
+            float z;
+        };
+    };
+} sensors_vec_t;
+
+typedef struct
+{
+    int32_t version;
+    int32_t sensor_id;
+    int32_t type;
+    int32_t reserved0;
+    int32_t timestamp;
+    union
+    {
+        sensors_vec_t acceleration;
+        sensors_vec_t gyro;
+    };
+} sensors_event_t;
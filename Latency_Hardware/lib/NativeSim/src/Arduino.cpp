@@ -0,0 +1,159 @@
+// Copyright 2021, Collabora, Ltd.
+// SPDX-License-Identifier: BSL-1.0
+// Original Author: Ryan Pavlik
+//
+// The Arduino API on the simulator.
+
+#include "Arduino.h"
+#include "simulator.h"
+
+#include <stdio.h>
+
+HostSerial Serial;
+
+static int analogBits = 10;
+static bool pinState[64] = {};
+
+unsigned long micros()
+{
+    Simulator &sim = simulator();
+    sim.advance(sim.config().clockReadUs);
+    // Wraps like the board's.
+    return static_cast<uint32_t>(sim.nowUs());
+}
+
+unsigned long millis()
+{
+    Simulator &sim = simulator();
+    sim.advance(sim.config().clockReadUs);
+    return static_cast<uint32_t>(sim.nowUs() / 1000);
+}
+
+void delay(unsigned long ms)
+{
+    simulator().advance(ms * 1000);
+}
+
+void delayMicroseconds(unsigned int us)
+{
+    simulator().advance(us);
+}
+
+void pinMode(int /* pin */, int /* mode */) {}
+
+void digitalWrite(int pin, int value)
+{
+    if (pin >= 0 && pin < 64)
+    {
+        pinState[pin] = value != LOW;
+    }
+}
+
+int digitalRead(int pin)
+{
+    return (pin >= 0 && pin < 64 && pinState[pin]) ? HIGH : LOW;
+}
+
+int analogRead(int pin)
+{
+    Simulator &sim = simulator();
+    sim.advance(sim.config().analogReadUs);
+    if (pin != A0)
+    {
+        return 0;
+    }
+    return sim.readPhotosensor(analogBits);
+}
+
+void analogReadResolution(int bits)
+{
+    analogBits = bits;
+}
+
+void analogReference(AnalogReferenceMode /* mode */) {}
+
+size_t HostSerial::write(uint8_t c)
+{
+    output_.push_back(static_cast<char>(c));
+    if (echo_)
+    {
+        fputc(c, stdout);
+    }
+    return 1;
+}
+
+size_t HostSerial::write(const uint8_t *data, size_t size)
+{
+    for (size_t i = 0; i < size; ++i)
+    {
+        write(data[i]);
+    }
+    return size;
+}
+
+int HostSerial::read()
+{
+    if (input_.empty())
+    {
+        return -1;
+    }
+    int c = input_.front();
+    input_.pop_front();
+    return c;
+}
+
+size_t HostSerial::print(const char *s)
+{
+    return write(reinterpret_cast<const uint8_t *>(s), strlen(s));
+}
+
+size_t HostSerial::print(char c)
+{
+    return write(static_cast<uint8_t>(c));
+}
+
+size_t HostSerial::print(long n, int base)
+{
+    if (n < 0 && base == DEC)
+    {
+        return print('-') + print(0UL - static_cast<unsigned long>(n), base);
+    }
+    return print(static_cast<unsigned long>(n), base);
+}
+
+size_t HostSerial::print(unsigned long n, int base)
+{
+    char buf[8 * sizeof(long) + 1];
+    char *p = buf + sizeof(buf) - 1;
+    *p = '\0';
+    if (base < 2)
+    {
+        base = DEC;
+    }
+    do
+    {
+        int digit = static_cast<int>(n % base);
+        *--p = static_cast<char>(digit < 10 ? '0' + digit : 'A' + digit - 10);
+        n /= base;
+    } while (n);
+    return print(p);
+}
+
+size_t HostSerial::print(double n, int digits)
+{
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%.*f", digits, n);
+    return print(buf);
+}
+
+std::string HostSerial::takeOutput()
+{
+    std::string out;
+    out.swap(output_);
+    return out;
+}
+
+void HostSerial::sendInput(std::string const &text)
+{
+    input_.insert(input_.end(), text.begin(), text.end());
+}
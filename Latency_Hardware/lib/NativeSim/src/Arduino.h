@@ -0,0 +1,118 @@
+// Copyright 2021, Collabora, Ltd.
+// SPDX-License-Identifier: BSL-1.0
+// Original Author: Ryan Pavlik
+//
+// Just enough of the Arduino API for the apps to build and run on the host,
+// against the simulator's clock and sensors. Serial output is kept for the
+// caller to take (and optionally echoed to stdout), and input is whatever
+// the caller sends.
+//
+// Unlike the real thing, abs, min and max aren't macros.
+
+#pragma once
+
+#include <algorithm>
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <deque>
+#include <string>
+
+typedef uint8_t byte;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+#define A0 14
+#define LED_BUILTIN 13
+#define LED_RED 22
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+using std::max;
+using std::min;
+
+unsigned long micros();
+unsigned long millis();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+void pinMode(int pin, int mode);
+void digitalWrite(int pin, int value);
+int digitalRead(int pin);
+
+int analogRead(int pin);
+void analogReadResolution(int bits);
+enum class AnalogReferenceMode
+{
+    AR_VDD,
+};
+void analogReference(AnalogReferenceMode mode);
+
+static inline void noInterrupts() {}
+static inline void interrupts() {}
+
+class HostSerial
+{
+public:
+    void begin(unsigned long /* baud */) {}
+    explicit operator bool() const { return true; }
+    void flush() {}
+
+    size_t write(uint8_t c);
+    size_t write(const uint8_t *data, size_t size);
+    int availableForWrite() const { return 4096; }
+
+    int available() const { return static_cast<int>(input_.size()); }
+    int read();
+
+    size_t print(const char *s);
+    size_t print(std::string const &s) { return print(s.c_str()); }
+    size_t print(char c);
+    size_t print(unsigned char n, int base = DEC) { return print(static_cast<unsigned long>(n), base); }
+    size_t print(int n, int base = DEC) { return print(static_cast<long>(n), base); }
+    size_t print(unsigned int n, int base = DEC) { return print(static_cast<unsigned long>(n), base); }
+    size_t print(long n, int base = DEC);
+    size_t print(unsigned long n, int base = DEC);
+    size_t print(double n, int digits = 2);
+
+    size_t println() { return print("\r\n"); }
+    // By value, like the real ones: a reference would need a definition
+    // for static constexpr members.
+    template <typename T>
+    size_t println(T value)
+    {
+        size_t n = print(value);
+        return n + println();
+    }
+    template <typename T>
+    size_t println(T value, int format)
+    {
+        size_t n = print(value, format);
+        return n + println();
+    }
+
+    // The host side.
+
+    /// Everything written since the last call.
+    std::string takeOutput();
+    /// Queue up @p text to be read, as if the host sent it.
+    void sendInput(std::string const &text);
+    /// Also copy output to stdout as it's written.
+    void setEcho(bool echo) { echo_ = echo; }
+
+private:
+    std::string output_;
+    std::deque<uint8_t> input_;
+    bool echo_ = false;
+};
+
+extern HostSerial Serial;
@@ -0,0 +1,193 @@
+// Copyright 2021, Collabora, Ltd.
+// SPDX-License-Identifier: BSL-1.0
+// Original Author: Ryan Pavlik
+
+#include "captureFile.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// strtol and strtof, checking each field as we go: sscanf is most of the
+// time it takes to read hours of captures.
+static bool parseLong(const char *&p, long &value)
+{
+    char *end = nullptr;
+    value = strtol(p, &end, 10);
+    if (end == p)
+    {
+        return false;
+    }
+    p = end;
+    return true;
+}
+
+static bool parseFloat(const char *&p, float &value)
+{
+    char *end = nullptr;
+    value = strtof(p, &end);
+    if (end == p)
+    {
+        return false;
+    }
+    p = end;
+    return true;
+}
+
+static bool skipComma(const char *&p)
+{
+    if (*p != ',')
+    {
+        return false;
+    }
+    ++p;
+    return true;
+}
+
+static bool atLineEnd(const char *p)
+{
+    return *p == '\0' || *p == '\r' || *p == '\n';
+}
+
+bool parseCaptureLine(const char *line, RecordedSample &sample)
+{
+    const char *p = line;
+    long us;
+    long brightness;
+    if (!parseLong(p, us) || !skipComma(p) || !parseFloat(p, sample.gyro[0]) || !skipComma(p) ||
+        !parseFloat(p, sample.gyro[1]) || !skipComma(p) || !parseFloat(p, sample.gyro[2]) || !skipComma(p) ||
+        !parseLong(p, brightness))
+    {
+        return false;
+    }
+    // capture.py saves times from its first sample, so they can be
+    // negative: only differences matter, and those survive the wrap.
+    sample.us = static_cast<uint32_t>(us);
+    sample.brightness = static_cast<int>(brightness);
+    sample.hasAccel = false;
+    if (atLineEnd(p))
+    {
+        return true;
+    }
+    if (!skipComma(p) || !parseFloat(p, sample.accel[0]) || !skipComma(p) || !parseFloat(p, sample.accel[1]) ||
+        !skipComma(p) || !parseFloat(p, sample.accel[2]) || !atLineEnd(p))
+    {
+        return false;
+    }
+    sample.hasAccel = true;
+    return true;
+}
+
+void readCapture(FILE *file, std::vector<RecordedSample> &samples)
+{
+    char line[256];
+    RecordedSample sample;
+    while (fgets(line, sizeof(line), file))
+    {
+        size_t length = strlen(line);
+        if (length + 1 == sizeof(line) && line[length - 1] != '\n')
+        {
+            // Too long to be a sample: skip the rest of it.
+            int c;
+            while ((c = fgetc(file)) != EOF && c != '\n')
+            {
+            }
+            continue;
+        }
+        if (parseCaptureLine(line, sample))
+        {
+            samples.push_back(sample);
+        }
+    }
+}
+
+bool readCaptureFile(const char *path, std::vector<RecordedSample> &samples)
+{
+    FILE *file = fopen(path, "r");
+    if (!file)
+    {
+        return false;
+    }
+    readCapture(file, samples);
+    fclose(file);
+    return true;
+}
+
+void readCaptureText(std::string const &text, std::vector<RecordedSample> &samples)
+{
+    RecordedSample sample;
+    size_t start = 0;
+    while (start < text.size())
+    {
+        size_t end = text.find('\n', start);
+        if (end == std::string::npos)
+        {
+            end = text.size();
+        }
+        if (parseCaptureLine(text.substr(start, end - start).c_str(), sample))
+        {
+            samples.push_back(sample);
+        }
+        start = end + 1;
+    }
+}
+
+bool readTruthFile(const char *path, std::vector<TruthEvent> &events)
+{
+    FILE *file = fopen(path, "r");
+    if (!file)
+    {
+        return false;
+    }
+    char line[128];
+    while (fgets(line, sizeof(line), file))
+    {
+        const char *p = line;
+        long us;
+        long latency;
+        if (parseLong(p, us) && skipComma(p) && parseLong(p, latency) && atLineEnd(p))
+        {
+            events.push_back({static_cast<uint32_t>(us), static_cast<unsigned long>(latency)});
+        }
+    }
+    fclose(file);
+    return true;
+}
+
+std::string truthPathFor(std::string const &path)
+{
+    static const char extension[] = ".csv";
+    size_t n = sizeof(extension) - 1;
+    std::string base = path;
+    if (base.size() >= n && base.compare(base.size() - n, n, extension) == 0)
+    {
+        base.resize(base.size() - n);
+    }
+    return base + ".truth.csv";
+}
+
+std::vector<long> numberLines(std::string const &output)
+{
+    std::vector<long> numbers;
+    size_t start = 0;
+    while (start < output.size())
+    {
+        size_t end = output.find('\n', start);
+        if (end == std::string::npos)
+        {
+            end = output.size();
+        }
+        std::string line = output.substr(start, end - start);
+        if (!line.empty() && line.back() == '\r')
+        {
+            line.pop_back();
+        }
+        char *parsedEnd = nullptr;
+        long value = strtol(line.c_str(), &parsedEnd, 10);
+        if (!line.empty() && *parsedEnd == '\0')
+        {
+            numbers.push_back(value);
+        }
+        start = end + 1;
+    }
+    return numbers;
+}
@@ -0,0 +1,42 @@
+// Copyright 2021, Collabora, Ltd.
+// SPDX-License-Identifier: BSL-1.0
+// Original Author: Ryan Pavlik
+//
+// Reading the CSV captures that the log app prints and capture.py saves:
+// us,drx,dry,drz,brightness and optionally ax,ay,az. Anything else (headers,
+// banners, half lines) is skipped, like capture.py does. And the true
+// latencies the synth tool writes beside its captures.
+
+#pragma once
+
+#include "simulator.h"
+#include "syntheticCapture.h"
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+/// @return false if @p line isn't a sample line.
+bool parseCaptureLine(const char *line, RecordedSample &sample);
+
+/// Append every sample line from @p file.
+void readCapture(FILE *file, std::vector<RecordedSample> &samples);
+
+/// Append every sample line from the file at @p path.
+/// @return false if it can't be opened.
+bool readCaptureFile(const char *path, std::vector<RecordedSample> &samples);
+
+/// Append every sample line in @p text, like the log app's output.
+void readCaptureText(std::string const &text, std::vector<RecordedSample> &samples);
+
+/// Read the true latencies from the file at @p path, as the synth tool
+/// writes them: us,latency_us.
+/// @return false if it can't be opened.
+bool readTruthFile(const char *path, std::vector<TruthEvent> &events);
+
+/// Where the true latencies for the capture at @p path go: "x.csv" has
+/// "x.truth.csv".
+std::string truthPathFor(std::string const &path);
+
+/// The lines of @p output that are just a number, like latencies.
+std::vector<long> numberLines(std::string const &output);
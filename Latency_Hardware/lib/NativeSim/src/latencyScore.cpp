@@ -0,0 +1,106 @@
+// Copyright 2021, Collabora, Ltd.
+// SPDX-License-Identifier: BSL-1.0
+// Original Author: Ryan Pavlik
+
+#include "latencyScore.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+void LatencyScore::add(LatencyScore const &other)
+{
+    events += other.events;
+    detections += other.detections;
+    matched += other.matched;
+    latencySum += other.latencySum;
+    latencySumSq += other.latencySumSq;
+    errorSum += other.errorSum;
+    errorSumSq += other.errorSumSq;
+}
+
+static double stddev(double sum, double sumSq, size_t n)
+{
+    if (n < 2)
+    {
+        return 0;
+    }
+    double variance = (sumSq - sum * sum / n) / (n - 1);
+    return variance > 0 ? sqrt(variance) : 0;
+}
+
+double LatencyScore::meanLatencyUs() const
+{
+    return detections ? latencySum / detections : 0;
+}
+
+double LatencyScore::latencyStddevUs() const
+{
+    return stddev(latencySum, latencySumSq, detections);
+}
+
+double LatencyScore::biasUs() const
+{
+    return matched ? errorSum / matched : 0;
+}
+
+double LatencyScore::errorStddevUs() const
+{
+    return stddev(errorSum, errorSumSq, matched);
+}
+
+double LatencyScore::missRate() const
+{
+    return events ? static_cast<double>(events - matched) / events : 0;
+}
+
+double LatencyScore::falseRate() const
+{
+    return detections ? static_cast<double>(detections - matched) / detections : 0;
+}
+
+LatencyScore scoreLatencies(std::vector<TruthEvent> const &truth, std::vector<Detection> const &detections,
+                            unsigned long windowUs)
+{
+    LatencyScore score;
+    score.events = truth.size();
+    score.detections = detections.size();
+    std::vector<bool> taken(truth.size(), false);
+    long window = static_cast<long>(windowUs);
+    // Both come in time order, so only look from the first event that's
+    // not too early for this detection.
+    size_t first = 0;
+    for (Detection const &detection : detections)
+    {
+        score.latencySum += detection.latencyUs;
+        score.latencySumSq += static_cast<double>(detection.latencyUs) * detection.latencyUs;
+
+        uint32_t motionUs = detection.us - static_cast<uint32_t>(detection.latencyUs);
+        // Wrapping, like micros().
+        auto offset = [&](size_t i) { return static_cast<long>(static_cast<int32_t>(truth[i].motionUs - motionUs)); };
+        while (first < truth.size() && offset(first) < -window)
+        {
+            first++;
+        }
+        long best = -1;
+        long bestDistance = window + 1;
+        for (size_t i = first; i < truth.size() && offset(i) <= window; ++i)
+        {
+            long distance = labs(offset(i));
+            if (!taken[i] && distance < bestDistance)
+            {
+                best = static_cast<long>(i);
+                bestDistance = distance;
+            }
+        }
+        if (best < 0)
+        {
+            continue;
+        }
+        taken[best] = true;
+        score.matched++;
+        double error = detection.latencyUs - static_cast<double>(truth[best].latencyUs);
+        score.errorSum += error;
+        score.errorSumSq += error * error;
+    }
+    return score;
+}
@@ -0,0 +1,56 @@
+// Copyright 2021, Collabora, Ltd.
+// SPDX-License-Identifier: BSL-1.0
+// Original Author: Ryan Pavlik
+//
+// Scoring the latencies an app reported against the true ones.
+//
+// Each detection is matched to the true event nearest where it says the
+// motion was (when it was reported, less its latency), if there's one
+// within the window that isn't already matched. True events left over are
+// misses; detections left over are false.
+
+#pragma once
+
+#include "syntheticCapture.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/// A latency an app reported, and micros() when it did.
+struct Detection
+{
+    uint32_t us;
+    long latencyUs;
+};
+
+struct LatencyScore
+{
+    size_t events = 0;
+    size_t detections = 0;
+    size_t matched = 0;
+    // Sums, so scores from several captures add up.
+    // Of every latency reported.
+    double latencySum = 0;
+    double latencySumSq = 0;
+    // Of reported minus true latency, where matched.
+    double errorSum = 0;
+    double errorSumSq = 0;
+
+    void add(LatencyScore const &other);
+
+    double meanLatencyUs() const;
+    double latencyStddevUs() const;
+    /// Mean of reported minus true.
+    double biasUs() const;
+    double errorStddevUs() const;
+    /// Of the true events, how many weren't detected.
+    double missRate() const;
+    /// Of the detections, how many didn't match a true event.
+    double falseRate() const;
+};
+
+constexpr unsigned long LATENCY_SCORE_WINDOW_US = 100000;
+
+LatencyScore scoreLatencies(std::vector<TruthEvent> const &truth, std::vector<Detection> const &detections,
+                            unsigned long windowUs = LATENCY_SCORE_WINDOW_US);
@@ -0,0 +1,35 @@
+// Copyright 2021, Collabora, Ltd.
+// SPDX-License-Identifier: BSL-1.0
+// Original Author: Ryan Pavlik
+//
+// Board implementation for the host, against the simulator.
+
+#if defined(TARGET_NATIVE)
+#include "nativeBoard.h"
+
+#include <string.h>
+
+bool Board::begin()
+{
+    pinMode(LED_RED, OUTPUT);
+    ledOff();
+    return true;
+}
+
+bool Board::getGyroData(unsigned long *microseconds, sensors_event_t *gyroEvent)
+{
+    simulator().waitForImuSample();
+    memset(gyroEvent, 0, sizeof(*gyroEvent));
+    simulator().readGyro(gyroEvent->gyro.v);
+    *microseconds = micros();
+    return true;
+}
+
+bool Board::getAccelData(sensors_event_t *accelEvent)
+{
+    memset(accelEvent, 0, sizeof(*accelEvent));
+    simulator().readAccel(accelEvent->acceleration.v);
+    return true;
+}
+
+#endif // TARGET_NATIVE
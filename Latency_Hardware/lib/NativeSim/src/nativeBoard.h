@@ -0,0 +1,47 @@
+// Copyright 2021, Collabora, Ltd.
+// SPDX-License-Identifier: BSL-1.0
+// Original Author: Ryan Pavlik
+//
+// Board header for running on the host, against the simulator.
+
+#pragma once
+
+#ifdef TARGET_NATIVE
+#include <Arduino.h>
+#include <Adafruit_Sensor.h>
+
+#include "simulator.h"
+
+// Same ADC and IMU setup as the Nano 33 BLE, so thresholds carry over.
+constexpr int MAX_ANALOG = 65535;
+constexpr unsigned long IMU_SAMPLE_INTERVAL_US = SIM_IMU_SAMPLE_INTERVAL_US;
+
+constexpr uint32_t ANALOG_RESOLUTION_BITS = 16;
+constexpr uint32_t DEFAULT_ANALOG_RESOLUTION_BITS = 10;
+
+static inline void setupAnalog() {
+    analogReadResolution(ANALOG_RESOLUTION_BITS);
+}
+
+static inline void resetAnalog() {
+    analogReadResolution(DEFAULT_ANALOG_RESOLUTION_BITS);
+}
+
+static inline void ledOn() {
+    digitalWrite(LED_RED, LOW);
+}
+
+static inline void ledOff() {
+    digitalWrite(LED_RED, HIGH);
+}
+
+class Board
+{
+public:
+    bool begin();
+    /// Waits (in virtual time) for the next sample, as the I2C read would.
+    bool getGyroData(unsigned long *microseconds, sensors_event_t *gyroEvent);
+    bool getAccelData(sensors_event_t *accelEvent);
+};
+
+#endif // TARGET_NATIVE
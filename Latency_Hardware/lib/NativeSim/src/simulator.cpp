@@ -0,0 +1,254 @@
+// Copyright 2021, Collabora, Ltd.
+// SPDX-License-Identifier: BSL-1.0
+// Original Author: Ryan Pavlik
+//
+// The simulated world for host builds.
+
+#include "simulator.h"
+
+#include <math.h>
+
+static constexpr float PI_F = 3.14159265358979f;
+static constexpr float GRAVITY = 9.80665f;
+// The gyro is set up for 245 dps full scale.
+static constexpr float GYRO_FULL_SCALE = 245.f * PI_F / 180.f;
+
+static float clampf(float v, float lo, float hi)
+{
+    return v < lo ? lo : (v > hi ? hi : v);
+}
+
+void Simulator::configure(SimulatorConfig const &config)
+{
+    config_ = config;
+    timeline_.clear();
+    recording_.clear();
+    recordedOffsetUs_.clear();
+    rng_.seed(config.seed);
+    normal_.reset();
+    nextImuUs_ = nowUs_;
+}
+
+void Simulator::play(std::vector<MotionSegment> const &segments)
+{
+    // Cut what was playing off at now, and forget the rest.
+    while (!timeline_.empty() && timeline_.back().startUs >= nowUs_)
+    {
+        timeline_.pop_back();
+    }
+    if (!timeline_.empty())
+    {
+        Scheduled &last = timeline_.back();
+        if (last.startUs + last.segment.durationUs > nowUs_)
+        {
+            last.segment.durationUs = static_cast<unsigned long>(nowUs_ - last.startUs);
+        }
+    }
+    uint64_t start = nowUs_;
+    for (MotionSegment const &segment : segments)
+    {
+        timeline_.push_back({segment, start});
+        start += segment.durationUs;
+    }
+}
+
+uint64_t Simulator::profileEndUs() const
+{
+    if (timeline_.empty())
+    {
+        return 0;
+    }
+    return timeline_.back().startUs + timeline_.back().segment.durationUs;
+}
+
+float Simulator::rotationRate(uint64_t t, int axis) const
+{
+    for (Scheduled const &s : timeline_)
+    {
+        if (t < s.startUs || t >= s.startUs + s.segment.durationUs || s.segment.axis != axis)
+        {
+            continue;
+        }
+        float tau = static_cast<float>(t - s.startUs) * 1e-6f;
+        switch (s.segment.kind)
+        {
+        case MotionSegment::Rotate:
+            return s.segment.amplitude;
+        case MotionSegment::Oscillate:
+            return s.segment.amplitude * sinf(2 * PI_F * tau / (s.segment.periodUs * 1e-6f));
+        default:
+            return 0;
+        }
+    }
+    return 0;
+}
+
+float Simulator::angle(uint64_t t, int axis) const
+{
+    // Sum up each segment so far: in closed form, so no drift.
+    float total = 0;
+    for (Scheduled const &s : timeline_)
+    {
+        if (t <= s.startUs)
+        {
+            break;
+        }
+        if (s.segment.axis != axis)
+        {
+            continue;
+        }
+        uint64_t elapsed = t - s.startUs;
+        if (elapsed > s.segment.durationUs)
+        {
+            elapsed = s.segment.durationUs;
+        }
+        float tau = static_cast<float>(elapsed) * 1e-6f;
+        switch (s.segment.kind)
+        {
+        case MotionSegment::Rotate:
+            total += s.segment.amplitude * tau;
+            break;
+        case MotionSegment::Oscillate:
+        {
+            float period = s.segment.periodUs * 1e-6f;
+            total += s.segment.amplitude * period / (2 * PI_F) * (1 - cosf(2 * PI_F * tau / period));
+            break;
+        }
+        default:
+            break;
+        }
+    }
+    return total;
+}
+
+float Simulator::linearAccel(uint64_t t, int axis) const
+{
+    for (Scheduled const &s : timeline_)
+    {
+        if (s.segment.kind == MotionSegment::Translate && s.segment.axis == axis && t >= s.startUs &&
+            t < s.startUs + s.segment.durationUs)
+        {
+            return s.segment.amplitude;
+        }
+    }
+    return 0;
+}
+
+float Simulator::trueBrightness(uint64_t t) const
+{
+    // The display is showing where we were, latencyUs ago.
+    uint64_t shown = t > config_.latencyUs ? t - config_.latencyUs : 0;
+    float b = config_.brightnessBase + config_.brightnessPerRadian * angle(shown, config_.brightnessAxis);
+    return clampf(b, 0.f, 1.f);
+}
+
+float Simulator::noise(float stddev)
+{
+    return stddev > 0 ? normal_(rng_) * stddev : 0.f;
+}
+
+void Simulator::replay(std::vector<RecordedSample> &&samples)
+{
+    recording_ = std::move(samples);
+    recordedOffsetUs_.clear();
+    uint64_t offset = 0;
+    for (size_t i = 0; i < recording_.size(); ++i)
+    {
+        if (i > 0)
+        {
+            // Differences of wrapping 32-bit times are right anyway.
+            offset += static_cast<uint32_t>(recording_[i].us - recording_[i - 1].us);
+        }
+        recordedOffsetUs_.push_back(offset);
+    }
+    replayStartUs_ = nowUs_;
+    // The first getGyroData() moves on to sample 0.
+    gyroCursor_ = static_cast<size_t>(-1);
+    brightnessCursor_ = 0;
+}
+
+uint32_t Simulator::replayMicros() const
+{
+    if (recording_.empty())
+    {
+        return 0;
+    }
+    return recording_[0].us + static_cast<uint32_t>(nowUs_ - replayStartUs_);
+}
+
+int Simulator::readPhotosensor(int bits)
+{
+    if (replaying())
+    {
+        // The latest sample at or before now.
+        while (brightnessCursor_ + 1 < recording_.size() && recordedTime(brightnessCursor_ + 1) <= nowUs_)
+        {
+            brightnessCursor_++;
+        }
+        return recording_[brightnessCursor_].brightness;
+    }
+    // Brighter is a higher reading.
+    float fullScale = static_cast<float>((1 << bits) - 1);
+    return static_cast<int>(readBrightness() * fullScale + 0.5f);
+}
+
+void Simulator::readGyro(float out[3])
+{
+    if (replaying())
+    {
+        for (int i = 0; i < 3; ++i)
+        {
+            out[i] = recording_[gyroCursor_].gyro[i];
+        }
+        return;
+    }
+    for (int i = 0; i < 3; ++i)
+    {
+        float rate = rotationRate(nowUs_, i) + config_.gyroBias[i] + noise(config_.gyroNoise);
+        out[i] = clampf(rate, -GYRO_FULL_SCALE, GYRO_FULL_SCALE);
+    }
+}
+
+void Simulator::readAccel(float out[3])
+{
+    if (replaying() && recording_[gyroCursor_].hasAccel)
+    {
+        for (int i = 0; i < 3; ++i)
+        {
+            out[i] = recording_[gyroCursor_].accel[i];
+        }
+        return;
+    }
+    for (int i = 0; i < 3; ++i)
+    {
+        // Lying flat: gravity is up the Z axis.
+        out[i] = linearAccel(nowUs_, i) + (i == 2 ? GRAVITY : 0.f) + noise(config_.accelNoise);
+    }
+}
+
+float Simulator::readBrightness()
+{
+    return clampf(trueBrightness(nowUs_) + noise(config_.brightnessNoise), 0.f, 1.f);
+}
+
+void Simulator::waitForImuSample()
+{
+    if (replaying())
+    {
+        // Hold on the last one, once they run out.
+        if (gyroCursor_ + 1 < recording_.size())
+        {
+            gyroCursor_++;
+        }
+        advanceTo(recordedTime(gyroCursor_));
+        return;
+    }
+    advanceTo(nextImuUs_);
+    nextImuUs_ = nowUs_ + config_.imuSampleIntervalUs;
+}
+
+Simulator &simulator()
+{
+    static Simulator sim;
+    return sim;
+}
@@ -0,0 +1,181 @@
+// Copyright 2021, Collabora, Ltd.
+// SPDX-License-Identifier: BSL-1.0
+// Original Author: Ryan Pavlik
+//
+// The world the firmware sees when it runs on the host: a virtual clock, and
+// a rig to measure. The rig moves through a list of motion segments, and the
+// "display" in front of the photosensor gets brighter or darker with the
+// angle it has turned through, some latency later, plus noise.
+//
+// Or, instead of the rig, it can replay a capture from the log app: the IMU
+// hands out the recorded samples at their recorded times, and the
+// photosensor reads whatever was recorded last.
+//
+// Nothing here waits: time only moves when the firmware reads a sensor,
+// delays, or asks the time, so apps run as fast as the host can go.
+
+#pragma once
+
+#include <random>
+#include <stdint.h>
+#include <vector>
+
+/// One piece of a motion profile, from when the previous one ends.
+struct MotionSegment
+{
+    enum Kind : uint8_t
+    {
+        Still,
+        /// Turn at a constant rate.
+        Rotate,
+        /// Turn back and forth: rate is amplitude * sin(2 pi t / period).
+        Oscillate,
+        /// Accelerate in a straight line, without turning.
+        Translate,
+    };
+    Kind kind;
+    unsigned long durationUs;
+    int axis;
+    /// rad/s for Rotate and Oscillate, m/s^2 for Translate
+    float amplitude;
+    unsigned long periodUs;
+
+    static MotionSegment still(unsigned long durationUs) { return {Still, durationUs, 0, 0, 0}; }
+    static MotionSegment rotate(unsigned long durationUs, int axis, float rate)
+    {
+        return {Rotate, durationUs, axis, rate, 0};
+    }
+    static MotionSegment oscillate(unsigned long durationUs, int axis, float amplitude, unsigned long periodUs)
+    {
+        return {Oscillate, durationUs, axis, amplitude, periodUs};
+    }
+    static MotionSegment translate(unsigned long durationUs, int axis, float accel)
+    {
+        return {Translate, durationUs, axis, accel, 0};
+    }
+};
+
+/// One line of a log app capture.
+struct RecordedSample
+{
+    /// micros() when it was taken: may wrap.
+    uint32_t us;
+    /// rad/s
+    float gyro[3];
+    /// What readBrightness() returned.
+    int brightness;
+    bool hasAccel;
+    /// m/s^2
+    float accel[3];
+};
+
+// The LSM9DS1 gyro rate the Adafruit driver sets up: 952Hz.
+constexpr unsigned long SIM_IMU_SAMPLE_INTERVAL_US = 1050;
+
+struct SimulatorConfig
+{
+    uint32_t seed = 1;
+
+    // Virtual time each operation takes.
+    unsigned long imuSampleIntervalUs = SIM_IMU_SAMPLE_INTERVAL_US;
+    unsigned long analogReadUs = 20;
+    /// Every call to micros() or millis(), so polling loops move on.
+    unsigned long clockReadUs = 1;
+
+    // Gyro, in rad/s
+    float gyroNoise = 0.005f;
+    float gyroBias[3] = {0.f, 0.f, 0.f};
+    // Accelerometer, in m/s^2
+    float accelNoise = 0.02f;
+
+    // Brightness, as a fraction of full scale: the display shows
+    // brightnessBase + brightnessPerRadian * (angle turned about
+    // brightnessAxis), latencyUs after the motion.
+    unsigned long latencyUs = 20000;
+    int brightnessAxis = 1;
+    float brightnessBase = 0.5f;
+    float brightnessPerRadian = 0.5f;
+    float brightnessNoise = 0.0005f;
+};
+
+class Simulator
+{
+public:
+    /// Start over: the clock stays where it is (apps keep their own time),
+    /// but the motion stops and the noise is reseeded.
+    void configure(SimulatorConfig const &config);
+    SimulatorConfig const &config() const { return config_; }
+
+    /// Move through @p segments starting now, replacing anything still to
+    /// come. The angles carry on from where they are.
+    void play(std::vector<MotionSegment> const &segments);
+
+    /// Replay @p samples from now, instead of the rig. Takes them over.
+    void replay(std::vector<RecordedSample> &&samples);
+    bool replaying() const { return !recording_.empty(); }
+    /// Once the IMU has handed out every recorded sample.
+    bool replayDone() const { return replaying() && gyroCursor_ + 1 >= recording_.size(); }
+    /// Where the replay is up to, in the recording's own micros().
+    uint32_t replayMicros() const;
+
+    /// What the ADC reads on the photosensor pin now, at @p bits resolution.
+    int readPhotosensor(int bits);
+
+    /// When what's been played ends.
+    uint64_t profileEndUs() const;
+    bool profileDone() const { return nowUs_ >= profileEndUs(); }
+
+    uint64_t nowUs() const { return nowUs_; }
+    void advance(unsigned long us) { nowUs_ += us; }
+    /// Wait until @p t, if it's still to come.
+    void advanceTo(uint64_t t)
+    {
+        if (t > nowUs_)
+        {
+            nowUs_ = t;
+        }
+    }
+
+    // The true motion, at time @p t.
+    float rotationRate(uint64_t t, int axis) const;
+    float angle(uint64_t t, int axis) const;
+    float linearAccel(uint64_t t, int axis) const;
+    /// 0 to 1, before noise.
+    float trueBrightness(uint64_t t) const;
+
+    // Sensor readings, now, with noise.
+    void readGyro(float out[3]);
+    void readAccel(float out[3]);
+    float readBrightness();
+
+    /// Block until the next IMU sample is due, like waiting for the bus.
+    void waitForImuSample();
+
+private:
+    struct Scheduled
+    {
+        MotionSegment segment;
+        uint64_t startUs;
+    };
+    float noise(float stddev);
+    /// Virtual time of a recorded sample.
+    uint64_t recordedTime(size_t index) const { return replayStartUs_ + recordedOffsetUs_[index]; }
+
+    std::vector<RecordedSample> recording_;
+    // From the first sample, unwrapped.
+    std::vector<uint64_t> recordedOffsetUs_;
+    uint64_t replayStartUs_ = 0;
+    // The last sample the IMU handed out, and the last the photosensor saw.
+    size_t gyroCursor_ = 0;
+    size_t brightnessCursor_ = 0;
+
+    SimulatorConfig config_;
+    std::vector<Scheduled> timeline_;
+    uint64_t nowUs_ = 0;
+    uint64_t nextImuUs_ = 0;
+    std::mt19937 rng_;
+    std::normal_distribution<float> normal_;
+};
+
+/// The one simulated world.
+Simulator &simulator();
@@ -0,0 +1,167 @@
+// Copyright 2021, Collabora, Ltd.
+// SPDX-License-Identifier: BSL-1.0
+// Original Author: Ryan Pavlik
+//
+// Work stealing for a pool of worker processes (the apps keep their state
+// in file statics, so the host tools can't use threads to run several).
+//
+// Tasks are numbered 0 to N-1, and start split into one contiguous range
+// per worker. Each worker takes from the front of its own range, and once
+// that's empty, steals the back half of whichever range has the most left.
+// Neighbouring tasks stay together, so a worker that numbers its tasks by
+// capture mostly runs one capture after another.
+//
+// It all lives in shared memory made before fork(), with a spin lock per
+// range: tasks take milliseconds, so the locks hardly matter.
+
+#pragma once
+
+#include <atomic>
+#include <new>
+#include <sched.h>
+#include <stddef.h>
+#include <sys/mman.h>
+
+class StealingQueues
+{
+public:
+    static constexpr size_t MaxWorkers = 256;
+
+    /// In shared memory, so the workers forked after share it.
+    /// @return nullptr if that fails.
+    static StealingQueues *create(size_t workers, size_t tasks)
+    {
+        if (workers == 0 || workers > MaxWorkers)
+        {
+            return nullptr;
+        }
+        void *memory = mmap(nullptr, sizeof(StealingQueues), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED)
+        {
+            return nullptr;
+        }
+        return new (memory) StealingQueues(workers, tasks);
+    }
+
+    static void destroy(StealingQueues *queues)
+    {
+        if (queues)
+        {
+            queues->~StealingQueues();
+            munmap(queues, sizeof(StealingQueues));
+        }
+    }
+
+    size_t workers() const { return workers_; }
+
+    /// The next task for @p worker, stealing if its own are done.
+    /// @return false once there are none left anywhere.
+    bool next(size_t worker, size_t &task)
+    {
+        while (true)
+        {
+            if (take(ranges_[worker], task))
+            {
+                return true;
+            }
+            if (!steal(worker))
+            {
+                return false;
+            }
+        }
+    }
+
+private:
+    struct alignas(64) Range
+    {
+        std::atomic<bool> locked{false};
+        // Atomic so remaining() can peek without the lock.
+        std::atomic<size_t> begin{0};
+        std::atomic<size_t> end{0};
+
+        void lock()
+        {
+            while (locked.exchange(true, std::memory_order_acquire))
+            {
+                // Let whoever has it finish, if we share a core.
+                sched_yield();
+            }
+        }
+        void unlock() { locked.store(false, std::memory_order_release); }
+        /// Without the lock: only a guess.
+        size_t remaining() const
+        {
+            size_t b = begin.load(std::memory_order_relaxed);
+            size_t e = end.load(std::memory_order_relaxed);
+            return e > b ? e - b : 0;
+        }
+    };
+
+    StealingQueues(size_t workers, size_t tasks) : workers_(workers)
+    {
+        for (size_t i = 0; i < workers; ++i)
+        {
+            ranges_[i].begin = tasks * i / workers;
+            ranges_[i].end = tasks * (i + 1) / workers;
+        }
+    }
+
+    static bool take(Range &range, size_t &task)
+    {
+        range.lock();
+        bool got = range.begin < range.end;
+        if (got)
+        {
+            task = range.begin++;
+        }
+        range.unlock();
+        return got;
+    }
+
+    /// Move the back half of the fullest other range to @p worker's.
+    bool steal(size_t worker)
+    {
+        while (true)
+        {
+            size_t victim = workers_;
+            size_t most = 0;
+            for (size_t i = 0; i < workers_; ++i)
+            {
+                size_t remaining = ranges_[i].remaining();
+                if (i != worker && remaining > most)
+                {
+                    victim = i;
+                    most = remaining;
+                }
+            }
+            if (victim == workers_)
+            {
+                return false;
+            }
+            Range &from = ranges_[victim];
+            from.lock();
+            size_t begin = from.begin;
+            size_t end = from.end;
+            if (begin >= end)
+            {
+                // Someone got there first: look again.
+                from.unlock();
+                continue;
+            }
+            size_t middle = end - (end - begin + 1) / 2;
+            from.end = middle;
+            from.unlock();
+
+            // Nobody else adds to ours, so it's still empty.
+            Range &to = ranges_[worker];
+            to.lock();
+            to.begin = middle;
+            to.end = end;
+            to.unlock();
+            return true;
+        }
+    }
+
+    size_t workers_;
+    Range ranges_[MaxWorkers];
+};
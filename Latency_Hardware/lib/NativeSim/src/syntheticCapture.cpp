@@ -0,0 +1,222 @@
+// Copyright 2021, Collabora, Ltd.
+// SPDX-License-Identifier: BSL-1.0
+// Original Author: Ryan Pavlik
+
+#include "syntheticCapture.h"
+
+#include <math.h>
+
+static constexpr double PI = 3.14159265358979323846;
+static constexpr float GRAVITY = 9.80665f;
+// The gyro is set up for 245 dps full scale.
+static constexpr float GYRO_FULL_SCALE = static_cast<float>(245. * PI / 180.);
+
+static float clampf(float v, float lo, float hi)
+{
+    return v < lo ? lo : (v > hi ? hi : v);
+}
+
+/// Angle turned about its axis, @p elapsedUs into @p segment.
+static float segmentAngle(MotionSegment const &segment, uint64_t elapsedUs)
+{
+    double tau = elapsedUs * 1e-6;
+    switch (segment.kind)
+    {
+    case MotionSegment::Rotate:
+        return static_cast<float>(segment.amplitude * tau);
+    case MotionSegment::Oscillate:
+    {
+        double period = segment.periodUs * 1e-6;
+        return static_cast<float>(segment.amplitude * period / (2 * PI) * (1 - cos(2 * PI * tau / period)));
+    }
+    default:
+        return 0;
+    }
+}
+
+static float stepFactor(float stepUs, float timeConstantUs)
+{
+    return timeConstantUs > 0 ? static_cast<float>(1 - exp(-stepUs / timeConstantUs)) : 1.f;
+}
+
+SyntheticCapture::SyntheticCapture(SyntheticConfig const &config) : config_(config)
+{
+    float angle[3] = {0, 0, 0};
+    uint64_t start = 0;
+    for (MotionSegment const &motion : config_.profile)
+    {
+        Segment segment{motion, start, {angle[0], angle[1], angle[2]}};
+        segments_.push_back(segment);
+        if (motion.axis >= 0 && motion.axis < 3)
+        {
+            angle[motion.axis] += segmentAngle(motion, motion.durationUs);
+        }
+        start += motion.durationUs;
+    }
+    endUs_ = start;
+    rng_.seed(config_.seed);
+
+    DisplayModel const &display = config_.display;
+    frameUs_ = display.refreshHz > 0 ? 1e6 / display.refreshHz : 0;
+    rowDelayUs_ = display.sensorRow * display.scanoutFraction * frameUs_;
+    nextRowUpdateUs_ = display.phaseUs + rowDelayUs_;
+    lastRowUpdateUs_ = nextRowUpdateUs_ - frameUs_;
+    float step = static_cast<float>(config_.modelStepUs);
+    riseFactor_ = stepFactor(step, display.riseUs);
+    fallFactor_ = stepFactor(step, display.fallUs);
+    photodiodeFactor_ = stepFactor(step, config_.photodiode.responseUs);
+
+    // Start settled on what's showing before anything moves.
+    target_ = renderedAt(0);
+    pixel_ = target_;
+    photodiode_ = target_ * (frameUs_ > 0 ? display.persistence : 1.f);
+}
+
+std::vector<TruthEvent> SyntheticCapture::truth(SyntheticConfig const &config)
+{
+    DisplayModel const &display = config.display;
+    double frameUs = display.refreshHz > 0 ? 1e6 / display.refreshHz : 0;
+    std::vector<TruthEvent> events;
+    auto add = [&](uint64_t motionUs) {
+        // Shown from the first frame rendered after it: one that starts
+        // exactly on it still renders the pose from before the motion.
+        double shownUs = static_cast<double>(motionUs + config.pipelineLatencyUs);
+        if (frameUs > 0)
+        {
+            double frame = floor((shownUs - display.phaseUs) / frameUs) + 1;
+            shownUs = display.phaseUs + (frame > 0 ? frame : 0) * frameUs +
+                      display.sensorRow * display.scanoutFraction * frameUs;
+        }
+        events.push_back({config.startUs + static_cast<uint32_t>(motionUs),
+                          static_cast<unsigned long>(lround(shownUs - static_cast<double>(motionUs)))});
+    };
+    uint64_t start = 0;
+    for (MotionSegment const &motion : config.profile)
+    {
+        if (motion.kind == MotionSegment::Oscillate && motion.periodUs > 0)
+        {
+            // Starting, then each turnaround.
+            for (uint64_t t = 0; t < motion.durationUs; t += motion.periodUs / 2)
+            {
+                add(start + t);
+            }
+        }
+        else if (motion.kind != MotionSegment::Still)
+        {
+            add(start);
+        }
+        start += motion.durationUs;
+    }
+    return events;
+}
+
+SyntheticCapture::Segment const *SyntheticCapture::segmentAt(size_t &cursor, uint64_t t) const
+{
+    while (cursor < segments_.size() && t >= segments_[cursor].startUs + segments_[cursor].motion.durationUs)
+    {
+        cursor++;
+    }
+    return cursor < segments_.size() ? &segments_[cursor] : nullptr;
+}
+
+float SyntheticCapture::angleAt(size_t &cursor, uint64_t t, int axis) const
+{
+    Segment const *segment = segmentAt(cursor, t);
+    if (!segment)
+    {
+        if (segments_.empty())
+        {
+            return 0;
+        }
+        // Past the end: where the last one left off.
+        Segment const &last = segments_.back();
+        return last.angleBefore[axis] +
+               (last.motion.axis == axis ? segmentAngle(last.motion, last.motion.durationUs) : 0.f);
+    }
+    float angle = segment->angleBefore[axis];
+    if (segment->motion.axis == axis && t > segment->startUs)
+    {
+        angle += segmentAngle(segment->motion, t - segment->startUs);
+    }
+    return angle;
+}
+
+float SyntheticCapture::renderedAt(uint64_t t)
+{
+    float b = config_.brightnessBase +
+              config_.brightnessPerRadian * angleAt(poseCursor_, t, config_.brightnessAxis);
+    return clampf(b, 0.f, 1.f);
+}
+
+void SyntheticCapture::stepDisplay(uint64_t until)
+{
+    DisplayModel const &display = config_.display;
+    uint64_t latency = config_.pipelineLatencyUs;
+    while (displayUs_ < until)
+    {
+        displayUs_ += config_.modelStepUs;
+        bool lit = true;
+        if (frameUs_ > 0)
+        {
+            while (displayUs_ >= nextRowUpdateUs_)
+            {
+                // Scanout reaches our row with a frame rendered from the
+                // pose as of its start, less the pipeline latency.
+                double frameStart = nextRowUpdateUs_ - rowDelayUs_;
+                double poseUs = frameStart - static_cast<double>(latency);
+                target_ = renderedAt(poseUs > 0 ? static_cast<uint64_t>(poseUs) : 0);
+                lastRowUpdateUs_ = nextRowUpdateUs_;
+                nextFrame_++;
+                nextRowUpdateUs_ = display.phaseUs + rowDelayUs_ + nextFrame_ * frameUs_;
+            }
+            lit = displayUs_ - lastRowUpdateUs_ < display.persistence * frameUs_;
+        }
+        else
+        {
+            target_ = renderedAt(displayUs_ > latency ? displayUs_ - latency : 0);
+        }
+        pixel_ += (target_ - pixel_) * (target_ > pixel_ ? riseFactor_ : fallFactor_);
+        float light = lit ? pixel_ : 0.f;
+        photodiode_ += (light - photodiode_) * photodiodeFactor_;
+    }
+}
+
+void SyntheticCapture::next(RecordedSample &sample)
+{
+    stepDisplay(nowUs_);
+    sample.us = config_.startUs + static_cast<uint32_t>(nowUs_);
+
+    Segment const *segment = segmentAt(gyroCursor_, nowUs_);
+    for (int i = 0; i < 3; ++i)
+    {
+        float rate = 0;
+        float accel = i == 2 ? GRAVITY : 0.f;
+        if (segment && segment->motion.axis == i)
+        {
+            MotionSegment const &motion = segment->motion;
+            if (motion.kind == MotionSegment::Rotate)
+            {
+                rate = motion.amplitude;
+            }
+            else if (motion.kind == MotionSegment::Oscillate)
+            {
+                double tau = (nowUs_ - segment->startUs) * 1e-6;
+                rate = static_cast<float>(motion.amplitude * sin(2 * PI * tau / (motion.periodUs * 1e-6)));
+            }
+            else if (motion.kind == MotionSegment::Translate)
+            {
+                accel += motion.amplitude;
+            }
+        }
+        sample.gyro[i] = clampf(rate + config_.gyroBias[i] + noise(config_.gyroNoise), -GYRO_FULL_SCALE,
+                                GYRO_FULL_SCALE);
+        sample.accel[i] = config_.withAccel ? accel + noise(config_.accelNoise) : 0.f;
+    }
+    sample.hasAccel = config_.withAccel;
+
+    float fullScale = static_cast<float>((1 << config_.photodiode.adcBits) - 1);
+    float reading = photodiode_ * fullScale + noise(config_.photodiode.adcNoise);
+    sample.brightness = static_cast<int>(lroundf(clampf(reading, 0.f, fullScale)));
+
+    nowUs_ += config_.sampleIntervalUs;
+}
@@ -0,0 +1,149 @@
+// Copyright 2021, Collabora, Ltd.
+// SPDX-License-Identifier: BSL-1.0
+// Original Author: Ryan Pavlik
+//
+// Captures with a known answer: a rig moving through a motion profile, an
+// app that renders its pose some pipeline latency later, and a display and
+// photosensor in between, as the log app would have recorded them.
+//
+// The display refreshes at a fixed rate, scanning out top to bottom, so a
+// pose shows up at the photosensor's row on the first frame that started
+// scanning out at least the pipeline latency after it. Each pixel then
+// moves to its new level with separate rise and fall time constants, lit
+// for some fraction of the frame (all of it for sample-and-hold). The
+// photodiode and its amplifier add another first-order lag, and the ADC
+// adds noise and rounds.
+//
+// Samples come out one at a time, walking forward in time, so this is
+// cheap enough to make hours of data.
+
+#pragma once
+
+#include "simulator.h"
+
+#include <random>
+#include <stdint.h>
+#include <vector>
+
+struct DisplayModel
+{
+    /// Frames per second: 0 for one that updates continuously.
+    float refreshHz = 90.f;
+    /// When the first frame starts scanning out.
+    float phaseUs = 0.f;
+    /// Of each frame, spent scanning from the first row to the last.
+    float scanoutFraction = 1.f;
+    /// Where the photosensor is: 0 for the first row, 1 for the last.
+    float sensorRow = 0.5f;
+    /// Of each frame, that a row is lit for after it's updated: 1 for
+    /// sample-and-hold.
+    float persistence = 1.f;
+    /// Pixel response time constants, to brighter and to darker.
+    float riseUs = 1000.f;
+    float fallUs = 2000.f;
+};
+
+struct PhotodiodeModel
+{
+    /// Time constant of the photodiode and amplifier.
+    float responseUs = 50.f;
+    int adcBits = 10;
+    /// In ADC counts.
+    float adcNoise = 0.5f;
+};
+
+struct SyntheticConfig
+{
+    uint32_t seed = 1;
+    unsigned long sampleIntervalUs = SIM_IMU_SAMPLE_INTERVAL_US;
+    /// micros() of the first sample.
+    uint32_t startUs = 0;
+    /// From a pose to the start of scanout of the first frame that can
+    /// show it.
+    unsigned long pipelineLatencyUs = 20000;
+    std::vector<MotionSegment> profile;
+
+    // What the app renders: brightnessBase + brightnessPerRadian * (angle
+    // turned about brightnessAxis), as a fraction of full scale.
+    int brightnessAxis = 1;
+    float brightnessBase = 0.5f;
+    float brightnessPerRadian = 0.5f;
+
+    // Gyro, in rad/s
+    float gyroNoise = 0.005f;
+    float gyroBias[3] = {0.f, 0.f, 0.f};
+    bool withAccel = false;
+    // Accelerometer, in m/s^2
+    float accelNoise = 0.02f;
+
+    DisplayModel display;
+    PhotodiodeModel photodiode;
+    /// The display and photodiode are stepped at this between samples.
+    unsigned long modelStepUs = 25;
+};
+
+/// A motion starting or turning around, and when that first reaches the
+/// photosensor's row.
+struct TruthEvent
+{
+    /// micros() it starts or turns around.
+    uint32_t motionUs;
+    unsigned long latencyUs;
+};
+
+class SyntheticCapture
+{
+public:
+    explicit SyntheticCapture(SyntheticConfig const &config);
+
+    /// Once the profile is over.
+    bool done() const { return nowUs_ >= endUs_; }
+    /// The next sample.
+    void next(RecordedSample &sample);
+
+    /// When each motion segment in the profile starts, and each time an
+    /// oscillation turns around, with their true latencies.
+    static std::vector<TruthEvent> truth(SyntheticConfig const &config);
+
+private:
+    struct Segment
+    {
+        MotionSegment motion;
+        uint64_t startUs;
+        /// Angle turned about each axis before it.
+        float angleBefore[3];
+    };
+    /// The segment at @p t, moving @p cursor on to it: each kind of query
+    /// has its own, since each asks about times in order.
+    Segment const *segmentAt(size_t &cursor, uint64_t t) const;
+    float angleAt(size_t &cursor, uint64_t t, int axis) const;
+    /// What the app renders for the pose at @p t.
+    float renderedAt(uint64_t t);
+    void stepDisplay(uint64_t until);
+    float noise(float stddev) { return stddev > 0 ? normal_(rng_) * stddev : 0.f; }
+
+    SyntheticConfig config_;
+    std::vector<Segment> segments_;
+    uint64_t endUs_ = 0;
+    uint64_t nowUs_ = 0;
+    size_t gyroCursor_ = 0;
+    size_t poseCursor_ = 0;
+
+    // The display, as of displayUs_.
+    uint64_t displayUs_ = 0;
+    double frameUs_ = 0;
+    double rowDelayUs_ = 0;
+    uint64_t nextFrame_ = 0;
+    double nextRowUpdateUs_ = 0;
+    double lastRowUpdateUs_ = 0;
+    float target_ = 0;
+    float pixel_ = 0;
+    float photodiode_ = 0;
+    // How far each moves towards where it's going, per model step.
+    float riseFactor_ = 0;
+    float fallFactor_ = 0;
+    float photodiodeFactor_ = 0;
+
+    std::mt19937 rng_;
+    std::normal_distribution<float> normal_;
+};
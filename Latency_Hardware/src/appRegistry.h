@@ -0,0 +1,109 @@
+// Copyright 2021, Collabora, Ltd.
+// SPDX-License-Identifier: BSL-1.0
+// Original Author: Ryan Pavlik
+//
+// Compile-time list of the apps built into a firmware image.
+//
+// Each app is a type with:
+//
+//     static constexpr bool enabled;           // built into this image?
+//     static constexpr const char *name;       // for the "app" command
+//     static constexpr size_t memoryBytes;     // of shared app memory it needs
+//     static void setup();
+//     static void loop(Board &board);
+//     static bool command(Board &board, const char *command);
+//
+// EnabledApps<...> keeps the enabled ones, in order. Everything that runs
+// per loop goes through Wrap<App>::run for a caller-supplied Wrap, so the
+// app's loop is called directly from a plain function: switching apps swaps
+// one function pointer, with no lookup per pass.
+
+#pragma once
+
+#include <stddef.h>
+#include <string.h>
+#include <type_traits>
+
+class Board;
+
+namespace app_registry_detail
+{
+constexpr size_t maxOf()
+{
+    return 0;
+}
+
+template <typename... Rest>
+constexpr size_t maxOf(size_t first, Rest... rest)
+{
+    return first > maxOf(rest...) ? first : maxOf(rest...);
+}
+} // namespace app_registry_detail
+
+template <typename... Apps>
+struct AppRegistry
+{
+    static constexpr size_t count = sizeof...(Apps);
+    /// Enough shared app memory for any of them.
+    static constexpr size_t memoryBytes = app_registry_detail::maxOf(Apps::memoryBytes...);
+
+    static const char *name(size_t index)
+    {
+        static const char *const names[] = {Apps::name...};
+        return names[index];
+    }
+
+    /// @return the index of the app called @p name, or -1.
+    static int find(const char *appName)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (strcmp(name(i), appName) == 0)
+            {
+                return static_cast<int>(i);
+            }
+        }
+        return -1;
+    }
+
+    static void setup(size_t index)
+    {
+        static void (*const setups[])() = {&Apps::setup...};
+        setups[index]();
+    }
+
+    static bool command(size_t index, Board &board, const char *command)
+    {
+        static bool (*const commands[])(Board &, const char *) = {&Apps::command...};
+        return commands[index](board, command);
+    }
+
+    /// Wrap<App>::run for app @p index.
+    template <template <typename> class Wrap>
+    static void (*wrapped(size_t index))()
+    {
+        static void (*const runs[])() = {&Wrap<Apps>::run...};
+        return runs[index];
+    }
+};
+
+namespace app_registry_detail
+{
+template <typename Registry, typename... Apps>
+struct Filter
+{
+    using type = Registry;
+};
+
+template <typename... Kept, typename First, typename... Rest>
+struct Filter<AppRegistry<Kept...>, First, Rest...>
+{
+    using type = typename Filter<typename std::conditional<First::enabled, AppRegistry<Kept..., First>,
+                                                           AppRegistry<Kept...>>::type,
+                                 Rest...>::type;
+};
+} // namespace app_registry_detail
+
+/// The registry of just those @p Apps that are enabled.
+template <typename... Apps>
+using EnabledApps = typename app_registry_detail::Filter<AppRegistry<>, Apps...>::type;
@@ -0,0 +1,77 @@
+// Copyright 2021, Collabora, Ltd.
+// SPDX-License-Identifier: BSL-1.0
+// Original Author: Ryan Pavlik
+//
+// Sending a block of binary data in the middle of the otherwise text-based
+// serial output.
+//
+// A block is a header line:
+//
+//     BLOCK,<kind>,<payload bytes>[,<key>=<value>...]
+//
+// followed by exactly that many raw (little-endian) payload bytes, and then
+// a trailer line:
+//
+//     ENDBLOCK,<CRC-16/CCITT-FALSE of the payload, hex>
+//
+// so the host can keep reading line-by-line until it sees a header.
+
+#pragma once
+
+#include <Arduino.h>
+#include <stdint.h>
+
+#include "crc16.h"
+
+class BlockWriter
+{
+public:
+    /// Start the header line. Follow with any number of field() calls,
+    /// then beginPayload().
+    void begin(const char *kind, size_t payloadBytes)
+    {
+        crc_ = CRC16_INIT;
+        Serial.print("BLOCK,");
+        Serial.print(kind);
+        Serial.print(",");
+        Serial.print(static_cast<unsigned long>(payloadBytes));
+    }
+
+    template <typename T>
+    void field(const char *key, T value)
+    {
+        Serial.print(",");
+        Serial.print(key);
+        Serial.print("=");
+        Serial.print(value);
+    }
+
+    void field(const char *key, float value, int digits)
+    {
+        Serial.print(",");
+        Serial.print(key);
+        Serial.print("=");
+        Serial.print(value, digits);
+    }
+
+    /// Finish the header line.
+    void beginPayload() { Serial.println(); }
+
+    void write(const void *data, size_t len)
+    {
+        auto bytes = static_cast<const uint8_t *>(data);
+        crc_ = crc16Update(crc_, bytes, len);
+        Serial.write(bytes, len);
+    }
+
+    /// Write the trailer line.
+    void end()
+    {
+        Serial.println();
+        Serial.print("ENDBLOCK,");
+        Serial.println(crc_, HEX);
+    }
+
+private:
+    uint16_t crc_ = CRC16_INIT;
+};
@@ -0,0 +1,135 @@
+// Copyright 2021, Collabora, Ltd.
+// SPDX-License-Identifier: BSL-1.0
+// Original Author: Ryan Pavlik
+//
+// Code for "brightness burst" app: fill most of RAM with photodiode samples
+// at a rate far beyond what we could stream, then send them all afterwards.
+// For looking at display flicker, PWM dimming, persistence and pixel response.
+
+#ifdef APP_BURST
+#include <Arduino.h>
+#include "defines.h"
+#include "apps.h"
+#include "binaryBlock.h"
+#include "hostCommands.h"
+#include "health.h"
+#include "refreshDetect.h"
+
+#include <stdlib.h>
+
+#ifndef HAVE_BRIGHTNESS_BURST
+#error "Burst capture not supported on this board"
+#endif
+
+// In the shared app memory: BURST_MAX_SAMPLES is set in apps.h.
+struct BurstMemory
+{
+    int16_t burstBuffer[BURST_MAX_SAMPLES];
+    float refreshScratch[2048];
+};
+static_assert(sizeof(BurstMemory) <= BURST_MEMORY_BYTES, "update BURST_MEMORY_BYTES");
+
+// Samples converted and written per Serial.write()
+static constexpr size_t SEND_CHUNK_SAMPLES = 256;
+
+static bool burstRequested = false;
+static uint32_t requestedRate = BURST_MAX_RATE_HZ;
+static unsigned long requestedWindowUs = 0;
+
+static size_t windowToSamples(float rate, unsigned long windowUs)
+{
+    if (windowUs == 0)
+    {
+        return BURST_MAX_SAMPLES;
+    }
+    size_t samples = static_cast<size_t>(rate * windowUs / 1000000.0f);
+    return constrain(samples, size_t(1), size_t(BURST_MAX_SAMPLES));
+}
+
+static void sendBurst(float rate, unsigned long startMicros, size_t count, RefreshEstimate const &refresh)
+{
+    BlockWriter block;
+    block.begin("burst", count * sizeof(uint16_t));
+    block.field("count", static_cast<unsigned long>(count));
+    block.field("rate_hz", rate, 3);
+    block.field("start_us", startMicros);
+    if (refresh.valid)
+    {
+        block.field("refresh_hz", refresh.frequencyHz, 3);
+        block.field("refresh_phase_us", refresh.phaseUs, 1);
+        block.field("refresh_confidence", refresh.confidence, 2);
+    }
+    block.beginPayload();
+
+    const int16_t *burstBuffer = appMemory<BurstMemory>().burstBuffer;
+    uint16_t converted[SEND_CHUNK_SAMPLES];
+    for (size_t i = 0; i < count; i += SEND_CHUNK_SAMPLES)
+    {
+        size_t n = min(SEND_CHUNK_SAMPLES, count - i);
+        {
+            ProfileScope profile{PROFILE_FORMAT};
+            for (size_t j = 0; j < n; ++j)
+            {
+                converted[j] = static_cast<uint16_t>(burstSampleToBrightness(burstBuffer[i + j]));
+            }
+        }
+        ProfileScope profile{PROFILE_SERIAL_WRITE};
+        block.write(converted, n * sizeof(uint16_t));
+    }
+    block.end();
+}
+
+//*****************************************************
+bool burstCommand(Board & /* board */, const char *command)
+//*****************************************************
+{
+    // burst [rate_hz [window_us]]
+    if (const char *args = matchCommand(command, "burst"))
+    {
+        char *end = nullptr;
+        unsigned long rate = strtoul(args, &end, 10);
+        requestedRate = rate > 0 ? rate : BURST_MAX_RATE_HZ;
+        requestedWindowUs = strtoul(end, nullptr, 10);
+        burstRequested = true;
+        return true;
+    }
+    return false;
+}
+
+//*****************************************************
+void burstSetup()
+//*****************************************************
+{
+    setupAnalog();
+    Serial.println("latency_hardware_firmware brightness burst v01.00.00");
+    Serial.println(" Mount the photosensor rigidly on the eyepiece or screen.");
+    Serial.print(" Send \"burst [rate_hz [window_us]]\" to capture up to ");
+    Serial.print(BURST_MAX_SAMPLES);
+    Serial.print(" samples at up to ");
+    Serial.print(BURST_MAX_RATE_HZ);
+    Serial.println("Hz.");
+}
+
+//*****************************************************
+void burstLoop(Board &board)
+//*****************************************************
+{
+    if (!burstRequested)
+    {
+        return;
+    }
+    burstRequested = false;
+
+    // Work out the count with the real rate, so the window is right.
+    size_t count = windowToSamples(Board::burstSampleRate(requestedRate), requestedWindowUs);
+
+    unsigned long startMicros;
+    BurstMemory &memory = appMemory<BurstMemory>();
+    float rate = board.captureBrightnessBurst(memory.burstBuffer, count, requestedRate, &startMicros);
+    healthCountAdcSamples(count);
+    auto refresh = estimateRefresh(memory.burstBuffer, count, rate, memory.refreshScratch, 2048, burstSampleToBrightness);
+    sendBurst(rate, startMicros, count, refresh);
+    healthPlannedStall();
+}
+
+#endif // APP_BURST
@@ -0,0 +1,314 @@
+// Copyright 2021, Collabora, Ltd.
+// SPDX-License-Identifier: BSL-1.0
+// Original Author: Ryan Pavlik
+//
+// Optional filtering of brightness before the threshold logic, so the
+// thresholds can be lower, and its delay taken back out of the timing.
+//
+// - IIR: one-pole low-pass, y += alpha * (x - y), alpha in q15. The state
+//   keeps 8 fractional bits. On Cortex-M4 the step is a single SMLAWB.
+// - Median of 3 or 5: rejects spikes, keeps edges sharp.
+//
+// How late the filter makes a detection depends on what the detector looks
+// for, so there's a delay for each:
+// - A threshold crossing after a step (the onset test): how many samples
+//   after the raw input the output got that far. For the IIR that depends
+//   on how far it got next to the step, which the input and (unrounded)
+//   output at the crossing tell us; for the median it's (N - 1) / 2.
+// - The turn of a ramp that reverses (the turnaround test): for the IIR,
+//   tau * ln 2 where tau = (1 - alpha) / alpha is the DC group delay, the
+//   lag on a steady ramp; for the median, (N - 1) / 2 again.
+//
+// Samples come once per app loop, not at a fixed rate, so delays in
+// microseconds use a running average of the time between samples. A longer
+// gap than MaxIntervalUs (the app stopped feeding us a while) restarts the
+// filter rather than counting in that average.
+
+#pragma once
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "staticContainers.h"
+
+enum BrightnessFilterKind : uint8_t
+{
+    FILTER_NONE,
+    FILTER_IIR,
+    FILTER_MEDIAN,
+};
+
+namespace brightness_filter
+{
+// Fractional bits of the IIR state
+constexpr int StateShift = 8;
+
+/// acc + (a * bottom half of b) >> 16, like the Cortex-M4 DSP instruction.
+static inline int32_t smlawb(int32_t a, int32_t b, int32_t acc)
+{
+#if defined(__ARM_FEATURE_DSP) && __ARM_FEATURE_DSP
+    int32_t result;
+    __asm__("smlawb %0, %1, %2, %3" : "=r"(result) : "r"(a), "r"(b), "r"(acc));
+    return result;
+#else
+    return acc + static_cast<int32_t>((static_cast<int64_t>(a) * static_cast<int16_t>(b)) >> 16);
+#endif
+}
+
+/// One IIR step: the kernel. Inputs are at most 24 bits, so doubling the
+/// difference turns SMLAWB's >> 16 into the >> 15 that q15 needs.
+static inline int32_t iirStep(int32_t state, int32_t input, int16_t alphaQ15)
+{
+    return smlawb((input - state) * 2, alphaQ15, state);
+}
+
+/// One IIR step: plain C++ reference for the kernel.
+static inline int32_t iirStepReference(int32_t state, int32_t input, int16_t alphaQ15)
+{
+    return state + static_cast<int32_t>((static_cast<int64_t>(input - state) * alphaQ15) >> 15);
+}
+
+static inline void sort2(int &a, int &b)
+{
+    int lo = a < b ? a : b;
+    b = a < b ? b : a;
+    a = lo;
+}
+
+static inline int median3(int a, int b, int c)
+{
+    sort2(a, b);
+    sort2(b, c);
+    sort2(a, b);
+    return b;
+}
+
+static inline int median5(int a, int b, int c, int d, int e)
+{
+    // Discard the two smallest and two largest: 7 compare-exchanges.
+    sort2(a, b);
+    sort2(d, e);
+    sort2(a, d);
+    sort2(b, e);
+    sort2(b, c);
+    sort2(c, d);
+    sort2(b, c);
+    return c;
+}
+} // namespace brightness_filter
+
+class BrightnessFilter
+{
+public:
+    static constexpr size_t MaxMedianWindow = 5;
+    static constexpr unsigned long MaxIntervalUs = 20000;
+
+    /// @param param alpha in q15 for FILTER_IIR (1..32767), window (3 or 5)
+    /// for FILTER_MEDIAN.
+    bool configure(BrightnessFilterKind kind, int param)
+    {
+        if (kind == FILTER_IIR && (param < 1 || param > 32767))
+        {
+            return false;
+        }
+        if (kind == FILTER_MEDIAN && param != 3 && param != 5)
+        {
+            return false;
+        }
+        kind_ = kind;
+        param_ = param;
+        reset();
+        return true;
+    }
+
+    /// Start again from the next sample.
+    void reset()
+    {
+        primed_ = false;
+        window_.clear();
+    }
+
+    BrightnessFilterKind kind() const { return kind_; }
+    int param() const { return param_; }
+    bool enabled() const { return kind_ != FILTER_NONE; }
+
+    /// Filter one sample, read at @p nowUs.
+    int update(int raw, unsigned long nowUs)
+    {
+        if (primed_)
+        {
+            unsigned long dt = nowUs - lastUs_;
+            if (dt > MaxIntervalUs)
+            {
+                // What we have is stale: start again from this sample.
+                reset();
+            }
+            else if (meanIntervalUs_ == 0)
+            {
+                meanIntervalUs_ = static_cast<float>(dt);
+            }
+            else
+            {
+                // Running average, moving 1/16 of the way each sample.
+                meanIntervalUs_ += (static_cast<float>(dt) - meanIntervalUs_) / 16.f;
+            }
+        }
+        lastUs_ = nowUs;
+        lastInput_ = raw;
+
+        switch (kind_)
+        {
+        case FILTER_NONE:
+            primed_ = true;
+            return raw;
+
+        case FILTER_IIR:
+        {
+            int32_t input = static_cast<int32_t>(raw) << brightness_filter::StateShift;
+            state_ = primed_ ? brightness_filter::iirStep(state_, input, static_cast<int16_t>(param_)) : input;
+            primed_ = true;
+            return (state_ + (1 << (brightness_filter::StateShift - 1))) >> brightness_filter::StateShift;
+        }
+
+        case FILTER_MEDIAN:
+        {
+            if (!primed_)
+            {
+                // Fill with the first sample, so we start out steady.
+                for (size_t i = 0; i < MaxMedianWindow; ++i)
+                {
+                    window_.push(raw);
+                }
+                primed_ = true;
+            }
+            window_.push(raw);
+            if (param_ == 3)
+            {
+                return brightness_filter::median3(window_[MaxMedianWindow - 3], window_[MaxMedianWindow - 2],
+                                                  window_[MaxMedianWindow - 1]);
+            }
+            return brightness_filter::median5(window_[0], window_[1], window_[2], window_[3], window_[4]);
+        }
+        }
+        return raw;
+    }
+
+    /// How many samples the output lags a steady ramp: the DC group delay.
+    float groupDelaySamples() const
+    {
+        switch (kind_)
+        {
+        case FILTER_IIR:
+        {
+            float alpha = param_ / 32768.f;
+            return (1.f - alpha) / alpha;
+        }
+        case FILTER_MEDIAN:
+            return (param_ - 1) / 2.f;
+        default:
+            return 0;
+        }
+    }
+
+    /// Note the output now as the level a step starts from, for
+    /// crossingDelaySamples().
+    void markLevel() { markState_ = state_; }
+
+    /// How many samples after the raw input the output got to where it is
+    /// now, if the input stepped from the markLevel() level to the last
+    /// sample.
+    float crossingDelaySamples() const
+    {
+        switch (kind_)
+        {
+        case FILTER_IIR:
+        {
+            // k samples into a step, the output has come 1 - (1 - alpha)^k
+            // of the way: solve for k, from the unrounded state. The
+            // unfiltered input got there at the first sample, k = 1.
+            int32_t change = (static_cast<int32_t>(lastInput_) << brightness_filter::StateShift) - markState_;
+            float fraction = static_cast<float>(state_ - markState_) / static_cast<float>(change);
+            if (!(fraction > 0.f && fraction < 1.f))
+            {
+                // Not a clean step: the best we have is the lag on a ramp.
+                return groupDelaySamples();
+            }
+            float alpha = param_ / 32768.f;
+            float samples = logf(1.f - fraction) / logf(1.f - alpha) - 1.f;
+            return samples > 0.f ? samples : 0.f;
+        }
+        case FILTER_MEDIAN:
+            return (param_ - 1) / 2.f;
+        default:
+            return 0;
+        }
+    }
+
+    /// How many samples the output's turn lags the input's, for a ramp that
+    /// reverses.
+    float turnDelaySamples() const
+    {
+        if (kind_ == FILTER_IIR)
+        {
+            return groupDelaySamples() * 0.693147f;
+        }
+        return groupDelaySamples();
+    }
+
+    /// crossingDelaySamples() at the recent sample rate: subtract from the
+    /// time the crossing was seen.
+    unsigned long crossingDelayUs() const { return toUs(crossingDelaySamples()); }
+
+    /// turnDelaySamples() at the recent sample rate: subtract from the time
+    /// the turn was seen.
+    unsigned long turnDelayUs() const { return toUs(turnDelaySamples()); }
+
+    float meanIntervalUs() const { return meanIntervalUs_; }
+
+    /// Ratio of output to input noise (standard deviation) for white noise.
+    float noiseGain() const
+    {
+        switch (kind_)
+        {
+        case FILTER_IIR:
+        {
+            float alpha = param_ / 32768.f;
+            return sqrtf(alpha / (2.f - alpha));
+        }
+        case FILTER_MEDIAN:
+            // For Gaussian noise
+            return param_ == 3 ? 0.67f : 0.54f;
+        default:
+            return 1;
+        }
+    }
+
+    /// A threshold with the same margin over the filtered noise as
+    /// @p threshold had over the raw noise.
+    int scaleThreshold(int threshold) const
+    {
+        int scaled = static_cast<int>(ceilf(threshold * noiseGain()));
+        return scaled < 1 ? 1 : scaled;
+    }
+
+private:
+    unsigned long toUs(float samples) const { return static_cast<unsigned long>(samples * meanIntervalUs_ + 0.5f); }
+
+    BrightnessFilterKind kind_ = FILTER_NONE;
+    int param_ = 0;
+    bool primed_ = false;
+    int32_t state_ = 0;
+    int32_t markState_ = 0;
+    // Always MaxMedianWindow long once primed: 3-tap uses the newest three.
+    CircularWindow<int, MaxMedianWindow> window_;
+    unsigned long lastUs_ = 0;
+    int lastInput_ = 0;
+    float meanIntervalUs_ = 0;
+};
+
+inline BrightnessFilter &brightnessFilter()
+{
+    static BrightnessFilter filter;
+    return filter;
+}
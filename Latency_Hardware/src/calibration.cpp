@@ -0,0 +1,181 @@
+// Copyright 2021, Collabora, Ltd.
+// SPDX-License-Identifier: BSL-1.0
+// Original Author: Ryan Pavlik
+//
+// Calibration results kept in flash.
+
+// Must come before Arduino because of abs
+#include <Eigen/Core>
+#include "calibration.h"
+
+#include <Arduino.h>
+#include "defines.h"
+#include "gyroProc.h"
+#include "health.h"
+#include "hostCommands.h"
+
+#ifdef HAVE_FLASH_STORAGE
+#include "recordStore.h"
+
+// "LTC" and a version: bump the version when Calibration changes.
+static constexpr uint32_t CALIBRATION_MAGIC = 0x4c544301;
+static FlashStorage flashStorage;
+static RecordStore<Calibration, FlashStorage> calibrationStore{flashStorage, CALIBRATION_MAGIC};
+#endif
+
+static Calibration currentCalibration;
+static GyroProc *attachedGyroProc = nullptr;
+// The gyro zero rate comes in from the middle of an app's sampling: the
+// flash write waits for calibrationTick().
+static bool savePending = false;
+
+Calibration &calibration()
+{
+    return currentCalibration;
+}
+
+bool calibrationLoad()
+{
+#ifdef HAVE_FLASH_STORAGE
+    return flashStorage.available() && calibrationStore.load(&currentCalibration);
+#else
+    return false;
+#endif
+}
+
+bool calibrationSave()
+{
+#ifdef HAVE_FLASH_STORAGE
+    if (!flashStorage.available())
+    {
+        Serial.println("Calibration not saved: program too big to leave room for it in flash");
+        return false;
+    }
+    if (!calibrationStore.save(currentCalibration))
+    {
+        Serial.println("Calibration not saved: flash write failed");
+        return false;
+    }
+    return true;
+#else
+    Serial.println("Calibration not saved: no flash storage on this board");
+    return false;
+#endif
+}
+
+void calibrationClear()
+{
+#ifdef HAVE_FLASH_STORAGE
+    // Erase rather than save the defaults, so the next boot finds nothing
+    // and waits for the host as an uncalibrated rig does.
+    if (flashStorage.available())
+    {
+        calibrationStore.clear();
+    }
+#endif
+}
+
+void calibrationPrint()
+{
+    Calibration const &cal = currentCalibration;
+    Serial.print("Calibration: thresholds on ");
+    Serial.print(cal.onThreshold);
+    Serial.print(", off ");
+    Serial.print(cal.offThreshold);
+    Serial.print(" at ");
+    Serial.print(cal.adcResolutionBits);
+    Serial.print(" bits; sensor latency on ");
+    Serial.print(cal.sensorOnLatencyUs);
+    Serial.print("us, off ");
+    Serial.print(cal.sensorOffLatencyUs);
+    Serial.print("us (");
+    Serial.print(cal.subtractSensorLatency ? "subtracted" : "not subtracted");
+    Serial.print("); gyro zero rate ");
+    if (cal.hasGyroBias)
+    {
+        Serial.print(cal.gyroBias[0], 5);
+        Serial.print(",");
+        Serial.print(cal.gyroBias[1], 5);
+        Serial.print(",");
+        Serial.println(cal.gyroBias[2], 5);
+    }
+    else
+    {
+        Serial.println("not set");
+    }
+}
+
+static void saveGyroBias(Vector3f const &zeroRate)
+{
+    Vector3f::Map(currentCalibration.gyroBias) = zeroRate;
+    currentCalibration.hasGyroBias = 1;
+    savePending = true;
+}
+
+void calibrationTick()
+{
+    if (!savePending)
+    {
+        return;
+    }
+    savePending = false;
+    calibrationSave();
+    // The CPU stops while flash is written: not the app falling behind.
+    healthPlannedStall();
+    calibrationPrint();
+}
+
+void calibrationAttachGyro(GyroProc &gyroProc)
+{
+    attachedGyroProc = &gyroProc;
+    if (currentCalibration.hasGyroBias)
+    {
+        gyroProc.setZeroRate(Vector3f::Map(currentCalibration.gyroBias));
+    }
+}
+
+bool calibrationCommand(Board & /* board */, const char *command)
+{
+    const char *args = matchCommand(command, "cal");
+    if (!args)
+    {
+        return false;
+    }
+    if (matchCommand(args, "gyro"))
+    {
+        if (!attachedGyroProc)
+        {
+            Serial.println("No gyro in this app");
+            return true;
+        }
+        Serial.println("Estimating gyro zero rate: hold still");
+        attachedGyroProc->estimateZeroRate(saveGyroBias);
+        return true;
+    }
+    if (const char *onOff = matchCommand(args, "subtract"))
+    {
+        if (strcmp(onOff, "on") != 0 && strcmp(onOff, "off") != 0)
+        {
+            Serial.println("Usage: cal subtract on|off");
+            return true;
+        }
+        currentCalibration.subtractSensorLatency = strcmp(onOff, "on") == 0;
+        calibrationSave();
+    }
+    else if (matchCommand(args, "clear"))
+    {
+        currentCalibration = Calibration{};
+        calibrationClear();
+    }
+    calibrationPrint();
+    return true;
+}
+
+uint32_t sensorLatencyCorrection(bool brighter)
+{
+    if (!currentCalibration.subtractSensorLatency)
+    {
+        return 0;
+    }
+    return brighter ? currentCalibration.sensorOnLatencyUs : currentCalibration.sensorOffLatencyUs;
+}
@@ -0,0 +1,74 @@
+// Copyright 2021, Collabora, Ltd.
+// SPDX-License-Identifier: BSL-1.0
+// Original Author: Ryan Pavlik
+//
+// Calibration results, kept in flash so a known rig can start measuring
+// right after boot instead of calibrating again.
+//
+// Host commands (handled in main.cpp via calibrationCommand()):
+//
+//     cal                     print the calibration
+//     cal gyro                estimate and save the gyro zero rate (hold still)
+//     cal subtract on|off     subtract the photosensor's own latency from results
+//     cal clear               forget everything, recalibrate on next use
+
+#pragma once
+
+#include <stdint.h>
+
+#include "numericPolicy.h"
+
+class Board;
+
+struct Calibration
+{
+    // Photodiode thresholds from the calibrate app, -1 if not set.
+    int32_t onThreshold = -1;
+    int32_t offThreshold = -1;
+    // analogReadResolution() the thresholds were measured at
+    uint32_t adcResolutionBits = 0;
+    // Photosensor latency (LED switched to threshold crossed) from the
+    // calibrate app, in microseconds, 0 if not measured.
+    uint32_t sensorOnLatencyUs = 0;
+    uint32_t sensorOffLatencyUs = 0;
+    // Gyro zero rate in rad/s, if hasGyroBias.
+    float gyroBias[3] = {0.f, 0.f, 0.f};
+    uint8_t hasGyroBias = 0;
+    // Whether to take the sensor latency off reported latencies.
+    uint8_t subtractSensorLatency = 0;
+    uint8_t reserved[2] = {0, 0};
+
+    bool hasThresholds(uint32_t resolutionBits) const
+    {
+        return onThreshold >= 0 && offThreshold >= 0 && adcResolutionBits == resolutionBits;
+    }
+    bool hasSensorLatency() const { return sensorOnLatencyUs != 0 || sensorOffLatencyUs != 0; }
+};
+
+/// The current calibration: change it, then calibrationSave().
+Calibration &calibration();
+
+/// Load from flash: call once at startup. False if nothing was saved.
+bool calibrationLoad();
+
+bool calibrationSave();
+
+/// Forget the saved calibration, so calibrationLoad() fails at next boot.
+void calibrationClear();
+
+void calibrationPrint();
+
+/// Save what "cal gyro" found, once it's done: run from the scheduler,
+/// outside the apps' sampling.
+void calibrationTick();
+
+/// Apply the saved gyro zero rate (if any) to @p gyroProc, and use it for
+/// "cal gyro".
+void calibrationAttachGyro(GyroProc &gyroProc);
+
+bool calibrationCommand(Board &board, const char *command);
+
+/// Microseconds to take off a reported latency that ended with the
+/// photosensor seeing the screen get brighter (or darker): 0 unless
+/// subtraction is turned on.
+uint32_t sensorLatencyCorrection(bool brighter);
@@ -0,0 +1,32 @@
+// Copyright 2021, Collabora, Ltd.
+// SPDX-License-Identifier: BSL-1.0
+// Original Author: Ryan Pavlik
+//
+// CRC-16/CCITT-FALSE: polynomial 0x1021, initial value 0xffff.
+// Python's binascii.crc_hqx(data, 0xffff) computes the same thing.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+constexpr uint16_t CRC16_INIT = 0xffff;
+
+static inline uint16_t crc16Update(uint16_t crc, uint8_t byte)
+{
+    crc ^= static_cast<uint16_t>(byte) << 8;
+    for (int bit = 0; bit < 8; ++bit)
+    {
+        crc = (crc & 0x8000) ? static_cast<uint16_t>((crc << 1) ^ 0x1021) : static_cast<uint16_t>(crc << 1);
+    }
+    return crc;
+}
+
+static inline uint16_t crc16Update(uint16_t crc, const uint8_t *data, size_t len)
+{
+    for (size_t i = 0; i < len; ++i)
+    {
+        crc = crc16Update(crc, data[i]);
+    }
+    return crc;
+}
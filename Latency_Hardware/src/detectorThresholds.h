@@ -0,0 +1,55 @@
+// Copyright 2021, Collabora, Ltd.
+// SPDX-License-Identifier: BSL-1.0
+// Original Author: Ryan Pavlik
+//
+// The thresholds the onset and turnaround detectors decide with.
+//
+// On the board they're constants, so they fold into the code just as they
+// did as consts in each app. Host builds can change them, so tools/sweep
+// can try a grid of them against captures with known latencies.
+//
+// No Eigen in here, so it can be included after Arduino.h.
+
+#pragma once
+
+#include "numericPolicy.h"
+
+// The defaults.
+// Gyro, in rad/s: moving above it for onset, settled below it for turnaround.
+constexpr float GYRO_THRESHOLD = 0.5f;
+// Turnaround only counts a settle after going faster than this, in rad/s.
+constexpr float GYRO_MIN_SPEED_THRESHOLD = 0.75f;
+// Turnaround brightness step, in readBrightness() counts.
+constexpr int BRIGHTNESS_THRESHOLD = 5;
+// Onset brightness change from before the motion, in readBrightness() counts.
+constexpr int BRIGHTNESS_CHANGE_THRESHOLD = 3;
+// How long onset must stay still before looking for motion.
+constexpr unsigned long CALM_USEC = 500000L;
+
+struct DetectorThresholds
+{
+    float gyro = GYRO_THRESHOLD;
+    float gyroMinSpeed = GYRO_MIN_SPEED_THRESHOLD;
+    int brightness = BRIGHTNESS_THRESHOLD;
+    int brightnessChange = BRIGHTNESS_CHANGE_THRESHOLD;
+    unsigned long calmUs = CALM_USEC;
+
+    // In the gyro pipeline's representation.
+    constexpr GyroScalar gyroScaled() const { return GyroPolicy::fromRadPerSec(gyro); }
+    constexpr GyroScalar gyroMinSpeedScaled() const { return GyroPolicy::fromRadPerSec(gyroMinSpeed); }
+};
+
+#ifdef TARGET_NATIVE
+inline DetectorThresholds &detectorThresholds()
+{
+    static DetectorThresholds thresholds;
+    return thresholds;
+}
+#else
+static constexpr DetectorThresholds defaultDetectorThresholds{};
+
+static constexpr DetectorThresholds const &detectorThresholds()
+{
+    return defaultDetectorThresholds;
+}
+#endif
@@ -0,0 +1,150 @@
+// Copyright 2021, Collabora, Ltd.
+// SPDX-License-Identifier: BSL-1.0
+// Original Author: Ryan Pavlik
+//
+// In-RAM trace of state machine transitions and detection events, for
+// debugging missed or wrong detections without print statements disturbing
+// the timing. Recording an event is a handful of cycles: no formatting, no
+// output. The most recent EVENT_TRACE_CAPACITY events are kept, and sent as
+// a binary "trace" block on request ("trace" command, handled in main.cpp).
+//
+// Events are stamped with the DWT cycle counter, extended to 64 bits: call
+// eventTraceTick() at least once per counter wrap (a minute at 64MHz), which
+// main.cpp does every loop.
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#include "binaryBlock.h"
+#include "cycleCounter.h"
+
+#ifndef EVENT_TRACE_CAPACITY
+#define EVENT_TRACE_CAPACITY 512
+#endif
+
+enum TraceEventKind : uint8_t
+{
+    /// Entered state @p state. value: the state left
+    TRACE_STATE,
+    /// Motion started. value: largest gyro axis in mrad/s (or accel change
+    /// in mm/s^2 for translation)
+    TRACE_MOTION,
+    /// Motion stopped. value: tracking axis
+    TRACE_SETTLED,
+    /// Brightness changed. value: brightness
+    TRACE_BRIGHTNESS,
+    /// Brightness reversed direction. value: brightness
+    TRACE_BRIGHTNESS_REVERSAL,
+    /// Reported a latency. value: microseconds
+    TRACE_LATENCY,
+    /// Gave up waiting. value: microseconds waited
+    TRACE_TIMEOUT,
+    /// Something inconsistent. value: app-specific (signed) detail
+    TRACE_ERROR,
+    /// Statistics or calibration reset. value: app-specific
+    TRACE_RESET,
+    TRACE_KIND_COUNT
+};
+
+// For the "kinds" field of the block, in order
+constexpr const char *TRACE_KIND_NAMES =
+    "state;motion;settled;brightness;brightness_reversal;latency;timeout;error;reset";
+
+struct TraceEvent
+{
+    uint64_t cycles;
+    uint8_t kind;
+    /// The app's state when recorded
+    uint8_t state;
+    uint16_t reserved;
+    int32_t value;
+};
+
+constexpr const char *TRACE_EVENT_FORMAT = "cycles:u64;kind:u8;state:u8;reserved:u16;value:i32";
+
+class EventTrace
+{
+public:
+    /// Names of the app's states, semicolon-separated in enum order, for
+    /// the host to label events with.
+    void setStateNames(const char *names) { stateNames_ = names; }
+
+    /// Keep the 64-bit timestamp going: call more often than the 32-bit
+    /// counter wraps.
+    void tick() { now(); }
+
+    void record(TraceEventKind kind, uint8_t state, int32_t value = 0)
+    {
+        TraceEvent &event = events_[next_];
+        event.cycles = now();
+        event.kind = kind;
+        event.state = state;
+        event.reserved = 0;
+        event.value = value;
+        next_ = (next_ + 1) % EVENT_TRACE_CAPACITY;
+        total_++;
+    }
+
+    void clear()
+    {
+        next_ = 0;
+        total_ = 0;
+    }
+
+    /// Send the events we have, oldest first, as a "trace" block.
+    void send()
+    {
+        uint32_t count = total_ < EVENT_TRACE_CAPACITY ? total_ : EVENT_TRACE_CAPACITY;
+        size_t first = total_ < EVENT_TRACE_CAPACITY ? 0 : next_;
+        // So the host can line the cycle counts up with micros()
+        uint64_t nowCycles = now();
+        unsigned long nowUs = micros();
+
+        BlockWriter block;
+        block.begin("trace", count * sizeof(TraceEvent));
+        block.field("count", count);
+        block.field("total", total_);
+        block.field("cpu_hz", cycleCounterHz());
+        block.field("now_cycles_hi", static_cast<uint32_t>(nowCycles >> 32));
+        block.field("now_cycles_lo", static_cast<uint32_t>(nowCycles));
+        block.field("now_us", nowUs);
+        block.field("kinds", TRACE_KIND_NAMES);
+        block.field("states", stateNames_);
+        block.field("format", TRACE_EVENT_FORMAT);
+        block.beginPayload();
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            block.write(&events_[(first + i) % EVENT_TRACE_CAPACITY], sizeof(TraceEvent));
+        }
+        block.end();
+    }
+
+private:
+    uint64_t now()
+    {
+        uint32_t low = cycleCount();
+        if (low < lastLow_)
+        {
+            high_++;
+        }
+        lastLow_ = low;
+        return (static_cast<uint64_t>(high_) << 32) | low;
+    }
+
+    TraceEvent events_[EVENT_TRACE_CAPACITY];
+    size_t next_ = 0;
+    uint32_t total_ = 0;
+    uint32_t high_ = 0;
+    uint32_t lastLow_ = 0;
+    const char *stateNames_ = "";
+};
+
+static_assert(sizeof(TraceEvent) == 16, "TraceEvent is sent as-is: keep it packed");
+
+inline EventTrace &eventTrace()
+{
+    static EventTrace trace;
+    return trace;
+}
@@ -7,36 +7,71 @@
 #include "gyroProc.h"
 #include "pairwiseReduce.h"
 #include "printVec.h"
+#include "profiler.h"
 
-std::pair<bool, Eigen::Vector3f> GyroProc::process(sensors_event_t &gyroData)
+template <typename Policy>
+std::pair<bool, typename BasicGyroProc<Policy>::Vector> BasicGyroProc<Policy>::process(sensors_event_t &gyroData)
 {
-    Eigen::Vector3f data = Eigen::Vector3f::Map(gyroData.gyro.v);
-    if (samplesAcquired < DiscardSamples)
+    ProfileScope profile{PROFILE_GYRO_PROCESS};
+    // The driver only gives us rad/s: convert once, here.
+    Vector data = fromRadPerSec(Eigen::Vector3f::Map(gyroData.gyro.v));
+    if (ready_)
     {
-        printVec(data);
+        return {true, subtract(data, zeroRate)};
+    }
+    if (discarded_ < DiscardSamples)
+    {
+        printVec(toRadPerSec(data));
         Serial.println();
-        samplesAcquired++;
-        return {false, Eigen::Vector3f::Zero()};
+        discarded_++;
+        return {false, Vector::Zero()};
     }
-    if (samplesAcquired < (DiscardSamples + InitSamples))
+    if (!samples_.full())
     {
-        printVec(data);
+        printVec(toRadPerSec(data));
         Serial.println();
-        samples[samplesAcquired - DiscardSamples] = data;
-        samplesAcquired++;
-        return {false, Eigen::Vector3f::Zero()};
+        samples_.push_back(data.template cast<typename Policy::Accum>());
+        return {false, Vector::Zero()};
     }
-    if (samplesAcquired == DiscardSamples + InitSamples)
+    if (shouldEstimateZeroRate_)
     {
-        if (shouldEstimateZeroRate_)
+        // pairwiseSum sums: we want the mean.
+        AccumVector sum = pairwiseSum(samples_.begin(), samples_.end());
+        zeroRate = (sum / typename Policy::Accum(InitSamples)).template cast<Scalar>();
+        if (zeroRateCallback_)
         {
-            zeroRate = pairwiseReduce(samples.begin(), samples.end());
+            zeroRateCallback_(getZeroRate());
         }
-
-        samplesAcquired++;
-        Serial.print("Zero rate: ");
-        printVec(zeroRate);
-        Serial.println();
     }
-    return {true, data - zeroRate};
-}
\ No newline at end of file
+
+    ready_ = true;
+    Serial.print("Zero rate: ");
+    printVec(getZeroRate());
+    Serial.println();
+    return {true, subtract(data, zeroRate)};
+}
+
+template <typename Policy>
+void BasicGyroProc<Policy>::setZeroRate(Eigen::Vector3f const &rate)
+{
+    zeroRate = fromRadPerSec(rate);
+    shouldEstimateZeroRate_ = false;
+    ready_ = true;
+}
+
+template <typename Policy>
+void BasicGyroProc<Policy>::estimateZeroRate(ZeroRateCallback callback)
+{
+    shouldEstimateZeroRate_ = true;
+    zeroRateCallback_ = callback;
+    discarded_ = 0;
+    samples_.clear();
+    ready_ = false;
+}
+
+// All of them, so any can be benchmarked whichever the firmware uses.
+template class BasicGyroProc<FloatPolicy>;
+template class BasicGyroProc<CountsPolicy>;
+template class BasicGyroProc<Q15Policy>;
+
+GyroProc gyroProc{};
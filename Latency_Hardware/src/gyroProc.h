@@ -2,30 +2,72 @@
 // SPDX-License-Identifier: BSL-1.0
 // Original Author: Ryan Pavlik
 //
-// Header for calibrating zero-rate out of a gyro.
-// Defaults to do-nothing because the LSM6DS1 in the Nano 33 BLE is
-// very good from the factory and my calibration only made it worse.
+// Header for calibrating zero-rate out of a gyro: BasicGyroProc, templated
+// on the numeric representation (numericPolicy.h). The zero rate is the saved
+// calibration's, or estimated from the samples after startup when asked ("cal
+// gyro"), and otherwise zero: the LSM9DS1 in the Nano 33 BLE is very good from
+// the factory.
 
 #pragma once
 // Must come before Arduino because of abs
 #include <Eigen/Core>
 #include <Adafruit_Sensor.h>
 #include <utility>
-#include <array>
+
+#include "numericPolicy.h"
+#include "staticContainers.h"
 
 using Eigen::Vector3f;
 
-class GyroProc
+/// Takes the zero rate off gyro readings, in the representation chosen by
+/// @p Policy (see numericPolicy.h). The zero rate goes in and out in rad/s,
+/// so a saved calibration works whatever the policy.
+template <typename Policy>
+class BasicGyroProc
 {
 public:
-    std::pair<bool, Vector3f> process(sensors_event_t &gyroData);
+    using Scalar = typename Policy::Scalar;
+    using Vector = Eigen::Matrix<Scalar, 3, 1>;
+    using AccumVector = Eigen::Matrix<typename Policy::Accum, 3, 1>;
+    using ZeroRateCallback = void (*)(Vector3f const &zeroRate);
+
+    std::pair<bool, Vector> process(sensors_event_t &gyroData);
+
+    /// Use a known zero rate (from a previous estimate), and skip the
+    /// discarded and initial samples.
+    void setZeroRate(Vector3f const &rate);
+
+    /// Start over, and estimate the zero rate from the initial samples,
+    /// calling @p callback (if not null) with it when done.
+    void estimateZeroRate(ZeroRateCallback callback);
+
+    Vector3f getZeroRate() const { return toRadPerSec(zeroRate); }
+
+    static Vector fromRadPerSec(Vector3f const &v)
+    {
+        return {Policy::fromRadPerSec(v[0]), Policy::fromRadPerSec(v[1]), Policy::fromRadPerSec(v[2])};
+    }
+    static Vector3f toRadPerSec(Vector const &v)
+    {
+        return {Policy::toRadPerSec(v[0]), Policy::toRadPerSec(v[1]), Policy::toRadPerSec(v[2])};
+    }
+    /// @p a - @p b, per Policy::subtract().
+    static Vector subtract(Vector const &a, Vector const &b)
+    {
+        return {Policy::subtract(a[0], b[0]), Policy::subtract(a[1], b[1]), Policy::subtract(a[2], b[2])};
+    }
 
     static constexpr size_t InitSamples = 16;
     static constexpr size_t DiscardSamples = 16;
 
 private:
     bool shouldEstimateZeroRate_ = false;
-    Vector3f zeroRate{Vector3f::Zero()};
-    std::array<Vector3f, InitSamples> samples;
-    size_t samplesAcquired = 0;
-};
\ No newline at end of file
+    ZeroRateCallback zeroRateCallback_ = nullptr;
+    Vector zeroRate{Vector::Zero()};
+    size_t discarded_ = 0;
+    StaticVector<AccumVector, InitSamples> samples_;
+    bool ready_ = false;
+};
+
+/// The one gyro processor, shared by all the apps in an image.
+extern GyroProc gyroProc;
@@ -0,0 +1,95 @@
+// Copyright 2021, Collabora, Ltd.
+// SPDX-License-Identifier: BSL-1.0
+// Original Author: Ryan Pavlik
+//
+// Non-blocking reader for newline-terminated commands sent by the host.
+
+#pragma once
+
+#include <Arduino.h>
+#include <string.h>
+
+class HostCommandReader
+{
+public:
+    static constexpr size_t MaxLength = 63;
+
+    /**
+     * @brief Consume whatever serial input is available without blocking.
+     *
+     * @return A null-terminated command line (without the line ending) once
+     * one is complete, otherwise nullptr. The returned buffer is only valid
+     * until the next call.
+     */
+    const char *poll()
+    {
+        while (Serial.available() > 0)
+        {
+            int c = Serial.read();
+            if (c < 0)
+            {
+                break;
+            }
+            if (c == '\r' || c == '\n')
+            {
+                if (length_ == 0)
+                {
+                    // blank line or second half of CRLF
+                    continue;
+                }
+                buffer_[length_] = '\0';
+                length_ = 0;
+                return buffer_;
+            }
+            if (length_ == 0)
+            {
+                startedUs_ = micros();
+            }
+            if (length_ < MaxLength)
+            {
+                buffer_[length_++] = static_cast<char>(c);
+            }
+        }
+        return nullptr;
+    }
+
+    /**
+     * @brief micros() when the command poll() last returned started to
+     * arrive: when this first read its first byte.
+     *
+     * The line may take several polls to finish, and the command waits for
+     * whatever else the loop is doing, so this is closer to when the host
+     * sent it than micros() is once it's handled.
+     */
+    unsigned long receivedUs() const { return startedUs_; }
+
+private:
+    char buffer_[MaxLength + 1];
+    size_t length_ = 0;
+    unsigned long startedUs_ = 0;
+};
+
+/**
+ * @brief Checks if @p command starts with the word @p name.
+ *
+ * @return Pointer to the arguments following the word (possibly empty),
+ * or nullptr if it does not match.
+ */
+static inline const char *matchCommand(const char *command, const char *name)
+{
+    size_t len = strlen(name);
+    if (strncmp(command, name, len) != 0)
+    {
+        return nullptr;
+    }
+    if (command[len] != '\0' && command[len] != ' ')
+    {
+        return nullptr;
+    }
+    const char *args = command + len;
+    while (*args == ' ')
+    {
+        args++;
+    }
+    return args;
+}
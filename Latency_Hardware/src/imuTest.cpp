@@ -17,12 +17,11 @@ using Eigen::Vector3f;
 #include "defines.h"
 
 #include "gyroProc.h"
+#include "health.h"
 
 
-bool ledState = false;
-unsigned long lastTimestamp = 0;
-
-GyroProc gyroProc;
+static bool ledState = false;
+static unsigned long lastTimestamp = 0;
 
 void imutestLoop(Board& board)
 {
@@ -30,15 +29,16 @@ void imutestLoop(Board& board)
     sensors_event_t g;
     if (!board.getGyroData(&timestamp, &g))
     {
-        Serial.println("Read failed!?");
-        delay(10);
+        // Reported in the status line.
+        healthCountFailedRead();
         return;
     }
     bool dataGood = false;
-    Vector3f processed;
-    std::tie(dataGood, processed) = gyroProc.process(g);
+    GyroProc::Vector raw;
+    std::tie(dataGood, raw) = gyroProc.process(g);
     if (dataGood)
     {
+        Vector3f processed = GyroProc::toRadPerSec(raw);
 
         Serial.print("Gyro X: ");
         Serial.print(processed.x());
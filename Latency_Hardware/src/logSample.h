@@ -0,0 +1,34 @@
+// Copyright 2021, Collabora, Ltd.
+// SPDX-License-Identifier: BSL-1.0
+// Original Author: Ryan Pavlik
+//
+// One sample of the log, and its binary form for sending in blocks.
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+struct LogSample
+{
+    uint32_t us;
+    float gyro[3];
+    uint16_t brightness;
+    // m/s^2, zero unless the app reads the accelerometer
+    float accel[3];
+};
+
+// Layout of a packed sample, for the "format" field of blocks:
+// semicolons, since the block header is comma-separated.
+constexpr const char *LOG_SAMPLE_FORMAT =
+    "us:u32;drx:f32;dry:f32;drz:f32;brightness:u16;ax:f32;ay:f32;az:f32";
+constexpr size_t LOG_SAMPLE_BYTES = 4 + 3 * 4 + 2 + 3 * 4;
+
+/// Pack with no padding. Both our MCUs and hosts are little-endian.
+static inline void packLogSample(LogSample const &sample, uint8_t *out)
+{
+    memcpy(out, &sample.us, 4);
+    memcpy(out + 4, sample.gyro, 3 * 4);
+    memcpy(out + 16, &sample.brightness, 2);
+    memcpy(out + 18, sample.accel, 3 * 4);
+}
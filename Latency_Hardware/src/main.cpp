@@ -7,19 +7,249 @@
 // Must come before Arduino because of abs
 #include <Eigen/Core>
 #include "apps.h"
+#include "appRegistry.h"
 using Eigen::Vector3f;
 
 #include <Arduino.h>
 #include "defines.h"
+#include "brightnessFilter.h"
+#include "calibration.h"
+#include "cycleCounter.h"
+#include "eventTrace.h"
+#include "health.h"
+#include "hostCommands.h"
+#include "memoryUsage.h"
+#include "profiler.h"
+#include "scheduler.h"
 
 Board board{};
+HostCommandReader hostCommands{};
+
+#ifndef HAVE_LOOP_METHOD
+// Every app that might be built in, in order of preference for the one to
+// start with: the APP_x defines pick which are.
+using Apps = EnabledApps<LogApp, OnsetApp, OnsetTranslationApp, TurnaroundApp, TriggerApp, BurstApp, CalibrateApp,
+                         ImuTestApp>;
+static_assert(Apps::count > 0, "not sure what app you want");
+
+static Scheduler<8> scheduler;
+static int appTaskId = -1;
+static size_t currentApp = 0;
+
+alignas(8) static uint8_t appMemoryStorage[Apps::memoryBytes > 0 ? Apps::memoryBytes : 1];
+
+void *appMemoryBytes()
+{
+    return appMemoryStorage;
+}
+
+/// An app's loop function, as a task: calls it directly.
+template <typename App>
+struct AppTask
+{
+    static void run()
+    {
+        unsigned long loopStart = micros();
+        {
+            ProfileScope profile{PROFILE_LOOP};
+            App::loop(board);
+        }
+        healthLoopDone(micros() - loopStart);
+    }
+};
+
+static void startApp(size_t index)
+{
+    currentApp = index;
+#ifdef HAVE_BRIGHTNESS_BURST
+    // Let a burst the last app started finish with the ADC first.
+    while (!board.brightnessBurstDone())
+    {
+    }
+#endif
+    // Start each app with the ADC as it is after a reset.
+    resetAnalog();
+    Apps::setup(index);
+    scheduler.replace(appTaskId, Apps::wrapped<AppTask>(index));
+    // Don't count the switch as the IMU falling behind.
+    healthPlannedStall();
+}
+
+static void printApps()
+{
+    Serial.print("App: ");
+    Serial.print(Apps::name(currentApp));
+    Serial.print(" (available:");
+    for (size_t i = 0; i < Apps::count; ++i)
+    {
+        Serial.print(" ");
+        Serial.print(Apps::name(i));
+    }
+    Serial.println(")");
+}
+#endif
+
+/// @p receivedUs: when the command started to arrive.
+static void handleHostCommand(const char *command, unsigned long receivedUs)
+{
+    // ping <token>: answer "PONG,<token>,<received us>,<sent us>" for the
+    // host to map our micros() onto its own clock
+    if (const char *args = matchCommand(command, "ping"))
+    {
+        Serial.print("PONG,");
+        Serial.print(args);
+        Serial.print(",");
+        Serial.print(receivedUs);
+        Serial.print(",");
+        Serial.println(micros());
+        return;
+    }
+    bool handled = calibrationCommand(board, command);
+    if (handled)
+    {
+        return;
+    }
+    // status on|off: periodic health status lines
+    if (const char *args = matchCommand(command, "status"))
+    {
+        healthCounters().enabled = strcmp(args, "off") != 0;
+        return;
+    }
+    // mem: peak stack and heap use
+    if (matchCommand(command, "mem"))
+    {
+        memoryPrint();
+        return;
+    }
+    // trace [clear]: send the event trace
+    if (const char *args = matchCommand(command, "trace"))
+    {
+        if (strcmp(args, "clear") == 0)
+        {
+            eventTrace().clear();
+        }
+        else
+        {
+            eventTrace().send();
+        }
+        return;
+    }
+    // filter [off|iir <alpha, q15>|median <3|5>]: brightness filter for the
+    // onset and turnaround tests
+    if (const char *args = matchCommand(command, "filter"))
+    {
+        if (*args)
+        {
+            bool ok = false;
+            if (strcmp(args, "off") == 0)
+            {
+                ok = brightnessFilter().configure(FILTER_NONE, 0);
+            }
+            else if (const char *param = matchCommand(args, "iir"))
+            {
+                ok = brightnessFilter().configure(FILTER_IIR, *param ? atoi(param) : 8192);
+            }
+            else if (const char *param = matchCommand(args, "median"))
+            {
+                ok = brightnessFilter().configure(FILTER_MEDIAN, *param ? atoi(param) : 3);
+            }
+            if (!ok)
+            {
+                Serial.println("Usage: filter off|iir <alpha, 1-32767>|median <3|5>");
+                return;
+            }
+        }
+        static const char *const kindNames[] = {"off", "iir", "median"};
+        Serial.print("Brightness filter ");
+        Serial.print(kindNames[brightnessFilter().kind()]);
+        if (brightnessFilter().enabled())
+        {
+            Serial.print(" ");
+            Serial.print(brightnessFilter().param());
+            Serial.print(", ramp delay ");
+            Serial.print(brightnessFilter().groupDelaySamples(), 2);
+            Serial.print(" samples, noise x");
+            Serial.print(brightnessFilter().noiseGain(), 2);
+        }
+        Serial.println();
+        return;
+    }
+#ifdef WANT_PROFILER
+    if (const char *args = matchCommand(command, "profile"))
+    {
+        if (strcmp(args, "reset") == 0)
+        {
+            profilerReset();
+            Serial.println("PROFILE,reset");
+        }
+        else
+        {
+            profilerDump();
+        }
+        return;
+    }
+#endif
+#ifndef HAVE_LOOP_METHOD
+    // app [name]: show the apps built in, or switch to one
+    if (const char *args = matchCommand(command, "app"))
+    {
+        if (*args)
+        {
+            int index = Apps::find(args);
+            if (index < 0)
+            {
+                Serial.print("Unknown app: ");
+                Serial.println(args);
+            }
+            else
+            {
+                startApp(index);
+            }
+        }
+        printApps();
+        return;
+    }
+    handled = Apps::command(currentApp, board, command);
+#endif
+    if (!handled)
+    {
+        Serial.print("Unknown command: ");
+        Serial.println(command);
+    }
+}
+
+static void pollHostCommands()
+{
+    if (const char *command = hostCommands.poll())
+    {
+        handleHostCommand(command, hostCommands.receivedUs());
+    }
+}
+
+#ifndef HAVE_LOOP_METHOD
+static void scheduleTasks()
+{
+    unsigned long now = micros();
+    scheduler.every(0, pollHostCommands, now);
+    // Filled in by startApp
+    appTaskId = scheduler.every(0, [] {}, now);
+    // Keeps its own interval, which it also needs to compute rates.
+    scheduler.every(0, [] { healthReport(millis()); }, now);
+    scheduler.every(0, [] { eventTrace().tick(); }, now);
+    scheduler.every(0, calibrationTick, now);
+}
+#endif
 
 void setup()
 {
+    memoryBegin();
     Serial.begin(115200);
 
-    // Pause until serial console on devices with native USB.
-    while (!Serial)
+    // Pause until serial console on devices with native USB, unless we
+    // have a saved calibration: then a known rig starts measuring right
+    // away, and the host can catch up.
+    bool calibrated = calibrationLoad();
+    while (!calibrated && !Serial)
         delay(10);
 
     // Try to initialise and warn if we couldn't detect the chip
@@ -29,16 +259,21 @@ void setup()
         while (1)
             ;
     }
+    cycleCounterBegin();
+    if (calibrated)
+    {
+        calibrationPrint();
+    }
 
 #ifndef HAVE_LOOP_METHOD
-#if defined(APP_ONSET)
-    onsetSetup();
-#elif defined(APP_TURNAROUND)
-    turnaroundSetup();
-#elif defined(APP_LOG)
-    logSetup();
-#endif
+    scheduleTasks();
+    startApp(0);
+    if (Apps::count > 1)
+    {
+        printApps();
+    }
 #endif
+    heapSteadyState();
 }
 
 void loop()
@@ -46,18 +281,6 @@ void loop()
 #ifdef HAVE_LOOP_METHOD
     board.loop();
 #else
-#if defined(APP_ONSET)
-    onsetLoop(board);
-#elif defined(APP_CALIBRATE)
-    calibrateLoop(board);
-#elif defined(APP_IMUTEST)
-    imutestLoop(board);
-#elif defined(APP_TURNAROUND)
-    turnaroundLoop(board);
-#elif defined(APP_LOG)
-    logLoop(board);
-#else
-#error "not sure what app you want"
+    scheduler.run(micros());
 #endif
-#endif
-}
\ No newline at end of file
+}
@@ -0,0 +1,234 @@
+// Copyright 2021, Collabora, Ltd.
+// SPDX-License-Identifier: BSL-1.0
+// Original Author: Ryan Pavlik
+//
+// Stack painting and heap counting: see memoryUsage.h.
+
+#include "memoryUsage.h"
+
+#include <malloc.h>
+#include <stdlib.h>
+
+#ifdef TARGET_ARDUINO_NANO33BLE
+#include <mbed.h>
+#include <rtx_os.h>
+#endif
+
+static uint32_t *stackBottom = nullptr;
+static uint32_t *stackTop = nullptr;
+
+void memoryBegin()
+{
+#ifdef TARGET_ARDUINO_NANO33BLE
+    // mbed runs setup() and loop() on RTX's main thread.
+    auto *thread = static_cast<osRtxThread_t *>(osThreadGetId());
+    stackBottom = static_cast<uint32_t *>(thread->stack_mem);
+    stackTop = stackBottom + thread->stack_size / sizeof(uint32_t);
+    // Leave RTX's overflow check word at the bottom, and what's in use
+    // (with room for this call) at the top.
+    uint32_t here = 0;
+    uintptr_t margin = reinterpret_cast<uintptr_t>(&here) - 256;
+    stackPaint(stackBottom + 1, reinterpret_cast<uint32_t *>(margin & ~uintptr_t(3)));
+#endif
+}
+
+size_t stackUsedBytes()
+{
+    return stackBottom ? stackPaintUsed(stackBottom + 1, stackTop) : 0;
+}
+
+size_t stackSizeBytes()
+{
+    return static_cast<size_t>(stackTop - stackBottom) * sizeof(uint32_t);
+}
+
+#ifdef WANT_HEAP_STATS
+/// Count an allocation, or say no to it.
+static bool heapAllow()
+{
+    HeapCounters &h = heapCounters();
+    if (!h.steady)
+    {
+        return true;
+    }
+    h.steadyAllocs++;
+#ifdef NO_STEADY_HEAP
+    return false;
+#else
+    return true;
+#endif
+}
+
+static void heapAdd(size_t bytes)
+{
+    HeapCounters &h = heapCounters();
+    size_t now = h.bytes += bytes;
+    size_t peak = h.peakBytes.load();
+    while (now > peak && !h.peakBytes.compare_exchange_weak(peak, now))
+    {
+    }
+}
+
+static void heapRemove(size_t bytes)
+{
+    heapCounters().bytes -= bytes;
+}
+
+#ifdef _NEWLIB_VERSION
+// Some builds of newlib's allocator call each other (calloc through malloc,
+// realloc through malloc and free) through the wrapped names: only count the
+// outermost call. The firmware allocates from one thread.
+static int heapDepth = 0;
+
+struct HeapCall
+{
+    HeapCall() : outer(heapDepth++ == 0) {}
+    ~HeapCall() { heapDepth--; }
+    bool const outer;
+};
+#else
+// glibc's calloc and realloc don't go through our wrappers.
+struct HeapCall
+{
+    bool const outer = true;
+};
+#endif
+
+/// Count what @p allocate (malloc, calloc or memalign) gives.
+template <typename F>
+static void *heapAllocate(F &&allocate)
+{
+    HeapCall call;
+    if (!call.outer)
+    {
+        return allocate();
+    }
+    if (!heapAllow())
+    {
+        return nullptr;
+    }
+    void *ptr = allocate();
+    if (ptr)
+    {
+        heapCounters().allocs++;
+        heapAdd(malloc_usable_size(ptr));
+    }
+    return ptr;
+}
+
+template <typename F>
+static void heapRelease(void *ptr, F &&release)
+{
+    HeapCall call;
+    if (call.outer && ptr)
+    {
+        heapCounters().frees++;
+        heapRemove(malloc_usable_size(ptr));
+    }
+    release();
+}
+
+/// realloc is malloc for a null pointer, free for no size, and otherwise
+/// might move it, even when shrinking.
+template <typename Malloc, typename Free, typename Realloc>
+static void *heapReallocate(void *ptr, size_t size, Malloc &&allocate, Free &&release, Realloc &&reallocate)
+{
+    if (!ptr)
+    {
+        return heapAllocate(allocate);
+    }
+    if (size == 0)
+    {
+        heapRelease(ptr, release);
+        return nullptr;
+    }
+    HeapCall call;
+    if (!call.outer)
+    {
+        return reallocate();
+    }
+    if (!heapAllow())
+    {
+        return nullptr;
+    }
+    size_t before = malloc_usable_size(ptr);
+    void *moved = reallocate();
+    if (moved)
+    {
+        heapRemove(before);
+        heapAdd(malloc_usable_size(moved));
+    }
+    return moved;
+}
+
+#ifdef _NEWLIB_VERSION
+// newlib's malloc() and friends call these, as does anything that passes
+// its own reentrancy struct (stdio, and mbed's own wrappers), so wrapping
+// them sees every allocation: see heap_stats_newlib in platformio.ini.
+extern "C" {
+void *__real__malloc_r(struct _reent *r, size_t size);
+void __real__free_r(struct _reent *r, void *ptr);
+void *__real__calloc_r(struct _reent *r, size_t count, size_t size);
+void *__real__realloc_r(struct _reent *r, void *ptr, size_t size);
+void *__real__memalign_r(struct _reent *r, size_t align, size_t size);
+
+void *__wrap__malloc_r(struct _reent *r, size_t size)
+{
+    return heapAllocate([=] { return __real__malloc_r(r, size); });
+}
+
+void __wrap__free_r(struct _reent *r, void *ptr)
+{
+    heapRelease(ptr, [=] { __real__free_r(r, ptr); });
+}
+
+void *__wrap__calloc_r(struct _reent *r, size_t count, size_t size)
+{
+    return heapAllocate([=] { return __real__calloc_r(r, count, size); });
+}
+
+void *__wrap__realloc_r(struct _reent *r, void *ptr, size_t size)
+{
+    return heapReallocate(
+        ptr, size, [=] { return __real__malloc_r(r, size); }, [=] { __real__free_r(r, ptr); },
+        [=] { return __real__realloc_r(r, ptr, size); });
+}
+
+void *__wrap__memalign_r(struct _reent *r, size_t align, size_t size)
+{
+    return heapAllocate([=] { return __real__memalign_r(r, align, size); });
+}
+}
+#else
+// glibc has no reentrant entry points to wrap: see heap_stats in
+// platformio.ini.
+extern "C" {
+void *__real_malloc(size_t size);
+void __real_free(void *ptr);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size)
+{
+    return heapAllocate([=] { return __real_malloc(size); });
+}
+
+void __wrap_free(void *ptr)
+{
+    heapRelease(ptr, [=] { __real_free(ptr); });
+}
+
+void *__wrap_calloc(size_t count, size_t size)
+{
+    return heapAllocate([=] { return __real_calloc(count, size); });
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    return heapReallocate(
+        ptr, size, [=] { return __real_malloc(size); }, [=] { __real_free(ptr); },
+        [=] { return __real_realloc(ptr, size); });
+}
+}
+#endif
+#endif // WANT_HEAP_STATS
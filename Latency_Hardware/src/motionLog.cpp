@@ -17,8 +17,70 @@ using Eigen::Vector3f;
 #include "gyroProc.h"
 
 #include "motionShared.h"
+#include "hostCommands.h"
+#include "streamCodec.h"
+#include "profiler.h"
 
-GyroProc gyroProc{};
+#ifdef WANT_ACCEL
+static constexpr bool log_accel = true;
+#else
+static constexpr bool log_accel = false;
+#endif
+
+// Send "codec dv1" (or "codec dv2") to switch to the compact binary stream,
+// "codec csv" to switch back. We reply with the codec actually used: dv2 if
+// we log the accelerometer, dv1 otherwise.
+static bool compressed = false;
+static StreamEncoder encoder{log_accel};
+
+static void printCsvHeader()
+{
+    if (log_accel)
+    {
+        Serial.println("us,drx,dry,drz,brightness,ax,ay,az");
+    }
+    else
+    {
+        Serial.println("us,drx,dry,drz,brightness");
+    }
+}
+
+//*****************************************************
+bool logCommand(Board & /* board */, const char *command)
+//*****************************************************
+{
+    if (const char *args = matchCommand(command, "codec"))
+    {
+        if (strcmp(args, STREAM_CODEC_NAME) == 0 || strcmp(args, STREAM_CODEC_ACCEL_NAME) == 0)
+        {
+            compressed = true;
+            encoder = StreamEncoder{log_accel};
+            Serial.print("CODEC,");
+            Serial.print(encoder.name());
+            Serial.print(",gyro_counts_per_rad_s=");
+            Serial.print(STREAM_CODEC_GYRO_COUNTS_PER_RAD_S, 4);
+            if (log_accel)
+            {
+                Serial.print(",accel_counts_per_m_s2=");
+                Serial.print(STREAM_CODEC_ACCEL_COUNTS_PER_M_S2, 4);
+            }
+            Serial.print(",packet_samples=");
+            Serial.println(StreamEncoder::MaxPacketSamples);
+        }
+        else
+        {
+            if (compressed && encoder.flush())
+            {
+                Serial.write(encoder.data(), encoder.size());
+            }
+            compressed = false;
+            Serial.println();
+            printCsvHeader();
+        }
+        return true;
+    }
+    return false;
+}
 
 
 //*****************************************************
@@ -32,15 +94,17 @@ void logSetup()
     Serial.println(" and lighter in the other.");
     Serial.println(" Hold the device still for 2 seconds.");
 
-    delay(100);
-    Serial.println("us,drx,dry,drz,brightness");
+    printCsvHeader();
 }
 
 //*****************************************************
 void logLoop(Board &board)
 //*****************************************************
 {
-    startupImu(board, gyroProc);
+    if (!startupImu(board, gyroProc))
+    {
+        return;
+    }
 
     // Read the values from the inertial sensors and photosensor.
     // Record the time we read these values.
@@ -51,15 +115,54 @@ void logLoop(Board &board)
     }
     int brightness = readBrightness();
     unsigned long now = data.timestamp;
-    Serial.print(now);
+    Vector3f gyro = GyroProc::toRadPerSec(data.gyro);
+    LogSample sample{static_cast<uint32_t>(now),
+                     {gyro.x(), gyro.y(), gyro.z()},
+                     static_cast<uint16_t>(brightness),
+                     {data.accel.x(), data.accel.y(), data.accel.z()}};
+    if (compressed)
+    {
+        bool packetReady;
+        {
+            ProfileScope profile{PROFILE_FORMAT};
+            packetReady = encoder.add(sample);
+        }
+        if (packetReady)
+        {
+            ProfileScope profile{PROFILE_SERIAL_WRITE};
+            Serial.write(encoder.data(), encoder.size());
+        }
+        return;
+    }
+    // Serial.print formats as it writes, so this counts as both.
+    ProfileScope profile{PROFILE_SERIAL_WRITE};
+    logPrintCsv(sample, log_accel);
+}
+
+//*****************************************************
+void logPrintCsv(LogSample const &sample, bool withAccel)
+//*****************************************************
+{
+    Serial.print(static_cast<unsigned long>(sample.us));
+    Serial.print(",");
+    Serial.print(sample.gyro[0]);
+    Serial.print(",");
+    Serial.print(sample.gyro[1]);
     Serial.print(",");
-    Serial.print(data.gyro.x());
+    Serial.print(sample.gyro[2]);
+    Serial.print(",");
+    if (!withAccel)
+    {
+        Serial.println(sample.brightness);
+        return;
+    }
+    Serial.print(sample.brightness);
     Serial.print(",");
-    Serial.print(data.gyro.y());
+    Serial.print(sample.accel[0]);
     Serial.print(",");
-    Serial.print(data.gyro.z());
+    Serial.print(sample.accel[1]);
     Serial.print(",");
-    Serial.println(brightness);
+    Serial.println(sample.accel[2]);
 }
 
 #endif
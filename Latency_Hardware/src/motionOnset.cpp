@@ -19,71 +19,248 @@ using Eigen::Vector3f;
 #include "gyroProc.h"
 
 #include "motionShared.h"
-
-GyroProc gyroProc{};
+#include "hostCommands.h"
+#include "refreshDetect.h"
+#include "eventTrace.h"
+#include "calibration.h"
+#include "staticContainers.h"
 
 #define VERBOSE
 #undef abs
-// Thresholds
-const int BRIGHTNESS_CHANGE_THRESHOLD = 3;
+// Thresholds: the rest are in detectorThresholds.h
 const unsigned long TIMEOUT_USEC = 1000000L;
 
+// Translation onset: trigger on linear acceleration instead of rotation.
+// While calm, we track the acceleration (mostly gravity) to compare against;
+// it moves 1/2^N of the way to each new sample (about 1kHz).
+// Chosen by which of the two apps started.
+static bool translation = false;
+const int CALM_ACCEL_AVERAGE_SHIFT = 6;
+static Vector3f calm_accel{Vector3f::Zero()};
+static bool calm_accel_valid = false;
+
+/// Whether this reading counts as the onset of motion.
+static bool motionDetected(ReadResults const &data)
+{
+    if (!data.dataGood)
+    {
+        return false;
+    }
+    if (translation)
+    {
+        return calm_accel_valid && translating(data.accel, calm_accel);
+    }
+    return moving(data.gyro);
+}
+
+/// How big the motion is, for the event trace: mrad/s, or mm/s^2 for
+/// translation.
+static int32_t motionMagnitude(ReadResults const &data)
+{
+    if (translation)
+    {
+        return static_cast<int32_t>((data.accel - calm_accel).norm() * 1000);
+    }
+    return static_cast<int32_t>(GyroProc::toRadPerSec(data.gyro).cwiseAbs().maxCoeff() * 1000);
+}
+
 // Keeps track of delays so we can do an average.
 const int NUM_DELAYS = 16;
-unsigned long delays[NUM_DELAYS];
-static int count = 0, odd_count = 0, even_count = 0;
+static StaticVector<unsigned long, NUM_DELAYS> delays;
+static int odd_count = 0, even_count = 0;
 
-void onsetSetup()
+// We run a finite-state machine that cycles through cases of waiting for
+// a period of non motion, detecting a sudden motion, waiting until there
+// is a change in brightness, and reporting the time passed in microseconds
+// between the motion and the brightness change.
+static enum { S_CALM,
+              S_MOTION,
+              S_BRIGHTNESS,
+              S_REFRESH } state = S_CALM;
+// In S_CALM: whether we've been still since calm_start.
+static bool calm = false;
+static unsigned long calm_start = 0;
+
+#ifdef HAVE_BRIGHTNESS_BURST
+// After each detection, we grab a short burst of brightness to find the
+// display refresh phase, so we can tell how much of the latency was
+// waiting for the display to refresh under the sensor.
+const uint32_t REFRESH_BURST_RATE_HZ = 20000;
+const size_t REFRESH_BURST_SAMPLES = 5000;
+// In the shared app memory: only needed while working out the split.
+struct OnsetMemory
+{
+    int16_t refreshBurst[REFRESH_BURST_SAMPLES];
+    float refreshScratch[1024];
+};
+static_assert(sizeof(OnsetMemory) <= ONSET_MEMORY_BYTES, "update ONSET_MEMORY_BYTES");
+static bool trackRefresh = true;
+// The burst in progress runs while the onset loop keeps going: these are
+// for working out the split once it's done.
+static float refreshBurstRate = 0;
+static unsigned long refreshBurstStart = 0;
+static unsigned long refreshMotionTime = 0;
+static unsigned long refreshLatency = 0;
+
+static void startRefreshBurst(Board &board, unsigned long motionTime, unsigned long latency)
+{
+    OnsetMemory &memory = appMemory<OnsetMemory>();
+    refreshBurstRate = board.startBrightnessBurst(memory.refreshBurst, REFRESH_BURST_SAMPLES, REFRESH_BURST_RATE_HZ,
+                                                  &refreshBurstStart);
+    refreshMotionTime = motionTime;
+    refreshLatency = latency;
+}
+
+static void reportRefreshSplit()
 {
+    OnsetMemory &memory = appMemory<OnsetMemory>();
+    healthCountAdcSamples(REFRESH_BURST_SAMPLES);
+    auto refresh = estimateRefresh(memory.refreshBurst, REFRESH_BURST_SAMPLES, refreshBurstRate, memory.refreshScratch,
+                                   1024, burstSampleToBrightness);
+    if (!refresh.valid)
+    {
+        Serial.println(" refresh: not detected");
+        return;
+    }
+    float scanoutWait = timeUntilRefresh(refresh, refreshBurstStart, refreshMotionTime);
+    Serial.print(" refresh: ");
+    Serial.print(refresh.frequencyHz, 3);
+    Serial.print("Hz, phase ");
+    Serial.print(refresh.phaseUs, 1);
+    Serial.print("us after ");
+    Serial.print(refreshBurstStart);
+    Serial.print(", scanout wait ");
+    Serial.print(scanoutWait, 1);
+    Serial.print("us, pipeline ");
+    Serial.print(refreshLatency - scanoutWait, 1);
+    Serial.println("us");
+}
+#endif // HAVE_BRIGHTNESS_BURST
+
+//*****************************************************
+bool onsetCommand(Board & /* board */, const char *command)
+//*****************************************************
+{
+#ifdef HAVE_BRIGHTNESS_BURST
+    // refresh on|off
+    if (const char *args = matchCommand(command, "refresh"))
+    {
+        trackRefresh = strcmp(args, "off") != 0;
+        Serial.print("Refresh tracking ");
+        Serial.println(trackRefresh ? "on" : "off");
+        return true;
+    }
+#else
+    (void)command;
+#endif
+    return false;
+}
+
+static void startOnset(bool translate)
+{
+    translation = translate;
+    calm_accel_valid = false;
+    state = S_CALM;
+    calm = false;
+    delays.clear();
+    odd_count = 0;
+    even_count = 0;
 
     Serial.println("latency_hardware_firmware onset test v04.00.00");
     Serial.println(" Mount the photosensor rigidly on the screen.");
-    Serial.println(" Move the inertial sensor along with the tracking hardware.");
+    if (translation)
+    {
+        Serial.println(" Translate (slide) the inertial sensor along with the tracking hardware.");
+    }
+    else
+    {
+        Serial.println(" Move the inertial sensor along with the tracking hardware.");
+    }
     Serial.println(" Make the app change the brightness in front of the photosensor.");
     Serial.println(" Latencies reported in microseconds, 1-second timeout");
+    if (calibration().subtractSensorLatency)
+    {
+        Serial.println(" Photosensor latency subtracted (\"cal subtract off\" to stop)");
+    }
+    brightnessFilter().reset();
+    if (brightnessFilter().enabled())
+    {
+        Serial.println(" Brightness filtered, its delay subtracted (\"filter off\" to stop)");
+    }
+    eventTrace().setStateNames("calm;motion;brightness;refresh");
+}
+
+void onsetSetup()
+{
+    startOnset(false);
+}
+
+void onsetTranslationSetup()
+{
+    startOnset(true);
 }
 
 //*****************************************************
 void onsetLoop(Board &board)
 //*****************************************************
 {
-    // We run a finite-state machine that cycles through cases of waiting for
-    // a period of non motion, detecting a sudden motion, waiting until there
-    // is a change in brightness, and reporting the time passed in microseconds
-    // between the motion and the brightness change.
-    static enum { S_CALM,
-                  S_MOTION,
-                  S_BRIGHTNESS } state = S_CALM;
+    auto enter = [](decltype(state) next) {
+        eventTrace().record(TRACE_STATE, next, state);
+        state = next;
+    };
     static unsigned long start;
     static int initial_brightness;
-    if (state == S_CALM)
+    if (state == S_CALM && !startupImu(board, gyroProc))
     {
-        startupImu(board, gyroProc);
+        return;
     }
 
     switch (state)
     {
     case S_CALM:
     {
-        // Wait for a period of at least 100 cycles where there is no motion above
-        // the motion threshold.
-        static int calm_cycles = 0;
+        // Wait for a period of at least half a second where there is no
+        // motion above the motion threshold.
+        if (brightnessFilter().enabled())
+        {
+            // Keep the filter settled, and its sample rate current, for when
+            // the motion comes.
+            readFilteredBrightness();
+        }
         auto data = doRead(board, gyroProc);
+        if (!data.dataGood)
+        {
+            break;
+        }
+        if (translation)
+        {
+            if (!calm_accel_valid || moving(data.gyro) || translating(data.accel, calm_accel))
+            {
+                // Restart the baseline from here.
+                calm_accel = data.accel;
+                calm_accel_valid = true;
+                calm = false;
+            }
+            else
+            {
+                calm_accel += (data.accel - calm_accel) / float(1 << CALM_ACCEL_AVERAGE_SHIFT);
+            }
+        }
         if (moving(data.gyro))
         {
-            calm_cycles = 0;
+            calm = false;
         }
-        else if (++calm_cycles >= 50)
+        else if (!calm)
         {
-            Serial.println("waiting for calm...");
-            state = S_MOTION;
-            calm_cycles = 0;
+            // Make sure we stay calm for a while
+            calm = true;
+            calm_start = data.timestamp;
         }
-        else
+        else if (data.timestamp - calm_start >= detectorThresholds().calmUs)
         {
-            Serial.println("Make sure we stay calm for a while");
-            // Make sure we stay calm for a while (half a second)
-            delay(10);
+            Serial.println("waiting for calm...");
+            enter(S_MOTION);
+            calm = false;
         }
     }
     break;
@@ -94,11 +271,15 @@ void onsetLoop(Board &board)
         // so we can compare it to when the brightness changes.  Also record the brightness
         // so we can look for changes.
         auto data = doRead(board, gyroProc);
-        if (moving(data.gyro))
+        // With a filter, it has to be running (and settled) before the motion.
+        int brightness = brightnessFilter().enabled() ? readFilteredBrightness() : 0;
+        if (motionDetected(data))
         {
             start = data.timestamp;
-            initial_brightness = readBrightness();
-            state = S_BRIGHTNESS;
+            initial_brightness = brightnessFilter().enabled() ? brightness : readBrightness();
+            brightnessFilter().markLevel();
+            eventTrace().record(TRACE_MOTION, state, motionMagnitude(data));
+            enter(S_BRIGHTNESS);
 #ifdef VERBOSE
             Serial.println("Moving");
 #endif
@@ -111,17 +292,33 @@ void onsetLoop(Board &board)
         // Wait for a change in brightness compared to the original value that
         // passes a threshold.  When we get it, report the latency.
         // If it takes too long, then we time out and start over.
-        int brightness = readBrightness();
+        int brightness = readFilteredBrightness();
         unsigned long now = micros();
 
         // Keep track of how many values we got for odd and even rows and
         // compute a running average when we get a full complement for each.
         // Ignore timeout values
-        if (abs(brightness - initial_brightness) > BRIGHTNESS_CHANGE_THRESHOLD)
+        // The filter lowers the noise, so we can lower the threshold with it.
+        int threshold = brightnessFilter().scaleThreshold(detectorThresholds().brightnessChange);
+        if (abs(brightness - initial_brightness) > threshold)
         {
+            unsigned long latency = now - start;
+            // The photosensor's own delay, if we know it and are asked to,
+            // and the filter's: how long its output took to get this far
+            // after a step as big as the raw input's.
+            unsigned long correction =
+                sensorLatencyCorrection(brightness > initial_brightness) + brightnessFilter().crossingDelayUs();
+            latency = latency > correction ? latency - correction : 0;
+            // Keep the rest of the bookkeeping consistent with what we print.
+            now = start + latency;
+            eventTrace().record(TRACE_BRIGHTNESS, state, brightness);
+            eventTrace().record(TRACE_LATENCY, state, latency);
             // Print the result for this time
-            Serial.println(now - start);
-            if (count % 2 == 0)
+            {
+                ProfileScope profile{PROFILE_SERIAL_WRITE};
+                Serial.println(latency);
+            }
+            if (delays.size() % 2 == 0)
             {
                 odd_count++; // This is the first one (zero indexed) or off by twos
             }
@@ -129,19 +326,28 @@ void onsetLoop(Board &board)
             {
                 even_count++;
             }
-            delays[count++] = now - start;
-            state = S_CALM;
+            delays.push_back(now - start);
+            auto next = S_CALM;
+#ifdef HAVE_BRIGHTNESS_BURST
+            if (trackRefresh)
+            {
+                startRefreshBurst(board, start, latency);
+                next = S_REFRESH;
+            }
+#endif
+            enter(next);
         }
         else if (now - start > TIMEOUT_USEC)
         {
             Serial.println("Timeout: no brightness change after motion, restarting");
+            eventTrace().record(TRACE_TIMEOUT, state, now - start);
             // We don't increment the counter and we set the reading to 0 so we ignore it.
-            delays[count++] = 0;
-            state = S_CALM;
+            delays.push_back(0);
+            enter(S_CALM);
         }
 
         // See if it is time to print the average result.
-        if (count == NUM_DELAYS)
+        if (delays.full())
         {
             unsigned long even_average = 0;
             unsigned long odd_average = 0;
@@ -162,16 +368,31 @@ void onsetLoop(Board &board)
             Serial.print(" even counts (ignoring timeouts) = ");
             Serial.println(even_average);
 
-            count = 0;
+            delays.clear();
             odd_count = 0;
             even_count = 0;
         }
     }
     break;
 
+#ifdef HAVE_BRIGHTNESS_BURST
+    case S_REFRESH:
+    {
+        // Wait for the burst after a detection, then work out how much of
+        // the latency was the display's refresh.
+        if (board.brightnessBurstDone())
+        {
+            reportRefreshSplit();
+            enter(S_CALM);
+        }
+    }
+    break;
+#endif
+
     default:
         Serial.println("Error: Unrecognized state; restarting");
-        state = S_CALM;
+        eventTrace().record(TRACE_ERROR, state);
+        enter(S_CALM);
         break;
     }
 }
@@ -13,53 +13,129 @@
 #include <Eigen/Core>
 using Eigen::Vector3f;
 #include "gyroProc.h"
+#include "detectorThresholds.h"
+#include "calibration.h"
+#include "brightnessFilter.h"
 
 #include <Arduino.h>
+#include "health.h"
+#include "profiler.h"
 
-const float GYRO_THRESHOLD = 0.5f;
+// In m/s^2, away from the acceleration (mostly gravity) while calm.
+const float ACCEL_CHANGE_THRESHOLD = 0.3f;
 
 struct ReadResults
 {
     bool dataGood = false;
     unsigned long timestamp;
-    Vector3f gyro;
+    GyroProc::Vector gyro;
+    // Only read if WANT_ACCEL is defined
+    Vector3f accel{Vector3f::Zero()};
 };
 
-static inline ReadResults doRead(Board& board, GyroProc& gyroProc)
+inline ReadResults doRead(Board& board, GyroProc& gyroProc)
 {
+    ProfileScope profile{PROFILE_DO_READ};
     unsigned long timestamp;
     sensors_event_t g;
     if (!board.getGyroData(&timestamp, &g))
     {
-        Serial.println("Read failed!?");
-        delay(10);
+        // Reported in the status line, rather than printing in the middle
+        // of the data.
+        healthCountFailedRead();
         return {};
     }
+    healthCountImuSample(timestamp, IMU_SAMPLE_INTERVAL_US);
     bool dataGood = false;
-    Vector3f processed;
+    GyroProc::Vector processed;
     std::tie(dataGood, processed) = gyroProc.process(g);
     if (!dataGood)
     {
         return {};
     }
+#ifdef WANT_ACCEL
+    sensors_event_t a;
+    if (!board.getAccelData(&a))
+    {
+        healthCountFailedRead();
+        return {};
+    }
+    return {true, timestamp, processed, Vector3f::Map(a.acceleration.v)};
+#else
     return {true, timestamp, processed};
+#endif
 }
 
-static inline void startupImu(Board& board, GyroProc& gyroProc)
+/// Zero out the IMU, a sample per call so the rest of the loop keeps
+/// running: returns true once done. Not static: done once for all apps.
+inline bool startupImu(Board& board, GyroProc& gyroProc)
 {
+    static bool started = false;
     static bool initialized = false;
-    if (!initialized) {
+    if (initialized)
+    {
+        return true;
+    }
+    if (!started) {
         Serial.println("zeroing out IMU");
+        // Skips the initial samples if we have a saved zero rate.
+        calibrationAttachGyro(gyroProc);
+        started = true;
+    }
+    initialized = doRead(board, gyroProc).dataGood;
+    return initialized;
+}
+
+static inline bool moving(GyroProc::Vector const &gyro)
+{
+    return (gyro.array().abs() > detectorThresholds().gyroScaled()).any();
+}
+
+/// Whether we're translating, given a calm acceleration to compare with.
+static inline bool translating(Vector3f const &accel, Vector3f const &calmAccel)
+{
+    return (accel - calmAccel).squaredNorm() > ACCEL_CHANGE_THRESHOLD * ACCEL_CHANGE_THRESHOLD;
+}
+
+// The turnaround test's direction logic.
+
+/// Whether we're moving in the positive direction above the threshold (1),
+/// in the negative direction below it (-1), or within it of zero (0).
+static inline int gyro_direction(GyroScalar value)
+{
+    GyroScalar threshold = detectorThresholds().gyroScaled();
+    if (value >= threshold)
+    {
+        return 1;
+    }
+    if (value <= -threshold)
+    {
+        return -1;
+    }
+    return 0;
+}
 
+/// Whether brightness changed in the positive direction above the threshold
+/// (1), in the negative direction below it (-1), or not (0).
+static inline int brightness_direction(int value)
+{
+    // The filter lowers the noise, so we can lower the threshold with it.
+    int threshold = brightnessFilter().scaleThreshold(detectorThresholds().brightness);
+    if (value >= threshold)
+    {
+        return 1;
     }
-    while (!initialized)
+    if (value <= -threshold)
     {
-        auto results = doRead(board, gyroProc);
-        initialized = results.dataGood;
+        return -1;
     }
+    return 0;
 }
 
-static inline bool moving(Vector3f const &gyro)
+/// readBrightness(), through the brightness filter if one is set ("filter"
+/// command). Call every pass, so the filter keeps up.
+static inline int readFilteredBrightness()
 {
-    return (gyro.array().abs() > GYRO_THRESHOLD).any();
-}
\ No newline at end of file
+    int raw = readBrightness();
+    return brightnessFilter().update(raw, micros());
+}
@@ -0,0 +1,274 @@
+// Copyright 2021, Collabora, Ltd.
+// SPDX-License-Identifier: Apache-2.0
+// Original Author: Ryan Pavlik
+//
+// Code for "motion trigger" test app: like an oscilloscope, keep a rolling
+// window of samples from before a trigger, capture a window after it, and
+// send the whole event as one binary block. Full-rate data around each
+// event, without spending bandwidth on the time in between.
+
+#ifdef APP_TRIGGER
+// Must come before Arduino because of abs
+#include <Eigen/Core>
+#include "apps.h"
+
+using Eigen::Vector3f;
+
+#include <Arduino.h>
+#include "defines.h"
+#include "gyroProc.h"
+
+#include "motionShared.h"
+#include "binaryBlock.h"
+#include "hostCommands.h"
+#include "logSample.h"
+#include "profiler.h"
+
+#include <new>
+#include <stdlib.h>
+
+#undef abs
+
+// Brightness edge: how far from the running average counts as a change.
+const int DEFAULT_BRIGHTNESS_EDGE_THRESHOLD = 500;
+// Running average of brightness moves 1/2^N of the way each sample.
+const int BRIGHTNESS_AVERAGE_SHIFT = 4;
+
+// TRIGGER_CAPACITY is set in apps.h.
+using SampleWindow = CircularWindow<LogSample, TRIGGER_CAPACITY>;
+static_assert(sizeof(SampleWindow) <= TRIGGER_MEMORY_BYTES, "update TRIGGER_MEMORY_BYTES");
+// In the shared app memory: made afresh by setup, since another app may
+// have used the memory since we last ran.
+static SampleWindow *samples = nullptr;
+static bool restart = true;
+
+static enum { TRIGGER_GYRO,
+              TRIGGER_BRIGHTNESS,
+              TRIGGER_HOST } trigger_source = TRIGGER_GYRO;
+static constexpr const char *trigger_names[] = {"gyro", "bright", "host"};
+// In rad/s, and converted for comparing with the gyro: the onset
+// threshold until the trigger command sets its own.
+static float gyro_threshold = detectorThresholds().gyro;
+static GyroScalar gyro_threshold_scaled = detectorThresholds().gyroScaled();
+static int brightness_edge_threshold = DEFAULT_BRIGHTNESS_EDGE_THRESHOLD;
+static size_t pre_samples = TRIGGER_CAPACITY / 4;
+static size_t post_samples = TRIGGER_CAPACITY - TRIGGER_CAPACITY / 4;
+
+static bool host_fired = false;
+
+static void printSettings()
+{
+    Serial.print("Trigger on ");
+    Serial.print(trigger_names[trigger_source]);
+    if (trigger_source == TRIGGER_GYRO)
+    {
+        Serial.print(" above ");
+        Serial.print(gyro_threshold);
+    }
+    else if (trigger_source == TRIGGER_BRIGHTNESS)
+    {
+        Serial.print(" change above ");
+        Serial.print(brightness_edge_threshold);
+    }
+    Serial.print(", ");
+    Serial.print(pre_samples);
+    Serial.print(" samples before, ");
+    Serial.print(post_samples);
+    Serial.println(" after");
+}
+
+static void sendEvent(size_t trigger_index, unsigned long trigger_us)
+{
+    BlockWriter block;
+    size_t count = samples->size();
+    block.begin("trigger", count * LOG_SAMPLE_BYTES);
+    block.field("count", static_cast<unsigned long>(count));
+    block.field("trigger_index", static_cast<unsigned long>(trigger_index));
+    block.field("trigger_us", trigger_us);
+    block.field("source", trigger_names[trigger_source]);
+    block.field("format", LOG_SAMPLE_FORMAT);
+    block.beginPayload();
+    for (size_t i = 0; i < count; ++i)
+    {
+        uint8_t packed[LOG_SAMPLE_BYTES];
+        {
+            ProfileScope profile{PROFILE_FORMAT};
+            packLogSample((*samples)[i], packed);
+        }
+        ProfileScope profile{PROFILE_SERIAL_WRITE};
+        block.write(packed, LOG_SAMPLE_BYTES);
+    }
+    block.end();
+}
+
+//*****************************************************
+bool triggerCommand(Board & /* board */, const char *command)
+//*****************************************************
+{
+    // trigger gyro [threshold] | trigger bright [threshold] | trigger host
+    if (const char *args = matchCommand(command, "trigger"))
+    {
+        char *end = nullptr;
+        if (const char *threshold = matchCommand(args, "gyro"))
+        {
+            trigger_source = TRIGGER_GYRO;
+            float value = strtof(threshold, &end);
+            if (end != threshold)
+            {
+                gyro_threshold = value;
+                gyro_threshold_scaled = GyroPolicy::fromRadPerSec(value);
+            }
+        }
+        else if (const char *threshold = matchCommand(args, "bright"))
+        {
+            trigger_source = TRIGGER_BRIGHTNESS;
+            long value = strtol(threshold, &end, 10);
+            if (end != threshold)
+            {
+                brightness_edge_threshold = value;
+            }
+        }
+        else if (matchCommand(args, "host"))
+        {
+            trigger_source = TRIGGER_HOST;
+        }
+        printSettings();
+        return true;
+    }
+    // window <pre> <post>
+    if (const char *args = matchCommand(command, "window"))
+    {
+        char *end = nullptr;
+        size_t pre = strtoul(args, &end, 10);
+        size_t post = strtoul(end, nullptr, 10);
+        if (post == 0 || pre + post > TRIGGER_CAPACITY)
+        {
+            Serial.print("Window must have post > 0 and pre + post <= ");
+            Serial.println(TRIGGER_CAPACITY);
+            return true;
+        }
+        pre_samples = pre;
+        post_samples = post;
+        printSettings();
+        return true;
+    }
+    // fire: trigger now, regardless of source
+    if (matchCommand(command, "fire"))
+    {
+        host_fired = true;
+        return true;
+    }
+    return false;
+}
+
+//*****************************************************
+void triggerSetup()
+//*****************************************************
+{
+    Serial.println("latency_hardware_firmware motion trigger test v01.00.00");
+    Serial.println(" Mount the photosensor rigidly on the eyepiece or screen.");
+    Serial.println(" Rotate the inertial sensor along with the tracking hardware.");
+    Serial.println(" Hold the device still for 2 seconds.");
+    Serial.println(" Commands: trigger gyro|bright|host [threshold], window <pre> <post>, fire");
+    printSettings();
+    samples = new (&appMemory<SampleWindow>()) SampleWindow;
+    restart = true;
+}
+
+//*****************************************************
+void triggerLoop(Board &board)
+//*****************************************************
+{
+    // We run a finite-state machine that fills the pre-trigger window,
+    // waits (keeping the window rolling) for a trigger, fills the
+    // post-trigger window, then sends the event and starts over.
+    static enum { S_FILL,
+                  S_ARMED,
+                  S_CAPTURE } state = S_FILL;
+    static int brightness_average = -1;
+    static size_t trigger_index = 0;
+    static unsigned long trigger_us = 0;
+
+    if (restart)
+    {
+        state = S_FILL;
+        brightness_average = -1;
+        samples->clear();
+        host_fired = false;
+        restart = false;
+    }
+
+    if (!startupImu(board, gyroProc))
+    {
+        return;
+    }
+
+    auto data = doRead(board, gyroProc);
+    if (!data.dataGood)
+    {
+        return;
+    }
+    int brightness = readBrightness();
+    Vector3f gyro = GyroProc::toRadPerSec(data.gyro);
+    samples->push({static_cast<uint32_t>(data.timestamp),
+                {gyro.x(), gyro.y(), gyro.z()},
+                static_cast<uint16_t>(brightness),
+                {data.accel.x(), data.accel.y(), data.accel.z()}});
+
+    if (brightness_average < 0)
+    {
+        brightness_average = brightness;
+    }
+    bool brightness_edge = abs(brightness - brightness_average) > brightness_edge_threshold;
+    brightness_average += (brightness - brightness_average) >> BRIGHTNESS_AVERAGE_SHIFT;
+
+    switch (state)
+    {
+    case S_FILL:
+        if (samples->size() >= pre_samples)
+        {
+            host_fired = false;
+            state = S_ARMED;
+        }
+        break;
+
+    case S_ARMED:
+    {
+        bool fired = host_fired;
+        switch (trigger_source)
+        {
+        case TRIGGER_GYRO:
+            fired = fired || (data.gyro.array().abs() > gyro_threshold_scaled).any();
+            break;
+        case TRIGGER_BRIGHTNESS:
+            fired = fired || brightness_edge;
+            break;
+        case TRIGGER_HOST:
+            break;
+        }
+        if (fired)
+        {
+            // Drop anything older than the pre-trigger window.
+            size_t keep = min(samples->size(), pre_samples + 1);
+            samples->dropOldest(samples->size() - keep);
+            trigger_index = keep - 1;
+            trigger_us = data.timestamp;
+            state = S_CAPTURE;
+        }
+    }
+    break;
+
+    case S_CAPTURE:
+        if (samples->size() >= trigger_index + post_samples)
+        {
+            sendEvent(trigger_index, trigger_us);
+            healthPlannedStall();
+            samples->clear();
+            host_fired = false;
+            state = S_FILL;
+        }
+        break;
+    }
+}
+
+#endif // APP_TRIGGER
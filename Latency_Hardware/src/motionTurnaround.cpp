@@ -13,7 +13,6 @@
 #include <Eigen/Core>
 #include "apps.h"
 
-using Eigen::Array3f;
 using Eigen::Vector3f;
 
 #include <Arduino.h>
@@ -21,8 +20,9 @@ using Eigen::Vector3f;
 #include "gyroProc.h"
 
 #include "motionShared.h"
-
-GyroProc gyroProc{};
+#include "eventTrace.h"
+#include "calibration.h"
+#include "staticContainers.h"
 
 // Debugging definitions.
 #undef VERBOSE
@@ -31,11 +31,10 @@ GyroProc gyroProc{};
 
 #undef abs
 
-// Thresholds
-const int ACCEL_CHANGE_THRESHOLD = 500;
-const float GYRO_MIN_SPEED_THRESHOLD = 0.75f;
-const int BRIGHTNESS_THRESHOLD = 5;
-const float GYRO_CALIBRATION_THRESHOLD = 4.0f;
+// Thresholds: the ones that decide latencies are in detectorThresholds.h
+// Gyro thresholds in rad/s, then in the gyro pipeline's representation.
+constexpr float GYRO_CALIBRATION_THRESHOLD = 4.0f;
+constexpr GyroPolicy::Accum GYRO_CALIBRATION_THRESHOLD_SCALED = GyroPolicy::fromRadPerSec(GYRO_CALIBRATION_THRESHOLD);
 const int BRIGHTNESS_CALIBRATION_THRESHOLD = 7;
 const unsigned long TIMEOUT_USEC = 2000000L;
 const unsigned long CALIBRATE_USEC = 1000000L;
@@ -44,48 +43,14 @@ const unsigned long CALIBRATE_USEC = 1000000L;
 #ifdef PRINT_TRACE
 const int TRACE_SIZE = 250;
 const int TRACE_SKIP = 5;
-static int trace_count = 0;
 static int trace_skip_count = 0;
-float trace_gyroY[TRACE_SIZE];
-unsigned char trace_bright[TRACE_SIZE];
-#endif
-
-
-// Determine if we are moving in the positive direction above
-// threshold (1), in the negative direction below threshold (-1),
-// or within threshold of the origin (0);
-//*****************************************************
-inline int gyro_direction(int value)
-//*****************************************************
+struct TracePoint
 {
-  if (value >= GYRO_THRESHOLD) {
-    return 1;
-  }
-  
-  if (value <= -GYRO_THRESHOLD) {
-    return -1;
-  }
-  
-  return 0;
-}
-
-// Determine if we brightness changed in the positive direction above
-// threshold (1), in the negative direction below threshold (-1),
-// or not (0);
-//*****************************************************
-inline int brightness_direction(int value)
-//*****************************************************
-{
-  if (value >= BRIGHTNESS_THRESHOLD) {
-    return 1;
-  }
-  
-  if (value <= -BRIGHTNESS_THRESHOLD) {
-    return -1;
-  }
-  
-  return 0;
-}
+    float gyroY;
+    unsigned char bright;
+};
+static StaticVector<TracePoint, TRACE_SIZE> trace;
+#endif
 
 
 //*****************************************************
@@ -98,16 +63,27 @@ void turnaroundSetup()
     Serial.println(" Make the app vary brightness darker in one direction");
     Serial.println(" and lighter in the other.");
     Serial.println(" Latencies reported in microseconds, 2-second timeout");
+    if (calibration().subtractSensorLatency)
+    {
+        Serial.println(" Photosensor latency subtracted (\"cal subtract off\" to stop)");
+    }
+    brightnessFilter().reset();
+    if (brightnessFilter().enabled())
+    {
+        Serial.println(" Brightness filtered, its delay subtracted (\"filter off\" to stop)");
+    }
     Serial.println(" Hold the device still for 2 seconds.");
-
-    delay(100);
+    eventTrace().setStateNames("calm;calibrate;reverse_direction;reverse_brightness");
 }
 
 //*****************************************************
 void turnaroundLoop(Board &board)
 //*****************************************************
 {
-    startupImu(board, gyroProc);
+    if (!startupImu(board, gyroProc))
+    {
+        return;
+    }
 
     // Read the values from the inertial sensors and photosensor.
     // Record the time we read these values.
@@ -116,16 +92,16 @@ void turnaroundLoop(Board &board)
     {
         return;
     }
-    int brightness = readBrightness();
+    int brightness = readFilteredBrightness();
     unsigned long now = data.timestamp;
 
 #ifdef VERBOSE2
     /* Debugging info to help figure out what the thresholds should be */
-    Serial.print(data.gyro.x());
+    Serial.print(GyroPolicy::toRadPerSec(data.gyro.x()));
     Serial.print(" ");
-    Serial.print(data.gyro.y());
+    Serial.print(GyroPolicy::toRadPerSec(data.gyro.y()));
     Serial.print(" ");
-    Serial.print(data.gyro.z());
+    Serial.print(GyroPolicy::toRadPerSec(data.gyro.z()));
     Serial.print(", ");
     Serial.println(brightness);
     delay(1000);
@@ -158,6 +134,10 @@ void turnaroundLoop(Board &board)
                   S_CALIBRATE,
                   S_REVERSE_DIRECTION,
                   S_REVERSE_BRIGHTNESS } state = S_CALM;
+    auto enter = [](decltype(state) next) {
+        eventTrace().record(TRACE_STATE, next, state);
+        state = next;
+    };
     static unsigned long calm_start = now;
     static unsigned long calibration_start = now;
 
@@ -191,6 +171,8 @@ void turnaroundLoop(Board &board)
             Serial.println(latency_sum / latency_count);
         }
         Serial.println("Statistics reset.  Initiate periodic motion to calibrate.");
+        // value: how many latencies we had
+        eventTrace().record(TRACE_RESET, state, latency_count);
 
         latency_count = 0;
         latency_sum = 0;
@@ -200,7 +182,7 @@ void turnaroundLoop(Board &board)
         calm_start = now;
         calibration_start = now;
         tracking_axis_index = -1;
-        state = S_CALIBRATE;
+        enter(S_CALIBRATE);
     }
 
 #ifdef PRINT_TRACE
@@ -209,12 +191,8 @@ void turnaroundLoop(Board &board)
         if (++trace_skip_count >= TRACE_SKIP)
         {
             trace_skip_count = 0;
-            if (trace_count < TRACE_SIZE)
-            {
-                trace_gyroY[trace_count] = data.gyro.y();
-                trace_bright[trace_count] = brightness / 4;
-                trace_count++;
-            }
+            // Keeps the start of the motion if it fills up.
+            trace.push_back({GyroPolicy::toRadPerSec(data.gyro.y()), static_cast<unsigned char>(brightness / 4)});
         }
     }
 #endif
@@ -235,18 +213,20 @@ void turnaroundLoop(Board &board)
     case S_CALIBRATE:
     {
         // The first loop iteration, we reset our variables.
-        static Array3f minGyro, maxGyro;
+        // Ranges in Accum, as they can be twice as big as a reading.
+        using GyroArray = Eigen::Array<GyroPolicy::Accum, 3, 1>;
+        static GyroArray minGyro, maxGyro;
         static int minBright, maxBright;
         if (calibration_start == now)
         {
-            minGyro = data.gyro.array();
-            maxGyro = data.gyro.array();
+            minGyro = data.gyro.array().cast<GyroPolicy::Accum>();
+            maxGyro = minGyro;
             minBright = maxBright = brightness;
         }
 
         // Keep track of the maximum and minimum in all 3 axes;
-        minGyro = minGyro.min(data.gyro.array());
-        maxGyro = maxGyro.max(data.gyro.array());
+        minGyro = minGyro.min(data.gyro.array().cast<GyroPolicy::Accum>());
+        maxGyro = maxGyro.max(data.gyro.array().cast<GyroPolicy::Accum>());
         if (brightness < minBright)
         {
             minBright = brightness;
@@ -262,19 +242,21 @@ void turnaroundLoop(Board &board)
         // maximum axis and in the brightness.
         if ((tracking_axis_index < 0) && (now - calibration_start >= CALIBRATE_USEC))
         {
-            Array3f range = maxGyro - minGyro;
+            GyroArray range = maxGyro - minGyro;
             size_t index = 0;
-            float maxRange = range.maxCoeff(&index);
+            GyroPolicy::Accum maxRange = range.maxCoeff(&index);
             tracking_axis_index = index;
-            if ((maxRange < GYRO_CALIBRATION_THRESHOLD) ||
+            if ((maxRange < GYRO_CALIBRATION_THRESHOLD_SCALED) ||
                 (maxBright - minBright < BRIGHTNESS_CALIBRATION_THRESHOLD))
             {
                 Serial.println("Insufficient change for calibrating, retrying");
                 Serial.print("  Gyroscope difference = ");
-                Serial.print(maxRange);
+                Serial.print(maxRange * GyroPolicy::toRadPerSec(1));
                 Serial.println("");
                 Serial.print("  Brightness difference = ");
                 Serial.println(maxBright - minBright);
+                // value: -1 for a calibration retry
+                eventTrace().record(TRACE_RESET, state, -1);
                 tracking_axis_index = -1;
                 calibration_start = now;
             }
@@ -283,7 +265,7 @@ void turnaroundLoop(Board &board)
                 // We have not yet dropped below motion threshold
                 // for this iteration.
                 last_gyroscope_settling_time = 0;
-                state = S_REVERSE_DIRECTION;
+                enter(S_REVERSE_DIRECTION);
                 Serial.print("Calibration complete, measuring latencies on ");
                 constexpr const char * axis[] = {"X axis", "Y axis", "Z axis"};
                 Serial.print(axis[tracking_axis_index]);
@@ -308,12 +290,12 @@ void turnaroundLoop(Board &board)
         // Keep track of when the gyroscope value most recently
         // dropped below threshold (was above threshold in the previous
         // time step and dropped below threshold this time).
-        static float last_gyroscope_value = 0;
+        static GyroScalar last_gyroscope_value = 0;
         if (tracking_axis_index >= 0)
         {
-            float tracking_axis = data.gyro[tracking_axis_index];
-            if ((tracking_axis > GYRO_MIN_SPEED_THRESHOLD) ||
-                (tracking_axis < -GYRO_MIN_SPEED_THRESHOLD))
+            GyroScalar tracking_axis = data.gyro[tracking_axis_index];
+            GyroScalar minSpeed = detectorThresholds().gyroMinSpeedScaled();
+            if ((tracking_axis > minSpeed) || (tracking_axis < -minSpeed))
             {
                 have_moved_fast = true;
             }
@@ -322,6 +304,7 @@ void turnaroundLoop(Board &board)
                 (gyro_direction(last_gyroscope_value) != 0))
             {
                 last_gyroscope_settling_time = now;
+                eventTrace().record(TRACE_SETTLED, state, tracking_axis_index);
             }
             last_gyroscope_value = tracking_axis;
         }
@@ -344,7 +327,7 @@ void turnaroundLoop(Board &board)
             // in one direction followed by a change in the other starting now.
             last_brightness_reach_end_time = 0;
             last_brightness_change_direction = 0;
-            state = S_REVERSE_BRIGHTNESS;
+            enter(S_REVERSE_BRIGHTNESS);
         }
     }
     break;
@@ -357,12 +340,16 @@ void turnaroundLoop(Board &board)
     {
         static int last_unchanged_brightness_value = 0;
         static unsigned long last_brightness_change_time = 0;
+        // Whether the extreme we turned around at was a bright one.
+        static bool reversed_at_brighter = false;
         int this_change = brightness_direction(brightness - last_unchanged_brightness_value);
         if (this_change != 0)
         {
             if (this_change * last_brightness_change_direction == -1)
             {
                 last_brightness_reach_end_time = last_brightness_change_time;
+                reversed_at_brighter = last_brightness_change_direction > 0;
+                eventTrace().record(TRACE_BRIGHTNESS_REVERSAL, state, last_unchanged_brightness_value);
                 /*
             if (this_change == -1) {
               Serial.print(" +");
@@ -386,23 +373,33 @@ void turnaroundLoop(Board &board)
                 Serial.print("Error: Inverted settling times: gyro settling time ");
                 Serial.print(last_gyroscope_settling_time);
                 Serial.println(" (resetting)");
-                state = S_CALM;
+                // value: brightness end time minus gyro settling time
+                eventTrace().record(TRACE_ERROR, state,
+                                    static_cast<int32_t>(last_brightness_reach_end_time - last_gyroscope_settling_time));
+                enter(S_CALM);
+                // Not a latency: don't report or count it.
+                break;
             }
 
 #ifdef PRINT_TRACE
             Serial.println("GyroY/100*100,brightness/4*4");
-            for (int i = 0; i < trace_count; i++)
+            for (TracePoint const &point : trace)
             {
-                Serial.print(static_cast<int>(trace_gyroY[i]) * 10);
+                Serial.print(static_cast<int>(point.gyroY) * 10);
                 Serial.print(",");
-                Serial.println(static_cast<int>(trace_bright[i]) * 4);
+                Serial.println(static_cast<int>(point.bright) * 4);
                 Serial.println("");
             }
             Serial.println();
-            trace_count = 0;
+            trace.clear();
 #endif
             unsigned long value = last_brightness_reach_end_time - last_gyroscope_settling_time;
+            // The photosensor's own delay, if we know it and are asked to,
+            // and the filter's.
+            unsigned long correction = sensorLatencyCorrection(reversed_at_brighter) + brightnessFilter().turnDelayUs();
+            value = value > correction ? value - correction : 0;
             Serial.println(value);
+            eventTrace().record(TRACE_LATENCY, state, value);
 
             // Track statistics;
             latency_count++;
@@ -417,14 +414,15 @@ void turnaroundLoop(Board &board)
             latency_sum += value;
 
             last_gyroscope_settling_time = 0;
-            state = S_REVERSE_DIRECTION;
+            enter(S_REVERSE_DIRECTION);
         }
     }
     break;
 
     default:
         Serial.println("Error: Unrecognized state; restarting");
-        state = S_CALM;
+        eventTrace().record(TRACE_ERROR, state);
+        enter(S_CALM);
         break;
     }
 }
@@ -8,6 +8,12 @@
 #include "nano33ble.h"
 
 #include <Arduino.h>
+#include <nrf.h>
+
+// From the linker script: where the program ends in flash.
+extern "C" uint32_t __etext;
+extern "C" uint32_t __data_start__;
+extern "C" uint32_t __data_end__;
 
 bool Board::begin()
 {
@@ -43,4 +49,295 @@ bool Board::getGyroData(unsigned long *microseconds, sensors_event_t *gyroEvent)
     return false;
 #endif
 }
-#endif // defined(TARGET_ARDUINO_NANO33BLE)
\ No newline at end of file
+bool Board::getAccelData(sensors_event_t *accelEvent)
+{
+#if defined(WANT_IMU)
+    return accel.getEvent(accelEvent);
+#else
+    return false;
+#endif
+}
+
+// A0 on the Nano 33 BLE is P0.04, which is AIN2.
+static constexpr uint32_t PHOTODIODE_AIN = SAADC_CH_PSELP_PSELP_AnalogInput2;
+
+// EasyDMA can only do 15 bits worth of samples in a go, so we chain buffers.
+static constexpr size_t BURST_CHUNK_SAMPLES = 16384;
+
+// A PPI channel we borrow to restart the SAADC at the end of each chunk.
+static constexpr int BURST_PPI_CHANNEL = 19;
+
+// Conversion time on top of the acquisition time.
+static constexpr uint32_t SAADC_CONVERSION_NS = 2000;
+
+// Pick the longest acquisition time that fits in the sample period:
+// our photodiode has a large load resistor, so the longer the better.
+static uint32_t chooseAcquisitionTime(uint32_t periodNs)
+{
+    static constexpr struct
+    {
+        uint32_t ns;
+        uint32_t value;
+    } tacqs[] = {
+        {40000, SAADC_CH_CONFIG_TACQ_40us},
+        {20000, SAADC_CH_CONFIG_TACQ_20us},
+        {15000, SAADC_CH_CONFIG_TACQ_15us},
+        {10000, SAADC_CH_CONFIG_TACQ_10us},
+        {5000, SAADC_CH_CONFIG_TACQ_5us},
+    };
+    for (auto &tacq : tacqs)
+    {
+        if (tacq.ns + SAADC_CONVERSION_NS < periodNs)
+        {
+            return tacq.value;
+        }
+    }
+    return SAADC_CH_CONFIG_TACQ_3us;
+}
+
+// The SAADC internal timer runs at 16MHz, with CC from 80 to 2047.
+static uint32_t burstTimerCC(uint32_t requestedRateHz)
+{
+    uint32_t cc = requestedRateHz == 0 ? 2047 : 16000000UL / requestedRateHz;
+    return constrain(cc, 80u, 2047u);
+}
+
+float Board::burstSampleRate(uint32_t requestedRateHz)
+{
+    return 16000000.0f / burstTimerCC(requestedRateHz);
+}
+
+static void waitForEvent(volatile uint32_t &event)
+{
+    while (event == 0)
+    {
+    }
+    event = 0;
+}
+
+float Board::captureBrightnessBurst(int16_t *buffer, size_t count, uint32_t requestedRateHz, unsigned long *startMicros)
+{
+    float rate = startBrightnessBurst(buffer, count, requestedRateHz, startMicros);
+    while (!brightnessBurstDone())
+    {
+    }
+    return rate;
+}
+
+// A burst in progress, and the SAADC setup to restore after it.
+static struct BurstState
+{
+    bool running = false;
+    int16_t *buffer = nullptr;
+    size_t count = 0;
+    size_t numChunks = 0;
+    size_t chunkSamples = 0;
+    size_t queued = 0;
+    size_t started = 0;
+    uint32_t savedInten = 0;
+    uint32_t savedEnable = 0;
+    uint32_t savedResolution = 0;
+    uint32_t savedOversample = 0;
+    uint32_t savedSampleRate = 0;
+    uint32_t savedPtr = 0;
+    uint32_t savedMaxCnt = 0;
+    uint32_t savedPselp[SAADC_CH_NUM] = {};
+    uint32_t savedConfig = 0;
+    uint32_t savedPseln = 0;
+} burst;
+
+static void queueBurstChunk()
+{
+    size_t n = min(burst.chunkSamples, burst.count - burst.queued);
+    NRF_SAADC->RESULT.PTR = reinterpret_cast<uint32_t>(burst.buffer + burst.queued);
+    NRF_SAADC->RESULT.MAXCNT = n;
+    burst.queued += n;
+}
+
+float Board::startBrightnessBurst(int16_t *buffer, size_t count, uint32_t requestedRateHz, unsigned long *startMicros)
+{
+    const uint32_t cc = burstTimerCC(requestedRateHz);
+    const uint32_t periodNs = cc * 1000UL / 16;
+
+    // Save everything the mbed analogin driver set up, so we can put it back.
+    BurstState &b = burst;
+    b.savedInten = NRF_SAADC->INTEN;
+    b.savedEnable = NRF_SAADC->ENABLE;
+    b.savedResolution = NRF_SAADC->RESOLUTION;
+    b.savedOversample = NRF_SAADC->OVERSAMPLE;
+    b.savedSampleRate = NRF_SAADC->SAMPLERATE;
+    b.savedPtr = NRF_SAADC->RESULT.PTR;
+    b.savedMaxCnt = NRF_SAADC->RESULT.MAXCNT;
+    b.savedConfig = NRF_SAADC->CH[0].CONFIG;
+    b.savedPseln = NRF_SAADC->CH[0].PSELN;
+
+    NRF_SAADC->INTENCLR = 0xffffffff;
+    for (int ch = 0; ch < SAADC_CH_NUM; ++ch)
+    {
+        b.savedPselp[ch] = NRF_SAADC->CH[ch].PSELP;
+        NRF_SAADC->CH[ch].PSELP = SAADC_CH_PSELP_PSELP_NC;
+    }
+
+    // Same gain and reference as setupAnalog()
+    NRF_SAADC->CH[0].CONFIG = (SAADC_CH_CONFIG_RESP_Bypass << SAADC_CH_CONFIG_RESP_Pos) |
+                              (SAADC_CH_CONFIG_RESN_Bypass << SAADC_CH_CONFIG_RESN_Pos) |
+                              (SAADC_CH_CONFIG_GAIN_Gain1_4 << SAADC_CH_CONFIG_GAIN_Pos) |
+                              (SAADC_CH_CONFIG_REFSEL_VDD1_4 << SAADC_CH_CONFIG_REFSEL_Pos) |
+                              (chooseAcquisitionTime(periodNs) << SAADC_CH_CONFIG_TACQ_Pos) |
+                              (SAADC_CH_CONFIG_MODE_SE << SAADC_CH_CONFIG_MODE_Pos) |
+                              (SAADC_CH_CONFIG_BURST_Disabled << SAADC_CH_CONFIG_BURST_Pos);
+    NRF_SAADC->CH[0].PSELN = SAADC_CH_PSELN_PSELN_NC;
+    NRF_SAADC->CH[0].PSELP = PHOTODIODE_AIN;
+    NRF_SAADC->RESOLUTION = SAADC_RESOLUTION_VAL_12bit;
+    NRF_SAADC->OVERSAMPLE = SAADC_OVERSAMPLE_OVERSAMPLE_Bypass;
+    NRF_SAADC->SAMPLERATE = (cc << SAADC_SAMPLERATE_CC_Pos) |
+                            (SAADC_SAMPLERATE_MODE_Timers << SAADC_SAMPLERATE_MODE_Pos);
+    NRF_SAADC->ENABLE = SAADC_ENABLE_ENABLE_Enabled << SAADC_ENABLE_ENABLE_Pos;
+
+    // Spread the samples evenly over the chunks so the last one isn't tiny.
+    b.buffer = buffer;
+    b.count = count;
+    b.numChunks = (count + BURST_CHUNK_SAMPLES - 1) / BURST_CHUNK_SAMPLES;
+    b.chunkSamples = (count + b.numChunks - 1) / b.numChunks;
+    b.queued = 0;
+
+    NRF_SAADC->EVENTS_STARTED = 0;
+    NRF_SAADC->EVENTS_END = 0;
+    NRF_SAADC->EVENTS_STOPPED = 0;
+
+    // PTR and MAXCNT are double-buffered: once STARTED fires we can queue
+    // the next chunk, and PPI restarts into it as soon as this one ENDs.
+    queueBurstChunk();
+    NRF_SAADC->TASKS_START = 1;
+    waitForEvent(NRF_SAADC->EVENTS_STARTED);
+    b.started = 1;
+    if (b.queued < count)
+    {
+        queueBurstChunk();
+        NRF_PPI->CH[BURST_PPI_CHANNEL].EEP = reinterpret_cast<uint32_t>(&NRF_SAADC->EVENTS_END);
+        NRF_PPI->CH[BURST_PPI_CHANNEL].TEP = reinterpret_cast<uint32_t>(&NRF_SAADC->TASKS_START);
+        NRF_PPI->CHENSET = 1UL << BURST_PPI_CHANNEL;
+    }
+
+    b.running = true;
+    *startMicros = micros();
+    NRF_SAADC->TASKS_SAMPLE = 1;
+    return 16000000.0f / cc;
+}
+
+bool Board::brightnessBurstDone()
+{
+    BurstState &b = burst;
+    if (!b.running)
+    {
+        return true;
+    }
+    const uint32_t ppiMask = 1UL << BURST_PPI_CHANNEL;
+    if (b.started < b.numChunks)
+    {
+        if (NRF_SAADC->EVENTS_STARTED == 0)
+        {
+            return false;
+        }
+        NRF_SAADC->EVENTS_STARTED = 0;
+        b.started++;
+        if (b.queued < b.count)
+        {
+            queueBurstChunk();
+        }
+        else
+        {
+            // Last chunk is running: don't restart when it ends.
+            NRF_PPI->CHENCLR = ppiMask;
+            // Any END events so far belong to earlier chunks.
+            NRF_SAADC->EVENTS_END = 0;
+        }
+        return false;
+    }
+    if (NRF_SAADC->EVENTS_END == 0)
+    {
+        return false;
+    }
+
+    NRF_SAADC->TASKS_STOP = 1;
+    waitForEvent(NRF_SAADC->EVENTS_STOPPED);
+    NRF_PPI->CHENCLR = ppiMask;
+
+    // Put things back for analogRead()
+    NRF_SAADC->ENABLE = b.savedEnable;
+    NRF_SAADC->SAMPLERATE = b.savedSampleRate;
+    NRF_SAADC->OVERSAMPLE = b.savedOversample;
+    NRF_SAADC->RESOLUTION = b.savedResolution;
+    NRF_SAADC->RESULT.PTR = b.savedPtr;
+    NRF_SAADC->RESULT.MAXCNT = b.savedMaxCnt;
+    NRF_SAADC->CH[0].CONFIG = b.savedConfig;
+    NRF_SAADC->CH[0].PSELN = b.savedPseln;
+    for (int ch = 0; ch < SAADC_CH_NUM; ++ch)
+    {
+        NRF_SAADC->CH[ch].PSELP = b.savedPselp[ch];
+    }
+    NRF_SAADC->EVENTS_STARTED = 0;
+    NRF_SAADC->EVENTS_END = 0;
+    NRF_SAADC->EVENTS_STOPPED = 0;
+    NRF_SAADC->EVENTS_RESULTDONE = 0;
+    NRF_SAADC->EVENTS_DONE = 0;
+    NRF_SAADC->INTENSET = b.savedInten;
+    b.running = false;
+    return true;
+}
+static uintptr_t storagePageAddress(int index)
+{
+    return (NRF_FICR->CODESIZE - 2 + index) * NRF_FICR->CODEPAGESIZE;
+}
+
+static void waitForFlash()
+{
+    while (NRF_NVMC->READY == NVMC_READY_READY_Busy)
+    {
+    }
+}
+
+bool FlashStorage::available() const
+{
+    // Initialized data is stored in flash right after the code.
+    uintptr_t imageEnd = reinterpret_cast<uintptr_t>(&__etext) +
+                         (reinterpret_cast<uintptr_t>(&__data_end__) - reinterpret_cast<uintptr_t>(&__data_start__));
+    return imageEnd <= storagePageAddress(0);
+}
+
+size_t FlashStorage::pageSize() const
+{
+    return NRF_FICR->CODEPAGESIZE;
+}
+
+const uint8_t *FlashStorage::page(int index) const
+{
+    return reinterpret_cast<const uint8_t *>(storagePageAddress(index));
+}
+
+void FlashStorage::erase(int index)
+{
+    // The CPU stalls for the 85ms or so this takes.
+    NRF_NVMC->CONFIG = NVMC_CONFIG_WEN_Een << NVMC_CONFIG_WEN_Pos;
+    waitForFlash();
+    NRF_NVMC->ERASEPAGE = storagePageAddress(index);
+    waitForFlash();
+    NRF_NVMC->CONFIG = NVMC_CONFIG_WEN_Ren << NVMC_CONFIG_WEN_Pos;
+    waitForFlash();
+}
+
+void FlashStorage::write(int index, size_t offset, const uint32_t *words, size_t count)
+{
+    volatile uint32_t *dest = reinterpret_cast<volatile uint32_t *>(storagePageAddress(index) + offset);
+    NRF_NVMC->CONFIG = NVMC_CONFIG_WEN_Wen << NVMC_CONFIG_WEN_Pos;
+    waitForFlash();
+    for (size_t i = 0; i < count; ++i)
+    {
+        dest[i] = words[i];
+        waitForFlash();
+    }
+    NRF_NVMC->CONFIG = NVMC_CONFIG_WEN_Ren << NVMC_CONFIG_WEN_Pos;
+    waitForFlash();
+}
+
+#endif // defined(TARGET_ARDUINO_NANO33BLE)
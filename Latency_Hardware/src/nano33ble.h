@@ -10,13 +10,34 @@
 #include <Arduino.h>
 #include <SPI.h>
 constexpr int MAX_ANALOG = 65535;
+// Adafruit_LSM9DS1::begin() sets the gyro to 952Hz
+constexpr unsigned long IMU_SAMPLE_INTERVAL_US = 1050;
+
+// Board::captureBrightnessBurst() is available
+#define HAVE_BRIGHTNESS_BURST
+// Raw SAADC resolution used by Board::captureBrightnessBurst()
+constexpr int BURST_SAMPLE_BITS = 12;
+// Fastest the SAADC can convert: 16MHz / 80
+constexpr uint32_t BURST_MAX_RATE_HZ = 200000;
+
+// What setupAnalog() sets: thresholds measured at another resolution don't apply.
+constexpr uint32_t ANALOG_RESOLUTION_BITS = 16;
 
 static inline void setupAnalog() {
-    analogReadResolution(16);
+    analogReadResolution(ANALOG_RESOLUTION_BITS);
     analogReference(AnalogReferenceMode::AR_VDD);
     // analogAcquisitionTime(AT_40_US);
 }
 
+// What analogRead() gives until setupAnalog() is called: VDD is already
+// the default reference.
+constexpr uint32_t DEFAULT_ANALOG_RESOLUTION_BITS = 10;
+
+/// Undo setupAnalog(), for apps that expect the defaults.
+static inline void resetAnalog() {
+    analogReadResolution(DEFAULT_ANALOG_RESOLUTION_BITS);
+}
+
 static inline void ledOn() {
     digitalWrite(LED_RED, LOW);
 }
@@ -31,16 +52,67 @@ static inline void ledOff() {
 #include <Adafruit_LSM9DS1.h>
 #endif // WANT_IMU
 
+// FlashStorage is available
+#define HAVE_FLASH_STORAGE
+
+/// The last two pages of flash, for a RecordStore.
+class FlashStorage
+{
+public:
+    /// False if the program reaches into the storage pages.
+    bool available() const;
+    size_t pageSize() const;
+    const uint8_t *page(int index) const;
+    void erase(int index);
+    void write(int index, size_t offset, const uint32_t *words, size_t count);
+};
+
 class Board
 {
 public:
     bool begin();
     bool getGyroData(unsigned long *microseconds, sensors_event_t *gyroEvent);
+    /// Acceleration in m/s^2, including gravity. A separate read from the
+    /// gyro, so only do it if you need it.
+    bool getAccelData(sensors_event_t *accelEvent);
     void loop();
+
+    /**
+     * @brief Capture a burst of photodiode samples straight from the SAADC,
+     * paced by its internal timer and written to RAM with EasyDMA.
+     *
+     * Blocks until @p count raw BURST_SAMPLE_BITS-bit samples are in
+     * @p buffer. Leaves the ADC set up the way analogRead() expects.
+     *
+     * @param requestedRateHz Clamped to what the timer can do, at most
+     * BURST_MAX_RATE_HZ. The acquisition time is the longest that fits.
+     * @param startMicros Set to micros() when sampling started.
+     * @return The actual sample rate in Hz.
+     */
+    float captureBrightnessBurst(int16_t *buffer, size_t count, uint32_t requestedRateHz, unsigned long *startMicros);
+
+    /**
+     * @brief Start a burst like captureBrightnessBurst(), but return once
+     * sampling has begun: call brightnessBurstDone() every loop until it
+     * returns true, and don't use analogRead() meanwhile.
+     *
+     * Bursts of over 16384 samples need a new buffer queued as each chunk
+     * starts, so keep the loop quick while they run.
+     */
+    float startBrightnessBurst(int16_t *buffer, size_t count, uint32_t requestedRateHz, unsigned long *startMicros);
+
+    /// Keep a burst from startBrightnessBurst() going: true once all its
+    /// samples are in and analogRead() works again (or if none is running).
+    bool brightnessBurstDone();
+
+    /// The rate captureBrightnessBurst() will actually use for a request.
+    static float burstSampleRate(uint32_t requestedRateHz);
+
 private:
 #ifdef WANT_IMU
     Adafruit_LSM9DS1 lsm = Adafruit_LSM9DS1(&Wire1);
     Adafruit_Sensor &gyro = lsm.getGyro();
+    Adafruit_Sensor &accel = lsm.getAccel();
 #endif // WANT_IMU
 };
 
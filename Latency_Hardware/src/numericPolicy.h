@@ -0,0 +1,98 @@
+// Copyright 2021, Collabora, Ltd.
+// SPDX-License-Identifier: BSL-1.0
+// Original Author: Ryan Pavlik
+//
+// Number representations for the gyro pipeline, picked at compile time, so
+// GyroProc, doRead(), moving() and the tests share one algorithm whatever
+// the representation:
+//
+// - FloatPolicy: rad/s in float, as the driver reports it (the default).
+// - CountsPolicy: LSM9DS1 counts in int32, at the 245 dps scale we set up.
+// - Q15Policy: q15 fraction of the 245 dps full scale, in int16.
+//
+// Build with -DGYRO_POLICY_COUNTS or -DGYRO_POLICY_Q15 to switch. Thresholds
+// stay written in rad/s: convert them with fromRadPerSec() in a constexpr.
+// Accum is wide enough to sum or subtract values without overflowing;
+// subtract() gives a Scalar again, saturating if it has to.
+//
+// No Eigen in here, so it can be included after Arduino.h.
+
+#pragma once
+
+#include <stdint.h>
+
+namespace numeric_policy
+{
+// Sensitivity of the LSM9DS1 gyro at 245 dps full scale.
+constexpr float GyroRadPerSecPerCount = 0.00875f * 0.017453292519943295f;
+constexpr float GyroFullScaleRadPerSec = 245.f * 0.017453292519943295f;
+
+constexpr int32_t roundToInt(float v)
+{
+    return static_cast<int32_t>(v >= 0 ? v + 0.5f : v - 0.5f);
+}
+
+constexpr int32_t clamp(int32_t v, int32_t lo, int32_t hi)
+{
+    return v < lo ? lo : (v > hi ? hi : v);
+}
+} // namespace numeric_policy
+
+struct FloatPolicy
+{
+    using Scalar = float;
+    using Accum = float;
+    static constexpr const char *name() { return "float"; }
+    static constexpr Scalar fromRadPerSec(float v) { return v; }
+    static constexpr float toRadPerSec(Scalar v) { return v; }
+    static constexpr Scalar subtract(Scalar a, Scalar b) { return a - b; }
+};
+
+struct CountsPolicy
+{
+    using Scalar = int32_t;
+    using Accum = int32_t;
+    static constexpr const char *name() { return "counts"; }
+    static constexpr Scalar fromRadPerSec(float v)
+    {
+        return numeric_policy::roundToInt(v / numeric_policy::GyroRadPerSecPerCount);
+    }
+    static constexpr float toRadPerSec(Scalar v) { return v * numeric_policy::GyroRadPerSecPerCount; }
+    static constexpr Scalar subtract(Scalar a, Scalar b) { return a - b; }
+};
+
+struct Q15Policy
+{
+    using Scalar = int16_t;
+    using Accum = int32_t;
+    static constexpr const char *name() { return "q15"; }
+    /// Saturates at full scale. -32768 is left out, so abs() can't overflow.
+    static constexpr Scalar fromRadPerSec(float v)
+    {
+        return static_cast<Scalar>(numeric_policy::clamp(
+            numeric_policy::roundToInt(v * (32768.f / numeric_policy::GyroFullScaleRadPerSec)), -32767, 32767));
+    }
+    static constexpr float toRadPerSec(Scalar v) { return v * (numeric_policy::GyroFullScaleRadPerSec / 32768.f); }
+    /// Saturates like fromRadPerSec(): a reading near full scale less a
+    /// zero rate of the other sign would wrap in int16.
+    static constexpr Scalar subtract(Scalar a, Scalar b)
+    {
+        return static_cast<Scalar>(numeric_policy::clamp(Accum(a) - Accum(b), -32767, 32767));
+    }
+};
+
+#if defined(GYRO_POLICY_Q15)
+using GyroPolicy = Q15Policy;
+#elif defined(GYRO_POLICY_COUNTS)
+using GyroPolicy = CountsPolicy;
+#else
+using GyroPolicy = FloatPolicy;
+#endif
+
+using GyroScalar = GyroPolicy::Scalar;
+
+template <typename Policy>
+class BasicGyroProc;
+
+/// The gyro processor the firmware is built with.
+using GyroProc = BasicGyroProc<GyroPolicy>;
@@ -12,77 +12,133 @@
 #include <Arduino.h>
 #include "defines.h"
 #include "apps.h"
+#include "calibration.h"
+#include "scheduler.h"
 #include <cmath>
 
+// Where we're up to: calibrateSetup() starts again from the top.
 static bool calibrated = false;
+static bool loop_delay_measured = false;
+// Pauses between steps: we return from the loop until this expires, rather
+// than calling delay().
+static Deadline wait;
 static int on_threshold = -1;
 static int off_threshold = -1;
 
+// The steps of calibrate(): finding the thresholds.
+static enum { C_START,
+              C_LED_OFF,
+              C_READ_DARK,
+              C_READ_BRIGHT,
+              C_CHECK } calibrate_state = C_START;
+
+// measureLoopDelay() has done its analog read.
+static bool loop_delay_started = false;
+
+// The steps of measureSensorLatency(): we test both the rising and falling
+// brightness condition.
+static enum { S_START,
+              S_SET_ON,
+              S_MEASURE_ON,
+              S_SET_OFF,
+              S_MEASURE_OFF } state = S_START;
+
+// Save the average sensor latency once we have this many of each.
+const int SENSOR_LATENCY_SAMPLES = 8;
+static unsigned long latency_sums[2] = {0, 0};
+static int latency_counts[2] = {0, 0};
+static bool latency_saved = false;
+
+/// Average the first few latencies, and save them to the calibration.
+static void recordSensorLatency(bool on, unsigned long latency)
+{
+    if (latency_saved || latency_counts[on] >= SENSOR_LATENCY_SAMPLES)
+    {
+        return;
+    }
+    latency_sums[on] += latency;
+    latency_counts[on]++;
+    if (latency_counts[0] < SENSOR_LATENCY_SAMPLES || latency_counts[1] < SENSOR_LATENCY_SAMPLES)
+    {
+        return;
+    }
+    Calibration &cal = calibration();
+    cal.sensorOnLatencyUs = latency_sums[1] / SENSOR_LATENCY_SAMPLES;
+    cal.sensorOffLatencyUs = latency_sums[0] / SENSOR_LATENCY_SAMPLES;
+    if (calibrationSave())
+    {
+        Serial.print("Saved average sensor latency: on ");
+        Serial.print(cal.sensorOnLatencyUs);
+        Serial.print(", off ");
+        Serial.println(cal.sensorOffLatencyUs);
+    }
+    latency_saved = true;
+}
+
 void measureSensorLatency()
 {
     // We run a finite-state machine to test the latency between when the LED is
     // turned on and when the photosensor changes its value to pass the threshold.
-    // We test both the rising and falling brightness condition.
 
-    Serial.println("Start photosensor latency measurement");
-    while (true)
+    // micros() will wrap around after about 7 hours of running.
+    // It has an accuracy of 4 microseconds.
+    static unsigned long start = 0;
+
+    switch (state)
     {
-        static enum { S_SET_ON,
-                      S_MEASURE_ON,
-                      S_SET_OFF,
-                      S_MEASURE_OFF } state = S_SET_ON;
+    case S_START:
+        Serial.println("Start photosensor latency measurement");
+        state = S_SET_ON;
+        break;
 
-        // micros() will wrap around after about 7 hours of running.
-        // It has an accuracy of 4 microseconds.
-        static unsigned long start = 0;
+    case S_SET_ON:
+        // Turn on the LED and record when we did.
+        start = micros();
+        ledOn();
+        state = S_MEASURE_ON;
+        break;
 
-        switch (state)
+    case S_MEASURE_ON:
+        // Wait until the LED passes threshold, then report how long it
+        // took and wait a bit for the printing to happen.
+        if (readBrightness() >= on_threshold)
         {
-        case S_SET_ON:
-            // Turn on the LED and record when we did.
-            start = micros();
-            ledOn();
-            state = S_MEASURE_ON;
-            break;
-
-        case S_MEASURE_ON:
-            // Wait until the LED passes threshold, then report how long it
-            // took and wait a bit for the printing to happen.
-            if (readBrightness() >= on_threshold)
-            {
-                unsigned long now = micros();
-                unsigned long latency = now - start;
-                Serial.print("On delay (microseconds) = ");
-                Serial.println(latency);
-                delay(500);
-                state = S_SET_OFF;
-            }
-            break;
+            unsigned long now = micros();
+            unsigned long latency = now - start;
+            Serial.print("On delay (microseconds) = ");
+            Serial.println(latency);
+            recordSensorLatency(true, latency);
+            wait.start(now, 500000);
+            state = S_SET_OFF;
+        }
+        break;
 
-        case S_SET_OFF:
-            // Turn off the LED and record when we did.
-            ledOff();
-            start = micros();
-            state = S_MEASURE_OFF;
-            break;
+    case S_SET_OFF:
+        // Turn off the LED and record when we did.
+        ledOff();
+        start = micros();
+        state = S_MEASURE_OFF;
+        break;
 
-        case S_MEASURE_OFF:
-            // Wait until the LED passes threshold, then report how long it
-            // took and wait it bit for the printing to happen.
-            if (readBrightness() <= off_threshold)
-            {
-                unsigned long now = micros();
-                unsigned long latency = now - start;
-                Serial.print("Off delay (microseconds) = ");
-                Serial.println(latency);
-                delay(500);
-                state = S_SET_ON;
-            }
-            break;
+    case S_MEASURE_OFF:
+        // Wait until the LED passes threshold, then report how long it
+        // took and wait it bit for the printing to happen.
+        if (readBrightness() <= off_threshold)
+        {
+            unsigned long now = micros();
+            unsigned long latency = now - start;
+            Serial.print("Off delay (microseconds) = ");
+            Serial.println(latency);
+            recordSensorLatency(false, latency);
+            wait.start(now, 500000);
+            state = S_SET_ON;
         }
+        break;
     }
 }
-void measureLoopDelay()
+
+/// @return true once done.
+bool measureLoopDelay()
 {
 
     // Once we have calibrated, measure how long
@@ -90,97 +146,155 @@ void measureLoopDelay()
     // the loop.  This lets us know how much of the
     // latency in the photodiode measurement is due
     // to housekeeping.
-    static bool loop_delay_measured = false;
-    while (!loop_delay_measured)
+    static unsigned long start;
+    if (!loop_delay_started)
     {
-        static bool first_time = true;
-        static unsigned long start;
-        if (first_time)
-        {
-            start = micros();
-            int unused [[maybe_unused]] = readBrightness();
+        start = micros();
+        int unused [[maybe_unused]] = readBrightness();
 
-            first_time = false;
-        }
-        else
-        {
-            unsigned long now = micros();
-            unsigned long latency = now - start;
-            Serial.print("Loop delay (microseconds) = ");
-            Serial.println(latency);
-            Serial.println();
-            delay(400);
-            loop_delay_measured = true;
-        }
+        loop_delay_started = true;
+        return false;
     }
+    unsigned long now = micros();
+    unsigned long latency = now - start;
+    Serial.print("Loop delay (microseconds) = ");
+    Serial.println(latency);
+    Serial.println();
+    wait.start(now, 400000);
+    return true;
 }
-void calibrate()
+
+/// @return true once calibrated.
+bool calibrate()
 {
     // The first time through the loop, we do a calibration to find out
     // what the threshold for turning the LED on and off should be.  We
     // turn it off, wait for it to go off, and then read it.  Then back
     // on and wait, then back off.
-    while (true)
+    static int dark_value = 0;
+    static int bright_value = 0;
+
+    unsigned long now = micros();
+    switch (calibrate_state)
+    {
+    case C_START:
     {
+        // If we saved thresholds before, at the same ADC settings, skip all that.
+        Calibration const &cal = calibration();
+        if (cal.hasThresholds(ANALOG_RESOLUTION_BITS))
+        {
+            on_threshold = cal.onThreshold;
+            off_threshold = cal.offThreshold;
+            Serial.print("Using saved calibration: on threshold = ");
+            Serial.print(on_threshold);
+            Serial.print(", off threshold = ");
+            Serial.print(off_threshold);
+            Serial.println(" (send \"cal clear\" and reset to calibrate again)");
+            return true;
+        }
+        calibrate_state = C_LED_OFF;
+    }
+    break;
+
+    case C_LED_OFF:
         ledOff();
+        wait.start(now, 1000000);
+        calibrate_state = C_READ_DARK;
+        break;
 
-        delay(1000);
-        int dark_value = readBrightness();
+    case C_READ_DARK:
+        dark_value = readBrightness();
         Serial.print("dark: ");
         Serial.println(dark_value);
 
         ledOn();
-        delay(1000);
-        int bright_value = readBrightness();
+        wait.start(now, 1000000);
+        calibrate_state = C_READ_BRIGHT;
+        break;
+
+    case C_READ_BRIGHT:
+        bright_value = readBrightness();
         Serial.print("bright: ");
         Serial.println(bright_value);
 
         ledOff();
-        delay(1000);
+        wait.start(now, 1000000);
+        calibrate_state = C_CHECK;
+        break;
+
+    case C_CHECK:
+    {
+        // Each message gets a second to be read.
+        unsigned long pause = 0;
         if (bright_value < dark_value) {
             Serial.println("please invert the meaning of the readBrightness command.\n");
-            delay(1000);
-
+            pause += 1000000;
         }
         if ((std::abs)(bright_value - dark_value) < 100)
         {
             Serial.println("Not enough brightness difference, reposition photosensor to see LED\n");
-            delay(1000);
-        }
-        else
-        {
-            int tenth_gap = (bright_value - dark_value) / 10;
-            on_threshold = dark_value + tenth_gap;
-            off_threshold = bright_value - tenth_gap;
-            Serial.print("Calibrated: on threshold = ");
-            Serial.print(on_threshold);
-            Serial.print(", off threshold = ");
-            Serial.print(off_threshold);
-            Serial.print(" (dark = ");
-            Serial.print(dark_value);
-            Serial.print(", bright = ");
-            Serial.print(bright_value);
-            Serial.println(")");
-            delay(400);
-            calibrated = true;
-            return;
+            wait.start(now, pause + 1000000);
+            calibrate_state = C_LED_OFF;
+            break;
         }
+        int tenth_gap = (bright_value - dark_value) / 10;
+        on_threshold = dark_value + tenth_gap;
+        off_threshold = bright_value - tenth_gap;
+        Serial.print("Calibrated: on threshold = ");
+        Serial.print(on_threshold);
+        Serial.print(", off threshold = ");
+        Serial.print(off_threshold);
+        Serial.print(" (dark = ");
+        Serial.print(dark_value);
+        Serial.print(", bright = ");
+        Serial.print(bright_value);
+        Serial.println(")");
+        Calibration &cal = calibration();
+        cal.onThreshold = on_threshold;
+        cal.offThreshold = off_threshold;
+        cal.adcResolutionBits = ANALOG_RESOLUTION_BITS;
+        calibrationSave();
+        wait.start(now, pause + 400000);
+        return true;
+    }
     }
+    return false;
 }
 void calibrateSetup()
 {
     setupAnalog();
+    calibrated = false;
+    loop_delay_measured = false;
+    wait.cancel();
+    calibrate_state = C_START;
+    loop_delay_started = false;
+    state = S_START;
+    latency_sums[0] = latency_sums[1] = 0;
+    latency_counts[0] = latency_counts[1] = 0;
+    latency_saved = false;
 }
 //*****************************************************
 void calibrateLoop(Board &board)
 //*****************************************************
 {
+    // Each step returns as soon as it can, so we get back here (and the
+    // rest of the main loop runs) even while waiting.
+    if (!wait.expired(micros()))
+    {
+        return;
+    }
     if (!calibrated)
     {
-        calibrate();
+        calibrated = calibrate();
+    }
+    else if (!loop_delay_measured)
+    {
+        loop_delay_measured = measureLoopDelay();
+    }
+    else
+    {
+        measureSensorLatency();
     }
-    measureLoopDelay();
-    measureSensorLatency();
 
 } //end loop
 
@@ -0,0 +1,167 @@
+// Copyright 2021, Collabora, Ltd.
+// SPDX-License-Identifier: BSL-1.0
+// Original Author: Ryan Pavlik
+//
+// Wear-levelled storage of one small struct in two pages of flash.
+//
+// Each save appends a new record (magic, sequence number, value, CRC) to the
+// next erased slot of the current page, so a page is only erased once every
+// few dozen saves: when it's full, we erase the other page and carry on
+// there. Loading takes the valid record with the highest sequence number, so
+// losing power part way through a save just leaves the previous value.
+//
+// The Flash type provides:
+//
+//     size_t pageSize() const;
+//     const uint8_t *page(int index) const;  // index 0 or 1
+//     void erase(int index);                 // all bytes to 0xff
+//     void write(int index, size_t offset, const uint32_t *words, size_t count);
+//
+// where writes are whole, aligned 32-bit words to erased flash.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "crc16.h"
+
+template <typename T, typename Flash>
+class RecordStore
+{
+public:
+    /// @param magic Identifies the record type and version: change it when
+    /// T changes, so old records are ignored.
+    RecordStore(Flash &flash, uint32_t magic) : flash_(flash), magic_(magic) {}
+
+    static constexpr size_t PayloadWords = (sizeof(T) + 3) / 4;
+    // magic, sequence number, payload, CRC
+    static constexpr size_t RecordWords = 2 + PayloadWords + 1;
+    static constexpr size_t RecordBytes = RecordWords * 4;
+
+    size_t slotsPerPage() const { return flash_.pageSize() / RecordBytes; }
+
+    /// Get the most recently saved value, if any.
+    bool load(T *out) const
+    {
+        Slot latest = findLatest();
+        if (!latest.valid)
+        {
+            return false;
+        }
+        memcpy(out, slotData(latest) + 2 * 4, sizeof(T));
+        return true;
+    }
+
+    bool save(T const &value)
+    {
+        Slot latest = findLatest();
+        uint32_t seq = latest.valid ? latest.seq + 1 : 0;
+        Slot target = latest.valid ? nextErased(latest.page, latest.index + 1) : nextErased(0, 0);
+        if (target.index < 0)
+        {
+            // Page full (or, the first time, not ours): move to the other one.
+            target.page = latest.valid ? 1 - latest.page : 0;
+            target.index = 0;
+            flash_.erase(target.page);
+        }
+
+        uint32_t words[RecordWords];
+        memset(words, 0, sizeof(words));
+        words[0] = magic_;
+        words[1] = seq;
+        memcpy(&words[2], &value, sizeof(T));
+        words[RecordWords - 1] = crc16Update(CRC16_INIT, reinterpret_cast<const uint8_t *>(words), (RecordWords - 1) * 4);
+        flash_.write(target.page, target.index * RecordBytes, words, RecordWords);
+
+        // Check it took: flash can fail, and the slot might not have been
+        // fully erased.
+        Slot written = findLatest();
+        return written.valid && written.seq == seq && memcmp(slotData(written) + 2 * 4, &value, sizeof(T)) == 0;
+    }
+
+    /// Erase both pages: forget everything.
+    void clear()
+    {
+        flash_.erase(0);
+        flash_.erase(1);
+    }
+
+private:
+    struct Slot
+    {
+        bool valid;
+        int page;
+        int index;
+        uint32_t seq;
+    };
+
+    const uint8_t *slotData(Slot const &slot) const { return flash_.page(slot.page) + slot.index * RecordBytes; }
+
+    static uint32_t word(const uint8_t *data, size_t index)
+    {
+        uint32_t value;
+        memcpy(&value, data + index * 4, 4);
+        return value;
+    }
+
+    bool isValid(const uint8_t *record) const
+    {
+        return word(record, 0) == magic_ &&
+               word(record, RecordWords - 1) == crc16Update(CRC16_INIT, record, (RecordWords - 1) * 4);
+    }
+
+    bool isErased(const uint8_t *record) const
+    {
+        for (size_t i = 0; i < RecordWords; ++i)
+        {
+            if (word(record, i) != 0xffffffff)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    Slot findLatest() const
+    {
+        Slot latest{false, 0, 0, 0};
+        for (int page = 0; page < 2; ++page)
+        {
+            const uint8_t *data = flash_.page(page);
+            for (size_t i = 0; i < slotsPerPage(); ++i)
+            {
+                const uint8_t *record = data + i * RecordBytes;
+                if (!isValid(record))
+                {
+                    continue;
+                }
+                uint32_t seq = word(record, 1);
+                // Wrap-safe comparison of sequence numbers
+                if (!latest.valid || static_cast<int32_t>(seq - latest.seq) > 0)
+                {
+                    latest = {true, page, static_cast<int>(i), seq};
+                }
+            }
+        }
+        return latest;
+    }
+
+    /// The first erased slot at or after @p index, or index -1 if none.
+    Slot nextErased(int page, int index) const
+    {
+        const uint8_t *data = flash_.page(page);
+        for (size_t i = index; i < slotsPerPage(); ++i)
+        {
+            if (isErased(data + i * RecordBytes))
+            {
+                return {false, page, static_cast<int>(i), 0};
+            }
+        }
+        return {false, page, -1, 0};
+    }
+
+    Flash &flash_;
+    uint32_t magic_;
+};
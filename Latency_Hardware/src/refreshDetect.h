@@ -0,0 +1,268 @@
+// Copyright 2021, Collabora, Ltd.
+// SPDX-License-Identifier: BSL-1.0
+// Original Author: Ryan Pavlik
+//
+// Estimating display refresh rate and phase from the brightness ripple in
+// a burst of high-rate photodiode samples.
+
+#pragma once
+
+#include <math.h>
+#include <stddef.h>
+
+struct RefreshEstimate
+{
+    bool valid = false;
+    float frequencyHz = 0;
+    float periodUs = 0;
+    /// Offset from the first sample to the first peak of the fundamental
+    /// of the refresh ripple, in [0, periodUs). This is when the display
+    /// refreshes the part of the screen under the sensor, give or take a
+    /// constant that depends on the display.
+    float phaseUs = 0;
+    /// Normalized autocorrelation at the refresh period: 1 is a perfect
+    /// periodic signal, 0 is noise.
+    float confidence = 0;
+};
+
+constexpr float REFRESH_MIN_HZ = 40.0f;
+constexpr float REFRESH_MAX_HZ = 250.0f;
+constexpr float REFRESH_MIN_CONFIDENCE = 0.3f;
+
+// We average down to about this rate before searching.
+constexpr float REFRESH_ANALYSIS_RATE_HZ = 8000.0f;
+
+namespace refresh_detail
+{
+    // Magnitude squared and phase of the DFT of x at a frequency given in
+    // cycles per sample, using a rotating phasor instead of sin/cos per sample.
+    static inline double dftAt(const float *x, size_t n, double cyclesPerSample, double *phase)
+    {
+        const double w = 2.0 * M_PI * cyclesPerSample;
+        const double stepC = cos(w);
+        const double stepS = sin(w);
+        double c = 1;
+        double s = 0;
+        double re = 0;
+        double im = 0;
+        for (size_t i = 0; i < n; ++i)
+        {
+            re += x[i] * c;
+            im += x[i] * s;
+            double nextC = c * stepC - s * stepS;
+            s = s * stepC + c * stepS;
+            c = nextC;
+        }
+        if (phase)
+        {
+            *phase = atan2(im, re);
+        }
+        return re * re + im * im;
+    }
+
+    // Normalized autocorrelation at an integer lag.
+    static inline float autocorrelation(const float *x, size_t n, size_t lag, float energyPerSample)
+    {
+        float sum = 0;
+        for (size_t i = 0; i + lag < n; ++i)
+        {
+            sum += x[i] * x[i + lag];
+        }
+        return sum / (n - lag) / energyPerSample;
+    }
+} // namespace refresh_detail
+
+/**
+ * @brief Estimate the display refresh rate and phase from a burst.
+ *
+ * Averages the samples down into @p scratch, removes the mean and any
+ * linear trend, finds the refresh period by autocorrelation, refines the
+ * frequency by maximizing the DFT magnitude, and takes the phase from it.
+ *
+ * @param samples Evenly spaced brightness samples
+ * @param sampleRateHz Their rate
+ * @param scratch Working space: more is only needed for longer bursts.
+ * @param toBrightness Converts a sample so that larger is brighter.
+ */
+template <typename Sample, typename Convert>
+static inline RefreshEstimate estimateRefresh(const Sample *samples, size_t count, float sampleRateHz,
+                                              float *scratch, size_t scratchLen, Convert &&toBrightness)
+{
+    using namespace refresh_detail;
+    RefreshEstimate ret;
+
+    // Decimate by averaging bins.
+    size_t bin = static_cast<size_t>(ceilf(sampleRateHz / REFRESH_ANALYSIS_RATE_HZ));
+    bin = bin < 1 ? 1 : bin;
+    if (count / bin > scratchLen)
+    {
+        bin = (count + scratchLen - 1) / scratchLen;
+    }
+    const size_t n = count / bin;
+    const float binRate = sampleRateHz / bin;
+    const size_t minLag = static_cast<size_t>(floorf(binRate / REFRESH_MAX_HZ));
+    const size_t maxLag = static_cast<size_t>(ceilf(binRate / REFRESH_MIN_HZ));
+    if (minLag < 2 || maxLag * 2 > n)
+    {
+        // Too slow to resolve the ripple, or not at least two of the longest periods
+        return ret;
+    }
+
+    double sum = 0;
+    double weightedSum = 0;
+    for (size_t i = 0; i < n; ++i)
+    {
+        float binSum = 0;
+        for (size_t j = 0; j < bin; ++j)
+        {
+            binSum += toBrightness(samples[i * bin + j]);
+        }
+        scratch[i] = binSum / bin;
+        sum += scratch[i];
+        weightedSum += scratch[i] * i;
+    }
+
+    // Least-squares line through the bins, which we subtract.
+    const double meanI = (n - 1) / 2.0;
+    const double mean = sum / n;
+    const double varI = (static_cast<double>(n) * n - 1) / 12.0;
+    const double slope = (weightedSum / n - meanI * mean) / varI;
+    double energy = 0;
+    for (size_t i = 0; i < n; ++i)
+    {
+        scratch[i] -= static_cast<float>(mean + slope * (i - meanI));
+        energy += scratch[i] * scratch[i];
+    }
+    const float energyPerSample = static_cast<float>(energy / n);
+    if (energyPerSample <= 0)
+    {
+        return ret;
+    }
+
+    // Strongest autocorrelation peak in range...
+    size_t bestLag = minLag;
+    float best = -1;
+    for (size_t lag = minLag; lag <= maxLag; ++lag)
+    {
+        float r = autocorrelation(scratch, n, lag, energyPerSample);
+        if (r > best)
+        {
+            best = r;
+            bestLag = lag;
+        }
+    }
+    // ...but multiples of the period correlate too, so prefer a submultiple
+    // that is nearly as good.
+    for (size_t k = 4; k >= 2; --k)
+    {
+        size_t lag = (bestLag + k / 2) / k;
+        if (lag < minLag + 1)
+        {
+            continue;
+        }
+        float r = autocorrelation(scratch, n, lag, energyPerSample);
+        float rPrev = autocorrelation(scratch, n, lag - 1, energyPerSample);
+        float rNext = autocorrelation(scratch, n, lag + 1, energyPerSample);
+        float peak = fmaxf(r, fmaxf(rPrev, rNext));
+        if (peak > 0.9f * best)
+        {
+            bestLag = rPrev > r && rPrev >= rNext ? lag - 1 : (rNext > r ? lag + 1 : lag);
+            best = peak;
+            break;
+        }
+    }
+    ret.confidence = best;
+    if (best < REFRESH_MIN_CONFIDENCE)
+    {
+        return ret;
+    }
+
+    // Sub-sample period from a parabola through the peak.
+    float lagEstimate = static_cast<float>(bestLag);
+    if (bestLag > minLag && bestLag < maxLag)
+    {
+        float rPrev = autocorrelation(scratch, n, bestLag - 1, energyPerSample);
+        float rNext = autocorrelation(scratch, n, bestLag + 1, energyPerSample);
+        float denom = rPrev - 2 * best + rNext;
+        if (denom < 0)
+        {
+            lagEstimate += 0.5f * (rPrev - rNext) / denom;
+        }
+    }
+
+    // Golden-section search for the DFT peak, within half a bin either side.
+    const double golden = 0.6180339887498949;
+    double lo = 1.0 / lagEstimate - 0.5 / n;
+    double hi = 1.0 / lagEstimate + 0.5 / n;
+    double a = hi - golden * (hi - lo);
+    double b = lo + golden * (hi - lo);
+    double magA = dftAt(scratch, n, a, nullptr);
+    double magB = dftAt(scratch, n, b, nullptr);
+    for (int iter = 0; iter < 24; ++iter)
+    {
+        if (magA > magB)
+        {
+            hi = b;
+            b = a;
+            magB = magA;
+            a = hi - golden * (hi - lo);
+            magA = dftAt(scratch, n, a, nullptr);
+        }
+        else
+        {
+            lo = a;
+            a = b;
+            magA = magB;
+            b = lo + golden * (hi - lo);
+            magB = dftAt(scratch, n, b, nullptr);
+        }
+    }
+    const double cyclesPerBin = (lo + hi) / 2;
+    double phase = 0;
+    dftAt(scratch, n, cyclesPerBin, &phase);
+
+    // x ~ cos(w i - phase), so peaks are at i = phase / w.
+    const double periodBins = 1.0 / cyclesPerBin;
+    double peakBins = phase / (2.0 * M_PI) * periodBins;
+    // Each bin is centered half a bin after its first sample
+    double peakUs = (peakBins + (bin - 1) / (2.0 * bin)) * bin * 1e6 / sampleRateHz;
+    const double periodUs = periodBins * bin * 1e6 / sampleRateHz;
+    peakUs = fmod(peakUs, periodUs);
+    if (peakUs < 0)
+    {
+        peakUs += periodUs;
+    }
+
+    ret.valid = true;
+    ret.periodUs = static_cast<float>(periodUs);
+    ret.frequencyHz = static_cast<float>(1e6 / periodUs);
+    ret.phaseUs = static_cast<float>(peakUs);
+    return ret;
+}
+
+template <typename Sample>
+static inline RefreshEstimate estimateRefresh(const Sample *samples, size_t count, float sampleRateHz,
+                                              float *scratch, size_t scratchLen)
+{
+    return estimateRefresh(samples, count, sampleRateHz, scratch, scratchLen,
+                           [](Sample s) { return static_cast<float>(s); });
+}
+
+/**
+ * @brief How long from @p timeUs until the display next refreshes under
+ * the sensor, given an estimate from a burst that started at @p burstStartUs.
+ *
+ * Both times are from micros(), so may have wrapped.
+ */
+static inline float timeUntilRefresh(RefreshEstimate const &estimate, unsigned long burstStartUs,
+                                     unsigned long timeUs)
+{
+    // signed, so it works either side of the burst
+    long sinceStart = static_cast<long>(timeUs - burstStartUs);
+    float wait = fmodf(estimate.phaseUs - static_cast<float>(sinceStart), estimate.periodUs);
+    if (wait < 0)
+    {
+        wait += estimate.periodUs;
+    }
+    return wait;
+}
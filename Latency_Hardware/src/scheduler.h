@@ -0,0 +1,138 @@
+// Copyright 2021, Collabora, Ltd.
+// SPDX-License-Identifier: BSL-1.0
+// Original Author: Ryan Pavlik
+//
+// Cooperative scheduling, so nothing has to call delay().
+//
+// Scheduler is a fixed table of tasks that loop() runs when they are due:
+// every pass, periodically, or once after a while. Tasks must return
+// promptly. An app that needs to wait between steps uses a Deadline in its
+// state machine and returns from its loop function until it expires, so
+// sampling, serial output and host commands carry on meanwhile.
+//
+// Times are microseconds from micros(), passed in so this can be tested off
+// the board. Comparisons are wrap-safe, for waits up to about 35 minutes.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// Whether @p now is at or past @p when, allowing for micros() wrapping.
+static inline bool timeReached(unsigned long now, unsigned long when)
+{
+    return static_cast<int32_t>(static_cast<uint32_t>(now - when)) >= 0;
+}
+
+/// A wait in progress, for state machines: start it, then check it each pass.
+class Deadline
+{
+public:
+    void start(unsigned long nowUs, unsigned long durationUs)
+    {
+        when_ = nowUs + durationUs;
+        active_ = true;
+    }
+
+    void cancel() { active_ = false; }
+
+    /// True if not started, or if the time has come.
+    bool expired(unsigned long nowUs) const { return !active_ || timeReached(nowUs, when_); }
+
+private:
+    unsigned long when_ = 0;
+    bool active_ = false;
+};
+
+using TaskFunction = void (*)();
+
+template <size_t Capacity>
+class Scheduler
+{
+public:
+    /// Run @p task every @p periodUs, or every pass if 0.
+    /// @return a task id for cancel(), or -1 if the table is full.
+    int every(unsigned long periodUs, TaskFunction task, unsigned long nowUs)
+    {
+        return add(task, periodUs, nowUs + periodUs, true);
+    }
+
+    /// Run @p task once, @p delayUs from now.
+    int after(unsigned long delayUs, TaskFunction task, unsigned long nowUs)
+    {
+        return add(task, 0, nowUs + delayUs, false);
+    }
+
+    /// Swap the function a task runs, keeping its place and timing.
+    void replace(int id, TaskFunction task)
+    {
+        if (id >= 0 && size_t(id) < Capacity && tasks_[id].task)
+        {
+            tasks_[id].task = task;
+        }
+    }
+
+    void cancel(int id)
+    {
+        if (id >= 0 && size_t(id) < Capacity)
+        {
+            tasks_[id].task = nullptr;
+        }
+    }
+
+    /// Run each task that is due, in the order they were added.
+    /// @return how many ran.
+    size_t run(unsigned long nowUs)
+    {
+        size_t ran = 0;
+        for (Task &t : tasks_)
+        {
+            if (!t.task || !timeReached(nowUs, t.due))
+            {
+                continue;
+            }
+            TaskFunction task = t.task;
+            if (t.repeat)
+            {
+                // Keep to the period, but if we fell a whole period behind,
+                // skip ahead rather than running several times to catch up.
+                t.due += t.periodUs;
+                if (timeReached(nowUs, t.due))
+                {
+                    t.due = nowUs + t.periodUs;
+                }
+            }
+            else
+            {
+                t.task = nullptr;
+            }
+            task();
+            ran++;
+        }
+        return ran;
+    }
+
+private:
+    struct Task
+    {
+        TaskFunction task = nullptr;
+        unsigned long periodUs = 0;
+        unsigned long due = 0;
+        bool repeat = false;
+    };
+
+    int add(TaskFunction task, unsigned long periodUs, unsigned long due, bool repeat)
+    {
+        for (size_t i = 0; i < Capacity; ++i)
+        {
+            if (!tasks_[i].task)
+            {
+                tasks_[i] = {task, periodUs, due, repeat};
+                return static_cast<int>(i);
+            }
+        }
+        return -1;
+    }
+
+    Task tasks_[Capacity];
+};
@@ -0,0 +1,164 @@
+// Copyright 2021, Collabora, Ltd.
+// SPDX-License-Identifier: BSL-1.0
+// Original Author: Ryan Pavlik
+//
+// Fixed-capacity containers that never allocate, for the firmware:
+//
+// - StaticVector: like std::vector, but the storage is inside it.
+// - CircularWindow: the most recent N values, pushing over the oldest in
+//   O(1), indexed oldest first.
+// - SpscRing: a queue from one producer to one consumer (say, an interrupt
+//   handler and the main loop) without locks or disabling interrupts.
+//
+// Capacities are template parameters, so everything is sized at compile
+// time. Operations that can't fit return false rather than failing.
+
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+template <typename T, size_t N>
+class StaticVector
+{
+public:
+    static constexpr size_t Capacity = N;
+
+    bool push_back(T const &value)
+    {
+        if (size_ == N)
+        {
+            return false;
+        }
+        data_[size_++] = value;
+        return true;
+    }
+
+    void pop_back() { size_--; }
+    void clear() { size_ = 0; }
+
+    size_t size() const { return size_; }
+    static constexpr size_t capacity() { return N; }
+    bool empty() const { return size_ == 0; }
+    bool full() const { return size_ == N; }
+
+    T &operator[](size_t i) { return data_[i]; }
+    T const &operator[](size_t i) const { return data_[i]; }
+    T &back() { return data_[size_ - 1]; }
+
+    T *data() { return data_; }
+    T *begin() { return data_; }
+    T *end() { return data_ + size_; }
+    T const *begin() const { return data_; }
+    T const *end() const { return data_ + size_; }
+
+private:
+    T data_[N]{};
+    size_t size_ = 0;
+};
+
+template <typename T, size_t N>
+class CircularWindow
+{
+public:
+    static constexpr size_t Capacity = N;
+
+    /// Add the newest value, dropping the oldest if full.
+    void push(T const &value)
+    {
+        if (size_ < N)
+        {
+            data_[wrap(start_ + size_)] = value;
+            size_++;
+        }
+        else
+        {
+            data_[start_] = value;
+            start_ = wrap(start_ + 1);
+        }
+    }
+
+    /// Forget the oldest @p count values.
+    void dropOldest(size_t count)
+    {
+        if (count > size_)
+        {
+            count = size_;
+        }
+        start_ = wrap(start_ + count);
+        size_ -= count;
+    }
+
+    void clear()
+    {
+        start_ = 0;
+        size_ = 0;
+    }
+
+    size_t size() const { return size_; }
+    static constexpr size_t capacity() { return N; }
+    bool empty() const { return size_ == 0; }
+    bool full() const { return size_ == N; }
+
+    /// Index 0 is the oldest.
+    T &operator[](size_t i) { return data_[wrap(start_ + i)]; }
+    T const &operator[](size_t i) const { return data_[wrap(start_ + i)]; }
+    T &newest() { return (*this)[size_ - 1]; }
+
+private:
+    // Indices are at most 2N - 1, so no need for %.
+    static size_t wrap(size_t i) { return i >= N ? i - N : i; }
+
+    T data_[N]{};
+    size_t start_ = 0;
+    size_t size_ = 0;
+};
+
+/// N must be a power of two. Holds up to N values.
+template <typename T, size_t N>
+class SpscRing
+{
+    static_assert(N > 0 && (N & (N - 1)) == 0, "SpscRing size must be a power of two");
+
+public:
+    static constexpr size_t Capacity = N;
+
+    /// Producer side. @return false if full: the value is dropped.
+    bool push(T const &value)
+    {
+        uint32_t head = head_.load(std::memory_order_relaxed);
+        if (head - tail_.load(std::memory_order_acquire) == N)
+        {
+            return false;
+        }
+        data_[head & (N - 1)] = value;
+        // Publish the value before the index that makes it visible.
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    /// Consumer side. @return false if empty.
+    bool pop(T &out)
+    {
+        uint32_t tail = tail_.load(std::memory_order_relaxed);
+        if (head_.load(std::memory_order_acquire) == tail)
+        {
+            return false;
+        }
+        out = data_[tail & (N - 1)];
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /// Either side: a snapshot, which may be stale by the time it's used.
+    size_t size() const { return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire); }
+    bool empty() const { return size() == 0; }
+    static constexpr size_t capacity() { return N; }
+
+private:
+    T data_[N]{};
+    // Free-running counts of values pushed and popped: they wrap together.
+    std::atomic<uint32_t> head_{0};
+    std::atomic<uint32_t> tail_{0};
+};
@@ -0,0 +1,398 @@
+// Copyright 2021, Collabora, Ltd.
+// SPDX-License-Identifier: BSL-1.0
+// Original Author: Ryan Pavlik
+//
+// Compact binary encoding of the log sample stream: "dv1", or "dv2" which
+// adds the accelerometer.
+//
+// Samples are grouped into packets of up to StreamEncoder::MaxPacketSamples:
+//
+//     0xA5 0x5A          sync
+//     seq                packet sequence number, u8, for spotting drops
+//     count              number of samples, u8
+//     length             payload bytes, varint
+//     payload
+//     crc                CRC-16/CCITT-FALSE of seq through payload, u16 LE
+//
+// The first sample in each payload is a keyframe: timestamp, gyro,
+// brightness (and accel) as varints. The rest are deltas from the sample
+// before: zig-zag varints of the change in timestamp delta (nearly constant),
+// and of the change in each other channel. Every packet starts with a
+// keyframe, so a decoder that loses bytes resyncs at the next packet.
+//
+// Gyro and accel values are quantized to sensor counts, so we lose nothing:
+// on the LSM9DS1 at 245dps, one count is 8.75 millidegrees per second, and at
+// 2g, one count is 0.061 milli-g.
+
+#pragma once
+
+#include "crc16.h"
+#include "logSample.h"
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+
+constexpr const char *STREAM_CODEC_NAME = "dv1";
+constexpr const char *STREAM_CODEC_ACCEL_NAME = "dv2";
+constexpr float STREAM_CODEC_GYRO_COUNTS_PER_RAD_S = 1.0f / (0.00875f * 0.017453292519943295f);
+constexpr float STREAM_CODEC_ACCEL_COUNTS_PER_M_S2 = 1.0f / (0.061e-3f * 9.80665f);
+
+namespace stream_codec
+{
+    constexpr uint8_t Sync0 = 0xa5;
+    constexpr uint8_t Sync1 = 0x5a;
+
+    static inline uint32_t zigzag(int32_t v)
+    {
+        return (static_cast<uint32_t>(v) << 1) ^ static_cast<uint32_t>(v >> 31);
+    }
+
+    static inline int32_t unzigzag(uint32_t v)
+    {
+        return static_cast<int32_t>(v >> 1) ^ -static_cast<int32_t>(v & 1);
+    }
+
+    static inline uint8_t *putVarint(uint8_t *out, uint32_t v)
+    {
+        while (v >= 0x80)
+        {
+            *out++ = static_cast<uint8_t>(v | 0x80);
+            v >>= 7;
+        }
+        *out++ = static_cast<uint8_t>(v);
+        return out;
+    }
+
+    /// Returns nullptr if the varint runs past @p end or is too long.
+    static inline const uint8_t *getVarint(const uint8_t *in, const uint8_t *end, uint32_t *v)
+    {
+        uint32_t result = 0;
+        for (int shift = 0; shift < 35 && in != end; shift += 7)
+        {
+            uint8_t byte = *in++;
+            result |= static_cast<uint32_t>(byte & 0x7f) << shift;
+            if ((byte & 0x80) == 0)
+            {
+                *v = result;
+                return in;
+            }
+        }
+        return nullptr;
+    }
+
+    // Everything but the timestamp: gyro x, y, z, brightness, accel x, y, z
+    constexpr size_t MaxChannels = 7;
+    constexpr size_t BaseChannels = 4;
+
+    struct Quantized
+    {
+        uint32_t us;
+        int32_t channels[MaxChannels];
+    };
+
+    static inline Quantized quantize(LogSample const &sample)
+    {
+        auto q = [](float value, float scale) { return static_cast<int32_t>(lroundf(value * scale)); };
+        return {sample.us,
+                {q(sample.gyro[0], STREAM_CODEC_GYRO_COUNTS_PER_RAD_S),
+                 q(sample.gyro[1], STREAM_CODEC_GYRO_COUNTS_PER_RAD_S),
+                 q(sample.gyro[2], STREAM_CODEC_GYRO_COUNTS_PER_RAD_S),
+                 sample.brightness,
+                 q(sample.accel[0], STREAM_CODEC_ACCEL_COUNTS_PER_M_S2),
+                 q(sample.accel[1], STREAM_CODEC_ACCEL_COUNTS_PER_M_S2),
+                 q(sample.accel[2], STREAM_CODEC_ACCEL_COUNTS_PER_M_S2)}};
+    }
+
+    static inline LogSample dequantize(Quantized const &q)
+    {
+        LogSample sample{q.us, {}, static_cast<uint16_t>(q.channels[3]), {}};
+        for (int i = 0; i < 3; ++i)
+        {
+            sample.gyro[i] = q.channels[i] / STREAM_CODEC_GYRO_COUNTS_PER_RAD_S;
+            sample.accel[i] = q.channels[BaseChannels + i] / STREAM_CODEC_ACCEL_COUNTS_PER_M_S2;
+        }
+        return sample;
+    }
+} // namespace stream_codec
+
+class StreamEncoder
+{
+public:
+    static constexpr size_t MaxPacketSamples = 16;
+    // Worst case is every field at its longest varint.
+    static constexpr size_t MaxSampleBytes = 5 * (1 + stream_codec::MaxChannels);
+    static constexpr size_t MaxPacketBytes = 2 + 1 + 1 + 2 + MaxPacketSamples * MaxSampleBytes + 2;
+
+    explicit StreamEncoder(bool withAccel = false)
+        : channels_(withAccel ? stream_codec::MaxChannels : stream_codec::BaseChannels)
+    {
+    }
+
+    const char *name() const
+    {
+        return channels_ == stream_codec::BaseChannels ? STREAM_CODEC_NAME : STREAM_CODEC_ACCEL_NAME;
+    }
+
+    /**
+     * @brief Add a sample.
+     *
+     * @return true if that filled a packet, now in data()/size() until the
+     * next call to add() or flush().
+     */
+    bool add(LogSample const &sample)
+    {
+        using namespace stream_codec;
+        if (count_ == 0)
+        {
+            // We build the payload after room for the longest header,
+            // and put the header right in front of it in flush().
+            payloadEnd_ = payload();
+            size_ = 0;
+        }
+        Quantized q = quantize(sample);
+        uint8_t *out = payloadEnd_;
+        if (count_ == 0)
+        {
+            out = putVarint(out, q.us);
+            for (size_t i = 0; i < channels_; ++i)
+            {
+                out = putVarint(out, zigzag(q.channels[i]));
+            }
+            prevDt_ = 0;
+        }
+        else
+        {
+            int32_t dt = static_cast<int32_t>(q.us - prev_.us);
+            out = putVarint(out, zigzag(dt - prevDt_));
+            for (size_t i = 0; i < channels_; ++i)
+            {
+                out = putVarint(out, zigzag(q.channels[i] - prev_.channels[i]));
+            }
+            prevDt_ = dt;
+        }
+        payloadEnd_ = out;
+        prev_ = q;
+        count_++;
+        if (count_ == MaxPacketSamples)
+        {
+            return flush();
+        }
+        return false;
+    }
+
+    /**
+     * @brief Finish a partial packet.
+     *
+     * @return true if there was anything to finish, now in data()/size().
+     */
+    bool flush()
+    {
+        using namespace stream_codec;
+        if (count_ == 0)
+        {
+            return false;
+        }
+        const size_t payloadLen = payloadEnd_ - payload();
+        uint8_t lengthBytes[5];
+        const size_t lengthLen = putVarint(lengthBytes, payloadLen) - lengthBytes;
+
+        // Header goes right before the payload
+        start_ = payload() - (4 + lengthLen);
+        uint8_t *out = start_;
+        *out++ = Sync0;
+        *out++ = Sync1;
+        *out++ = seq_++;
+        *out++ = static_cast<uint8_t>(count_);
+        for (size_t i = 0; i < lengthLen; ++i)
+        {
+            *out++ = lengthBytes[i];
+        }
+        uint16_t crc = crc16Update(CRC16_INIT, start_ + 2, (payloadEnd_ - start_) - 2);
+        payloadEnd_[0] = static_cast<uint8_t>(crc & 0xff);
+        payloadEnd_[1] = static_cast<uint8_t>(crc >> 8);
+        size_ = payloadEnd_ + 2 - start_;
+        count_ = 0;
+        return true;
+    }
+
+    const uint8_t *data() const { return start_; }
+    size_t size() const { return size_; }
+
+private:
+    // Room for the longest header we use: sync, seq, count, 2-byte length.
+    uint8_t *payload() { return buffer_ + 6; }
+
+    uint8_t buffer_[MaxPacketBytes];
+    uint8_t *start_ = buffer_;
+    uint8_t *payloadEnd_ = buffer_ + 6;
+    size_t size_ = 0;
+    size_t count_ = 0;
+    size_t channels_;
+    uint8_t seq_ = 0;
+    int32_t prevDt_ = 0;
+    stream_codec::Quantized prev_{};
+};
+
+/// Decodes a stream from StreamEncoder, skipping anything that isn't a
+/// valid packet (such as text, or a packet that lost bytes).
+class StreamDecoder
+{
+public:
+    explicit StreamDecoder(bool withAccel = false)
+        : channels_(withAccel ? stream_codec::MaxChannels : stream_codec::BaseChannels)
+    {
+    }
+
+    /// Feed bytes in; @p onSample is called with each decoded LogSample.
+    template <typename F>
+    void feed(const uint8_t *data, size_t len, F &&onSample)
+    {
+        for (size_t i = 0; i < len; ++i)
+        {
+            if (pending_ == sizeof(buffer_))
+            {
+                // Can't be a packet: drop a byte and look for sync again.
+                skip(1);
+            }
+            buffer_[pending_++] = data[i];
+            parse(onSample);
+        }
+    }
+
+    /// Packets that arrived intact
+    size_t packets() const { return packets_; }
+    /// Packets missing between the ones we got, by sequence number
+    size_t droppedPackets() const { return dropped_; }
+    /// Bytes that were not part of a valid packet
+    size_t skippedBytes() const { return skipped_; }
+
+private:
+    template <typename F>
+    void parse(F &onSample)
+    {
+        using namespace stream_codec;
+        while (pending_ > 0)
+        {
+            if (buffer_[0] != Sync0 || (pending_ > 1 && buffer_[1] != Sync1))
+            {
+                skip(1);
+                continue;
+            }
+            if (pending_ < 5)
+            {
+                return;
+            }
+            const uint8_t *end = buffer_ + pending_;
+            uint32_t payloadLen = 0;
+            const uint8_t *payload = getVarint(buffer_ + 4, end, &payloadLen);
+            if (!payload)
+            {
+                if (pending_ >= 4 + 5)
+                {
+                    // Longer than any varint: not a real packet
+                    skip(1);
+                    continue;
+                }
+                return;
+            }
+            const size_t total = (payload - buffer_) + payloadLen + 2;
+            if (total > sizeof(buffer_))
+            {
+                skip(1);
+                continue;
+            }
+            if (pending_ < total)
+            {
+                return;
+            }
+            uint16_t crc = crc16Update(CRC16_INIT, buffer_ + 2, total - 4);
+            if ((buffer_[total - 2] | (buffer_[total - 1] << 8)) != crc ||
+                !decodePayload(buffer_[3], payload, payload + payloadLen, onSample))
+            {
+                skip(1);
+                continue;
+            }
+            uint8_t seq = buffer_[2];
+            if (packets_ > 0)
+            {
+                dropped_ += static_cast<uint8_t>(seq - lastSeq_ - 1);
+            }
+            lastSeq_ = seq;
+            packets_++;
+            discard(total);
+        }
+    }
+
+    template <typename F>
+    bool decodePayload(size_t count, const uint8_t *in, const uint8_t *end, F &onSample)
+    {
+        using namespace stream_codec;
+        // Decode it all first, so a bad packet produces no samples.
+        LogSample samples[StreamEncoder::MaxPacketSamples];
+        if (count == 0 || count > StreamEncoder::MaxPacketSamples)
+        {
+            return false;
+        }
+        Quantized q{};
+        int32_t dt = 0;
+        for (size_t s = 0; s < count; ++s)
+        {
+            uint32_t fields[1 + MaxChannels]{};
+            for (size_t f = 0; f < 1 + channels_; ++f)
+            {
+                in = getVarint(in, end, &fields[f]);
+                if (!in)
+                {
+                    return false;
+                }
+            }
+            if (s == 0)
+            {
+                q.us = fields[0];
+            }
+            else
+            {
+                dt += unzigzag(fields[0]);
+                q.us += dt;
+            }
+            for (size_t i = 0; i < channels_; ++i)
+            {
+                q.channels[i] = (s == 0 ? 0 : q.channels[i]) + unzigzag(fields[1 + i]);
+            }
+            samples[s] = dequantize(q);
+        }
+        if (in != end)
+        {
+            return false;
+        }
+        for (size_t s = 0; s < count; ++s)
+        {
+            onSample(samples[s]);
+        }
+        return true;
+    }
+
+    void skip(size_t n)
+    {
+        skipped_ += n;
+        discard(n);
+    }
+
+    void discard(size_t n)
+    {
+        for (size_t i = n; i < pending_; ++i)
+        {
+            buffer_[i - n] = buffer_[i];
+        }
+        pending_ -= n;
+    }
+
+    uint8_t buffer_[StreamEncoder::MaxPacketBytes];
+    size_t pending_ = 0;
+    size_t packets_ = 0;
+    size_t dropped_ = 0;
+    size_t skipped_ = 0;
+    size_t channels_;
+    uint8_t lastSeq_ = 0;
+};
@@ -0,0 +1,76 @@
+// Copyright 2021, Collabora, Ltd.
+// SPDX-License-Identifier: BSL-1.0
+// Original Author: Ryan Pavlik
+
+#include "tests.h"
+
+#include <unity.h>
+#include <appRegistry.h>
+
+class Board
+{
+};
+
+static const char *lastSetup = nullptr;
+static const char *lastRun = nullptr;
+
+template <bool Enabled, size_t MemoryBytes>
+struct FakeApp
+{
+    static constexpr bool enabled = Enabled;
+    static constexpr size_t memoryBytes = MemoryBytes;
+    static const char *const name;
+    static void setup() { lastSetup = name; }
+    static void loop(Board &) {}
+    static bool command(Board &, const char *command) { return command[0] == name[0]; }
+};
+
+using AppA = FakeApp<true, 100>;
+using AppB = FakeApp<false, 5000>;
+using AppC = FakeApp<true, 300>;
+template <>
+const char *const AppA::name = "alpha";
+template <>
+const char *const AppB::name = "bravo";
+template <>
+const char *const AppC::name = "charlie";
+
+template <typename App>
+struct Recorder
+{
+    static void run() { lastRun = App::name; }
+};
+
+using Apps = EnabledApps<AppA, AppB, AppC>;
+
+void test_registry_filters()
+{
+    TEST_ASSERT_EQUAL(2, Apps::count);
+    // The disabled app's memory doesn't count.
+    TEST_ASSERT_EQUAL(300, Apps::memoryBytes);
+    TEST_ASSERT_EQUAL_STRING("alpha", Apps::name(0));
+    TEST_ASSERT_EQUAL_STRING("charlie", Apps::name(1));
+    TEST_ASSERT_EQUAL(0, EnabledApps<AppB>::count);
+}
+
+void test_registry_dispatch()
+{
+    TEST_ASSERT_EQUAL(1, Apps::find("charlie"));
+    TEST_ASSERT_EQUAL(-1, Apps::find("bravo"));
+    TEST_ASSERT_EQUAL(-1, Apps::find("char"));
+
+    Apps::setup(1);
+    TEST_ASSERT_EQUAL_STRING("charlie", lastSetup);
+    Apps::wrapped<Recorder>(0)();
+    TEST_ASSERT_EQUAL_STRING("alpha", lastRun);
+
+    Board board;
+    TEST_ASSERT_TRUE(Apps::command(1, board, "cal"));
+    TEST_ASSERT_FALSE(Apps::command(0, board, "cal"));
+}
+
+void runAppRegistryTests()
+{
+    RUN_TEST(test_registry_filters);
+    RUN_TEST(test_registry_dispatch);
+}
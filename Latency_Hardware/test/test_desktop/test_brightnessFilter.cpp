@@ -0,0 +1,237 @@
+// Copyright 2021, Collabora, Ltd.
+// SPDX-License-Identifier: BSL-1.0
+// Original Author: Ryan Pavlik
+
+#include "tests.h"
+
+#include <unity.h>
+#include <brightnessFilter.h>
+
+#include <math.h>
+#include <random>
+
+void test_iir_kernel_matches_reference()
+{
+    std::mt19937 rng(1234);
+    std::uniform_int_distribution<int32_t> value(0, 65535 << brightness_filter::StateShift);
+    std::uniform_int_distribution<int> alpha(1, 32767);
+    for (int i = 0; i < 100000; ++i)
+    {
+        int32_t state = value(rng);
+        int32_t input = value(rng);
+        int16_t a = static_cast<int16_t>(alpha(rng));
+        TEST_ASSERT_EQUAL(brightness_filter::iirStepReference(state, input, a),
+                          brightness_filter::iirStep(state, input, a));
+    }
+}
+
+void test_iir_settles_and_lags_ramp()
+{
+    BrightnessFilter filter;
+    TEST_ASSERT_TRUE(filter.configure(FILTER_IIR, 8192));
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, 3.f, filter.groupDelaySamples());
+
+    // A step settles on the new value: no offset.
+    unsigned long t = 0;
+    filter.update(1000, t);
+    int out = 0;
+    for (int i = 0; i < 200; ++i)
+    {
+        out = filter.update(2000, t += 100);
+    }
+    TEST_ASSERT_EQUAL(2000, out);
+
+    // A ramp comes out the group delay behind.
+    const int slope = 64;
+    int input = 2000;
+    for (int i = 0; i < 200; ++i)
+    {
+        input += slope;
+        out = filter.update(input, t += 100);
+    }
+    TEST_ASSERT_INT_WITHIN(2, input - 3 * slope, out);
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 100.f, filter.meanIntervalUs());
+}
+
+void test_filter_restarts_after_gap()
+{
+    BrightnessFilter filter;
+    TEST_ASSERT_TRUE(filter.configure(FILTER_IIR, 8192));
+    unsigned long t = 0;
+    for (int i = 0; i < 50; ++i)
+    {
+        filter.update(1000, t += 100);
+    }
+    // Half a second unread, as when the onset test waits out a burst: no
+    // stale state, and no long interval in the average.
+    t += 500000;
+    TEST_ASSERT_EQUAL(3000, filter.update(3000, t));
+    TEST_ASSERT_EQUAL(3000, filter.update(3000, t += 100));
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 100.f, filter.meanIntervalUs());
+}
+
+/// Mean time from a brightness step to when the onset test's check sees it,
+/// less the filter's crossing delay: jittered sample times, the step
+/// anywhere between two samples, a little noise.
+static double meanStepError(BrightnessFilterKind kind, int param, int step)
+{
+    BrightnessFilter filter;
+    if (kind != FILTER_NONE)
+    {
+        TEST_ASSERT_TRUE(filter.configure(kind, param));
+    }
+    const int rawThreshold = 20;
+    int threshold = filter.scaleThreshold(rawThreshold);
+    std::mt19937 rng(99);
+    std::uniform_int_distribution<unsigned long> interval(80, 120);
+    std::normal_distribution<float> noise(0.f, 1.f);
+    auto sample = [&](int level) { return level + static_cast<int>(lroundf(noise(rng))); };
+
+    double sum = 0;
+    int count = 0;
+    unsigned long t = 0;
+    for (int run = 0; run < 400; ++run)
+    {
+        int out = 0;
+        for (int i = 0; i < 400; ++i)
+        {
+            out = filter.update(sample(1000), t += interval(rng));
+        }
+        int initial = out;
+        filter.markLevel();
+        unsigned long stepUs = t + interval(rng);
+        for (int i = 0; i < 200; ++i)
+        {
+            t += interval(rng);
+            out = filter.update(sample(t >= stepUs ? 1000 + step : 1000), t);
+            if (t >= stepUs && abs(out - initial) > threshold)
+            {
+                unsigned long seen = t - filter.crossingDelayUs();
+                sum += static_cast<double>(static_cast<long>(seen - stepUs));
+                count++;
+                break;
+            }
+        }
+    }
+    TEST_ASSERT_EQUAL(400, count);
+    return sum / count;
+}
+
+void test_step_crossing_has_no_bias()
+{
+    // Unfiltered, a step is seen at the first sample after it: on average
+    // half an interval later.
+    double raw = meanStepError(FILTER_NONE, 0, 100);
+    TEST_ASSERT_FLOAT_WITHIN(10.f, 50.f, static_cast<float>(raw));
+
+    // Filtered and corrected, the same on average, whatever the threshold
+    // is next to the step. (The DC group delay would take 15 samples off
+    // for the slow IIR, where the crossing comes 0 to 3 samples late.)
+    const struct
+    {
+        BrightnessFilterKind kind;
+        int param;
+        int step;
+    } cases[] = {
+        {FILTER_IIR, 8192, 100}, {FILTER_IIR, 2048, 100}, {FILTER_IIR, 2048, 40}, {FILTER_IIR, 2048, 20},
+        {FILTER_MEDIAN, 3, 100}, {FILTER_MEDIAN, 5, 40},
+    };
+    for (auto const &c : cases)
+    {
+        double filtered = meanStepError(c.kind, c.param, c.step);
+        TEST_ASSERT_FLOAT_WITHIN(10.f, static_cast<float>(raw), static_cast<float>(filtered));
+    }
+}
+
+void test_turn_delay()
+{
+    // A ramp that reverses: the output turns tau * ln 2 samples late, not
+    // the tau it lags the ramp by.
+    BrightnessFilter filter;
+    TEST_ASSERT_TRUE(filter.configure(FILTER_IIR, 2048));
+    unsigned long t = 0;
+    int input = 100000;
+    for (int i = 0; i < 400; ++i)
+    {
+        filter.update(input -= 100, t += 100);
+    }
+    int lowest = filter.update(input, t += 100);
+    unsigned long lowestUs = t;
+    for (int i = 0; i < 100; ++i)
+    {
+        int out = filter.update(input += 100, t += 100);
+        if (out < lowest)
+        {
+            lowest = out;
+            lowestUs = t;
+        }
+    }
+    unsigned long turnUs = t - 100 * 100;
+    TEST_ASSERT_INT_WITHIN(100, static_cast<long>(lowestUs - turnUs), static_cast<long>(filter.turnDelayUs()));
+
+    TEST_ASSERT_TRUE(filter.configure(FILTER_MEDIAN, 5));
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, 2.f, filter.turnDelaySamples());
+}
+
+void test_median_rejects_spikes_and_delays_steps()
+{
+    BrightnessFilter filter;
+    TEST_ASSERT_FALSE(filter.configure(FILTER_MEDIAN, 4));
+    TEST_ASSERT_TRUE(filter.configure(FILTER_MEDIAN, 5));
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, 2.f, filter.groupDelaySamples());
+
+    unsigned long t = 0;
+    TEST_ASSERT_EQUAL(100, filter.update(100, t += 50));
+    TEST_ASSERT_EQUAL(100, filter.update(900, t += 50));
+    TEST_ASSERT_EQUAL(100, filter.update(5, t += 50));
+    for (int i = 0; i < 5; ++i)
+    {
+        TEST_ASSERT_EQUAL(100, filter.update(100, t += 50));
+    }
+
+    // A step comes through whole, (5 - 1) / 2 samples late.
+    TEST_ASSERT_EQUAL(100, filter.update(500, t += 50));
+    TEST_ASSERT_EQUAL(100, filter.update(500, t += 50));
+    TEST_ASSERT_EQUAL(500, filter.update(500, t += 50));
+
+    TEST_ASSERT_TRUE(filter.configure(FILTER_MEDIAN, 3));
+    TEST_ASSERT_EQUAL(100, filter.update(100, t += 50));
+    TEST_ASSERT_EQUAL(100, filter.update(500, t += 50));
+    TEST_ASSERT_EQUAL(500, filter.update(500, t += 50));
+}
+
+void test_filter_noise_and_threshold()
+{
+    BrightnessFilter filter;
+    TEST_ASSERT_EQUAL(5, filter.scaleThreshold(5));
+    TEST_ASSERT_EQUAL(0, filter.crossingDelayUs());
+    TEST_ASSERT_EQUAL(0, filter.turnDelayUs());
+
+    filter.configure(FILTER_IIR, 8192);
+    std::mt19937 rng(42);
+    std::normal_distribution<float> noise(0.f, 20.f);
+    double sumSq = 0;
+    const int count = 20000;
+    unsigned long t = 0;
+    filter.update(30000, t);
+    for (int i = 0; i < count; ++i)
+    {
+        int out = filter.update(30000 + static_cast<int>(lroundf(noise(rng))), t += 100);
+        sumSq += double(out - 30000) * (out - 30000);
+    }
+    float gain = static_cast<float>(sqrt(sumSq / count)) / 20.f;
+    TEST_ASSERT_FLOAT_WITHIN(0.05f, filter.noiseGain(), gain);
+    TEST_ASSERT_TRUE(filter.scaleThreshold(5) < 5);
+    TEST_ASSERT_TRUE(filter.scaleThreshold(1) >= 1);
+}
+
+void runBrightnessFilterTests()
+{
+    RUN_TEST(test_iir_kernel_matches_reference);
+    RUN_TEST(test_iir_settles_and_lags_ramp);
+    RUN_TEST(test_filter_restarts_after_gap);
+    RUN_TEST(test_step_crossing_has_no_bias);
+    RUN_TEST(test_turn_delay);
+    RUN_TEST(test_median_rejects_spikes_and_delays_steps);
+    RUN_TEST(test_filter_noise_and_threshold);
+}
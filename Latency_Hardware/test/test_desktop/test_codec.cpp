@@ -0,0 +1,177 @@
+// Copyright 2021, Collabora, Ltd.
+// SPDX-License-Identifier: BSL-1.0
+// Original Author: Ryan Pavlik
+
+#include "tests.h"
+
+#include <unity.h>
+#include <streamCodec.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+// Something like a slow rotation at about 950Hz
+static std::vector<LogSample> makeSamples(size_t count)
+{
+    std::vector<LogSample> samples(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        auto &s = samples[i];
+        s.us = static_cast<uint32_t>(4000000000UL + i * 1052 + (i % 3));
+        float t = i / 950.0f;
+        s.gyro[0] = 0.01f * sinf(t);
+        s.gyro[1] = 1.5f * sinf(2 * t);
+        s.gyro[2] = -0.02f;
+        s.brightness = static_cast<uint16_t>(30000 + 20000 * sinf(2 * t - 0.3f));
+        s.accel[0] = 0.5f * sinf(3 * t);
+        s.accel[1] = 0.1f;
+        s.accel[2] = 9.81f + 0.2f * sinf(t);
+    }
+    return samples;
+}
+
+static std::vector<uint8_t> encode(std::vector<LogSample> const &samples, bool withAccel = false)
+{
+    std::vector<uint8_t> out;
+    StreamEncoder encoder{withAccel};
+    auto append = [&] { out.insert(out.end(), encoder.data(), encoder.data() + encoder.size()); };
+    for (auto &s : samples)
+    {
+        if (encoder.add(s))
+        {
+            append();
+        }
+    }
+    if (encoder.flush())
+    {
+        append();
+    }
+    return out;
+}
+
+static std::vector<LogSample> decode(std::vector<uint8_t> const &bytes, StreamDecoder &decoder)
+{
+    std::vector<LogSample> out;
+    decoder.feed(bytes.data(), bytes.size(), [&](LogSample const &s) { out.push_back(s); });
+    return out;
+}
+
+static void checkSame(LogSample const &expected, LogSample const &actual, bool withAccel = false)
+{
+    TEST_ASSERT_EQUAL_UINT32(expected.us, actual.us);
+    for (int i = 0; i < 3; ++i)
+    {
+        // within half a sensor count
+        TEST_ASSERT_FLOAT_WITHIN(0.5f / STREAM_CODEC_GYRO_COUNTS_PER_RAD_S, expected.gyro[i], actual.gyro[i]);
+    }
+    TEST_ASSERT_EQUAL(expected.brightness, actual.brightness);
+    for (int i = 0; i < 3; ++i)
+    {
+        if (withAccel)
+        {
+            // within half a count, plus float rounding near 1g
+            TEST_ASSERT_FLOAT_WITHIN(0.501f / STREAM_CODEC_ACCEL_COUNTS_PER_M_S2, expected.accel[i], actual.accel[i]);
+        }
+        else
+        {
+            TEST_ASSERT_EQUAL_FLOAT(0.f, actual.accel[i]);
+        }
+    }
+}
+
+void test_zigzag(void)
+{
+    using namespace stream_codec;
+    TEST_ASSERT_EQUAL_UINT32(0, zigzag(0));
+    TEST_ASSERT_EQUAL_UINT32(1, zigzag(-1));
+    TEST_ASSERT_EQUAL_UINT32(2, zigzag(1));
+    for (int32_t v : {0, 1, -1, 63, -64, 1000000, -1000000, INT32_MAX, INT32_MIN})
+    {
+        TEST_ASSERT_EQUAL(v, unzigzag(zigzag(v)));
+    }
+}
+
+void test_codec_roundtrip(void)
+{
+    // Not a multiple of the packet size, so we flush a partial one too.
+    auto samples = makeSamples(1000);
+    auto bytes = encode(samples);
+    StreamDecoder decoder;
+    auto decoded = decode(bytes, decoder);
+    TEST_ASSERT_EQUAL(samples.size(), decoded.size());
+    for (size_t i = 0; i < samples.size() && i < decoded.size(); ++i)
+    {
+        checkSame(samples[i], decoded[i]);
+    }
+    TEST_ASSERT_EQUAL(0, decoder.droppedPackets());
+    TEST_ASSERT_EQUAL(0, decoder.skippedBytes());
+}
+
+void test_codec_accel_roundtrip(void)
+{
+    auto samples = makeSamples(1000);
+    auto bytes = encode(samples, true);
+    StreamDecoder decoder{true};
+    auto decoded = decode(bytes, decoder);
+    TEST_ASSERT_EQUAL(samples.size(), decoded.size());
+    for (size_t i = 0; i < samples.size() && i < decoded.size(); ++i)
+    {
+        checkSame(samples[i], decoded[i], true);
+    }
+    TEST_ASSERT_EQUAL(0, decoder.droppedPackets());
+}
+
+void test_codec_ratio(void)
+{
+    auto samples = makeSamples(1024);
+    auto bytes = encode(samples);
+    size_t csvBytes = 0;
+    for (auto &s : samples)
+    {
+        // What motionLog.cpp sends
+        char line[64];
+        csvBytes += snprintf(line, sizeof(line), "%lu,%.2f,%.2f,%.2f,%u\r\n", static_cast<unsigned long>(s.us),
+                             s.gyro[0], s.gyro[1], s.gyro[2], s.brightness);
+    }
+    char msg[80];
+    snprintf(msg, sizeof(msg), "%.2f bytes/sample encoded vs %.2f CSV", bytes.size() / 1024.0, csvBytes / 1024.0);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_TRUE(bytes.size() * 3 < csvBytes);
+}
+
+void test_codec_resync(void)
+{
+    auto samples = makeSamples(160);
+    auto bytes = encode(samples);
+    // Text in front, like startup messages
+    const char *text = "latency_hardware_firmware motion log test\r\n";
+    bytes.insert(bytes.begin(), text, text + strlen(text));
+    // Lose a few bytes out of the third packet
+    size_t packetStart = 0;
+    for (int found = 0; found < 3; ++packetStart)
+    {
+        if (bytes[packetStart] == stream_codec::Sync0 && bytes[packetStart + 1] == stream_codec::Sync1)
+        {
+            found++;
+        }
+    }
+    bytes.erase(bytes.begin() + packetStart + 10, bytes.begin() + packetStart + 13);
+
+    StreamDecoder decoder;
+    auto decoded = decode(bytes, decoder);
+    TEST_ASSERT_EQUAL(samples.size() - StreamEncoder::MaxPacketSamples, decoded.size());
+    TEST_ASSERT_EQUAL(1, decoder.droppedPackets());
+    // The packet after the damage decodes fine
+    checkSame(samples[3 * StreamEncoder::MaxPacketSamples], decoded[2 * StreamEncoder::MaxPacketSamples]);
+    checkSame(samples.back(), decoded.back());
+}
+
+void runCodecTests()
+{
+    RUN_TEST(test_zigzag);
+    RUN_TEST(test_codec_roundtrip);
+    RUN_TEST(test_codec_accel_roundtrip);
+    RUN_TEST(test_codec_ratio);
+    RUN_TEST(test_codec_resync);
+}
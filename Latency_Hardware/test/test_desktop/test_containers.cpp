@@ -0,0 +1,129 @@
+// Copyright 2021, Collabora, Ltd.
+// SPDX-License-Identifier: BSL-1.0
+// Original Author: Ryan Pavlik
+
+#include "tests.h"
+
+#include <unity.h>
+#include <staticContainers.h>
+
+#include <thread>
+
+void test_static_vector()
+{
+    StaticVector<int, 4> vec;
+    TEST_ASSERT_TRUE(vec.empty());
+    for (int i = 0; i < 4; ++i)
+    {
+        TEST_ASSERT_TRUE(vec.push_back(i * 10));
+    }
+    TEST_ASSERT_TRUE(vec.full());
+    TEST_ASSERT_FALSE(vec.push_back(40));
+    TEST_ASSERT_EQUAL(4, vec.size());
+    int sum = 0;
+    for (int value : vec)
+    {
+        sum += value;
+    }
+    TEST_ASSERT_EQUAL(60, sum);
+    vec.pop_back();
+    TEST_ASSERT_EQUAL(20, vec.back());
+    vec.clear();
+    TEST_ASSERT_TRUE(vec.empty());
+}
+
+void test_circular_window()
+{
+    CircularWindow<int, 4> window;
+    for (int i = 0; i < 3; ++i)
+    {
+        window.push(i);
+    }
+    TEST_ASSERT_EQUAL(3, window.size());
+    TEST_ASSERT_EQUAL(0, window[0]);
+    TEST_ASSERT_EQUAL(2, window.newest());
+    // Wrap around: oldest are dropped.
+    for (int i = 3; i < 10; ++i)
+    {
+        window.push(i);
+    }
+    TEST_ASSERT_TRUE(window.full());
+    for (int i = 0; i < 4; ++i)
+    {
+        TEST_ASSERT_EQUAL(6 + i, window[i]);
+    }
+    window.dropOldest(3);
+    TEST_ASSERT_EQUAL(1, window.size());
+    TEST_ASSERT_EQUAL(9, window[0]);
+    window.push(10);
+    TEST_ASSERT_EQUAL(10, window.newest());
+    window.dropOldest(100);
+    TEST_ASSERT_TRUE(window.empty());
+}
+
+void test_spsc_ring()
+{
+    SpscRing<int, 4> ring;
+    int out = -1;
+    TEST_ASSERT_FALSE(ring.pop(out));
+    for (int i = 0; i < 4; ++i)
+    {
+        TEST_ASSERT_TRUE(ring.push(i));
+    }
+    TEST_ASSERT_FALSE(ring.push(4));
+    TEST_ASSERT_EQUAL(4, ring.size());
+    // Keep going past the index wrapping many times.
+    for (int i = 4; i < 1000; ++i)
+    {
+        TEST_ASSERT_TRUE(ring.pop(out));
+        TEST_ASSERT_EQUAL(i - 4, out);
+        TEST_ASSERT_TRUE(ring.push(i));
+    }
+    TEST_ASSERT_EQUAL(4, ring.size());
+}
+
+void test_spsc_ring_threads()
+{
+    // One thread standing in for the interrupt handler, one for the loop.
+    static SpscRing<uint32_t, 64> ring;
+    const uint32_t count = 200000;
+    std::thread producer([&] {
+        for (uint32_t i = 0; i < count;)
+        {
+            if (ring.push(i))
+            {
+                ++i;
+            }
+            else
+            {
+                std::this_thread::yield();
+            }
+        }
+    });
+    uint32_t expected = 0;
+    bool inOrder = true;
+    while (expected < count)
+    {
+        uint32_t value;
+        if (ring.pop(value))
+        {
+            inOrder = inOrder && value == expected;
+            ++expected;
+        }
+        else
+        {
+            std::this_thread::yield();
+        }
+    }
+    producer.join();
+    TEST_ASSERT_TRUE(inOrder);
+    TEST_ASSERT_TRUE(ring.empty());
+}
+
+void runContainerTests()
+{
+    RUN_TEST(test_static_vector);
+    RUN_TEST(test_circular_window);
+    RUN_TEST(test_spsc_ring);
+    RUN_TEST(test_spsc_ring_threads);
+}
@@ -0,0 +1,47 @@
+// Copyright 2021, Collabora, Ltd.
+// SPDX-License-Identifier: BSL-1.0
+// Original Author: Ryan Pavlik
+//
+// Reading command lines from the host, and when they arrived.
+
+#include "tests.h"
+
+#include <Arduino.h>
+#include <hostCommands.h>
+#include <unity.h>
+
+void test_command_received_time()
+{
+    HostCommandReader reader;
+    // Arrives over two polls: the time is from the first.
+    Serial.sendInput("pi");
+    unsigned long started = micros();
+    TEST_ASSERT_NULL(reader.poll());
+    delay(5);
+    Serial.sendInput("ng 3\r\n");
+    const char *command = reader.poll();
+    TEST_ASSERT_NOT_NULL(command);
+    TEST_ASSERT_EQUAL_STRING("ping 3", command);
+    TEST_ASSERT_INT_WITHIN(100, started, reader.receivedUs());
+
+    // The next one gets its own.
+    delay(5);
+    unsigned long next = micros();
+    Serial.sendInput("status off\n");
+    TEST_ASSERT_EQUAL_STRING("status off", reader.poll());
+    TEST_ASSERT_INT_WITHIN(100, next, reader.receivedUs());
+}
+
+void test_match_command()
+{
+    TEST_ASSERT_EQUAL_STRING("3", matchCommand("ping  3", "ping"));
+    TEST_ASSERT_EQUAL_STRING("", matchCommand("ping", "ping"));
+    TEST_ASSERT_NULL(matchCommand("pinged", "ping"));
+    TEST_ASSERT_NULL(matchCommand("status", "ping"));
+}
+
+void runHostCommandTests()
+{
+    RUN_TEST(test_command_received_time);
+    RUN_TEST(test_match_command);
+}
@@ -0,0 +1,166 @@
+// Copyright 2021, Collabora, Ltd.
+// SPDX-License-Identifier: BSL-1.0
+// Original Author: Ryan Pavlik
+//
+// What the threshold sweep is built from: scoring against the truth, the
+// work-stealing queues, and thresholds that can be changed on the host.
+
+#include "tests.h"
+
+// Must come before Arduino because of abs
+#include <Eigen/Core>
+#include <apps.h>
+
+#include <Arduino.h>
+#include <captureFile.h>
+#include <defines.h>
+#include <detectorThresholds.h>
+#include <latencyScore.h>
+#include <simulator.h>
+#include <stealingQueues.h>
+#include <syntheticCapture.h>
+#include <unity.h>
+
+#include <atomic>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+void test_score_matching()
+{
+    std::vector<TruthEvent> truth = {{1000000, 20000}, {3000000, 20000}, {5000000, 20000}};
+    // Two right, a bit late; one far from anything; none for the last.
+    std::vector<Detection> detections = {{1025000, 24000}, {3022000, 22000}, {4000000, 20000}};
+    LatencyScore score = scoreLatencies(truth, detections);
+    TEST_ASSERT_EQUAL_INT(3, score.events);
+    TEST_ASSERT_EQUAL_INT(3, score.detections);
+    TEST_ASSERT_EQUAL_INT(2, score.matched);
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 3000.f, static_cast<float>(score.biasUs()));
+    TEST_ASSERT_FLOAT_WITHIN(0.1f, 1414.2f, static_cast<float>(score.errorStddevUs()));
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, 1.f / 3, static_cast<float>(score.missRate()));
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, 1.f / 3, static_cast<float>(score.falseRate()));
+
+    // Each true event only matches once.
+    std::vector<Detection> twice = {{1020000, 20000}, {1021000, 20000}};
+    score = scoreLatencies(truth, twice);
+    TEST_ASSERT_EQUAL_INT(1, score.matched);
+
+    // Adding up captures is the same as scoring them together.
+    LatencyScore total = scoreLatencies(truth, detections);
+    total.add(scoreLatencies(truth, detections));
+    TEST_ASSERT_EQUAL_INT(6, total.events);
+    TEST_ASSERT_EQUAL_INT(4, total.matched);
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 3000.f, static_cast<float>(total.biasUs()));
+}
+
+void test_stealing_queues()
+{
+    // More tasks than one worker would get, with one worker doing none of
+    // its own: every task still runs, once.
+    constexpr size_t workers = 4;
+    constexpr size_t tasks = 1000;
+    StealingQueues *queues = StealingQueues::create(workers, tasks);
+    TEST_ASSERT_NOT_NULL(queues);
+    void *shared = mmap(nullptr, tasks * sizeof(std::atomic<int>), PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    TEST_ASSERT_TRUE(shared != MAP_FAILED);
+    auto *runs = static_cast<std::atomic<int> *>(shared);
+    for (size_t i = 0; i < tasks; ++i)
+    {
+        new (&runs[i]) std::atomic<int>{0};
+    }
+    std::vector<pid_t> pids;
+    for (size_t worker = 1; worker < workers; ++worker)
+    {
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            size_t task;
+            while (queues->next(worker, task))
+            {
+                runs[task]++;
+            }
+            _exit(0);
+        }
+        pids.push_back(pid);
+    }
+    for (pid_t pid : pids)
+    {
+        waitpid(pid, nullptr, 0);
+    }
+    size_t task;
+    TEST_ASSERT_FALSE(queues->next(0, task));
+    int wrong = 0;
+    for (size_t i = 0; i < tasks; ++i)
+    {
+        wrong += runs[i] != 1;
+    }
+    TEST_ASSERT_EQUAL_INT(0, wrong);
+    munmap(shared, tasks * sizeof(std::atomic<int>));
+    StealingQueues::destroy(queues);
+}
+
+static std::vector<long> runOnset(SyntheticConfig const &config)
+{
+    std::vector<RecordedSample> samples;
+    SyntheticCapture capture{config};
+    RecordedSample sample;
+    while (!capture.done())
+    {
+        capture.next(sample);
+        samples.push_back(sample);
+    }
+    simulator().configure(SimulatorConfig{});
+    simulator().replay(std::move(samples));
+    resetAnalog();
+    onsetSetup();
+    Board board;
+    while (!simulator().replayDone())
+    {
+        onsetLoop(board);
+    }
+    return numberLines(Serial.takeOutput());
+}
+
+void test_thresholds_tunable()
+{
+    SyntheticConfig config;
+    for (int i = 0; i < 3; ++i)
+    {
+        config.profile.push_back(MotionSegment::still(1500000));
+        config.profile.push_back(MotionSegment::rotate(300000, 1, (i % 2) ? -2.f : 2.f));
+    }
+    TEST_ASSERT_EQUAL_INT(3, runOnset(config).size());
+
+    // More of a change than the display can make: nothing.
+    detectorThresholds().brightnessChange = 2000;
+    std::vector<long> none = runOnset(config);
+    detectorThresholds() = DetectorThresholds{};
+    TEST_ASSERT_EQUAL_INT(0, none.size());
+    TEST_ASSERT_EQUAL_INT(BRIGHTNESS_CHANGE_THRESHOLD, detectorThresholds().brightnessChange);
+}
+
+void test_turnaround_truth()
+{
+    SyntheticConfig config;
+    config.display.refreshHz = 0;
+    config.profile.push_back(MotionSegment::still(1000000));
+    config.profile.push_back(MotionSegment::oscillate(2000000, 1, 3.f, 1000000));
+    std::vector<TruthEvent> truth = SyntheticCapture::truth(config);
+    // It starts, then turns around every half period, but not at the end.
+    TEST_ASSERT_EQUAL_INT(4, truth.size());
+    for (size_t i = 0; i < truth.size(); ++i)
+    {
+        TEST_ASSERT_EQUAL_UINT32(1000000u + 500000u * i, truth[i].motionUs);
+        TEST_ASSERT_EQUAL_INT(20000, truth[i].latencyUs);
+    }
+}
+
+void runLatencyScoreTests()
+{
+    RUN_TEST(test_score_matching);
+    RUN_TEST(test_stealing_queues);
+    RUN_TEST(test_thresholds_tunable);
+    RUN_TEST(test_turnaround_truth);
+}
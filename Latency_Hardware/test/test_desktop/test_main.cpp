@@ -0,0 +1,29 @@
+// Copyright 2021, Collabora, Ltd.
+// SPDX-License-Identifier: BSL-1.0
+// Original Author: Ryan Pavlik
+
+#include "tests.h"
+
+#include <unity.h>
+
+int main()
+{
+    UNITY_BEGIN();
+    runReduceTests();
+    runRefreshTests();
+    runCodecTests();
+    runRecordStoreTests();
+    runSchedulerTests();
+    runAppRegistryTests();
+    runContainerTests();
+    runBrightnessFilterTests();
+    runNumericPolicyTests();
+    runSimulatorTests();
+    runSyntheticCaptureTests();
+    runLatencyScoreTests();
+    runMemoryUsageTests();
+    runHostCommandTests();
+    UNITY_END();
+
+    return 0;
+}
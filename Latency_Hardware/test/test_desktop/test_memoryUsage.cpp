@@ -0,0 +1,67 @@
+// Copyright 2021, Collabora, Ltd.
+// SPDX-License-Identifier: BSL-1.0
+// Original Author: Ryan Pavlik
+//
+// Stack painting, and the heap counters.
+
+#include "tests.h"
+
+#include <memoryUsage.h>
+#include <unity.h>
+
+#include <stdlib.h>
+
+void test_stack_paint()
+{
+    uint32_t stack[64];
+    stackPaint(stack, stack + 64);
+    TEST_ASSERT_EQUAL_INT(0, stackPaintUsed(stack, stack + 64));
+    // Grows down: the top 10 words used, and one deeper down, so the
+    // deepest counts even if what's between happens to match the paint.
+    stack[63] = 1;
+    stack[54] = 2;
+    stack[40] = 0;
+    TEST_ASSERT_EQUAL_INT(24 * 4, stackPaintUsed(stack, stack + 64));
+    stack[0] = 3;
+    TEST_ASSERT_EQUAL_INT(64 * 4, stackPaintUsed(stack, stack + 64));
+}
+
+#ifdef WANT_HEAP_STATS
+// So the compiler can't leave out a malloc and free that cancel out.
+static void *volatile kept;
+
+void test_heap_counters()
+{
+    HeapCounters &h = heapCounters();
+    uint32_t allocs = h.allocs;
+    uint32_t frees = h.frees;
+    size_t bytes = h.bytes;
+
+    kept = malloc(1000);
+    TEST_ASSERT_NOT_NULL(kept);
+    TEST_ASSERT_EQUAL_INT(allocs + 1, h.allocs);
+    TEST_ASSERT_TRUE(h.bytes >= bytes + 1000);
+    TEST_ASSERT_TRUE(h.peakBytes >= h.bytes);
+    kept = realloc(kept, 4000);
+    TEST_ASSERT_TRUE(h.bytes >= bytes + 4000);
+    free(kept);
+    TEST_ASSERT_EQUAL_INT(frees + 1, h.frees);
+    TEST_ASSERT_EQUAL_INT(bytes, h.bytes);
+
+    // After setup, they're counted (and fail, with NO_STEADY_HEAP).
+    uint32_t steady = h.steadyAllocs;
+    heapSteadyState();
+    kept = malloc(16);
+    h.steady = false;
+    free(kept);
+    TEST_ASSERT_EQUAL_INT(steady + 1, h.steadyAllocs);
+}
+#endif
+
+void runMemoryUsageTests()
+{
+    RUN_TEST(test_stack_paint);
+#ifdef WANT_HEAP_STATS
+    RUN_TEST(test_heap_counters);
+#endif
+}
@@ -0,0 +1,118 @@
+// Copyright 2021, Collabora, Ltd.
+// SPDX-License-Identifier: BSL-1.0
+// Original Author: Ryan Pavlik
+
+#include "tests.h"
+
+#include <unity.h>
+#include <numericPolicy.h>
+#include <Eigen/Core>
+#include <gyroProc.h>
+
+#include <random>
+#include <vector>
+
+// Thresholds convert at compile time.
+static_assert(FloatPolicy::fromRadPerSec(0.5f) == 0.5f, "float is rad/s");
+static_assert(CountsPolicy::fromRadPerSec(0.5f) == 3274, "8.75 mdps per count");
+static_assert(Q15Policy::fromRadPerSec(0.5f) == 3832, "q15 of 245 dps");
+static_assert(Q15Policy::fromRadPerSec(100.f) == 32767, "q15 saturates");
+static_assert(Q15Policy::fromRadPerSec(-100.f) == -32767, "q15 saturates, symmetric");
+static_assert(Q15Policy::subtract(30000, -10000) == 32767, "q15 subtraction saturates");
+static_assert(Q15Policy::subtract(-30000, 10000) == -32767, "q15 subtraction saturates, symmetric");
+static_assert(Q15Policy::subtract(30000, 10000) == 20000, "q15 subtraction");
+
+template <typename Policy>
+static void checkRoundTrip(float lsb)
+{
+    for (float v = -4.f; v <= 4.f; v += 0.01f)
+    {
+        TEST_ASSERT_FLOAT_WITHIN(lsb, v, Policy::toRadPerSec(Policy::fromRadPerSec(v)));
+    }
+}
+
+void test_policy_round_trip()
+{
+    checkRoundTrip<FloatPolicy>(0.f);
+    checkRoundTrip<CountsPolicy>(numeric_policy::GyroRadPerSecPerCount);
+    checkRoundTrip<Q15Policy>(numeric_policy::GyroFullScaleRadPerSec / 32768.f);
+}
+
+void test_policy_sign_and_rounding()
+{
+    TEST_ASSERT_EQUAL(0, CountsPolicy::fromRadPerSec(0.f));
+    TEST_ASSERT_EQUAL(-CountsPolicy::fromRadPerSec(0.3f), CountsPolicy::fromRadPerSec(-0.3f));
+    TEST_ASSERT_EQUAL(-Q15Policy::fromRadPerSec(0.3f), Q15Policy::fromRadPerSec(-0.3f));
+    // Half a count rounds away from zero.
+    TEST_ASSERT_EQUAL(1, CountsPolicy::fromRadPerSec(numeric_policy::GyroRadPerSecPerCount * 0.51f));
+    TEST_ASSERT_EQUAL(0, CountsPolicy::fromRadPerSec(numeric_policy::GyroRadPerSecPerCount * 0.49f));
+}
+
+void test_q15_zero_rate_saturates()
+{
+    // Near full scale one way, with a zero rate the other: in int16 this
+    // would wrap around to a large rate the wrong way.
+    BasicGyroProc<Q15Policy> proc;
+    proc.setZeroRate(Vector3f{-1.f, 1.f, 0.f});
+    sensors_event_t event{};
+    event.gyro.v[0] = 4.2f;
+    event.gyro.v[1] = -4.2f;
+    event.gyro.v[2] = 0.5f;
+    auto result = proc.process(event);
+    TEST_ASSERT_TRUE(result.first);
+    TEST_ASSERT_EQUAL(32767, result.second[0]);
+    TEST_ASSERT_EQUAL(-32767, result.second[1]);
+    TEST_ASSERT_EQUAL(Q15Policy::fromRadPerSec(0.5f), result.second[2]);
+}
+
+// What the gyro pipeline does per sample: take off the zero rate, then check
+// against a threshold, as GyroProc::process() and moving() do. Returns how
+// many of them count as moving.
+template <typename Policy>
+static size_t countMoving(std::vector<Eigen::Vector3f> const &input)
+{
+    using Proc = BasicGyroProc<Policy>;
+    using Vector = typename Proc::Vector;
+    const Vector zeroRate = Proc::fromRadPerSec(Eigen::Vector3f{0.01f, -0.02f, 0.005f});
+    constexpr typename Policy::Scalar threshold = Policy::fromRadPerSec(0.5f);
+    size_t movingCount = 0;
+    for (auto const &v : input)
+    {
+        Vector processed = Proc::subtract(Proc::fromRadPerSec(v), zeroRate);
+        movingCount += (processed.array().abs() > threshold).any() ? 1 : 0;
+    }
+    return movingCount;
+}
+
+void test_policies_agree_on_moving()
+{
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> half(-0.5f, 0.5f);
+    std::uniform_real_distribution<float> fast(0.6f, 3.f);
+    std::vector<Eigen::Vector3f> input;
+    // Half still, half moving on some axis.
+    for (int i = 0; i < 10000; ++i)
+    {
+        Eigen::Vector3f v{half(rng) * 0.5f, half(rng) * 0.5f, half(rng) * 0.5f};
+        if (i % 2)
+        {
+            v[i % 3] = (i % 4 == 1) ? fast(rng) : -fast(rng);
+        }
+        input.push_back(v);
+    }
+    // The same samples count as moving whatever the representation, bar
+    // those right at the threshold.
+    int expected = static_cast<int>(input.size() / 2);
+    int tolerance = static_cast<int>(input.size() / 100);
+    TEST_ASSERT_INT_WITHIN(tolerance, expected, static_cast<int>(countMoving<FloatPolicy>(input)));
+    TEST_ASSERT_INT_WITHIN(tolerance, expected, static_cast<int>(countMoving<CountsPolicy>(input)));
+    TEST_ASSERT_INT_WITHIN(tolerance, expected, static_cast<int>(countMoving<Q15Policy>(input)));
+}
+
+void runNumericPolicyTests()
+{
+    RUN_TEST(test_policy_round_trip);
+    RUN_TEST(test_policy_sign_and_rounding);
+    RUN_TEST(test_q15_zero_rate_saturates);
+    RUN_TEST(test_policies_agree_on_moving);
+}
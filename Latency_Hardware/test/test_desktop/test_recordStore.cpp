@@ -0,0 +1,132 @@
+// Copyright 2021, Collabora, Ltd.
+// SPDX-License-Identifier: BSL-1.0
+// Original Author: Ryan Pavlik
+
+#include "tests.h"
+
+#include <unity.h>
+#include <recordStore.h>
+#include <string.h>
+
+// Two pages of RAM behaving like NOR flash: writes can only clear bits.
+struct FakeFlash
+{
+    static constexpr size_t PageSize = 256;
+    uint8_t pages[2][PageSize];
+    int erases[2] = {0, 0};
+    // If >= 0, only write this many words, as if power was lost.
+    int tornAfterWords = -1;
+
+    FakeFlash() { memset(pages, 0xff, sizeof(pages)); }
+
+    size_t pageSize() const { return PageSize; }
+    const uint8_t *page(int index) const { return pages[index]; }
+    void erase(int index)
+    {
+        memset(pages[index], 0xff, PageSize);
+        erases[index]++;
+    }
+    void write(int index, size_t offset, const uint32_t *words, size_t count)
+    {
+        for (size_t i = 0; i < count && (tornAfterWords < 0 || int(i) < tornAfterWords); ++i)
+        {
+            uint32_t current;
+            memcpy(&current, &pages[index][offset + i * 4], 4);
+            current &= words[i];
+            memcpy(&pages[index][offset + i * 4], &current, 4);
+        }
+    }
+};
+
+struct TestValue
+{
+    int32_t a;
+    float b[3];
+    uint8_t c;
+};
+
+using TestStore = RecordStore<TestValue, FakeFlash>;
+static constexpr uint32_t MAGIC = 0x54455354;
+
+void test_store_empty(void)
+{
+    FakeFlash flash;
+    TestStore store{flash, MAGIC};
+    TestValue value;
+    TEST_ASSERT_FALSE(store.load(&value));
+}
+
+void test_store_roundtrip(void)
+{
+    FakeFlash flash;
+    TestStore store{flash, MAGIC};
+    TEST_ASSERT_TRUE(store.save({42, {1.5f, -2.f, 3.f}, 7}));
+    TEST_ASSERT_TRUE(store.save({43, {0.f, 0.f, 0.f}, 8}));
+    // A fresh store on the same flash, like after a reboot
+    TestStore reloaded{flash, MAGIC};
+    TestValue value;
+    TEST_ASSERT_TRUE(reloaded.load(&value));
+    TEST_ASSERT_EQUAL(43, value.a);
+    TEST_ASSERT_EQUAL(8, value.c);
+    TEST_ASSERT_EQUAL(0, flash.erases[0] + flash.erases[1]);
+}
+
+void test_store_wear_levelling(void)
+{
+    FakeFlash flash;
+    TestStore store{flash, MAGIC};
+    const int saves = 1000;
+    for (int i = 0; i < saves; ++i)
+    {
+        TEST_ASSERT_TRUE(store.save({i, {}, 0}));
+    }
+    TestValue value;
+    TEST_ASSERT_TRUE(store.load(&value));
+    TEST_ASSERT_EQUAL(saves - 1, value.a);
+    // One erase per page-full of saves, shared between the pages
+    int slots = static_cast<int>(store.slotsPerPage());
+    TEST_ASSERT_EQUAL(8, slots);
+    TEST_ASSERT_INT_WITHIN(1, saves / slots, flash.erases[0] + flash.erases[1]);
+    TEST_ASSERT_INT_WITHIN(1, flash.erases[0], flash.erases[1]);
+}
+
+void test_store_torn_write(void)
+{
+    FakeFlash flash;
+    TestStore store{flash, MAGIC};
+    TEST_ASSERT_TRUE(store.save({1, {}, 0}));
+    flash.tornAfterWords = 3;
+    TEST_ASSERT_FALSE(store.save({2, {}, 0}));
+    TestValue value;
+    TEST_ASSERT_TRUE(store.load(&value));
+    TEST_ASSERT_EQUAL(1, value.a);
+    // The torn slot is skipped next time
+    flash.tornAfterWords = -1;
+    TEST_ASSERT_TRUE(store.save({3, {}, 0}));
+    TEST_ASSERT_TRUE(store.load(&value));
+    TEST_ASSERT_EQUAL(3, value.a);
+}
+
+void test_store_other_magic(void)
+{
+    FakeFlash flash;
+    TestStore store{flash, MAGIC};
+    TEST_ASSERT_TRUE(store.save({1, {}, 0}));
+    TestStore newer{flash, MAGIC + 1};
+    TestValue value;
+    TEST_ASSERT_FALSE(newer.load(&value));
+    TEST_ASSERT_TRUE(newer.save({2, {}, 0}));
+    TEST_ASSERT_TRUE(newer.load(&value));
+    TEST_ASSERT_EQUAL(2, value.a);
+    store.clear();
+    TEST_ASSERT_FALSE(store.load(&value));
+}
+
+void runRecordStoreTests()
+{
+    RUN_TEST(test_store_empty);
+    RUN_TEST(test_store_roundtrip);
+    RUN_TEST(test_store_wear_levelling);
+    RUN_TEST(test_store_torn_write);
+    RUN_TEST(test_store_other_magic);
+}
@@ -2,10 +2,16 @@
 // SPDX-License-Identifier: BSL-1.0
 // Original Author: Ryan Pavlik
 
+#include "tests.h"
+
 #include <unity.h>
 #include <numeric>
 #include <pairwiseReduce.h>
+#include <Eigen/Core>
 #include <array>
+#include <list>
+#include <math.h>
+#include <random>
 #include <vector>
 
 const std::array<int, 8> baseVals = {1, 2, 3, 4, 5, 6, 7, 8};
@@ -22,13 +28,76 @@ void test_floats(void)
     TEST_ASSERT_EQUAL(simpleSum, pairwiseReduce(vals.begin(), vals.end()));
 }
 
+void test_any_length(void)
+{
+    std::vector<int> vals;
+    for (int n = 0; n < 200; ++n)
+    {
+        int expected = std::accumulate(vals.begin(), vals.end(), 0);
+        TEST_ASSERT_EQUAL(expected, pairwiseSum(vals.begin(), vals.end()));
+        TEST_ASSERT_EQUAL(expected, kahanSum(vals.begin(), vals.end()));
+        std::vector<int> copy = vals;
+        TEST_ASSERT_EQUAL(expected, pairwiseReduce(copy.begin(), copy.end()));
+        vals.push_back(n * 3 - 50);
+    }
+    // Not random access, too.
+    std::list<int> list{vals.begin(), vals.end()};
+    TEST_ASSERT_EQUAL(std::accumulate(vals.begin(), vals.end(), 0), pairwiseSum(list.begin(), list.end()));
+}
 
-int main(int argc, char **argv)
+void test_sum_leaves_input(void)
+{
+    std::vector<float> vals{baseVals.begin(), baseVals.end()};
+    std::vector<float> copy = vals;
+    TEST_ASSERT_EQUAL(simpleSum, pairwiseSum(vals.begin(), vals.end()));
+    TEST_ASSERT_EQUAL(simpleSum, kahanSum(vals.begin(), vals.end()));
+    TEST_ASSERT_TRUE(vals == copy);
+}
+
+void test_eigen_vectors(void)
+{
+    std::vector<Eigen::Vector3f> vals;
+    for (int i = 0; i < 37; ++i)
+    {
+        vals.emplace_back(float(i), float(-2 * i), 0.5f);
+    }
+    Eigen::Vector3f expected{666.f, -1332.f, 18.5f};
+    TEST_ASSERT_TRUE(pairwiseSum(vals.begin(), vals.end()) == expected);
+    TEST_ASSERT_TRUE(kahanSum(vals.begin(), vals.end()) == expected);
+    TEST_ASSERT_TRUE(pairwiseSum(vals.begin(), vals.begin()) == Eigen::Vector3f::Zero());
+}
+
+// Accuracy and speed against std::accumulate: prints, and checks that the
+// new sums do better.
+
+void test_sum_accuracy(void)
+{
+    const size_t count = 1 << 20;
+    std::vector<float> vals(count);
+    std::mt19937 rng(99);
+    // Like gyro readings: small, all about the same size.
+    std::uniform_real_distribution<float> dist(0.f, 0.1f);
+    double exact = 0;
+    for (float &v : vals)
+    {
+        v = dist(rng);
+        exact += v;
+    }
+    auto relativeError = [&](float sum) { return fabs(sum - exact) / exact; };
+    double accumulate = relativeError(std::accumulate(vals.begin(), vals.end(), 0.f));
+    double pairwise = relativeError(pairwiseSum(vals.begin(), vals.end()));
+    double kahan = relativeError(kahanSum(vals.begin(), vals.end()));
+
+    TEST_ASSERT_TRUE(pairwise < accumulate / 10);
+    TEST_ASSERT_TRUE(kahan < 1e-6);
+}
+
+void runReduceTests()
 {
-    UNITY_BEGIN();
     RUN_TEST(test_ints);
     RUN_TEST(test_floats);
-    UNITY_END();
-
-    return 0;
-}
\ No newline at end of file
+    RUN_TEST(test_any_length);
+    RUN_TEST(test_sum_leaves_input);
+    RUN_TEST(test_eigen_vectors);
+    RUN_TEST(test_sum_accuracy);
+}
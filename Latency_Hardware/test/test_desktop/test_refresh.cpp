@@ -0,0 +1,94 @@
+// Copyright 2021, Collabora, Ltd.
+// SPDX-License-Identifier: BSL-1.0
+// Original Author: Ryan Pavlik
+
+#include "tests.h"
+
+#include <unity.h>
+#include <refreshDetect.h>
+#include <math.h>
+#include <stdint.h>
+#include <vector>
+
+static float scratch[2048];
+
+// A display lit for the first fifth of each period, on a slowly rising
+// background, with a little deterministic "noise".
+static std::vector<uint16_t> makeFlicker(float refreshHz, float sampleRateHz, size_t count, float firstPulseUs)
+{
+    std::vector<uint16_t> samples(count);
+    const float periodUs = 1e6f / refreshHz;
+    for (size_t i = 0; i < count; ++i)
+    {
+        float t = i * 1e6f / sampleRateHz;
+        float phase = fmodf(t - firstPulseUs + periodUs, periodUs) / periodUs;
+        float value = 1000 + 0.3f * t / 1000 + (phase < 0.2f ? 800 : 0) + ((i * 7919) % 41) - 20;
+        samples[i] = static_cast<uint16_t>(value);
+    }
+    return samples;
+}
+
+static void checkRefresh(float refreshHz, float sampleRateHz, size_t count)
+{
+    const float firstPulseUs = 3000;
+    auto samples = makeFlicker(refreshHz, sampleRateHz, count, firstPulseUs);
+    auto estimate = estimateRefresh(samples.data(), samples.size(), sampleRateHz, scratch, 2048);
+    TEST_ASSERT_TRUE(estimate.valid);
+    TEST_ASSERT_FLOAT_WITHIN(refreshHz * 0.001f, refreshHz, estimate.frequencyHz);
+    // the fundamental peaks in the middle of the lit part
+    const float periodUs = 1e6f / refreshHz;
+    TEST_ASSERT_FLOAT_WITHIN(50.0f, fmodf(firstPulseUs + 0.1f * periodUs, periodUs), estimate.phaseUs);
+}
+
+void test_refresh_60(void)
+{
+    checkRefresh(60, 20000, 10000);
+}
+
+void test_refresh_120_fast(void)
+{
+    checkRefresh(120, 200000, 80000);
+}
+
+void test_refresh_144(void)
+{
+    checkRefresh(144, 20000, 10000);
+}
+
+void test_refresh_noise(void)
+{
+    std::vector<uint16_t> samples(10000);
+    uint32_t state = 12345;
+    for (auto &sample : samples)
+    {
+        // xorshift32
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        sample = static_cast<uint16_t>(1000 + state % 97);
+    }
+    auto estimate = estimateRefresh(samples.data(), samples.size(), 20000, scratch, 2048);
+    TEST_ASSERT_FALSE(estimate.valid);
+}
+
+void test_time_until_refresh(void)
+{
+    RefreshEstimate estimate;
+    estimate.valid = true;
+    estimate.periodUs = 10000;
+    estimate.phaseUs = 2500;
+    // before the burst started
+    TEST_ASSERT_FLOAT_WITHIN(0.5f, 4500.0f, timeUntilRefresh(estimate, 100000, 98000));
+    // after, including across micros() wrapping
+    TEST_ASSERT_FLOAT_WITHIN(0.5f, 1500.0f, timeUntilRefresh(estimate, 0xffffff00UL, 0xffffff00UL + 11000));
+    TEST_ASSERT_FLOAT_WITHIN(0.5f, 6904.0f, timeUntilRefresh(estimate, 0xfffff000UL, 0xfffff000UL + 0x1000 + 1500));
+}
+
+void runRefreshTests()
+{
+    RUN_TEST(test_refresh_60);
+    RUN_TEST(test_refresh_120_fast);
+    RUN_TEST(test_refresh_144);
+    RUN_TEST(test_refresh_noise);
+    RUN_TEST(test_time_until_refresh);
+}
@@ -0,0 +1,117 @@
+// Copyright 2021, Collabora, Ltd.
+// SPDX-License-Identifier: BSL-1.0
+// Original Author: Ryan Pavlik
+
+#include "tests.h"
+
+#include <unity.h>
+#include <scheduler.h>
+
+static int everyPassRuns = 0;
+static int periodicRuns = 0;
+static int onceRuns = 0;
+
+static void everyPass()
+{
+    everyPassRuns++;
+}
+static void periodic()
+{
+    periodicRuns++;
+}
+static void once()
+{
+    onceRuns++;
+}
+
+static void resetRuns()
+{
+    everyPassRuns = 0;
+    periodicRuns = 0;
+    onceRuns = 0;
+}
+
+void test_scheduler_every_pass()
+{
+    resetRuns();
+    Scheduler<4> scheduler;
+    TEST_ASSERT_EQUAL(0, scheduler.every(0, everyPass, 100));
+    for (unsigned long now = 100; now < 110; ++now)
+    {
+        scheduler.run(now);
+    }
+    TEST_ASSERT_EQUAL(10, everyPassRuns);
+}
+
+void test_scheduler_periodic()
+{
+    resetRuns();
+    Scheduler<4> scheduler;
+    scheduler.every(1000, periodic, 0);
+    scheduler.run(999);
+    TEST_ASSERT_EQUAL(0, periodicRuns);
+    scheduler.run(1000);
+    TEST_ASSERT_EQUAL(1, periodicRuns);
+    // Late, but keeps to the original phase.
+    scheduler.run(2300);
+    scheduler.run(2999);
+    TEST_ASSERT_EQUAL(2, periodicRuns);
+    scheduler.run(3000);
+    TEST_ASSERT_EQUAL(3, periodicRuns);
+    // Far behind: runs once, not once per missed period.
+    scheduler.run(10500);
+    scheduler.run(10600);
+    TEST_ASSERT_EQUAL(4, periodicRuns);
+    scheduler.run(11500);
+    TEST_ASSERT_EQUAL(5, periodicRuns);
+}
+
+void test_scheduler_once_and_cancel()
+{
+    resetRuns();
+    Scheduler<2> scheduler;
+    int onceId = scheduler.after(50, once, 0);
+    int periodicId = scheduler.every(10, periodic, 0);
+    // Table full
+    TEST_ASSERT_EQUAL(-1, scheduler.every(0, everyPass, 0));
+    scheduler.run(100);
+    scheduler.run(200);
+    TEST_ASSERT_EQUAL(1, onceRuns);
+    TEST_ASSERT_EQUAL(2, periodicRuns);
+    scheduler.cancel(periodicId);
+    scheduler.run(300);
+    TEST_ASSERT_EQUAL(2, periodicRuns);
+    // Both slots free again.
+    TEST_ASSERT_EQUAL(onceId, scheduler.every(0, everyPass, 300));
+    TEST_ASSERT_EQUAL(periodicId, scheduler.every(0, everyPass, 300));
+}
+
+void test_scheduler_wraparound()
+{
+    resetRuns();
+    Scheduler<1> scheduler;
+    unsigned long start = 0xfffffc00UL;
+    scheduler.every(2000, periodic, start);
+    scheduler.run(start + 1999);
+    TEST_ASSERT_EQUAL(0, periodicRuns);
+    // micros() has wrapped by now.
+    scheduler.run((start + 2000) & 0xffffffffUL);
+    TEST_ASSERT_EQUAL(1, periodicRuns);
+
+    Deadline wait;
+    TEST_ASSERT_TRUE(wait.expired(0));
+    wait.start(start, 2000);
+    TEST_ASSERT_FALSE(wait.expired(start + 1000));
+    TEST_ASSERT_FALSE(wait.expired((start + 1999) & 0xffffffffUL));
+    TEST_ASSERT_TRUE(wait.expired((start + 2000) & 0xffffffffUL));
+    wait.cancel();
+    TEST_ASSERT_TRUE(wait.expired(start));
+}
+
+void runSchedulerTests()
+{
+    RUN_TEST(test_scheduler_every_pass);
+    RUN_TEST(test_scheduler_periodic);
+    RUN_TEST(test_scheduler_once_and_cancel);
+    RUN_TEST(test_scheduler_wraparound);
+}
@@ -0,0 +1,197 @@
+// Copyright 2021, Collabora, Ltd.
+// SPDX-License-Identifier: BSL-1.0
+// Original Author: Ryan Pavlik
+//
+// The apps themselves, unmodified, against the simulated board.
+
+#include "tests.h"
+
+// Must come before Arduino because of abs
+#include <Eigen/Core>
+#include <apps.h>
+
+#include <Arduino.h>
+#include <captureFile.h>
+#include <defines.h>
+#include <simulator.h>
+#include <unity.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+static Board simBoard;
+
+/// Run @p loop until @p durationUs of virtual time has passed.
+template <typename F>
+static void runFor(unsigned long durationUs, F &&loop)
+{
+    uint64_t end = simulator().nowUs() + durationUs;
+    while (simulator().nowUs() < end)
+    {
+        loop(simBoard);
+    }
+}
+
+void test_sim_clock_and_signals()
+{
+    SimulatorConfig config;
+    config.brightnessNoise = 0;
+    simulator().configure(config);
+    simulator().play({MotionSegment::still(1000), MotionSegment::rotate(100000, 1, 2.f)});
+    uint64_t start = simulator().nowUs();
+    // Half way through the turn: 0.1 rad, so far.
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, 0.1f, simulator().angle(start + 51000, 1));
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, 0.f, simulator().angle(start + 51000, 0));
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, 2.f, simulator().rotationRate(start + 51000, 1));
+    // The display lags by the latency.
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, 0.5f, simulator().trueBrightness(start + 1000 + config.latencyUs));
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, 0.55f, simulator().trueBrightness(start + 51000 + config.latencyUs));
+
+    unsigned long before = micros();
+    delay(5);
+    TEST_ASSERT_INT_WITHIN(2, 5000, micros() - before);
+    runFor(200000, [](Board &) { analogRead(A0); });
+    TEST_ASSERT_TRUE(simulator().profileDone());
+}
+
+void test_sim_onset()
+{
+    SimulatorConfig config;
+    config.latencyUs = 30000;
+    simulator().configure(config);
+    std::vector<MotionSegment> profile;
+    for (int i = 0; i < 6; ++i)
+    {
+        // Still long enough to count as calm, then a sharp turn.
+        profile.push_back(MotionSegment::still(1500000));
+        profile.push_back(MotionSegment::rotate(300000, 1, (i % 2) ? -2.f : 2.f));
+    }
+    simulator().play(profile);
+    resetAnalog();
+    onsetSetup();
+    runFor(static_cast<unsigned long>(simulator().profileEndUs() - simulator().nowUs()), onsetLoop);
+
+    std::vector<long> latencies = numberLines(Serial.takeOutput());
+    TEST_ASSERT_TRUE(latencies.size() >= 4);
+    for (long latency : latencies)
+    {
+        // Detection waits up to an IMU sample, and the brightness takes a
+        // little while to pass the threshold.
+        TEST_ASSERT_INT_WITHIN(2500, 30000, latency);
+    }
+}
+
+void test_sim_turnaround()
+{
+    SimulatorConfig config;
+    config.latencyUs = 40000;
+    simulator().configure(config);
+    // Still, to reset, then back and forth.
+    simulator().play({MotionSegment::still(2500000), MotionSegment::oscillate(12000000, 1, 3.f, 1000000)});
+    resetAnalog();
+    turnaroundSetup();
+    runFor(static_cast<unsigned long>(simulator().profileEndUs() - simulator().nowUs()), turnaroundLoop);
+
+    std::vector<long> latencies = numberLines(Serial.takeOutput());
+    TEST_ASSERT_TRUE(latencies.size() >= 10);
+    std::sort(latencies.begin(), latencies.end());
+    // The gyro counts as settled a little before it turns around, and the
+    // brightness as at its end a little before it does, by amounts that
+    // depend on the thresholds: so results come out somewhat over.
+    TEST_ASSERT_INT_WITHIN(15000, 40000 + 15000, latencies[latencies.size() / 2]);
+}
+
+void test_sim_log()
+{
+    simulator().configure(SimulatorConfig{});
+    simulator().play({MotionSegment::oscillate(200000, 0, 1.f, 100000)});
+    resetAnalog();
+    logSetup();
+    Serial.takeOutput();
+    runFor(100000, logLoop);
+    std::string output = Serial.takeOutput();
+    // About one line per IMU sample, each starting with a timestamp.
+    size_t lines = 0;
+    for (char c : output)
+    {
+        lines += c == '\n';
+    }
+    TEST_ASSERT_INT_WITHIN(5, 100000 / IMU_SAMPLE_INTERVAL_US, lines);
+}
+
+void test_sim_capture_parse()
+{
+    RecordedSample sample;
+    TEST_ASSERT_FALSE(parseCaptureLine("us,drx,dry,drz,brightness", sample));
+    TEST_ASSERT_FALSE(parseCaptureLine(" Hold the device still for 2 seconds.", sample));
+    TEST_ASSERT_FALSE(parseCaptureLine("1234,0.5,-0.25", sample));
+
+    TEST_ASSERT_TRUE(parseCaptureLine("-1050,0.50,-0.25,0.00,612\r\n", sample));
+    // From capture.py's first sample: before it wraps round.
+    TEST_ASSERT_EQUAL_UINT32(0xFFFFFFFFu - 1049u, sample.us);
+    TEST_ASSERT_FLOAT_WITHIN(1e-6f, 0.5f, sample.gyro[0]);
+    TEST_ASSERT_FLOAT_WITHIN(1e-6f, -0.25f, sample.gyro[1]);
+    TEST_ASSERT_EQUAL_INT(612, sample.brightness);
+    TEST_ASSERT_FALSE(sample.hasAccel);
+
+    TEST_ASSERT_TRUE(parseCaptureLine("7,0,0,0,1,0.1,0.2,9.81", sample));
+    TEST_ASSERT_TRUE(sample.hasAccel);
+    TEST_ASSERT_FLOAT_WITHIN(1e-6f, 9.81f, sample.accel[2]);
+    TEST_ASSERT_FALSE(parseCaptureLine("7,0,0,0,1,0.1,0.2", sample));
+}
+
+void test_sim_replay()
+{
+    // Capture with the log app, as capture.py would...
+    SimulatorConfig config;
+    config.latencyUs = 25000;
+    simulator().configure(config);
+    std::vector<MotionSegment> profile;
+    for (int i = 0; i < 4; ++i)
+    {
+        profile.push_back(MotionSegment::still(1500000));
+        profile.push_back(MotionSegment::rotate(300000, 1, (i % 2) ? -2.f : 2.f));
+    }
+    simulator().play(profile);
+    resetAnalog();
+    logSetup();
+    runFor(static_cast<unsigned long>(simulator().profileEndUs() - simulator().nowUs()), logLoop);
+    std::vector<RecordedSample> capture;
+    readCaptureText(Serial.takeOutput(), capture);
+    long expectedSamples = 4 * 1800000 / IMU_SAMPLE_INTERVAL_US;
+    TEST_ASSERT_INT_WITHIN(20, expectedSamples, static_cast<long>(capture.size()));
+    uint32_t firstUs = capture.front().us;
+    size_t recorded = capture.size();
+
+    // ...then run the onset app on the capture, with the rig stopped.
+    simulator().configure(SimulatorConfig{});
+    simulator().replay(std::move(capture));
+    resetAnalog();
+    onsetSetup();
+    while (!simulator().replayDone())
+    {
+        onsetLoop(simBoard);
+    }
+    // On the capture's own clock, to the end of it.
+    long replayedUs = static_cast<long>(simulator().replayMicros() - firstUs);
+    long recordedUs = static_cast<long>((recorded - 1) * IMU_SAMPLE_INTERVAL_US);
+    TEST_ASSERT_INT_WITHIN(recordedUs / 100, recordedUs, replayedUs);
+    std::vector<long> latencies = numberLines(Serial.takeOutput());
+    TEST_ASSERT_TRUE(latencies.size() >= 2);
+    for (long latency : latencies)
+    {
+        // As live, plus up to a sample of the brightness being held.
+        TEST_ASSERT_INT_WITHIN(static_cast<long>(2500 + IMU_SAMPLE_INTERVAL_US), 25000, latency);
+    }
+}
+
+void runSimulatorTests()
+{
+    RUN_TEST(test_sim_clock_and_signals);
+    RUN_TEST(test_sim_onset);
+    RUN_TEST(test_sim_turnaround);
+    RUN_TEST(test_sim_log);
+    RUN_TEST(test_sim_capture_parse);
+    RUN_TEST(test_sim_replay);
+}
@@ -0,0 +1,184 @@
+// Copyright 2021, Collabora, Ltd.
+// SPDX-License-Identifier: BSL-1.0
+// Original Author: Ryan Pavlik
+//
+// The synthetic capture model, and the onset app's scores against its
+// ground truth.
+
+#include "tests.h"
+
+// Must come before Arduino because of abs
+#include <Eigen/Core>
+#include <apps.h>
+
+#include <Arduino.h>
+#include <captureFile.h>
+#include <defines.h>
+#include <simulator.h>
+#include <syntheticCapture.h>
+#include <unity.h>
+
+#include <vector>
+
+static SyntheticConfig onsetConfig(int moves)
+{
+    SyntheticConfig config;
+    for (int i = 0; i < moves; ++i)
+    {
+        config.profile.push_back(MotionSegment::still(1500000));
+        config.profile.push_back(MotionSegment::rotate(300000, 1, (i % 2) ? -2.f : 2.f));
+    }
+    return config;
+}
+
+static std::vector<RecordedSample> generate(SyntheticConfig const &config)
+{
+    std::vector<RecordedSample> samples;
+    SyntheticCapture capture{config};
+    RecordedSample sample;
+    while (!capture.done())
+    {
+        capture.next(sample);
+        samples.push_back(sample);
+    }
+    return samples;
+}
+
+void test_synthetic_truth()
+{
+    SyntheticConfig config = onsetConfig(1);
+    config.startUs = 1000;
+    config.display.refreshHz = 100;
+    config.display.sensorRow = 0.5f;
+    // The frame at 1520000 renders the pose from just before the motion, so
+    // the first one from after it starts at 1530000, and reaches the middle
+    // of the screen half a frame later.
+    std::vector<TruthEvent> truth = SyntheticCapture::truth(config);
+    TEST_ASSERT_EQUAL_INT(1, truth.size());
+    TEST_ASSERT_EQUAL_UINT32(1501000u, truth[0].motionUs);
+    TEST_ASSERT_EQUAL_INT(35000, truth[0].latencyUs);
+
+    config.display.phaseUs = 2500;
+    TEST_ASSERT_EQUAL_INT(25000 + 2500, SyntheticCapture::truth(config)[0].latencyUs);
+    // Without frames, it's just the pipeline.
+    config.display.refreshHz = 0;
+    TEST_ASSERT_EQUAL_INT(20000, SyntheticCapture::truth(config)[0].latencyUs);
+}
+
+void test_synthetic_truth_on_frame()
+{
+    // The motion plus the pipeline lands exactly on a frame: the truth has
+    // to agree with what the simulated display does then.
+    SyntheticConfig config = onsetConfig(1);
+    config.display.refreshHz = 100;
+    config.gyroNoise = 0;
+    config.photodiode.adcNoise = 0;
+    config.profile.push_back(MotionSegment::still(100000));
+    TruthEvent truth = SyntheticCapture::truth(config)[0];
+    TEST_ASSERT_EQUAL_INT(35000, truth.latencyUs);
+
+    std::vector<RecordedSample> samples = generate(config);
+    int initial = samples[0].brightness;
+    uint32_t changedUs = 0;
+    for (RecordedSample const &sample : samples)
+    {
+        if (sample.brightness != initial)
+        {
+            changedUs = sample.us;
+            break;
+        }
+    }
+    long shownUs = static_cast<long>(changedUs - truth.motionUs);
+    TEST_ASSERT_TRUE(shownUs >= static_cast<long>(truth.latencyUs));
+    TEST_ASSERT_TRUE(shownUs <= static_cast<long>(truth.latencyUs + 2 * config.sampleIntervalUs));
+}
+
+void test_synthetic_display()
+{
+    SyntheticConfig config = onsetConfig(1);
+    config.gyroNoise = 0;
+    config.photodiode.adcNoise = 0;
+    // Long enough after for it all to show.
+    config.profile.push_back(MotionSegment::still(100000));
+    std::vector<RecordedSample> samples = generate(config);
+    TEST_ASSERT_EQUAL_INT(1900000 / config.sampleIntervalUs + 1, samples.size());
+    TruthEvent truth = SyntheticCapture::truth(config)[0];
+
+    int initial = samples[0].brightness;
+    TEST_ASSERT_INT_WITHIN(1, 512, initial);
+    uint32_t changedUs = 0;
+    for (RecordedSample const &sample : samples)
+    {
+        if (sample.gyro[1] != 0)
+        {
+            TEST_ASSERT_TRUE(sample.us >= truth.motionUs);
+        }
+        if (!changedUs && sample.brightness != initial)
+        {
+            changedUs = sample.us;
+        }
+    }
+    // Nothing shows before the truth, and it shows within a sample or so
+    // of the pixels starting to respond.
+    long shownUs = static_cast<long>(changedUs - truth.motionUs);
+    TEST_ASSERT_TRUE(shownUs >= static_cast<long>(truth.latencyUs));
+    TEST_ASSERT_TRUE(shownUs <= static_cast<long>(truth.latencyUs + 2 * config.sampleIntervalUs));
+    // Turned 0.6 rad at 0.5 per rad, from half way.
+    TEST_ASSERT_INT_WITHIN(3, 819, samples.back().brightness);
+}
+
+void test_synthetic_seed()
+{
+    SyntheticConfig config = onsetConfig(1);
+    std::vector<RecordedSample> a = generate(config);
+    std::vector<RecordedSample> b = generate(config);
+    config.seed = 2;
+    std::vector<RecordedSample> c = generate(config);
+    bool same = true;
+    bool differs = false;
+    for (size_t i = 0; i < a.size(); ++i)
+    {
+        same = same && a[i].gyro[0] == b[i].gyro[0] && a[i].brightness == b[i].brightness;
+        differs = differs || a[i].gyro[0] != c[i].gyro[0];
+    }
+    TEST_ASSERT_TRUE(same);
+    TEST_ASSERT_TRUE(differs);
+}
+
+void test_synthetic_onset_scores()
+{
+    SyntheticConfig config = onsetConfig(6);
+    config.pipelineLatencyUs = 15000;
+    std::vector<TruthEvent> truth = SyntheticCapture::truth(config);
+
+    simulator().configure(SimulatorConfig{});
+    simulator().replay(generate(config));
+    resetAnalog();
+    onsetSetup();
+    Board board;
+    while (!simulator().replayDone())
+    {
+        onsetLoop(board);
+    }
+    std::vector<long> latencies = numberLines(Serial.takeOutput());
+    TEST_ASSERT_EQUAL_INT(truth.size(), latencies.size());
+    double frameUs = 1e6 / config.display.refreshHz;
+    for (size_t i = 0; i < latencies.size() && i < truth.size(); ++i)
+    {
+        // The first frame to show the motion shows hardly any of it: the
+        // app can't see the change until the next, then it waits for the
+        // pixels to get past its threshold.
+        long error = latencies[i] - static_cast<long>(truth[i].latencyUs);
+        TEST_ASSERT_TRUE(error >= 0);
+        TEST_ASSERT_TRUE(error <= static_cast<long>(frameUs) + 5000);
+    }
+}
+
+void runSyntheticCaptureTests()
+{
+    RUN_TEST(test_synthetic_truth);
+    RUN_TEST(test_synthetic_truth_on_frame);
+    RUN_TEST(test_synthetic_display);
+    RUN_TEST(test_synthetic_seed);
+    RUN_TEST(test_synthetic_onset_scores);
+}
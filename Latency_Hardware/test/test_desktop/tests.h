@@ -0,0 +1,22 @@
+// Copyright 2021, Collabora, Ltd.
+// SPDX-License-Identifier: BSL-1.0
+// Original Author: Ryan Pavlik
+//
+// Each test file provides one of these to run its tests.
+
+#pragma once
+
+void runReduceTests();
+void runRefreshTests();
+void runCodecTests();
+void runRecordStoreTests();
+void runSchedulerTests();
+void runAppRegistryTests();
+void runContainerTests();
+void runBrightnessFilterTests();
+void runNumericPolicyTests();
+void runSimulatorTests();
+void runSyntheticCaptureTests();
+void runLatencyScoreTests();
+void runMemoryUsageTests();
+void runHostCommandTests();
@@ -0,0 +1,485 @@
+// Copyright 2021, Collabora, Ltd.
+// SPDX-License-Identifier: BSL-1.0
+// Original Author: Ryan Pavlik
+//
+// Time the firmware's hot paths, as built for the host, over a few input
+// sizes:
+//
+//     bench [--filter TEXT] [--min-time MS] [--compare old.csv [--tolerance FRACTION]]
+//
+// Output is CSV on stdout: the benchmark, its input size, and nanoseconds
+// per item (a sample, an element summed, a value pushed). Each is the best
+// of several timed runs, each long enough to time reliably. Save the output
+// for one version and --compare the next against it: that adds the old
+// time and the change, and exits with 1 if anything got slower by more
+// than the tolerance (0.1, for 10%).
+//
+// The host isn't the board, so compare host numbers with host numbers: this
+// is for seeing what a change does, not how long the board takes.
+
+// Must come before Arduino because of abs
+#include <Eigen/Core>
+#include "apps.h"
+
+#include <Arduino.h>
+#include "defines.h"
+#include "gyroProc.h"
+#include "logSample.h"
+#include "motionShared.h"
+#include "numericPolicy.h"
+#include "pairwiseReduce.h"
+#include "staticContainers.h"
+#include "streamCodec.h"
+
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace
+{
+/// Keep the compiler from optimizing away what's being timed.
+template <typename T>
+inline void keep(T const &value)
+{
+    asm volatile("" : : "m"(value) : "memory");
+}
+
+struct Benchmark
+{
+    std::string name;
+    size_t size;
+    /// Items processed by one call to run.
+    size_t items;
+    std::function<void()> run;
+};
+
+/// Random but repeatable inputs.
+std::mt19937 &rng()
+{
+    static std::mt19937 generator{1};
+    return generator;
+}
+
+std::vector<float> randomFloats(size_t count)
+{
+    std::uniform_real_distribution<float> dist{-1.f, 1.f};
+    std::vector<float> values(count);
+    for (float &v : values)
+    {
+        v = dist(rng());
+    }
+    return values;
+}
+
+/// Rates like the gyro reads: mostly still, sometimes moving.
+std::vector<Vector3f> randomRates(size_t count)
+{
+    std::normal_distribution<float> noise{0.f, 0.01f};
+    std::uniform_real_distribution<float> motion{-3.f, 3.f};
+    std::vector<Vector3f> rates(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        bool moving = (i / 64) % 4 == 3;
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            rates[i][axis] = noise(rng()) + (moving ? motion(rng()) : 0.f);
+        }
+    }
+    return rates;
+}
+
+std::vector<LogSample> randomSamples(size_t count)
+{
+    std::vector<Vector3f> rates = randomRates(count);
+    std::uniform_int_distribution<int> brightness{0, 1023};
+    std::vector<LogSample> samples(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        samples[i] = {static_cast<uint32_t>(i * 1050),
+                      {rates[i][0], rates[i][1], rates[i][2]},
+                      static_cast<uint16_t>(brightness(rng())),
+                      {0.1f, -0.2f, 9.8f}};
+    }
+    return samples;
+}
+
+// How many per-sample calls each of those times: enough to cycle through
+// the cases, few enough to stay in cache.
+constexpr size_t SAMPLES = 1024;
+
+const size_t reduceSizes[] = {16, 256, 4096, 65536};
+
+void addReduceBenchmarks(std::vector<Benchmark> &all)
+{
+    for (size_t size : reduceSizes)
+    {
+        auto input = std::make_shared<std::vector<float>>(randomFloats(size));
+        auto scratch = std::make_shared<std::vector<float>>(size);
+        // It works in place, so each run copies the input first (timed too).
+        all.push_back({"pairwise_reduce_float", size, size, [=] {
+                           *scratch = *input;
+                           keep(pairwiseReduce(scratch->begin(), scratch->end()));
+                       }});
+        all.push_back({"pairwise_sum_float", size, size,
+                       [=] { keep(pairwiseSum(input->begin(), input->end())); }});
+        all.push_back({"kahan_sum_float", size, size, [=] { keep(kahanSum(input->begin(), input->end())); }});
+        // The naive sum, for comparison.
+        all.push_back({"accumulate_float", size, size,
+                       [=] { keep(std::accumulate(input->begin(), input->end(), 0.f)); }});
+
+        auto vectors = std::make_shared<std::vector<Vector3f>>(randomRates(size));
+        auto vectorScratch = std::make_shared<std::vector<Vector3f>>(size);
+        all.push_back({"pairwise_reduce_vec3", size, size, [=] {
+                           *vectorScratch = *vectors;
+                           keep(pairwiseReduce(vectorScratch->begin(), vectorScratch->end()));
+                       }});
+    }
+}
+
+void addGyroBenchmarks(std::vector<Benchmark> &all)
+{
+    std::vector<Vector3f> rates = randomRates(SAMPLES);
+    auto events = std::make_shared<std::vector<sensors_event_t>>(SAMPLES);
+    auto processed = std::make_shared<std::vector<GyroProc::Vector>>(SAMPLES);
+    for (size_t i = 0; i < SAMPLES; ++i)
+    {
+        memset(&(*events)[i], 0, sizeof(sensors_event_t));
+        Vector3f::Map((*events)[i].gyro.v) = rates[i];
+        (*processed)[i] = GyroProc::fromRadPerSec(rates[i]);
+    }
+    auto proc = std::make_shared<GyroProc>();
+    proc->setZeroRate(Vector3f{0.001f, -0.002f, 0.0005f});
+    all.push_back({"gyro_process", SAMPLES, SAMPLES, [=] {
+                       for (sensors_event_t &event : *events)
+                       {
+                           keep(proc->process(event));
+                       }
+                   }});
+    all.push_back({"moving", SAMPLES, SAMPLES, [=] {
+                       for (GyroProc::Vector const &gyro : *processed)
+                       {
+                           keep(moving(gyro));
+                       }
+                   }});
+    all.push_back({"gyro_direction", SAMPLES, SAMPLES, [=] {
+                       for (GyroProc::Vector const &gyro : *processed)
+                       {
+                           keep(gyro_direction(gyro[1]));
+                       }
+                   }});
+
+    auto changes = std::make_shared<std::vector<int>>(SAMPLES);
+    std::uniform_int_distribution<int> change{-12, 12};
+    for (int &c : *changes)
+    {
+        c = change(rng());
+    }
+    all.push_back({"brightness_direction", SAMPLES, SAMPLES, [=] {
+                       for (int c : *changes)
+                       {
+                           keep(brightness_direction(c));
+                       }
+                   }});
+}
+
+/// What the gyro pipeline does per sample in each representation: take off
+/// the zero rate and check against the threshold.
+template <typename Policy>
+void addPolicyBenchmark(std::vector<Benchmark> &all, std::vector<Vector3f> const &rates)
+{
+    using Proc = BasicGyroProc<Policy>;
+    auto converted = std::make_shared<std::vector<typename Proc::Vector>>();
+    for (Vector3f const &rate : rates)
+    {
+        converted->push_back(Proc::fromRadPerSec(rate));
+    }
+    typename Proc::Vector zeroRate = Proc::fromRadPerSec(Vector3f{0.001f, -0.002f, 0.0005f});
+    typename Policy::Scalar threshold = Policy::fromRadPerSec(GYRO_THRESHOLD);
+    all.push_back({std::string("gyro_threshold_") + Policy::name(), SAMPLES, SAMPLES, [=] {
+                       for (typename Proc::Vector const &gyro : *converted)
+                       {
+                           keep((Proc::subtract(gyro, zeroRate).array().abs() > threshold).any());
+                       }
+                   }});
+}
+
+void addPolicyBenchmarks(std::vector<Benchmark> &all)
+{
+    std::vector<Vector3f> rates = randomRates(SAMPLES);
+    addPolicyBenchmark<FloatPolicy>(all, rates);
+    addPolicyBenchmark<CountsPolicy>(all, rates);
+    addPolicyBenchmark<Q15Policy>(all, rates);
+}
+
+void addFormatBenchmarks(std::vector<Benchmark> &all)
+{
+    auto samples = std::make_shared<std::vector<LogSample>>(randomSamples(SAMPLES));
+    for (bool withAccel : {false, true})
+    {
+        auto encoder = std::make_shared<StreamEncoder>(withAccel);
+        all.push_back({withAccel ? "stream_encode_dv2" : "stream_encode_dv1", SAMPLES, SAMPLES, [=] {
+                           for (LogSample const &sample : *samples)
+                           {
+                               if (encoder->add(sample))
+                               {
+                                   keep(encoder->data()[0]);
+                               }
+                           }
+                       }});
+    }
+#ifdef APP_LOG
+    // The log app's text lines, through the simulated Serial.
+    for (bool withAccel : {false, true})
+    {
+        all.push_back({withAccel ? "csv_record_accel" : "csv_record", SAMPLES, SAMPLES, [=] {
+                           for (LogSample const &sample : *samples)
+                           {
+                               logPrintCsv(sample, withAccel);
+                           }
+                           keep(Serial.takeOutput());
+                       }});
+    }
+#endif
+    auto packed = std::make_shared<std::vector<uint8_t>>(SAMPLES * LOG_SAMPLE_BYTES);
+    all.push_back({"pack_log_sample", SAMPLES, SAMPLES, [=] {
+                       uint8_t *out = packed->data();
+                       for (LogSample const &sample : *samples)
+                       {
+                           packLogSample(sample, out);
+                           out += LOG_SAMPLE_BYTES;
+                       }
+                       keep(*packed->data());
+                   }});
+}
+
+/// Push four times the capacity: most pushes drop the oldest.
+template <size_t N>
+void addCircularWindow(std::vector<Benchmark> &all, std::shared_ptr<std::vector<LogSample>> const &samples)
+{
+    auto window = std::make_shared<CircularWindow<LogSample, N>>();
+    all.push_back({"circular_window_push", N, 4 * N, [=] {
+                       for (size_t i = 0; i < 4 * N; ++i)
+                       {
+                           window->push((*samples)[i % samples->size()]);
+                       }
+                       keep(window->newest());
+                   }});
+}
+
+/// Fill, then empty: one thread, so this is the cost of the atomics and
+/// copies, not of contention.
+template <size_t N>
+void addSpscRing(std::vector<Benchmark> &all, std::shared_ptr<std::vector<LogSample>> const &samples)
+{
+    auto ring = std::make_shared<SpscRing<LogSample, N>>();
+    all.push_back({"spsc_ring_push_pop", N, N, [=] {
+                       for (size_t i = 0; i < N; ++i)
+                       {
+                           ring->push((*samples)[i % samples->size()]);
+                       }
+                       LogSample out;
+                       while (ring->pop(out))
+                       {
+                           keep(out);
+                       }
+                   }});
+}
+
+/// A window kept by shifting everything down a place, for comparison with
+/// CircularWindow.
+template <size_t N>
+void addShiftingWindow(std::vector<Benchmark> &all, std::shared_ptr<std::vector<LogSample>> const &samples)
+{
+    auto window = std::make_shared<std::vector<LogSample>>(N);
+    all.push_back({"shifting_window_push", N, 4 * N, [=] {
+                       for (size_t i = 0; i < 4 * N; ++i)
+                       {
+                           memmove(window->data(), window->data() + 1, (N - 1) * sizeof(LogSample));
+                           window->back() = (*samples)[i % samples->size()];
+                       }
+                       keep(window->back());
+                   }});
+}
+
+/// Fill, then clear.
+template <size_t N>
+void addStaticVector(std::vector<Benchmark> &all, std::shared_ptr<std::vector<LogSample>> const &samples)
+{
+    auto vec = std::make_shared<StaticVector<LogSample, N>>();
+    all.push_back({"static_vector_push", N, N, [=] {
+                       vec->clear();
+                       for (size_t i = 0; i < N; ++i)
+                       {
+                           vec->push_back((*samples)[i % samples->size()]);
+                       }
+                       keep(vec->back());
+                   }});
+}
+
+void addRingBenchmarks(std::vector<Benchmark> &all)
+{
+    auto samples = std::make_shared<std::vector<LogSample>>(randomSamples(SAMPLES));
+    addShiftingWindow<64>(all, samples);
+    addShiftingWindow<1024>(all, samples);
+    addCircularWindow<64>(all, samples);
+    addCircularWindow<1024>(all, samples);
+    addCircularWindow<16384>(all, samples);
+    addSpscRing<64>(all, samples);
+    addSpscRing<1024>(all, samples);
+    addSpscRing<16384>(all, samples);
+    addStaticVector<64>(all, samples);
+    addStaticVector<1024>(all, samples);
+}
+
+double secondsFor(Benchmark const &benchmark, size_t runs)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < runs; ++i)
+    {
+        benchmark.run();
+    }
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/// Best of a few, so other things running on the host count for less.
+double nsPerItem(Benchmark const &benchmark, double minSeconds)
+{
+    constexpr int REPEATS = 5;
+    size_t runs = 1;
+    while (secondsFor(benchmark, runs) < minSeconds / REPEATS)
+    {
+        runs *= 2;
+    }
+    double best = secondsFor(benchmark, runs);
+    for (int i = 1; i < REPEATS; ++i)
+    {
+        double seconds = secondsFor(benchmark, runs);
+        best = seconds < best ? seconds : best;
+    }
+    return best * 1e9 / (static_cast<double>(runs) * static_cast<double>(benchmark.items));
+}
+
+/// ns per item from an earlier run's output, by benchmark and size.
+bool readBaseline(const char *path, std::map<std::pair<std::string, size_t>, double> &baseline)
+{
+    FILE *fp = fopen(path, "r");
+    if (!fp)
+    {
+        return false;
+    }
+    char line[256];
+    while (fgets(line, sizeof(line), fp))
+    {
+        char name[128];
+        unsigned long size;
+        double ns;
+        if (sscanf(line, "%127[^,],%lu,%lf", name, &size, &ns) == 3)
+        {
+            baseline[{name, size}] = ns;
+        }
+    }
+    fclose(fp);
+    return true;
+}
+
+void usage(const char *argv0)
+{
+    fprintf(stderr, "Usage: %s [--filter TEXT] [--min-time MS] [--compare old.csv [--tolerance FRACTION]]\n",
+            argv0);
+}
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    const char *filter = nullptr;
+    const char *compare = nullptr;
+    double minSeconds = 0.1;
+    double tolerance = 0.1;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (i + 1 >= argc)
+        {
+            usage(argv[0]);
+            return 1;
+        }
+        const char *value = argv[++i];
+        if (arg == "--filter")
+        {
+            filter = value;
+        }
+        else if (arg == "--min-time")
+        {
+            minSeconds = atof(value) / 1000;
+        }
+        else if (arg == "--compare")
+        {
+            compare = value;
+        }
+        else if (arg == "--tolerance")
+        {
+            tolerance = atof(value);
+        }
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    std::map<std::pair<std::string, size_t>, double> baseline;
+    if (compare && !readBaseline(compare, baseline))
+    {
+        perror(compare);
+        return 1;
+    }
+
+    std::vector<Benchmark> all;
+    addReduceBenchmarks(all);
+    addGyroBenchmarks(all);
+    addPolicyBenchmarks(all);
+    addFormatBenchmarks(all);
+    addRingBenchmarks(all);
+
+    int status = 0;
+    printf(compare ? "benchmark,size,ns_per_item,baseline_ns_per_item,change\n" : "benchmark,size,ns_per_item\n");
+    for (Benchmark const &benchmark : all)
+    {
+        if (filter && benchmark.name.find(filter) == std::string::npos)
+        {
+            continue;
+        }
+        double ns = nsPerItem(benchmark, minSeconds);
+        printf("%s,%zu,%.3f", benchmark.name.c_str(), benchmark.size, ns);
+        if (compare)
+        {
+            auto old = baseline.find({benchmark.name, benchmark.size});
+            if (old == baseline.end() || old->second <= 0)
+            {
+                printf(",,");
+            }
+            else
+            {
+                double change = ns / old->second - 1;
+                printf(",%.3f,%+.3f", old->second, change);
+                if (change > tolerance)
+                {
+                    status = 1;
+                    fprintf(stderr, "%s (%zu): %.0f%% slower\n", benchmark.name.c_str(), benchmark.size,
+                            change * 100);
+                }
+            }
+        }
+        printf("\n");
+        fflush(stdout);
+    }
+    return status;
+}
@@ -0,0 +1,361 @@
+// Copyright 2021, Collabora, Ltd.
+// SPDX-License-Identifier: BSL-1.0
+// Original Author: Ryan Pavlik
+//
+// Pretend to be a tester plugged in over USB: run the firmware, as built
+// for the simulated board, behind a pseudo-terminal that capture.py (or
+// anything else) can open like the real serial port.
+//
+//     emulator [--speed X] [--link PATH] [--capture capture.csv | synthetic options]
+//
+// Prints the device to open, then waits for something to open it before
+// starting the firmware, like a board waiting for its USB serial port. The
+// IMU and photosensor replay a capture, or a synthetic one made on the fly
+// (see syntheticCapture.h), and the firmware answers commands as usual.
+// --speed runs it faster than real time (0 for as fast as the host reads),
+// to load-test the host side.
+//
+// Once the data runs out the firmware stops sending, but the device stays
+// open until the host closes it.
+
+#include <Arduino.h>
+#include "captureFile.h"
+#include "simulator.h"
+#include "syntheticCapture.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+// The firmware's, in main.cpp.
+void setup();
+void loop();
+
+namespace
+{
+struct Options
+{
+    double speed = 1;
+    const char *link = nullptr;
+    const char *capture = nullptr;
+    SyntheticConfig config;
+    std::string profile = "onset";
+    double durationSec = 600;
+};
+
+/// Sent on in chunks about this big, like USB packets get batched.
+constexpr size_t FLUSH_BYTES = 512;
+
+volatile sig_atomic_t stopping = 0;
+
+uint64_t monotonicUs()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000 + static_cast<uint64_t>(ts.tv_nsec) / 1000;
+}
+
+void usage(const char *argv0)
+{
+    fprintf(stderr, "Usage: %s [options]\n", argv0);
+    fprintf(stderr, "  --speed X             times real time, or 0 for as fast as it's read (1)\n");
+    fprintf(stderr, "  --link PATH           also make PATH a symlink to the device\n");
+    fprintf(stderr, "  --capture FILE        replay a capture from capture.py or synth\n");
+    fprintf(stderr, "Otherwise, a synthetic capture (run synth for more choices):\n");
+    fprintf(stderr, "  --profile onset|turnaround\n");
+    fprintf(stderr, "  --duration SEC        (600)\n");
+    fprintf(stderr, "  --seed N              noise seed\n");
+    fprintf(stderr, "  --latency US          pipeline latency, pose to start of scanout (20000)\n");
+    fprintf(stderr, "  --refresh HZ          display refresh, 0 for continuous (90)\n");
+}
+
+bool parseArgs(int argc, char *argv[], Options &options)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (i + 1 >= argc)
+        {
+            return false;
+        }
+        const char *value = argv[++i];
+        if (arg == "--speed")
+        {
+            options.speed = atof(value);
+        }
+        else if (arg == "--link")
+        {
+            options.link = value;
+        }
+        else if (arg == "--capture")
+        {
+            options.capture = value;
+        }
+        else if (arg == "--profile")
+        {
+            options.profile = value;
+        }
+        else if (arg == "--duration")
+        {
+            options.durationSec = atof(value);
+        }
+        else if (arg == "--seed")
+        {
+            options.config.seed = static_cast<uint32_t>(strtoul(value, nullptr, 0));
+        }
+        else if (arg == "--latency")
+        {
+            options.config.pipelineLatencyUs = strtoul(value, nullptr, 0);
+        }
+        else if (arg == "--refresh")
+        {
+            options.config.display.refreshHz = static_cast<float>(atof(value));
+        }
+        else
+        {
+            return false;
+        }
+    }
+    return options.speed >= 0 && options.durationSec > 0 &&
+           (options.profile == "onset" || options.profile == "turnaround");
+}
+
+bool loadSamples(Options &options, std::vector<RecordedSample> &samples)
+{
+    if (options.capture)
+    {
+        if (!readCaptureFile(options.capture, samples) || samples.empty())
+        {
+            fprintf(stderr, "%s: no samples\n", options.capture);
+            return false;
+        }
+        return true;
+    }
+    SyntheticConfig &config = options.config;
+    // The native build logs the accelerometer.
+    config.withAccel = true;
+    auto us = [](double sec) { return static_cast<unsigned long>(sec * 1e6); };
+    // Still for long enough to calibrate, then the same as synth makes.
+    config.profile.push_back(MotionSegment::still(us(2.5)));
+    if (options.profile == "turnaround")
+    {
+        config.profile.push_back(MotionSegment::oscillate(us(options.durationSec), 1, 3.f, us(1)));
+    }
+    else
+    {
+        for (int i = 0; i * 1.8 < options.durationSec; ++i)
+        {
+            config.profile.push_back(MotionSegment::rotate(us(0.3), 1, (i % 2) ? -2.f : 2.f));
+            config.profile.push_back(MotionSegment::still(us(1.5)));
+        }
+    }
+    SyntheticCapture capture{config};
+    RecordedSample sample;
+    while (!capture.done())
+    {
+        capture.next(sample);
+        samples.push_back(sample);
+    }
+    return true;
+}
+
+/// The host end of the serial port: the master side of a pty.
+class Device
+{
+public:
+    bool open()
+    {
+        fd_ = posix_openpt(O_RDWR | O_NOCTTY);
+        if (fd_ < 0 || grantpt(fd_) != 0 || unlockpt(fd_) != 0)
+        {
+            perror("posix_openpt");
+            return false;
+        }
+        path_ = ptsname(fd_);
+        // Raw, like a USB serial port: no echo, no line editing.
+        int slave = ::open(path_.c_str(), O_RDWR | O_NOCTTY);
+        termios tio;
+        if (slave < 0 || tcgetattr(slave, &tio) != 0)
+        {
+            perror(path_.c_str());
+            return false;
+        }
+        cfmakeraw(&tio);
+        tcsetattr(slave, TCSANOW, &tio);
+        close(slave);
+        fcntl(fd_, F_SETFL, fcntl(fd_, F_GETFL) | O_NONBLOCK);
+        return true;
+    }
+
+    std::string const &path() const { return path_; }
+
+    /// Until something opens the other end, or we're stopped.
+    bool waitForHost()
+    {
+        while (!stopping)
+        {
+            // The master hangs up while nothing has the other end open.
+            pollfd p{fd_, POLLIN, 0};
+            if (poll(&p, 1, 0) >= 0 && !(p.revents & POLLHUP))
+            {
+                return true;
+            }
+            usleep(50000);
+        }
+        return false;
+    }
+
+    /// Wait up to @p timeoutUs for the host to send something, and pass it
+    /// on to the firmware. @return false once the host has gone.
+    bool pollInput(uint64_t timeoutUs)
+    {
+        pollfd p{fd_, POLLIN, 0};
+        int timeoutMs = static_cast<int>(timeoutUs / 1000);
+        if (poll(&p, 1, timeoutMs) <= 0)
+        {
+            return !stopping;
+        }
+        if (p.revents & POLLHUP)
+        {
+            return false;
+        }
+        char buf[256];
+        ssize_t n = read(fd_, buf, sizeof(buf));
+        if (n > 0)
+        {
+            Serial.sendInput(std::string(buf, static_cast<size_t>(n)));
+        }
+        return n > 0 || (n < 0 && (errno == EAGAIN || errno == EINTR));
+    }
+
+    /// Send everything, waiting while the host falls behind, as the board
+    /// waits on a full USB buffer. @return false once the host has gone.
+    bool write(std::string const &data)
+    {
+        size_t written = 0;
+        while (written < data.size())
+        {
+            ssize_t n = ::write(fd_, data.data() + written, data.size() - written);
+            if (n > 0)
+            {
+                written += static_cast<size_t>(n);
+                bytes += static_cast<uint64_t>(n);
+                continue;
+            }
+            if (n < 0 && errno != EAGAIN && errno != EINTR)
+            {
+                return false;
+            }
+            uint64_t start = monotonicUs();
+            pollfd p{fd_, POLLOUT, 0};
+            poll(&p, 1, 100);
+            blockedUs += monotonicUs() - start;
+            if ((p.revents & POLLHUP) || stopping)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    uint64_t bytes = 0;
+    uint64_t blockedUs = 0;
+
+private:
+    int fd_ = -1;
+    std::string path_;
+};
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    Options options;
+    if (!parseArgs(argc, argv, options))
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    std::vector<RecordedSample> samples;
+    if (!loadSamples(options, samples))
+    {
+        return 1;
+    }
+    size_t sampleCount = samples.size();
+
+    Device device;
+    if (!device.open())
+    {
+        return 1;
+    }
+    if (options.link)
+    {
+        unlink(options.link);
+        if (symlink(device.path().c_str(), options.link) != 0)
+        {
+            perror(options.link);
+            return 1;
+        }
+    }
+    signal(SIGINT, [](int) { stopping = 1; });
+    signal(SIGTERM, [](int) { stopping = 1; });
+    printf("%s\n", options.link ? options.link : device.path().c_str());
+    fflush(stdout);
+
+    bool connected = device.waitForHost();
+    uint64_t wallStart = monotonicUs();
+    if (connected)
+    {
+        Simulator &sim = simulator();
+        sim.configure(SimulatorConfig{});
+        sim.replay(std::move(samples));
+        uint64_t virtualStart = sim.nowUs();
+        setup();
+        std::string pending;
+        while (connected && !sim.replayDone())
+        {
+            loop();
+            pending += Serial.takeOutput();
+            uint64_t waitUs = 0;
+            if (options.speed > 0)
+            {
+                // Ahead of the wall clock: send what we have and wait.
+                uint64_t dueUs = wallStart + static_cast<uint64_t>((sim.nowUs() - virtualStart) / options.speed);
+                uint64_t now = monotonicUs();
+                waitUs = dueUs > now + 1000 ? dueUs - now : 0;
+            }
+            if (waitUs > 0 || pending.size() >= FLUSH_BYTES)
+            {
+                connected = device.write(pending);
+                pending.clear();
+            }
+            if (connected && (waitUs > 0 || Serial.available() == 0))
+            {
+                connected = device.pollInput(waitUs);
+            }
+        }
+        pending += Serial.takeOutput();
+        connected = connected && device.write(pending);
+    }
+    double wallSec = static_cast<double>(monotonicUs() - wallStart) * 1e-6;
+    fprintf(stderr, "%zu samples, %llu bytes in %.1f s (%.0f samples/s), %.1f s waiting on the host\n", sampleCount,
+            static_cast<unsigned long long>(device.bytes), wallSec, wallSec > 0 ? sampleCount / wallSec : 0.,
+            static_cast<double>(device.blockedUs) * 1e-6);
+    // Until the host lets go.
+    while (connected && device.pollInput(100000))
+    {
+    }
+    if (options.link)
+    {
+        unlink(options.link);
+    }
+    return 0;
+}
@@ -0,0 +1,205 @@
+// Copyright 2021, Collabora, Ltd.
+// SPDX-License-Identifier: BSL-1.0
+// Original Author: Ryan Pavlik
+//
+// Run captures from capture.py through the onset or turnaround app, as
+// built for the board, and print every latency it would have reported:
+//
+//     replay [--app onset|onset_translation|turnaround] [--jobs N] capture.csv|directory...
+//
+// Output is CSV on stdout: file, the capture's "us" when the latency was
+// reported, and the latency in microseconds. Each file gets its own
+// process, since the apps keep their state in file statics: up to --jobs
+// (by default, one per core) at once, with each file's results printed
+// together as it finishes.
+
+#include "replayApps.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static bool writeAll(int fd, std::string const &text)
+{
+    size_t written = 0;
+    while (written < text.size())
+    {
+        ssize_t n = write(fd, text.data() + written, text.size() - written);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return false;
+        }
+        written += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+/// Replay one capture, writing its results to @p fd.
+/// @return the exit status for the worker.
+static int replayFile(std::string const &file, size_t app, int fd)
+{
+    std::vector<RecordedSample> samples;
+    if (!readCaptureFile(file.c_str(), samples))
+    {
+        fprintf(stderr, "%s: can't open\n", file.c_str());
+        return 1;
+    }
+    if (samples.empty())
+    {
+        fprintf(stderr, "%s: no samples\n", file.c_str());
+        return 1;
+    }
+    std::string results;
+    char line[64];
+    replayCapture(app, std::move(samples), [&](uint32_t us, long latency) {
+        // The capture's times are signed, from capture.py.
+        snprintf(line, sizeof(line), ",%ld,%ld\n", static_cast<long>(static_cast<int32_t>(us)), latency);
+        results += file;
+        results += line;
+    });
+    return writeAll(fd, results) ? 0 : 1;
+}
+
+struct Worker
+{
+    pid_t pid;
+    int fd;
+    std::string results;
+};
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr, "Usage: %s [--app", argv0);
+    for (size_t i = 0; i < ReplayApps::count; ++i)
+    {
+        fprintf(stderr, "%s%s", i ? "|" : " ", ReplayApps::name(i));
+    }
+    fprintf(stderr, "] [--jobs N] capture.csv|directory...\n");
+}
+
+int main(int argc, char *argv[])
+{
+    int app = 0;
+    long jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    std::vector<std::string> files;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--app" && i + 1 < argc)
+        {
+            app = ReplayApps::find(argv[++i]);
+            if (app < 0)
+            {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+        else if (arg == "--jobs" && i + 1 < argc)
+        {
+            jobs = atol(argv[++i]);
+        }
+        else if (arg.compare(0, 2, "--") == 0)
+        {
+            usage(argv[0]);
+            return 1;
+        }
+        else
+        {
+            addCaptureFiles(arg, files);
+        }
+    }
+    if (files.empty())
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    if (jobs < 1)
+    {
+        jobs = 1;
+    }
+    printf("file,us,latency_us\n");
+    // Before forking, so the children don't print it too.
+    fflush(stdout);
+    int status = 0;
+    size_t next = 0;
+    std::vector<Worker> workers;
+    while (next < files.size() || !workers.empty())
+    {
+        while (next < files.size() && static_cast<long>(workers.size()) < jobs)
+        {
+            int fds[2];
+            if (pipe(fds) != 0)
+            {
+                perror("pipe");
+                return 1;
+            }
+            pid_t pid = fork();
+            if (pid < 0)
+            {
+                perror("fork");
+                return 1;
+            }
+            if (pid == 0)
+            {
+                close(fds[0]);
+                _exit(replayFile(files[next], static_cast<size_t>(app), fds[1]));
+            }
+            close(fds[1]);
+            workers.push_back({pid, fds[0], {}});
+            next++;
+        }
+
+        std::vector<pollfd> polls;
+        for (Worker const &worker : workers)
+        {
+            polls.push_back({worker.fd, POLLIN, 0});
+        }
+        if (poll(polls.data(), polls.size(), -1) < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            perror("poll");
+            return 1;
+        }
+        // Back to front, so finished ones can go as we go.
+        for (size_t i = workers.size(); i-- > 0;)
+        {
+            if (!polls[i].revents)
+            {
+                continue;
+            }
+            Worker &worker = workers[i];
+            char buf[4096];
+            ssize_t n = read(worker.fd, buf, sizeof(buf));
+            if (n > 0)
+            {
+                worker.results.append(buf, static_cast<size_t>(n));
+                continue;
+            }
+            if (n < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            // Done: print a whole file's worth at once.
+            close(worker.fd);
+            fwrite(worker.results.data(), 1, worker.results.size(), stdout);
+            fflush(stdout);
+            int workerStatus = 0;
+            waitpid(worker.pid, &workerStatus, 0);
+            if (!WIFEXITED(workerStatus) || WEXITSTATUS(workerStatus) != 0)
+            {
+                status = 1;
+            }
+            workers.erase(workers.begin() + static_cast<long>(i));
+        }
+    }
+    return status;
+}
@@ -0,0 +1,104 @@
+// Copyright 2021, Collabora, Ltd.
+// SPDX-License-Identifier: BSL-1.0
+// Original Author: Ryan Pavlik
+//
+// Running a capture through one of the apps that report latencies, on the
+// simulated board, for the host tools.
+//
+// The apps keep their state in file statics, so run each capture in a
+// fresh process (fork) to start it from scratch.
+
+#pragma once
+
+// Must come before Arduino because of abs
+#include <Eigen/Core>
+#include "apps.h"
+#include "appRegistry.h"
+
+#include <Arduino.h>
+#include "captureFile.h"
+#include "defines.h"
+#include "simulator.h"
+
+#include <algorithm>
+#include <dirent.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <sys/stat.h>
+#include <utility>
+#include <vector>
+
+// The apps that report latencies.
+using ReplayApps = EnabledApps<OnsetApp, OnsetTranslationApp, TurnaroundApp>;
+static_assert(ReplayApps::count > 0, "build with APP_ONSET or APP_TURNAROUND");
+
+namespace replay_detail
+{
+static Board board;
+
+template <typename App>
+struct Loop
+{
+    static void run() { App::loop(board); }
+};
+} // namespace replay_detail
+
+/// @p path, or the captures in it if it's a directory, in order: .csv
+/// files, but not the .truth.csv ones beside synthetic captures.
+static void addCaptureFiles(std::string const &path, std::vector<std::string> &files)
+{
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0 || !S_ISDIR(info.st_mode))
+    {
+        files.push_back(path);
+        return;
+    }
+    auto endsWith = [](std::string const &s, const char *suffix) {
+        size_t n = strlen(suffix);
+        return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+    };
+    std::vector<std::string> found;
+    if (DIR *dir = opendir(path.c_str()))
+    {
+        while (dirent *entry = readdir(dir))
+        {
+            std::string name = entry->d_name;
+            if (endsWith(name, ".csv") && !endsWith(name, ".truth.csv"))
+            {
+                found.push_back(path + "/" + name);
+            }
+        }
+        closedir(dir);
+    }
+    std::sort(found.begin(), found.end());
+    files.insert(files.end(), found.begin(), found.end());
+}
+
+/// Run app @p app over @p samples, from the start, as fast as it goes.
+/// @p onLatency is called with the capture's micros() and each latency
+/// the app reports.
+template <typename F>
+static void replayCapture(size_t app, std::vector<RecordedSample> &&samples, F &&onLatency)
+{
+    simulator().configure(SimulatorConfig{});
+    simulator().replay(std::move(samples));
+    resetAnalog();
+    ReplayApps::setup(app);
+    Serial.takeOutput();
+
+    void (*loop)() = ReplayApps::wrapped<replay_detail::Loop>(app);
+    while (!simulator().replayDone())
+    {
+        loop();
+        std::string output = Serial.takeOutput();
+        if (output.empty())
+        {
+            continue;
+        }
+        for (long latency : numberLines(output))
+        {
+            onLatency(simulator().replayMicros(), latency);
+        }
+    }
+}
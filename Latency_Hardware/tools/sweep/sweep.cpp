@@ -0,0 +1,415 @@
+// Copyright 2021, Collabora, Ltd.
+// SPDX-License-Identifier: BSL-1.0
+// Original Author: Ryan Pavlik
+//
+// Try a grid of detector thresholds (see detectorThresholds.h) against
+// captures with known latencies, and score each set:
+//
+//     sweep [--app onset|turnaround] [--jobs N] [grid...] capture.csv|directory...
+//     sweep [--app onset|turnaround] [--jobs N] [grid...] --synthetic N [--duration SEC]
+//
+// Each capture needs its true latencies beside it, as the synth tool
+// writes them (x.csv has x.truth.csv), or --synthetic makes N captures of
+// its own, each with a different seed and display phase.
+//
+// Grid options take a list, 0.3,0.5,0.7, or a range, 0.3:0.7:0.1; each
+// left out stays at its default. Every combination runs on every capture.
+//
+// Output is CSV on stdout, one line per combination: the thresholds, how
+// many true events and detections there were, the bias (mean of reported
+// minus true latency) and its standard deviation, and the miss and false
+// detection rates.
+//
+// The work is spread over --jobs worker processes (by default, one per
+// core) with work stealing. Each run of an app is forked from its worker,
+// so it starts from scratch.
+
+#include "../replay/replayApps.h"
+
+#include "captureFile.h"
+#include "detectorThresholds.h"
+#include "latencyScore.h"
+#include "stealingQueues.h"
+#include "syntheticCapture.h"
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace
+{
+struct Grid
+{
+    std::vector<float> gyro{GYRO_THRESHOLD};
+    std::vector<float> gyroMinSpeed{GYRO_MIN_SPEED_THRESHOLD};
+    std::vector<float> brightness{static_cast<float>(BRIGHTNESS_THRESHOLD)};
+    std::vector<float> brightnessChange{static_cast<float>(BRIGHTNESS_CHANGE_THRESHOLD)};
+    std::vector<float> calmUs{static_cast<float>(CALM_USEC)};
+
+    std::vector<DetectorThresholds> combinations() const
+    {
+        std::vector<DetectorThresholds> all;
+        for (float g : gyro)
+            for (float s : gyroMinSpeed)
+                for (float b : brightness)
+                    for (float c : brightnessChange)
+                        for (float calm : calmUs)
+                        {
+                            DetectorThresholds t;
+                            t.gyro = g;
+                            t.gyroMinSpeed = s;
+                            t.brightness = static_cast<int>(lroundf(b));
+                            t.brightnessChange = static_cast<int>(lroundf(c));
+                            t.calmUs = static_cast<unsigned long>(calm);
+                            all.push_back(t);
+                        }
+        return all;
+    }
+};
+
+struct GridOption
+{
+    const char *name;
+    std::vector<float> Grid::*values;
+};
+
+const GridOption gridOptions[] = {
+    {"--gyro", &Grid::gyro},
+    {"--gyro-min-speed", &Grid::gyroMinSpeed},
+    {"--brightness", &Grid::brightness},
+    {"--brightness-change", &Grid::brightnessChange},
+    {"--calm-us", &Grid::calmUs},
+};
+
+/// "a,b,c" or "start:stop:step".
+bool parseValues(const char *text, std::vector<float> &values)
+{
+    values.clear();
+    float start;
+    float stop;
+    float step;
+    if (sscanf(text, "%f:%f:%f", &start, &stop, &step) == 3)
+    {
+        if (step <= 0 || stop < start)
+        {
+            return false;
+        }
+        // Half a step over, so rounding doesn't lose the last.
+        for (int i = 0; start + i * step <= stop + step / 2; ++i)
+        {
+            values.push_back(start + i * step);
+        }
+        return true;
+    }
+    const char *p = text;
+    while (*p)
+    {
+        char *end = nullptr;
+        values.push_back(strtof(p, &end));
+        if (end == p || (*end != ',' && *end != '\0'))
+        {
+            return false;
+        }
+        p = *end ? end + 1 : end;
+    }
+    return !values.empty();
+}
+
+struct Options
+{
+    int app = 0;
+    long jobs = 1;
+    Grid grid;
+    std::vector<std::string> files;
+    size_t synthetic = 0;
+    double durationSec = 60;
+};
+
+/// A capture and its truth, made or loaded by whichever worker needs it.
+struct Capture
+{
+    std::vector<RecordedSample> samples;
+    std::vector<TruthEvent> truth;
+};
+
+SyntheticConfig syntheticConfig(Options const &options, size_t index)
+{
+    SyntheticConfig config;
+    config.seed = static_cast<uint32_t>(index + 1);
+    std::mt19937 rng{config.seed};
+    // Land the motions on different parts of the frame each time.
+    float frameUs = 1e6f / config.display.refreshHz;
+    config.display.phaseUs = std::uniform_real_distribution<float>{0.f, frameUs}(rng);
+    auto us = [](double sec) { return static_cast<unsigned long>(sec * 1e6); };
+    if (strcmp(ReplayApps::name(options.app), "turnaround") == 0)
+    {
+        config.profile.push_back(MotionSegment::still(us(2.5)));
+        config.profile.push_back(MotionSegment::oscillate(us(options.durationSec), 1, 3.f, us(1)));
+        return config;
+    }
+    for (int i = 0; i * 1.8 < options.durationSec; ++i)
+    {
+        config.profile.push_back(MotionSegment::still(us(1.5)));
+        config.profile.push_back(MotionSegment::rotate(us(0.3), 1, (i % 2) ? -2.f : 2.f));
+    }
+    return config;
+}
+
+bool loadCapture(Options const &options, size_t index, Capture &capture)
+{
+    capture.samples.clear();
+    capture.truth.clear();
+    if (options.synthetic)
+    {
+        SyntheticConfig config = syntheticConfig(options, index);
+        SyntheticCapture synthetic{config};
+        RecordedSample sample;
+        while (!synthetic.done())
+        {
+            synthetic.next(sample);
+            capture.samples.push_back(sample);
+        }
+        capture.truth = SyntheticCapture::truth(config);
+        return true;
+    }
+    std::string const &file = options.files[index];
+    if (!readCaptureFile(file.c_str(), capture.samples) || capture.samples.empty())
+    {
+        fprintf(stderr, "%s: no samples\n", file.c_str());
+        return false;
+    }
+    std::string truthPath = truthPathFor(file);
+    if (!readTruthFile(truthPath.c_str(), capture.truth))
+    {
+        fprintf(stderr, "%s: no true latencies in %s\n", file.c_str(), truthPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+/// Shared with the workers: what each task scored, and whether it ran.
+struct TaskResult
+{
+    LatencyScore score;
+    bool ok;
+};
+
+/// Run one set of thresholds over one capture, in a process of its own.
+bool runTask(Options const &options, Capture const &capture, DetectorThresholds const &thresholds, TaskResult &result)
+{
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        return false;
+    }
+    if (pid == 0)
+    {
+        detectorThresholds() = thresholds;
+        std::vector<Detection> detections;
+        std::vector<RecordedSample> samples = capture.samples;
+        replayCapture(options.app, std::move(samples),
+                      [&](uint32_t us, long latency) { detections.push_back({us, latency}); });
+        result.score = scoreLatencies(capture.truth, detections);
+        result.ok = true;
+        _exit(0);
+    }
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR)
+    {
+    }
+    return result.ok;
+}
+
+void workerLoop(Options const &options, std::vector<DetectorThresholds> const &combinations,
+                StealingQueues &queues, size_t worker, TaskResult *results)
+{
+    // Tasks go capture by capture, so neighbours share one.
+    size_t captures = options.synthetic ? options.synthetic : options.files.size();
+    size_t loaded = captures;
+    bool loadedOk = false;
+    Capture capture;
+    size_t task;
+    while (queues.next(worker, task))
+    {
+        size_t index = task / combinations.size();
+        if (index != loaded)
+        {
+            loaded = index;
+            loadedOk = loadCapture(options, index, capture);
+        }
+        if (loadedOk)
+        {
+            runTask(options, capture, combinations[task % combinations.size()], results[task]);
+        }
+    }
+}
+
+void usage(const char *argv0)
+{
+    fprintf(stderr, "Usage: %s [--app", argv0);
+    for (size_t i = 0; i < ReplayApps::count; ++i)
+    {
+        fprintf(stderr, "%s%s", i ? "|" : " ", ReplayApps::name(i));
+    }
+    fprintf(stderr, "] [--jobs N] [grid...] capture.csv|directory...|--synthetic N [--duration SEC]\n");
+    fprintf(stderr, "Grid, each a,b,c or start:stop:step:");
+    for (GridOption const &option : gridOptions)
+    {
+        fprintf(stderr, " %s", option.name);
+    }
+    fprintf(stderr, "\n");
+}
+
+bool parseArgs(int argc, char *argv[], Options &options)
+{
+    options.jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg.compare(0, 2, "--") != 0)
+        {
+            addCaptureFiles(arg, options.files);
+            continue;
+        }
+        if (i + 1 >= argc)
+        {
+            return false;
+        }
+        const char *value = argv[++i];
+        if (arg == "--app")
+        {
+            options.app = ReplayApps::find(value);
+            if (options.app < 0)
+            {
+                return false;
+            }
+            continue;
+        }
+        if (arg == "--jobs")
+        {
+            options.jobs = atol(value);
+            continue;
+        }
+        if (arg == "--synthetic")
+        {
+            options.synthetic = strtoul(value, nullptr, 0);
+            continue;
+        }
+        if (arg == "--duration")
+        {
+            options.durationSec = atof(value);
+            continue;
+        }
+        bool known = false;
+        for (GridOption const &option : gridOptions)
+        {
+            if (arg == option.name)
+            {
+                known = parseValues(value, options.grid.*option.values);
+            }
+        }
+        if (!known)
+        {
+            return false;
+        }
+    }
+    if (options.jobs < 1)
+    {
+        options.jobs = 1;
+    }
+    if (options.jobs > static_cast<long>(StealingQueues::MaxWorkers))
+    {
+        options.jobs = StealingQueues::MaxWorkers;
+    }
+    // One or the other.
+    return options.synthetic > 0 ? options.files.empty() : !options.files.empty();
+}
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    Options options;
+    if (!parseArgs(argc, argv, options))
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    std::vector<DetectorThresholds> combinations = options.grid.combinations();
+    size_t captures = options.synthetic ? options.synthetic : options.files.size();
+    size_t tasks = captures * combinations.size();
+    size_t workers = static_cast<size_t>(options.jobs) < tasks ? static_cast<size_t>(options.jobs) : tasks;
+    if (tasks == 0)
+    {
+        // Nothing to share out, and nothing for mmap to map.
+        fprintf(stderr, "Nothing to try: the grid or the captures are empty\n");
+        return 1;
+    }
+
+    StealingQueues *queues = StealingQueues::create(workers, tasks);
+    size_t resultsBytes = tasks * sizeof(TaskResult);
+    void *shared = mmap(nullptr, resultsBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (!queues || shared == MAP_FAILED)
+    {
+        perror("mmap");
+        return 1;
+    }
+    TaskResult *results = static_cast<TaskResult *>(shared);
+    for (size_t i = 0; i < tasks; ++i)
+    {
+        new (&results[i]) TaskResult{LatencyScore{}, false};
+    }
+
+    fflush(stdout);
+    std::vector<pid_t> pids;
+    for (size_t worker = 0; worker < workers; ++worker)
+    {
+        pid_t pid = fork();
+        if (pid < 0)
+        {
+            perror("fork");
+            return 1;
+        }
+        if (pid == 0)
+        {
+            workerLoop(options, combinations, *queues, worker, results);
+            _exit(0);
+        }
+        pids.push_back(pid);
+    }
+    for (pid_t pid : pids)
+    {
+        int status = 0;
+        while (waitpid(pid, &status, 0) < 0 && errno == EINTR)
+        {
+        }
+    }
+
+    int status = 0;
+    printf("gyro,gyro_min_speed,brightness,brightness_change,calm_us,events,detections,bias_us,stddev_us,miss_rate,"
+           "false_rate\n");
+    for (size_t c = 0; c < combinations.size(); ++c)
+    {
+        LatencyScore total;
+        for (size_t capture = 0; capture < captures; ++capture)
+        {
+            TaskResult const &result = results[capture * combinations.size() + c];
+            if (!result.ok)
+            {
+                status = 1;
+                continue;
+            }
+            total.add(result.score);
+        }
+        DetectorThresholds const &t = combinations[c];
+        printf("%g,%g,%d,%d,%lu,%zu,%zu,%.1f,%.1f,%.4f,%.4f\n", t.gyro, t.gyroMinSpeed, t.brightness,
+               t.brightnessChange, t.calmUs, total.events, total.detections, total.biasUs(), total.errorStddevUs(),
+               total.missRate(), total.falseRate());
+    }
+    munmap(shared, resultsBytes);
+    StealingQueues::destroy(queues);
+    return status;
+}
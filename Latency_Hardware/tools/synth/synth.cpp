@@ -0,0 +1,410 @@
+// Copyright 2021, Collabora, Ltd.
+// SPDX-License-Identifier: BSL-1.0
+// Original Author: Ryan Pavlik
+//
+// Make captures with a known answer (see syntheticCapture.h), in the CSV
+// that capture.py saves or the log app's "dv1"/"dv2" binary stream, and
+// optionally the true latency of each motion alongside:
+//
+//     synth [options] -o capture.csv [--truth truth.csv]
+//
+// Run with --help for the options: everything in SyntheticConfig has one.
+
+#include "logSample.h"
+#include "streamCodec.h"
+
+#include "simulator.h"
+#include "syntheticCapture.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+namespace
+{
+enum class Format
+{
+    Csv,
+    Binary,
+};
+
+struct Options
+{
+    SyntheticConfig config;
+    std::string profile = "onset";
+    double durationSec = 60;
+    /// For the onset profile: how long to hold still, then move.
+    double stillSec = 1.5;
+    double moveSec = 0.3;
+    float rate = 2.f;
+    /// For the turnaround profile.
+    double periodSec = 1;
+    Format format = Format::Csv;
+    int digits = 4;
+    const char *output = nullptr;
+    const char *truth = nullptr;
+};
+
+struct FloatOption
+{
+    const char *name;
+    const char *help;
+    float SyntheticConfig::*field;
+};
+
+// SyntheticConfig's numbers, by name.
+const FloatOption floatOptions[] = {
+    {"--brightness-base", "rendered brightness at the start, 0-1", &SyntheticConfig::brightnessBase},
+    {"--brightness-per-rad", "rendered brightness change per radian", &SyntheticConfig::brightnessPerRadian},
+    {"--gyro-noise", "rad/s", &SyntheticConfig::gyroNoise},
+    {"--accel-noise", "m/s^2", &SyntheticConfig::accelNoise},
+};
+
+struct DisplayOption
+{
+    const char *name;
+    const char *help;
+    float DisplayModel::*field;
+};
+
+const DisplayOption displayOptions[] = {
+    {"--refresh", "display refresh in Hz, 0 for continuous", &DisplayModel::refreshHz},
+    {"--phase", "us from the start to the first frame", &DisplayModel::phaseUs},
+    {"--scanout", "fraction of the frame spent scanning out", &DisplayModel::scanoutFraction},
+    {"--row", "photosensor position down the screen, 0-1", &DisplayModel::sensorRow},
+    {"--persistence", "fraction of the frame each row is lit", &DisplayModel::persistence},
+    {"--rise", "pixel response time constant to brighter, us", &DisplayModel::riseUs},
+    {"--fall", "pixel response time constant to darker, us", &DisplayModel::fallUs},
+};
+
+void usage(const char *argv0)
+{
+    fprintf(stderr, "Usage: %s [options] -o capture.csv|capture.dv1 [--truth truth.csv]\n", argv0);
+    fprintf(stderr, "  --seed N              noise seed\n");
+    fprintf(stderr, "  --duration SEC        length of the capture (60)\n");
+    fprintf(stderr, "  --profile onset|turnaround\n");
+    fprintf(stderr, "                        still then a sharp turn, over and over; or back and forth\n");
+    fprintf(stderr, "  --still SEC, --move SEC, --rate RAD_S\n");
+    fprintf(stderr, "                        onset profile: hold still (1.5), then turn (0.3) at (2)\n");
+    fprintf(stderr, "  --period SEC          turnaround profile: period of the back and forth (1)\n");
+    fprintf(stderr, "  --latency US          pipeline latency, pose to start of scanout (20000)\n");
+    fprintf(stderr, "  --interval US         between samples (%lu)\n", SIM_IMU_SAMPLE_INTERVAL_US);
+    fprintf(stderr, "  --photodiode US       photodiode response time constant (50)\n");
+    fprintf(stderr, "  --adc-bits N          (10)\n");
+    fprintf(stderr, "  --adc-noise COUNTS    (0.5)\n");
+    for (FloatOption const &option : floatOptions)
+    {
+        fprintf(stderr, "  %-21s %s\n", option.name, option.help);
+    }
+    for (DisplayOption const &option : displayOptions)
+    {
+        fprintf(stderr, "  %-21s %s\n", option.name, option.help);
+    }
+    fprintf(stderr, "  --accel               include the accelerometer\n");
+    fprintf(stderr, "  --format csv|binary   binary is the log app's dv1 (or dv2, with --accel) stream\n");
+    fprintf(stderr, "  --digits N            decimals for CSV: 4 keeps whole gyro counts (4)\n");
+}
+
+bool parseArgs(int argc, char *argv[], Options &options)
+{
+    SyntheticConfig &config = options.config;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--accel")
+        {
+            config.withAccel = true;
+            continue;
+        }
+        if (i + 1 >= argc)
+        {
+            return false;
+        }
+        const char *value = argv[++i];
+        bool known = true;
+        if (arg == "-o")
+        {
+            options.output = value;
+        }
+        else if (arg == "--truth")
+        {
+            options.truth = value;
+        }
+        else if (arg == "--seed")
+        {
+            config.seed = static_cast<uint32_t>(strtoul(value, nullptr, 0));
+        }
+        else if (arg == "--duration")
+        {
+            options.durationSec = atof(value);
+        }
+        else if (arg == "--profile")
+        {
+            options.profile = value;
+        }
+        else if (arg == "--still")
+        {
+            options.stillSec = atof(value);
+        }
+        else if (arg == "--move")
+        {
+            options.moveSec = atof(value);
+        }
+        else if (arg == "--rate")
+        {
+            options.rate = static_cast<float>(atof(value));
+        }
+        else if (arg == "--period")
+        {
+            options.periodSec = atof(value);
+        }
+        else if (arg == "--latency")
+        {
+            config.pipelineLatencyUs = strtoul(value, nullptr, 0);
+        }
+        else if (arg == "--interval")
+        {
+            config.sampleIntervalUs = strtoul(value, nullptr, 0);
+        }
+        else if (arg == "--photodiode")
+        {
+            config.photodiode.responseUs = static_cast<float>(atof(value));
+        }
+        else if (arg == "--adc-bits")
+        {
+            config.photodiode.adcBits = atoi(value);
+        }
+        else if (arg == "--adc-noise")
+        {
+            config.photodiode.adcNoise = static_cast<float>(atof(value));
+        }
+        else if (arg == "--format")
+        {
+            options.format = strcmp(value, "binary") == 0 ? Format::Binary : Format::Csv;
+            known = strcmp(value, "binary") == 0 || strcmp(value, "csv") == 0;
+        }
+        else if (arg == "--digits")
+        {
+            options.digits = atoi(value);
+        }
+        else
+        {
+            known = false;
+            for (FloatOption const &option : floatOptions)
+            {
+                if (arg == option.name)
+                {
+                    config.*option.field = static_cast<float>(atof(value));
+                    known = true;
+                }
+            }
+            for (DisplayOption const &option : displayOptions)
+            {
+                if (arg == option.name)
+                {
+                    config.display.*option.field = static_cast<float>(atof(value));
+                    known = true;
+                }
+            }
+        }
+        if (!known)
+        {
+            return false;
+        }
+    }
+    return options.output != nullptr && config.sampleIntervalUs > 0 && options.digits >= 0 && options.digits <= 9 &&
+           config.photodiode.adcBits > 0 && config.photodiode.adcBits <= 16;
+}
+
+std::vector<MotionSegment> makeProfile(Options const &options)
+{
+    std::vector<MotionSegment> profile;
+    auto us = [](double sec) { return static_cast<unsigned long>(sec * 1e6); };
+    unsigned long total = us(options.durationSec);
+    unsigned long sofar = 0;
+    if (options.profile == "turnaround")
+    {
+        // Still, to let it calibrate, then back and forth.
+        unsigned long still = us(2.5);
+        profile.push_back(MotionSegment::still(still));
+        if (total > still)
+        {
+            profile.push_back(MotionSegment::oscillate(total - still, 1, 3.f, us(options.periodSec)));
+        }
+        return profile;
+    }
+    // Alternate directions, so the brightness goes back and forth too.
+    for (int i = 0; sofar < total; ++i)
+    {
+        profile.push_back(MotionSegment::still(us(options.stillSec)));
+        profile.push_back(MotionSegment::rotate(us(options.moveSec), 1, (i % 2) ? -options.rate : options.rate));
+        sofar += us(options.stillSec) + us(options.moveSec);
+    }
+    return profile;
+}
+
+/// Fixed-point, since printf is most of the time otherwise.
+char *putFixed(char *out, float value, int digits, long scale)
+{
+    long scaled = lroundf(value * static_cast<float>(scale));
+    if (scaled < 0)
+    {
+        *out++ = '-';
+        scaled = -scaled;
+    }
+    char buf[24];
+    int n = 0;
+    do
+    {
+        buf[n++] = static_cast<char>('0' + scaled % 10);
+        scaled /= 10;
+    } while (scaled || n <= digits);
+    while (n > 0)
+    {
+        *out++ = buf[--n];
+        if (n == digits && digits > 0)
+        {
+            *out++ = '.';
+        }
+    }
+    return out;
+}
+
+char *putLong(char *out, long value)
+{
+    unsigned long magnitude = value < 0 ? 0UL - static_cast<unsigned long>(value) : value;
+    if (value < 0)
+    {
+        *out++ = '-';
+    }
+    char buf[24];
+    int n = 0;
+    do
+    {
+        buf[n++] = static_cast<char>('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude);
+    while (n > 0)
+    {
+        *out++ = buf[--n];
+    }
+    return out;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    Options options;
+    if (!parseArgs(argc, argv, options) || (options.profile != "onset" && options.profile != "turnaround"))
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    SyntheticConfig &config = options.config;
+    config.profile = makeProfile(options);
+
+    FILE *out = fopen(options.output, options.format == Format::Binary ? "wb" : "w");
+    if (!out)
+    {
+        perror(options.output);
+        return 1;
+    }
+    SyntheticCapture capture{config};
+    RecordedSample sample;
+    std::vector<char> buffer;
+    buffer.reserve(1 << 20);
+    if (options.format == Format::Binary)
+    {
+        // What the log app sends, after "codec dv1".
+        StreamEncoder encoder{config.withAccel};
+        fprintf(out, "CODEC,%s,gyro_counts_per_rad_s=%.4f", encoder.name(), STREAM_CODEC_GYRO_COUNTS_PER_RAD_S);
+        if (config.withAccel)
+        {
+            fprintf(out, ",accel_counts_per_m_s2=%.4f", STREAM_CODEC_ACCEL_COUNTS_PER_M_S2);
+        }
+        fprintf(out, ",packet_samples=%u\r\n", static_cast<unsigned>(StreamEncoder::MaxPacketSamples));
+        while (!capture.done())
+        {
+            capture.next(sample);
+            LogSample logSample{sample.us,
+                                {sample.gyro[0], sample.gyro[1], sample.gyro[2]},
+                                static_cast<uint16_t>(sample.brightness),
+                                {sample.accel[0], sample.accel[1], sample.accel[2]}};
+            if (encoder.add(logSample) || (capture.done() && encoder.flush()))
+            {
+                buffer.insert(buffer.end(), encoder.data(), encoder.data() + encoder.size());
+            }
+            if (buffer.size() > (1 << 20) - StreamEncoder::MaxPacketBytes)
+            {
+                fwrite(buffer.data(), 1, buffer.size(), out);
+                buffer.clear();
+            }
+        }
+    }
+    else
+    {
+        fputs(config.withAccel ? "us,drx,dry,drz,brightness,ax,ay,az\n" : "us,drx,dry,drz,brightness\n", out);
+        long scale = 1;
+        for (int i = 0; i < options.digits; ++i)
+        {
+            scale *= 10;
+        }
+        char line[256];
+        while (!capture.done())
+        {
+            capture.next(sample);
+            // Signed, from the first sample, like capture.py.
+            char *p = putLong(line, static_cast<int32_t>(sample.us - config.startUs));
+            for (float gyro : sample.gyro)
+            {
+                *p++ = ',';
+                p = putFixed(p, gyro, options.digits, scale);
+            }
+            *p++ = ',';
+            p = putLong(p, sample.brightness);
+            if (config.withAccel)
+            {
+                for (float accel : sample.accel)
+                {
+                    *p++ = ',';
+                    p = putFixed(p, accel, options.digits, scale);
+                }
+            }
+            *p++ = '\n';
+            buffer.insert(buffer.end(), line, p);
+            if (buffer.size() > (1 << 20) - sizeof(line))
+            {
+                fwrite(buffer.data(), 1, buffer.size(), out);
+                buffer.clear();
+            }
+        }
+    }
+    fwrite(buffer.data(), 1, buffer.size(), out);
+    if (fclose(out) != 0)
+    {
+        perror(options.output);
+        return 1;
+    }
+
+    if (options.truth)
+    {
+        FILE *truth = fopen(options.truth, "w");
+        if (!truth)
+        {
+            perror(options.truth);
+            return 1;
+        }
+        fputs("us,latency_us\n", truth);
+        for (TruthEvent const &event : SyntheticCapture::truth(config))
+        {
+            fprintf(truth, "%ld,%lu\n", static_cast<long>(static_cast<int32_t>(event.motionUs - config.startUs)),
+                    event.latencyUs);
+        }
+        fclose(truth);
+    }
+    return 0;
+}
@@ -0,0 +1,100 @@
+#!/usr/bin/env python3
+# Copyright 2021, Collabora, Ltd.
+# SPDX-License-Identifier: BSL-1.0
+"""Read binary blocks embedded in the firmware's text serial output.
+
+A block is a header line ``BLOCK,<kind>,<payload bytes>[,<key>=<value>...]``,
+the raw payload, then a trailer line ``ENDBLOCK,<crc16 hex>``.
+"""
+
+import binascii
+import dataclasses
+import struct
+from typing import Dict, List, Optional, Tuple
+
+import serial
+
+from health import HealthMonitor
+
+
+@dataclasses.dataclass
+class Block:
+    kind: str
+    fields: Dict[str, str]
+    payload: bytes
+
+
+def parse_header(line: bytes):
+    """Return (kind, payload length, fields) from a header line, or None."""
+    if not line.startswith(b"BLOCK,"):
+        return None
+    parts = line.strip().decode("ascii").split(",")
+    kind = parts[1]
+    length = int(parts[2])
+    fields = dict(part.split("=", 1) for part in parts[3:])
+    return kind, length, fields
+
+
+def crc16(data: bytes) -> int:
+    """CRC-16/CCITT-FALSE, as computed by the firmware's BlockWriter."""
+    return binascii.crc_hqx(data, 0xFFFF)
+
+
+def read_block(
+    port: serial.Serial, kind: Optional[str] = None, health: Optional[HealthMonitor] = None
+) -> Block:
+    """Read lines until a block header (of the given kind), then the block.
+
+    Status lines on the way are passed to ``health``, if given.
+    """
+    while True:
+        line = port.readline()
+        if not line:
+            raise TimeoutError("No block received")
+        header = parse_header(line)
+        if header is None:
+            if health:
+                health.check_line(line)
+            continue
+        block_kind, length, fields = header
+        payload = port.read(length)
+        if len(payload) != length:
+            raise TimeoutError(f"Short {block_kind} block: {len(payload)} of {length} bytes")
+        trailer = b""
+        while not trailer.strip():
+            trailer = port.readline()
+        if not trailer.startswith(b"ENDBLOCK,"):
+            raise ValueError(f"Missing block trailer, got {trailer!r}")
+        expected_crc = int(trailer.strip().split(b",")[1], 16)
+        if crc16(payload) != expected_crc:
+            raise ValueError(f"CRC mismatch in {block_kind} block")
+        if kind is not None and block_kind != kind:
+            continue
+        return Block(kind=block_kind, fields=fields, payload=payload)
+
+
+_FORMAT_CODES = {
+    "u8": "B",
+    "u16": "H",
+    "u32": "I",
+    "u64": "Q",
+    "i16": "h",
+    "i32": "i",
+    "i64": "q",
+    "f32": "f",
+}
+
+
+def unpack_samples(block: Block) -> Tuple[List[str], List[tuple]]:
+    """Unpack a block of samples described by its "format" field.
+
+    The format is ``name:type`` items separated by semicolons, all packed
+    little-endian with no padding.
+    """
+    columns = []
+    codes = "<"
+    for item in block.fields["format"].split(";"):
+        name, type_name = item.split(":")
+        columns.append(name)
+        codes += _FORMAT_CODES[type_name]
+    return columns, list(struct.iter_unpack(codes, block.payload))
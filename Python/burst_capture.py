@@ -0,0 +1,75 @@
+#!/usr/bin/env python3
+# Copyright 2021, Collabora, Ltd.
+# SPDX-License-Identifier: BSL-1.0
+"""Trigger a brightness burst on the "burst" firmware and save it as CSV."""
+
+import argparse
+import array
+import datetime
+import sys
+from typing import Optional
+
+import serial
+
+from blocks import read_block
+from capture import _get_known_ports
+from health import HealthMonitor
+
+
+def _make_filename():
+    now = datetime.datetime.now()
+    return "burst_{}{:02d}{:02d}_{:02d}{:02d}{:02d}.csv".format(
+        now.year, now.month, now.day, now.hour, now.minute, now.second
+    )
+
+
+def capture_burst(
+    port: serial.Serial, rate_hz: int, window_us: int, health: Optional[HealthMonitor] = None
+):
+    """Return (start_us, rate_hz, samples, fields) for one burst."""
+    port.reset_input_buffer()
+    port.write(f"burst {rate_hz} {window_us}\n".encode("ascii"))
+    block = read_block(port, "burst", health)
+    samples = array.array("H")
+    samples.frombytes(block.payload)
+    if sys.byteorder != "little":
+        samples.byteswap()
+    return int(block.fields["start_us"]), float(block.fields["rate_hz"]), samples, block.fields
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("--rate", type=int, default=200000, help="Sample rate in Hz")
+    parser.add_argument(
+        "--window", type=int, default=0, help="Window in microseconds (0 = as long as fits)"
+    )
+    parser.add_argument("--device", help="Serial port (default: autodetect)")
+    parser.add_argument("--output", help="CSV file to write")
+    args = parser.parse_args()
+
+    device = args.device or _get_known_ports()
+    filename = args.output or _make_filename()
+    health = HealthMonitor()
+    with serial.Serial(device, baudrate=115200, timeout=10) as port:
+        start_us, rate_hz, samples, fields = capture_burst(port, args.rate, args.window, health)
+
+    print(f"Got {len(samples)} samples at {rate_hz}Hz")
+    if "refresh_hz" in fields:
+        print(
+            "Display refresh detected: {}Hz, first refresh {}us after start (confidence {})".format(
+                fields["refresh_hz"], fields["refresh_phase_us"], fields["refresh_confidence"]
+            )
+        )
+    else:
+        print("No display refresh detected")
+    period_us = 1000000.0 / rate_hz
+    with open(filename, "w") as fp:
+        fp.write("us,brightness\n")
+        for i, brightness in enumerate(samples):
+            fp.write(f"{start_us + i * period_us:.3f},{brightness}\n")
+    print(health.summary())
+    print(f"All done! Wrote {filename}")
+
+
+if __name__ == "__main__":
+    main()
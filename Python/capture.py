@@ -3,23 +3,39 @@
 # SPDX-License-Identifier: BSL-1.0
 """Handle the process of recording data from the "log" firmware."""
 
+import argparse
 import asyncio
+import binascii
 import logging
+import queue
+import re
 import dataclasses
 import datetime
-from typing import Optional
+import threading
+import time
+from typing import List, Optional
 
 import aioconsole
 import aioserial
+import numpy as np
 from serial.tools import list_ports
 
+from clock_sync import PING_INTERVAL_S, ClockSync
+from health import HealthMonitor
+
 logging.basicConfig(level=logging.DEBUG)
 
 FILENAME = "measurements.csv"
+# Most to read from the serial port at once
+READ_CHUNK = 1 << 16
+# How often to hand samples over to be written
+WRITE_INTERVAL_S = 0.25
+# How often to show the sample rate while recording
+REPORT_INTERVAL_S = 5.0
 
-def _make_filename():
+def _make_filename(suffix=""):
     now = datetime.datetime.now()
-    return "meas_{}{:02d}{:02d}_{:02d}{:02d}.csv".format(now.year, now.month, now.day, now.hour, now.minute)
+    return "meas_{}{:02d}{:02d}_{:02d}{:02d}{}.csv".format(now.year, now.month, now.day, now.hour, now.minute, suffix)
 
 def _get_known_devices():
     return {_vid_pid("2341", "805A"): "Arduino Nano 33 BLE"}
@@ -29,8 +45,9 @@ def _vid_pid(vid_string, pid_string):
     return (int(vid_string, 16), int(pid_string, 16))
 
 
-def _get_known_ports():
+def _get_all_known_ports() -> List[str]:
     known_devices = _get_known_devices()
+    devices = []
     for info in list_ports.comports():
         our_vid_pid = (info.vid, info.pid)
         if our_vid_pid in known_devices:
@@ -41,8 +58,19 @@ def _get_known_ports():
                 hex(info.pid),
                 known_devices[our_vid_pid],
             )
-            return info.device
-    raise RuntimeError("Could not find any connected devices")
+            devices.append(info.device)
+    if not devices:
+        raise RuntimeError("Could not find any connected devices")
+    return devices
+
+
+def _get_known_ports():
+    return _get_all_known_ports()[0]
+
+
+def _device_name(device: str) -> str:
+    """Make a short name from a serial port, fit for a filename: ttyACM0, COM3."""
+    return re.sub(r"[^A-Za-z0-9]+", "_", device.replace("/dev/", "")).strip("_")
 
 
 @dataclasses.dataclass
@@ -52,37 +80,415 @@ class Measurement:
     dry: float
     drz: float
     brightness: int
+    # Only from firmware that logs the accelerometer, in m/s^2
+    ax: Optional[float] = None
+    ay: Optional[float] = None
+    az: Optional[float] = None
+
+
+@dataclasses.dataclass
+class SampleBatch:
+    """Measurements as they came in, a column each, to handle many at once."""
+
+    us: np.ndarray
+    # drx, dry, drz
+    gyro: np.ndarray
+    brightness: np.ndarray
+    # Only from firmware that logs the accelerometer, in m/s^2: ax, ay, az
+    accel: Optional[np.ndarray] = None
+
+    def __len__(self):
+        return len(self.us)
+
+    def __getitem__(self, i: int) -> Measurement:
+        accel = [None] * 3 if self.accel is None else self.accel[i].tolist()
+        return Measurement(int(self.us[i]), *self.gyro[i].tolist(), int(self.brightness[i]), *accel)
+
+    @property
+    def has_accel(self) -> bool:
+        return self.accel is not None
 
     @classmethod
-    def from_csv_line(cls, line: bytes):
-        try:
-            us_str, drx_str, dry_str, drz_str, brightness_str = line.split(b",")
-            return Measurement(
-                us=int(us_str),
-                drx=float(drx_str),
-                dry=float(dry_str),
-                drz=float(drz_str),
-                brightness=int(brightness_str),
-            )
-        except:
+    def concatenate(cls, batches: List["SampleBatch"]) -> "SampleBatch":
+        if len(batches) == 1:
+            return batches[0]
+        accel = None
+        if all(batch.has_accel for batch in batches):
+            accel = np.concatenate([batch.accel for batch in batches])
+        return cls(
+            np.concatenate([batch.us for batch in batches]),
+            np.concatenate([batch.gyro for batch in batches]),
+            np.concatenate([batch.brightness for batch in batches]),
+            accel,
+        )
+
+    def get_csv_header(self):
+        if self.has_accel:
+            return "us,drx,dry,drz,brightness,ax,ay,az\n"
+        return "us,drx,dry,drz,brightness\n"
+
+    def format_csv(self, zero_time: int) -> str:
+        """Return the CSV lines, with zero_time subtracted from the timestamps."""
+        # Enough digits for the firmware's single precision floats
+        fmt = "%d,%.9g,%.9g,%.9g,%d"
+        columns = [(self.us - zero_time).tolist(), *self.gyro.T.tolist(), self.brightness.tolist()]
+        if self.has_accel:
+            fmt += ",%.9g,%.9g,%.9g"
+            columns += self.accel.T.tolist()
+        fmt += "\n"
+        return "".join([fmt % row for row in zip(*columns)])
+
+
+def _parse_csv_samples(lines: List[bytes]) -> SampleBatch:
+    """Parse CSV lines that all have the same number of fields (5, or 8 with accel) in one go.
+
+    Raises ValueError if any of them doesn't parse.
+    """
+    fields = lines[0].count(b",") + 1
+    values = np.array(b",".join(lines).split(b",")).astype(np.float64).reshape(-1, fields)
+    accel = values[:, 5:8] if fields == 8 else None
+    return SampleBatch(
+        values[:, 0].astype(np.int64), values[:, 1:4], values[:, 4].astype(np.int64), accel
+    )
+
+
+def _read_varint(buf, pos: int, end: int):
+    """Return (value, new position), or (None, pos) if incomplete/invalid."""
+    result = 0
+    for shift in range(0, 35, 7):
+        if pos >= end:
+            return None, pos
+        byte = buf[pos]
+        pos += 1
+        result |= (byte & 0x7F) << shift
+        if not byte & 0x80:
+            return result, pos
+    return None, pos
+
+
+def _grouped_cumsum(values: np.ndarray, first: np.ndarray, counts: np.ndarray) -> np.ndarray:
+    """Cumulative sum down the rows, starting over at each group's first row."""
+    sums = np.cumsum(values, axis=0)
+    before = sums[first] - values[first]
+    return sums - np.repeat(before, counts, axis=0)
+
+
+# Bytes with the varint continuation bit set
+_CONTINUATION_BYTES = bytes(range(0x80, 0x100))
+# A varint too long for 32 bits
+_LONG_VARINT = re.compile(rb"[\x80-\xff]{5}")
+
+
+class StreamDecoder:
+    """Decoder for the "dv1" compact binary stream, or "dv2" which adds accel.
+
+    See streamCodec.h in the firmware. Packets are found and checked one at a
+    time, then all the samples in them are decoded at once.
+    """
+
+    SYNC = b"\xa5\x5a"
+    MAX_PACKET_SAMPLES = 16
+    # Longest text line we keep waiting for the end of
+    MAX_LINE = 1024
+
+    def __init__(self, gyro_counts_per_rad_s: float, accel_counts_per_m_s2: Optional[float] = None):
+        self.gyro_scale = 1.0 / gyro_counts_per_rad_s
+        self.accel_scale = None if accel_counts_per_m_s2 is None else 1.0 / accel_counts_per_m_s2
+        # Channels after the timestamp: gyro, brightness, and maybe accel
+        self.channels = 4 if self.accel_scale is None else 7
+        self.buf = bytearray()
+        self.packets = 0
+        self.dropped_packets = 0
+        # Bytes dropped resyncing after damage
+        self.skipped_bytes = 0
+        self.last_seq = None
+        # Text (like status lines) between packets
+        self.text = bytearray()
+
+    @classmethod
+    def from_header_line(cls, line: bytes):
+        """Make a decoder from the firmware's ``CODEC,dv1,...`` or ``CODEC,dv2,...`` line."""
+        parts = line.strip().decode("ascii").split(",")
+        if len(parts) < 2 or parts[0] != "CODEC" or parts[1] not in ("dv1", "dv2"):
+            raise ValueError(f"Unsupported codec: {line!r}")
+        fields = dict(part.split("=", 1) for part in parts[2:])
+        accel = None
+        if parts[1] == "dv2":
+            accel = float(fields["accel_counts_per_m_s2"])
+        return cls(float(fields["gyro_counts_per_rad_s"]), accel)
+
+    def feed(self, data: bytes) -> Optional[SampleBatch]:
+        """Add data: return the samples in the packets it completes, if any."""
+        buf = self.buf
+        buf += data
+        pos = 0
+        payloads = []
+        counts = []
+        while True:
+            start = buf.find(self.SYNC, pos)
+            if start < 0:
+                # Keep a trailing first sync byte for next time, unless it
+                # was the end of a packet we just took
+                keep = 1 if len(buf) > pos and buf[-1] == self.SYNC[0] else 0
+                pos = self._take_text(pos, len(buf) - keep)
+                break
+            pos = self._take_text(pos, start)
+            if len(buf) - pos < 5:
+                break
+            payload_len, payload_start = _read_varint(buf, pos + 4, len(buf))
+            if payload_len is None:
+                if len(buf) - pos >= 9:
+                    self.skipped_bytes += 1
+                    pos += 1
+                    continue
+                break
+            end = payload_start + payload_len
+            if len(buf) < end + 2:
+                break
+            count = buf[pos + 3]
+            payload = bytes(buf[payload_start:end])
+            crc = binascii.crc_hqx(buf[pos + 2 : end], 0xFFFF)
+            if crc != buf[end] | (buf[end + 1] << 8) or not self._payload_ok(count, payload):
+                self.skipped_bytes += 1
+                pos += 1
+                continue
+            seq = buf[pos + 2]
+            if self.last_seq is not None:
+                self.dropped_packets += (seq - self.last_seq - 1) & 0xFF
+            self.last_seq = seq
+            self.packets += 1
+            payloads.append(payload)
+            counts.append(count)
+            pos = end + 2
+        del buf[:pos]
+        if not payloads:
             return None
+        return self._decode_payloads(payloads, counts)
 
-    def get_csv_line(self):
-        return f"{self.us},{self.drx},{self.dry},{self.drz},{self.brightness}\n"
+    def _take_text(self, start: int, end: int) -> int:
+        self.text += self.buf[start:end]
+        if len(self.text) > self.MAX_LINE and b"\n" not in self.text:
+            self.skipped_bytes += len(self.text)
+            self.text.clear()
+        return end
 
+    def take_lines(self) -> List[bytes]:
+        """Return and remove the complete lines of text received so far."""
+        end = self.text.rfind(b"\n")
+        if end < 0:
+            return []
+        lines = bytes(self.text[: end + 1]).splitlines(keepends=True)
+        del self.text[: end + 1]
+        return lines
 
-async def get_measurement(serial_port: aioserial.AioSerial, retries=1):
-    for _ in range(retries + 1):
-        line = await serial_port.readline_async()
-        if not line:
-            # all done
-            return
-        if b"\n" not in line:
-            # partial line: all done
-            return
-        meas = Measurement.from_csv_line(line)
-        if meas:
-            return meas
+    def _payload_ok(self, count: int, payload: bytes) -> bool:
+        """Check a packet has as many whole varints as its samples need."""
+        if count == 0 or count > self.MAX_PACKET_SAMPLES or not payload or payload[-1] & 0x80:
+            return False
+        if _LONG_VARINT.search(payload):
+            return False
+        # Each varint has exactly one byte without the continuation bit
+        varints = len(payload.translate(None, _CONTINUATION_BYTES))
+        return varints == count * (1 + self.channels)
+
+    def _decode_payloads(self, payloads: List[bytes], counts: List[int]) -> SampleBatch:
+        data = np.frombuffer(b"".join(payloads), dtype=np.uint8)
+        # Each varint ends at a byte without the continuation bit.
+        ends = np.flatnonzero(data < 0x80)
+        starts = np.concatenate(([0], ends[:-1] + 1))
+        place = np.arange(len(data)) - np.repeat(starts, ends - starts + 1)
+        values = np.add.reduceat((data & 0x7F).astype(np.int64) << (7 * place), starts)
+        fields = values.reshape(-1, 1 + self.channels)
+        zigzag = (fields >> 1) ^ -(fields & 1)
+
+        counts = np.array(counts)
+        first = np.concatenate(([0], np.cumsum(counts)[:-1]))
+        # A packet's first sample is absolute (its time not zigzagged), and
+        # the rest are deltas: of the channels, and of the time step.
+        channels = _grouped_cumsum(zigzag[:, 1:], first, counts)
+        step_deltas = zigzag[:, 0].copy()
+        step_deltas[first] = 0
+        steps = _grouped_cumsum(step_deltas, first, counts)
+        us = (np.repeat(fields[first, 0], counts) + _grouped_cumsum(steps, first, counts)) & 0xFFFFFFFF
+
+        accel = None
+        if self.accel_scale is not None:
+            accel = channels[:, 4:7] * self.accel_scale
+        return SampleBatch(us, channels[:, 0:3] * self.gyro_scale, channels[:, 3], accel)
+
+
+class SampleReader:
+    """Reads measurements from the log firmware, as CSV or in a compact stream, in bulk."""
+
+    def __init__(self, serial_port: aioserial.AioSerial):
+        self.serial_port = serial_port
+        self.decoder: Optional[StreamDecoder] = None
+        # CSV received but not yet a whole line
+        self.text = bytearray()
+        self.health = HealthMonitor()
+        self.clock = ClockSync()
+        self.bytes = 0
+        # A read still going when read_batch was cancelled: its data is next
+        self.reading: Optional[asyncio.Future] = None
+
+    async def request_codec(self, codec: str):
+        """Ask the firmware to switch codec: it's in effect once we see its header."""
+        await self.serial_port.write_async(f"codec {codec}\n".encode("ascii"))
+
+    async def read_batch(self, retries=1) -> Optional[SampleBatch]:
+        """Return the samples that have come in, waiting for at least one.
+
+        Returns None once the data stops, or if more than retries lines of CSV
+        in a row make no sense.
+        """
+        while True:
+            if self.reading is None:
+                self.reading = asyncio.ensure_future(
+                    self.serial_port.read_async(min(READ_CHUNK, max(1, self.serial_port.in_waiting)))
+                )
+            # Shielded, so cancelling between steps doesn't lose data
+            data = await asyncio.shield(self.reading)
+            self.reading = None
+            received_ns = time.monotonic_ns()
+            if not data:
+                # all done
+                return None
+            self.bytes += len(data)
+            if self.decoder:
+                batch = self.decoder.feed(data)
+                self._check_lines(self.decoder.take_lines(), received_ns)
+            else:
+                batch, bad_lines = self._feed_csv(data, received_ns)
+                if not batch:
+                    retries -= bad_lines
+                    if retries < 0:
+                        return None
+            if batch:
+                return batch
+
+    async def send_pings(self):
+        """Keep the clock sync estimate up to date, until cancelled."""
+        while self.clock.supported:
+            await self.serial_port.write_async(self.clock.make_ping())
+            await asyncio.sleep(PING_INTERVAL_S)
+
+    def _check_lines(self, lines: List[bytes], received_ns: int) -> int:
+        """Handle lines of text that aren't samples: return how many made no sense."""
+        unknown = 0
+        for line in lines:
+            if not (self.clock.check_line(line, received_ns) or self.health.check_line(line)):
+                unknown += 1
+        return unknown
+
+    def _feed_csv(self, data: bytes, received_ns: int):
+        """Parse the whole lines of CSV: return their samples, and how many lines made no sense."""
+        self.text += data
+        text = self.text
+        # After a codec header, the rest is the compact stream.
+        codec_at = text.find(b"CODEC,")
+        codec_end = text.find(b"\n", codec_at) if codec_at >= 0 else -1
+        end = codec_at if codec_end >= 0 else text.rfind(b"\n") + 1
+        lines = bytes(text[:end]).splitlines()
+        samples = [line for line in lines if line[:1].isdigit()]
+        bad_lines = self._check_lines([line for line in lines if not line[:1].isdigit()], received_ns)
+        batches = []
+        # Parse runs of lines with the same number of fields together
+        run_start = 0
+        for i in range(1, len(samples) + 1):
+            if i < len(samples) and samples[i].count(b",") == samples[run_start].count(b","):
+                continue
+            parsed, bad = _parse_csv_run(samples[run_start:i])
+            batches += parsed
+            bad_lines += bad
+            run_start = i
+        if codec_end >= 0:
+            self.decoder = StreamDecoder.from_header_line(bytes(text[codec_at:codec_end]))
+            logging.info("Firmware switched to compact stream")
+            rest = bytes(text[codec_end + 1 :])
+            text.clear()
+            batch = self.decoder.feed(rest)
+            if batch:
+                batches.append(batch)
+        else:
+            del text[:end]
+            if len(text) > StreamDecoder.MAX_LINE:
+                text.clear()
+                bad_lines += 1
+        if not batches:
+            return None, bad_lines
+        return SampleBatch.concatenate(batches), bad_lines
+
+
+def _parse_csv_run(lines: List[bytes]):
+    """Parse lines with the same number of fields: return a list of batches, and how many didn't parse."""
+    if not lines:
+        return [], 0
+    if lines[0].count(b",") + 1 not in (5, 8):
+        return [], len(lines)
+    try:
+        return [_parse_csv_samples(lines)], 0
+    except ValueError:
+        pass
+    # Find the bad ones
+    batches = []
+    for line in lines:
+        try:
+            batches.append(_parse_csv_samples([line]))
+        except ValueError:
+            pass
+    return batches, len(lines) - len(batches)
+
+
+class BackgroundWriter:
+    """Formats and writes samples on a thread, while the next ones come in.
+
+    Double buffered: samples collect here while the thread writes the ones
+    handed over before. If the thread falls behind, handing over waits for it.
+    """
+
+    def __init__(self, fp, zero_time: int):
+        self.fp = fp
+        self.zero_time = zero_time
+        self.filling: List[SampleBatch] = []
+        self.handed_over = time.monotonic()
+        self.queue: "queue.Queue[Optional[List[SampleBatch]]]" = queue.Queue(maxsize=1)
+        self.error: Optional[BaseException] = None
+        self.thread = threading.Thread(target=self._run, daemon=True)
+        self.thread.start()
+
+    async def write(self, batch: SampleBatch):
+        self.filling.append(batch)
+        if time.monotonic() - self.handed_over >= WRITE_INTERVAL_S:
+            await self._hand_over(self.filling)
+            self.filling = []
+
+    async def _hand_over(self, batches: Optional[List[SampleBatch]]):
+        self.handed_over = time.monotonic()
+        try:
+            self.queue.put_nowait(batches)
+        except queue.Full:
+            await asyncio.get_running_loop().run_in_executor(None, self.queue.put, batches)
+
+    def close(self):
+        """Write what's left, and wait for it."""
+        if self.filling:
+            self.queue.put(self.filling)
+            self.filling = []
+        self.queue.put(None)
+        self.thread.join()
+        if self.error:
+            raise self.error
+
+    def _run(self):
+        while True:
+            batches = self.queue.get()
+            if batches is None:
+                return
+            try:
+                self.fp.write("".join([batch.format_csv(self.zero_time) for batch in batches]))
+            except Exception as e:
+                # Keep taking them, so nothing waits forever: close() raises it.
+                self.error = e
 
 
 @dataclasses.dataclass
@@ -112,80 +518,212 @@ class RunningExtrema:
         return changed
 
 
-async def get_measurement_or_enter(
-    input_task: asyncio.Task, serial_port: aioserial.AioSerial, retries=1
-):
-    """Return a measurement, or None if there was a problem or the user hit enter."""
-    meas_task = asyncio.create_task(get_measurement(serial_port, retries=retries))
-    done, _ = await asyncio.wait(
-        (input_task, meas_task), return_when=asyncio.FIRST_COMPLETED
-    )
-    if input_task in done:
-        # They hit enter
-        meas_task.cancel()
-        return None
-    meas = meas_task.result()
-    if not meas:
-        return None
-    return meas
-
-
-async def main(device: str):
-    serial_port = aioserial.AioSerial(port=device, baudrate=115200)
-
-    print("Talking with your device")
-    meas = await get_measurement(serial_port)
-    print(meas)
-    if not meas:
+async def _until_enter_or_done(tasks: List[asyncio.Task]) -> bool:
+    """Wait for the user to hit enter, or for any of tasks to finish, then cancel the rest.
+
+    Returns whether they hit enter.
+    """
+    input_task = asyncio.create_task(aioconsole.ainput())
+    done, _ = await asyncio.wait([input_task, *tasks], return_when=asyncio.FIRST_COMPLETED)
+    for task in [input_task, *tasks]:
+        task.cancel()
+    for result in await asyncio.gather(*tasks, return_exceptions=True):
+        if isinstance(result, Exception):
+            raise result
+    return input_task in done
+
+
+class _StartTogether:
+    """Holds each device's recording back until every device is ready."""
+
+    def __init__(self, count: int):
+        self.waiting = count
+        self.event = asyncio.Event()
+        self.start_ns: Optional[int] = None
+
+    async def arrive(self):
+        self.waiting -= 1
+        if self.waiting == 0:
+            self.start_ns = time.monotonic_ns()
+            self.event.set()
+        await self.event.wait()
+
+
+class DeviceCapture:
+    """One tester's part of a capture session."""
+
+    def __init__(self, device: str, name: str = ""):
+        self.name = name
+        self.reader = SampleReader(aioserial.AioSerial(port=device, baudrate=115200))
+        self.reader.clock.name = name
+        self.brightness_extrema = RunningExtrema()
+        self.filename = _make_filename(f"_{name}" if name else "")
+        self.sync_filename = self.filename[: -len(".csv")] + ".sync.json"
+        self.device_zero_us: Optional[int] = None
+        self.samples = 0
+        self.record_s = 0.0
+
+    def close(self):
+        self.reader.serial_port.close()
+
+    def say(self, *args):
+        if self.name:
+            print(f"{self.name}:", *args)
+        else:
+            print(*args)
+
+    async def start(self, codec: str) -> bool:
+        if codec != "csv":
+            # Older firmware ignores this and keeps sending CSV, which is fine.
+            await self.reader.request_codec(codec)
+        batch = await self.reader.read_batch(retries=50)
+        self.say(batch[0] if batch else None)
+        return batch is not None
+
+    async def find_limits(self):
+        """Track the brightness range until cancelled: returns early on trouble."""
+        extrema = self.brightness_extrema
+        while True:
+            batch = await self.reader.read_batch()
+            if not batch:
+                self.say("Device stopped sending data")
+                return
+            # Not "or": both have to be processed
+            if extrema.process(int(batch.brightness.min())) | extrema.process(int(batch.brightness.max())):
+                self.say(extrema.min_val, extrema.max_val)
+                if extrema.min_val == 0:
+                    self.say("Got a brightness of zero, not OK. Is your sensor connected right?")
+                    return
+
+    async def record(self, start: _StartTogether):
+        """Write samples from when every device is ready until cancelled: returns early on trouble."""
+        await start.arrive()
+        # The first batch after every device is ready: the capture starts there
+        batch = await self.reader.read_batch()
+        if not batch:
+            self.say("Could not get our baseline timestamp")
+            return
+        zero_time = int(batch.us[0])
+        self.device_zero_us = self.reader.clock.unwrap(zero_time)
+        began = time.monotonic()
+        next_report = began + REPORT_INTERVAL_S
+        reported_samples = 0
+        with open(self.filename, "w") as fp:
+            # header row
+            fp.write(batch.get_csv_header())
+            writer = BackgroundWriter(fp, zero_time)
+            try:
+                while batch:
+                    # The timestamps are offset for ease of use as they're written.
+                    await writer.write(batch)
+                    self.samples += len(batch)
+                    now = time.monotonic()
+                    if now >= next_report:
+                        rate = (self.samples - reported_samples) / (now - next_report + REPORT_INTERVAL_S)
+                        self.say(f"{rate:.0f} samples/s")
+                        reported_samples = self.samples
+                        next_report = now + REPORT_INTERVAL_S
+                    batch = await self.reader.read_batch()
+                self.say("Device stopped sending data: stopping the others too")
+            finally:
+                self.record_s = time.monotonic() - began
+                # Waits for the thread: off the event loop, so the other
+                # devices' reads carry on meanwhile
+                await asyncio.get_running_loop().run_in_executor(None, writer.close)
+
+    def finish(self, **session):
+        reader = self.reader
+        if self.record_s > 0:
+            self.say(
+                f"Recorded {self.samples} samples in {self.record_s:.1f}s:"
+                f" {self.samples / self.record_s:.0f} samples/s, {reader.bytes / self.record_s / 1000:.0f}kB/s"
+            )
+        if reader.decoder:
+            self.say(
+                f"Compact stream: {reader.decoder.packets} packets,"
+                f" {reader.decoder.dropped_packets} dropped, {reader.decoder.skipped_bytes} bytes skipped"
+            )
+        self.say(reader.health.summary())
+        self.say(reader.clock.summary())
+        if self.device_zero_us is not None:
+            reader.clock.write(self.sync_filename, self.device_zero_us, **session)
+
+
+async def main(devices: List[str], codec: str):
+    captures: List[DeviceCapture] = []
+    try:
+        for device in devices:
+            # Names tell the devices apart: not needed for just one
+            captures.append(DeviceCapture(device, _device_name(device) if len(devices) > 1 else ""))
+        await _start_and_record(captures, codec)
+    finally:
+        # Including the ones opened before one that couldn't be
+        for capture in captures:
+            capture.close()
+
+
+async def _start_and_record(captures: List[DeviceCapture], codec: str):
+    print("Talking with your device" + ("s" if len(captures) > 1 else ""))
+    started = await asyncio.gather(*(capture.start(codec) for capture in captures))
+    if not all(started):
         return
+    # Pinging from the start gives the drift estimate more to go on.
+    ping_tasks = [asyncio.create_task(capture.reader.send_pings()) for capture in captures]
+    try:
+        await _find_limits_and_record(captures)
+    finally:
+        for task in ping_tasks:
+            task.cancel()
+
+
+async def _find_limits_and_record(captures: List[DeviceCapture]):
     print(
         "OK - Please rotate thru the range of brightnesses to determine the limits. Press enter when done"
     )
-    brightness_extrema = RunningExtrema()
-    input_task = asyncio.create_task(aioconsole.ainput())
-    while True:
-        meas = await get_measurement_or_enter(input_task, serial_port)
-        if not meas:
-            # they hit enter
-            break
-        if brightness_extrema.process(meas.brightness):
-            print(brightness_extrema.min_val, brightness_extrema.max_val)
-            if brightness_extrema.min_val == 0:
-                print("Got a brightness of zero, not OK. Is your sensor connected right?")
-                return
+    if not await _until_enter_or_done([asyncio.create_task(capture.find_limits()) for capture in captures]):
+        return
 
     print("OK, limits found.")
-    if brightness_extrema.get_range() < 200:
-        print(
-            "Range not large enough: improve sensitivity of sensor or connection to display"
-        )
+    in_range = True
+    for capture in captures:
+        if capture.brightness_extrema.get_range() < 200:
+            capture.say(
+                "Range not large enough: improve sensitivity of sensor or connection to display"
+            )
+            in_range = False
+    if not in_range:
         return
 
-    filename = _make_filename()
     print("OK, recording to disk, enter to stop.")
-    with open(filename, "w") as fp:
-        # header row
-        fp.write("us,drx,dry,drz,brightness\n")
-        base_meas = await get_measurement(serial_port)
-        if not base_meas:
-            raise RuntimeError("Could not get our baseline timestamp")
-        zero_time = base_meas.us
-        # the task watching for the enter press
-        input_task = asyncio.create_task(aioconsole.ainput())
-        while True:
-            meas = await get_measurement_or_enter(input_task, serial_port)
-            if not meas:
-                # they hit enter
-                break
-
-            # Offset the timestamp for ease of use.
-            meas.us -= zero_time
-            fp.write(meas.get_csv_line())
-    print(f"All done! Go move/rename {filename} and analyze it!")
+    # Every device stops on enter, or when any one of them stops.
+    start = _StartTogether(len(captures))
+    await _until_enter_or_done([asyncio.create_task(capture.record(start)) for capture in captures])
+    # Host time.monotonic_ns(), to line the captures up by with their clock sync
+    session = {"session_start_ns": start.start_ns, "session_stop_ns": time.monotonic_ns()}
+    for capture in captures:
+        capture.finish(**session)
+    written = [capture for capture in captures if capture.device_zero_us is not None]
+    for capture in written:
+        print(f"All done! Go move/rename {capture.filename} (and {capture.sync_filename}, its clock sync) and analyze it!")
 
 
 if __name__ == "__main__":
-    device = _get_known_ports()
-    print(f"Opening {device}")
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument(
+        "--codec",
+        choices=("dv1", "csv"),
+        default="dv1",
+        help="Stream format to ask the firmware for: dv1 fits several times more samples through"
+        " (firmware that logs the accelerometer answers with dv2)",
+    )
+    parser.add_argument(
+        "--device",
+        action="append",
+        help="Serial port, or the emulator's device: repeat to capture from several"
+        " (default: every tester found)",
+    )
+    args = parser.parse_args()
+    devices = args.device or _get_all_known_ports()
+    print(f"Opening {', '.join(devices)}")
     # app = Capture()
-    asyncio.run(main(device))
+    asyncio.run(main(devices, args.codec))
@@ -0,0 +1,205 @@
+#!/usr/bin/env python3
+# Copyright 2021, Collabora, Ltd.
+# SPDX-License-Identifier: BSL-1.0
+"""Map the firmware's ``micros()`` onto the host's monotonic clock.
+
+The host sends ``ping <token>`` now and then, and the firmware answers
+``PONG,<token>,<received us>,<sent us>``. Like NTP, each exchange gives four
+times: host sent, device received, device sent, host received. The exchanges
+that came back quickest (least stuck in USB and OS queues) are fit with a
+line, whose slope is the drift between the two clocks.
+
+The mapping is saved next to each capture as ``<capture>.sync.json``: see
+``add_host_time`` in ``latency_utils.py`` to use it.
+"""
+
+import dataclasses
+import json
+import logging
+import time
+from typing import Dict, List, Optional
+
+DEVICE_WRAP = 1 << 32
+PING_INTERVAL_S = 1.0
+# Log the estimate after this many exchanges, and every so many after that
+LOG_EVERY = 10
+# At least this many of the quickest exchanges go into the fit, or a quarter
+# of them once there are more
+MIN_FIT_EXCHANGES = 4
+
+
+@dataclasses.dataclass
+class Exchange:
+    host_sent_ns: int
+    # Unwrapped: see ClockSync.unwrap
+    device_received_us: int
+    device_sent_us: int
+    host_received_ns: int
+
+    @property
+    def round_trip_ns(self) -> int:
+        """Time spent on the way there and back, not counting the device's turnaround."""
+        device_ns = (self.device_sent_us - self.device_received_us) * 1000
+        return self.host_received_ns - self.host_sent_ns - device_ns
+
+    @property
+    def device_mid_us(self) -> float:
+        return (self.device_received_us + self.device_sent_us) / 2
+
+    @property
+    def host_mid_ns(self) -> float:
+        return (self.host_sent_ns + self.host_received_ns) / 2
+
+
+@dataclasses.dataclass
+class ClockFit:
+    """host_ns = host_ns_at_device_zero + device_us * ns_per_us"""
+
+    host_ns_at_device_zero: float
+    ns_per_us: float
+    # RMS distance of the exchanges used from the line
+    residual_ns: float
+    # Worst case error of the exchanges used (half their round trip)
+    bound_ns: float
+    exchanges: int
+
+    @property
+    def drift_ppm(self) -> float:
+        return (self.ns_per_us / 1000 - 1) * 1e6
+
+    def to_host_ns(self, device_us: float) -> float:
+        return self.host_ns_at_device_zero + device_us * self.ns_per_us
+
+
+def fit_exchanges(exchanges: List[Exchange]) -> Optional[ClockFit]:
+    """Fit a line through the midpoints of the quickest exchanges."""
+    if not exchanges:
+        return None
+    count = max(MIN_FIT_EXCHANGES, len(exchanges) // 4)
+    best = sorted(exchanges, key=lambda e: e.round_trip_ns)[:count]
+    # Centered, to keep the precision that large timestamps would lose
+    x0 = best[0].device_mid_us
+    y0 = best[0].host_mid_ns
+    xs = [e.device_mid_us - x0 for e in best]
+    ys = [e.host_mid_ns - y0 for e in best]
+    x_mean = sum(xs) / len(xs)
+    y_mean = sum(ys) / len(ys)
+    sxx = sum((x - x_mean) ** 2 for x in xs)
+    if sxx > 0:
+        slope = sum((x - x_mean) * (y - y_mean) for x, y in zip(xs, ys)) / sxx
+    else:
+        # Only one point in time so far: no drift estimate yet
+        slope = 1000.0
+    intercept = y_mean - slope * x_mean
+    residual = (sum((intercept + slope * x - y) ** 2 for x, y in zip(xs, ys)) / len(xs)) ** 0.5
+    return ClockFit(
+        host_ns_at_device_zero=y0 + intercept - slope * x0,
+        ns_per_us=slope,
+        residual_ns=residual,
+        bound_ns=max(e.round_trip_ns for e in best) / 2,
+        exchanges=len(best),
+    )
+
+
+class ClockSync:
+    """Send pings, collect the answers, and keep the estimate up to date."""
+
+    def __init__(self, name: str = ""):
+        self.name = name
+        self.exchanges: List[Exchange] = []
+        # Token to host send time, for pings not answered yet
+        self.pending: Dict[int, int] = {}
+        self.next_token = 0
+        # False once the firmware says it doesn't know "ping"
+        self.supported = True
+        self._last_raw: Optional[int] = None
+        self._last_unwrapped = 0
+
+    def make_ping(self) -> bytes:
+        """Return the next ping to send, noting the time: send it right away."""
+        token = self.next_token
+        self.next_token += 1
+        self.pending[token] = time.monotonic_ns()
+        return f"ping {token}\n".encode("ascii")
+
+    def unwrap(self, device_us: int) -> int:
+        """Extend a 32-bit device time past its wrap (every 71 minutes).
+
+        Assumes calls come in time order, at most half a wrap apart.
+        """
+        if self._last_raw is not None:
+            delta = (device_us - self._last_raw) % DEVICE_WRAP
+            if delta >= DEVICE_WRAP // 2:
+                delta -= DEVICE_WRAP
+            self._last_unwrapped += delta
+        else:
+            self._last_unwrapped = device_us
+        self._last_raw = device_us
+        return self._last_unwrapped
+
+    def check_line(self, line: bytes, received_ns: Optional[int] = None) -> bool:
+        """Process a line if it's an answer to a ping: return whether it was.
+
+        Pass the time the line was read, if it was a while ago.
+        """
+        if received_ns is None:
+            received_ns = time.monotonic_ns()
+        if line.startswith(b"Unknown command: ping"):
+            if self.supported:
+                logging.warning("%sFirmware doesn't answer pings: no clock sync", self._prefix())
+            self.supported = False
+            return True
+        if not line.startswith(b"PONG,"):
+            return False
+        try:
+            _, token, received_us, sent_us = line.strip().decode("ascii").split(",")
+            sent_ns = self.pending.pop(int(token))
+            device_received = self.unwrap(int(received_us))
+            device_sent = self.unwrap(int(sent_us))
+        except (ValueError, KeyError):
+            logging.warning("%sUnexpected ping answer: %r", self._prefix(), line)
+            return True
+        self.exchanges.append(Exchange(sent_ns, device_received, device_sent, received_ns))
+        if len(self.exchanges) % LOG_EVERY == 0:
+            logging.info("%s%s", self._prefix(), self.summary())
+        return True
+
+    def fit(self) -> Optional[ClockFit]:
+        return fit_exchanges(self.exchanges)
+
+    def summary(self) -> str:
+        fit = self.fit()
+        if fit is None:
+            return "Clock sync: no ping answers"
+        return (
+            f"Clock sync: drift {fit.drift_ppm:+.1f}ppm, {fit.residual_ns / 1000:.0f}us residual,"
+            f" within {fit.bound_ns / 1000:.0f}us, from {fit.exchanges} of {len(self.exchanges)} pings"
+        )
+
+    def write(self, filename: str, device_us_at_zero: int, **extra):
+        """Save the mapping for a capture whose ``us`` column is relative to device_us_at_zero.
+
+        device_us_at_zero must have gone through unwrap(). Anything in extra
+        (like the session's start and stop times) is saved too.
+        """
+        fit = self.fit()
+        record = {
+            "host_clock": "time.monotonic_ns",
+            "device_us_at_zero": device_us_at_zero,
+            "exchanges": [dataclasses.astuple(e) for e in self.exchanges],
+            **extra,
+        }
+        if fit is not None:
+            # host_ns = host_ns_at_zero + us * ns_per_us, for the capture's us column
+            record.update(
+                host_ns_at_zero=fit.to_host_ns(device_us_at_zero),
+                ns_per_us=fit.ns_per_us,
+                drift_ppm=fit.drift_ppm,
+                residual_ns=fit.residual_ns,
+                bound_ns=fit.bound_ns,
+            )
+        with open(filename, "w") as fp:
+            json.dump(record, fp, indent=1)
+
+    def _prefix(self) -> str:
+        return f"{self.name}: " if self.name else ""
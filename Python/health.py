@@ -0,0 +1,85 @@
+#!/usr/bin/env python3
+# Copyright 2021, Collabora, Ltd.
+# SPDX-License-Identifier: BSL-1.0
+"""Check the firmware's periodic ``STATUS,...`` health lines during a run.
+
+See ``include/health.h`` in the firmware for what each field means.
+"""
+
+import logging
+from typing import Dict, List, Optional
+
+# A status line reporting a loop rate this far below the best so far is flagged.
+LOOP_RATE_DROP_FRACTION = 0.75
+# A single loop taking longer than this is flagged as a stall.
+STALL_US = 20000
+
+
+def parse_status(line: bytes) -> Optional[Dict[str, float]]:
+    """Return the fields of a status line, or None if it isn't one."""
+    if not line.startswith(b"STATUS,"):
+        return None
+    try:
+        parts = line.strip().decode("ascii").split(",")[1:]
+        return {key: float(value) for key, value in (part.split("=", 1) for part in parts)}
+    except ValueError:
+        return None
+
+
+class HealthMonitor:
+    """Track status lines and warn about anything that means degraded data."""
+
+    def __init__(self):
+        self.reports = 0
+        self.problems: List[str] = []
+        self.best_loop_hz = 0.0
+        self.last_seq: Optional[int] = None
+
+    def check_line(self, line: bytes) -> bool:
+        """Process a line if it's a status line: return whether it was."""
+        if line.startswith(b"MEM,"):
+            # Answer to the "mem" command: just pass it on.
+            logging.info("Firmware memory: %s", line.strip().decode("ascii", "replace")[4:])
+            return True
+        status = parse_status(line)
+        if status is None:
+            return False
+        for problem in self.check(status):
+            logging.warning("Firmware health: %s", problem)
+            self.problems.append(problem)
+        return True
+
+    def check(self, status: Dict[str, float]) -> List[str]:
+        """Return the problems reported in one status line."""
+        self.reports += 1
+        problems = []
+        seq = int(status.get("seq", 0))
+        if self.last_seq is not None and seq != self.last_seq + 1:
+            problems.append(f"missed {seq - self.last_seq - 1} status lines (lost serial data?)")
+        self.last_seq = seq
+
+        at = f"at {status.get('ms', 0) / 1000:.1f}s"
+        if status.get("gaps", 0) > 0:
+            problems.append(
+                f"{int(status['gaps'])} IMU gaps, about {int(status.get('dropped', 0))} samples dropped {at}"
+            )
+        if status.get("failed_reads", 0) > 0:
+            problems.append(f"{int(status['failed_reads'])} failed sensor reads {at}")
+        if status.get("max_loop_us", 0) > STALL_US:
+            problems.append(f"loop stalled for {int(status['max_loop_us'])}us {at}")
+        # Zero free space only means something if we've ever seen any: not all
+        # serial implementations report it.
+        if status.get("tx_free_max", 0) > 0 and status.get("tx_free_min", 1) == 0:
+            problems.append(f"serial output buffer filled up {at}: host not keeping up")
+        loop_hz = status.get("loop_hz", 0)
+        if loop_hz < self.best_loop_hz * LOOP_RATE_DROP_FRACTION:
+            problems.append(f"loop rate dropped to {loop_hz}Hz from {self.best_loop_hz}Hz {at}")
+        self.best_loop_hz = max(self.best_loop_hz, loop_hz)
+        return problems
+
+    def summary(self) -> str:
+        if not self.reports:
+            return "No firmware health status received (older firmware?)"
+        if not self.problems:
+            return f"Firmware health: OK ({self.reports} status reports)"
+        return f"Firmware health: {len(self.problems)} problems in {self.reports} status reports, see warnings above"
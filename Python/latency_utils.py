@@ -2,6 +2,8 @@
 # Copyright 2021, Collabora, Ltd.
 # SPDX-License-Identifier: BSL-1.0
 
+import json
+
 import numpy as np
 import pandas as pd
 from scipy import interpolate, signal
@@ -93,6 +95,18 @@ def read_without_headers(fn, *args, **kwargs):
     return cleanup(df, *args, **kwargs)
 
 
+def add_host_time(df, sync_fn):
+    """Add a host_ns column: the host's time.monotonic_ns() for each sample.
+
+    sync_fn is the .sync.json that capture.py saves next to the CSV.
+    """
+    with open(sync_fn) as fp:
+        sync = json.load(fp)
+    if 'ns_per_us' not in sync:
+        raise ValueError(f"{sync_fn} has no clock sync (no ping answers)")
+    return df.assign(host_ns=sync['host_ns_at_zero'] + df['us'] * sync['ns_per_us'])
+
+
 def second_to_timestamp_micros(sec): return pd.Timestamp(
     pd.to_datetime(sec, unit='s'), freq='us')
 
@@ -0,0 +1,45 @@
+#!/usr/bin/env python3
+# Copyright 2021, Collabora, Ltd.
+# SPDX-License-Identifier: BSL-1.0
+"""Checks for the compact stream decoder: run with ``python3 -m unittest``."""
+
+import binascii
+import unittest
+
+from capture import StreamDecoder
+
+
+def _packet(seq: int, payload: bytes, count: int = 1) -> bytes:
+    body = bytes([seq, count, len(payload)]) + payload
+    crc = binascii.crc_hqx(body, 0xFFFF)
+    return StreamDecoder.SYNC + body + bytes([crc & 0xFF, crc >> 8])
+
+
+class StreamDecoderTest(unittest.TestCase):
+    def test_packet_ending_in_sync_byte(self):
+        # A packet whose last CRC byte is the first sync byte, at the end of a
+        # chunk, mustn't leave that byte behind to start the next text line.
+        payload = bytes([100, 2, 4, 6, 8])
+        packet = next(
+            p for p in (_packet(seq, payload) for seq in range(256)) if p[-1] == StreamDecoder.SYNC[0]
+        )
+        decoder = StreamDecoder(100.0)
+        batch = decoder.feed(packet)
+        self.assertEqual(len(batch), 1)
+        self.assertEqual(batch.us.tolist(), [100])
+        self.assertEqual(batch.brightness.tolist(), [4])
+        self.assertIsNone(decoder.feed(b"STATUS,seq=1\r\n"))
+        self.assertEqual(decoder.take_lines(), [b"STATUS,seq=1\r\n"])
+        self.assertEqual(decoder.skipped_bytes, 0)
+
+    def test_sync_byte_split_across_chunks(self):
+        payload = bytes([100, 2, 4, 6, 8])
+        packet = _packet(0, payload)
+        decoder = StreamDecoder(100.0)
+        self.assertIsNone(decoder.feed(b"PONG,0,1,2\r\n" + packet[:1]))
+        self.assertEqual(len(decoder.feed(packet[1:])), 1)
+        self.assertEqual(decoder.take_lines(), [b"PONG,0,1,2\r\n"])
+
+
+if __name__ == "__main__":
+    unittest.main()
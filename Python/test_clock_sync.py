@@ -0,0 +1,90 @@
+#!/usr/bin/env python3
+# Copyright 2021, Collabora, Ltd.
+# SPDX-License-Identifier: BSL-1.0
+"""Checks for the clock mapping: run with ``python3 -m unittest``."""
+
+import unittest
+
+from clock_sync import DEVICE_WRAP, ClockSync, Exchange, fit_exchanges
+
+# The device's clock runs 50ppm fast, and started 5s after the host's
+NS_PER_US = 1000 / 1.00005
+HOST_NS_AT_DEVICE_ZERO = 5_000_000_000
+
+
+def _exchange(device_us: int, there_ns: int, back_ns: int, turnaround_us: int = 20) -> Exchange:
+    """An exchange with the given delays on the way there and back."""
+    received_host_ns = HOST_NS_AT_DEVICE_ZERO + device_us * NS_PER_US
+    sent_host_ns = received_host_ns + turnaround_us * NS_PER_US
+    return Exchange(
+        host_sent_ns=round(received_host_ns - there_ns),
+        device_received_us=device_us,
+        device_sent_us=device_us + turnaround_us,
+        host_received_ns=round(sent_host_ns + back_ns),
+    )
+
+
+class FitTest(unittest.TestCase):
+    def test_quickest_quarter(self):
+        # A symmetric 200us each way every fourth ping, and the rest stuck in
+        # queues for milliseconds, mostly on the way back. Only the quick ones
+        # should go into the fit.
+        exchanges = []
+        for i in range(40):
+            if i % 4 == 0:
+                there, back = 200_000, 200_000
+            else:
+                there, back = 300_000, 3_000_000 + 100_000 * i
+            exchanges.append(_exchange(i * 1_000_000, there, back))
+        fit = fit_exchanges(exchanges)
+        self.assertEqual(fit.exchanges, 10)
+        self.assertAlmostEqual(fit.drift_ppm, -50, delta=0.1)
+        self.assertAlmostEqual(fit.bound_ns, 200_000, delta=1)
+        self.assertLess(fit.residual_ns, 1)
+        for device_us in (0, 20_000_000, 40_000_000):
+            expected = HOST_NS_AT_DEVICE_ZERO + device_us * NS_PER_US
+            self.assertAlmostEqual(fit.to_host_ns(device_us), expected, delta=10)
+
+    def test_few_exchanges(self):
+        # Fewer than the minimum: they're all used.
+        exchanges = [_exchange(i * 1_000_000, 200_000, 200_000 + i * 1000) for i in range(3)]
+        self.assertEqual(fit_exchanges(exchanges).exchanges, 3)
+        self.assertIsNone(fit_exchanges([]))
+
+    def test_one_exchange(self):
+        fit = fit_exchanges([_exchange(1_000_000, 200_000, 200_000)])
+        self.assertEqual(fit.ns_per_us, 1000.0)
+        self.assertAlmostEqual(fit.to_host_ns(1_000_010), HOST_NS_AT_DEVICE_ZERO + 1_000_010 * NS_PER_US, delta=100)
+
+
+class UnwrapTest(unittest.TestCase):
+    def test_wraparound(self):
+        sync = ClockSync()
+        self.assertEqual(sync.unwrap(DEVICE_WRAP - 1000), DEVICE_WRAP - 1000)
+        self.assertEqual(sync.unwrap(500), DEVICE_WRAP + 500)
+        # Slightly out of order, as received and sent times can be.
+        self.assertEqual(sync.unwrap(400), DEVICE_WRAP + 400)
+        # Less than half a wrap at a time, around again.
+        self.assertEqual(sync.unwrap(DEVICE_WRAP // 3), DEVICE_WRAP + DEVICE_WRAP // 3)
+        self.assertEqual(sync.unwrap(2 * DEVICE_WRAP // 3), DEVICE_WRAP + 2 * DEVICE_WRAP // 3)
+        self.assertEqual(sync.unwrap(10), 2 * DEVICE_WRAP + 10)
+
+    def test_backwards_across_wrap(self):
+        sync = ClockSync()
+        sync.unwrap(5)
+        self.assertEqual(sync.unwrap(DEVICE_WRAP - 5), -5)
+
+    def test_pong_lines_unwrap(self):
+        sync = ClockSync()
+        for token, device_us in enumerate((DEVICE_WRAP - 2_000_000, DEVICE_WRAP - 1_000_000, 500)):
+            sync.pending[token] = token * 1_000_000_000
+            line = f"PONG,{token},{device_us},{(device_us + 20) % DEVICE_WRAP}\r\n".encode("ascii")
+            self.assertTrue(sync.check_line(line, received_ns=token * 1_000_000_000 + 400_000))
+        self.assertEqual(
+            [e.device_received_us for e in sync.exchanges],
+            [DEVICE_WRAP - 2_000_000, DEVICE_WRAP - 1_000_000, DEVICE_WRAP + 500],
+        )
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,75 @@
+#!/usr/bin/env python3
+# Copyright 2021, Collabora, Ltd.
+# SPDX-License-Identifier: BSL-1.0
+"""Fetch the state machine event trace from the firmware and print or save it."""
+
+import argparse
+from typing import List
+
+import serial
+
+from blocks import Block, read_block, unpack_samples
+from capture import _get_known_ports
+
+
+def decode_trace(block: Block) -> List[dict]:
+    """Turn a "trace" block into a list of events, with times in microseconds
+    on the firmware's micros() clock."""
+    _, rows = unpack_samples(block)
+    fields = block.fields
+    cpu_hz = float(fields["cpu_hz"])
+    now_cycles = (int(fields["now_cycles_hi"]) << 32) | int(fields["now_cycles_lo"])
+    now_us = int(fields["now_us"])
+    kinds = fields["kinds"].split(";")
+    states = fields["states"].split(";") if fields["states"] else []
+
+    def name(names, index):
+        return names[index] if index < len(names) else str(index)
+
+    events = []
+    for cycles, kind, state, _, value in rows:
+        events.append(
+            {
+                "us": now_us - (now_cycles - cycles) * 1e6 / cpu_hz,
+                "kind": name(kinds, kind),
+                "state": name(states, state),
+                "value": value,
+            }
+        )
+    return events
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("--device", help="Serial port (default: autodetect)")
+    parser.add_argument("--output", help="CSV file to write, instead of printing")
+    parser.add_argument("--clear", action="store_true", help="Clear the trace after fetching it")
+    args = parser.parse_args()
+
+    device = args.device or _get_known_ports()
+    with serial.Serial(device, baudrate=115200, timeout=5) as port:
+        port.write(b"trace\n")
+        block = read_block(port, "trace")
+        if args.clear:
+            port.write(b"trace clear\n")
+
+    events = decode_trace(block)
+    lost = int(block.fields["total"]) - len(events)
+    if lost > 0:
+        print(f"({lost} older events were overwritten)")
+    if args.output:
+        with open(args.output, "w") as fp:
+            fp.write("us,kind,state,value\n")
+            for event in events:
+                fp.write("{us:.2f},{kind},{state},{value}\n".format(**event))
+        print(f"Wrote {len(events)} events to {args.output}")
+        return
+    previous = None
+    for event in events:
+        delta = "" if previous is None else f"(+{event['us'] - previous:.1f})"
+        print(f"{event['us']:14.1f} {delta:>14} {event['state']:>20} {event['kind']:<20} {event['value']}")
+        previous = event["us"]
+
+
+if __name__ == "__main__":
+    main()
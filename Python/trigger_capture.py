@@ -0,0 +1,58 @@
+#!/usr/bin/env python3
+# Copyright 2021, Collabora, Ltd.
+# SPDX-License-Identifier: BSL-1.0
+"""Save each event sent by the "trigger" firmware to its own CSV file."""
+
+import argparse
+import datetime
+
+import serial
+
+from blocks import read_block, unpack_samples
+from capture import _get_known_ports
+from health import HealthMonitor
+
+
+def _make_filename(index):
+    now = datetime.datetime.now()
+    return "event_{}{:02d}{:02d}_{:02d}{:02d}{:02d}_{:03d}.csv".format(
+        now.year, now.month, now.day, now.hour, now.minute, now.second, index
+    )
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("--device", help="Serial port (default: autodetect)")
+    parser.add_argument(
+        "--trigger",
+        help="Trigger setup to send first, like 'gyro 0.5', 'bright 300' or 'host'",
+    )
+    parser.add_argument("--window", nargs=2, type=int, metavar=("PRE", "POST"))
+    parser.add_argument("--events", type=int, default=0, help="Stop after this many (0 = forever)")
+    args = parser.parse_args()
+
+    device = args.device or _get_known_ports()
+    with serial.Serial(device, baudrate=115200, timeout=None) as port:
+        if args.trigger:
+            port.write(f"trigger {args.trigger}\n".encode("ascii"))
+        if args.window:
+            port.write("window {} {}\n".format(*args.window).encode("ascii"))
+        health = HealthMonitor()
+        index = 0
+        while not args.events or index < args.events:
+            block = read_block(port, "trigger", health)
+            columns, rows = unpack_samples(block)
+            trigger_index = int(block.fields["trigger_index"])
+            filename = _make_filename(index)
+            with open(filename, "w") as fp:
+                fp.write(",".join(columns) + ",trigger\n")
+                for i, row in enumerate(rows):
+                    fp.write(",".join(str(x) for x in row))
+                    fp.write(",1\n" if i == trigger_index else ",0\n")
+            print(f"Event {index}: {len(rows)} samples, triggered by {block.fields['source']}, wrote {filename}")
+            index += 1
+        print(health.summary())
+
+
+if __name__ == "__main__":
+    main()